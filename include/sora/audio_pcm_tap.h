@@ -0,0 +1,88 @@
+#ifndef SORA_AUDIO_PCM_TAP_H_
+#define SORA_AUDIO_PCM_TAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/media_stream_interface.h>
+#include <api/scoped_refptr.h>
+#include <rtc_base/synchronization/mutex.h>
+
+namespace sora {
+
+struct AudioPcmTapConfig {
+  // 出力するサンプリングレート
+  int sample_rate = 16000;
+  // 出力するチャンネル数 (1 か 2)
+  size_t channels = 1;
+  // トラックごとに溜めておける最大の長さ。
+  // 取り出しが間に合わずにこれを超えた場合、新しいサンプルを捨てる。
+  int buffer_ms = 2000;
+};
+
+// 受信した音声トラックの PCM を、指定したサンプリングレートとチャンネル数に変換して
+// トラックごとのリングバッファに溜めておくクラス。
+// 音声認識のように、ある程度まとまった単位で音声を処理したい場合に使う。
+//
+// 音声はワーカースレッドから 10ms ごとに届くが、そのスレッドではメモリ確保も排他もせずに
+// リサンプリングしてリングバッファに書き込むだけにしている。
+// 取り出し側は任意のスレッドから Read() でまとめて読み出せる。
+//
+// 使い方:
+//   auto tap = sora::AudioPcmTap::Create(config);
+//   // SoraSignalingObserver::OnTrack で
+//   if (track->kind() == webrtc::MediaStreamTrackInterface::kAudioKind) {
+//     tap->AddTrack(
+//         static_cast<webrtc::AudioTrackInterface*>(track.get()));
+//   }
+//   // 別スレッドで 100ms ごとに
+//   for (const auto& id : tap->GetTrackIds()) {
+//     size_t n = tap->Read(id, buf.data(), buf.size() / channels);
+//     ...
+//   }
+class AudioPcmTap {
+ public:
+  static std::shared_ptr<AudioPcmTap> Create(AudioPcmTapConfig config);
+  ~AudioPcmTap();
+
+  // track の音声を溜め始める。同じ ID のトラックが既にある場合は何もしない
+  void AddTrack(rtc::scoped_refptr<webrtc::AudioTrackInterface> track);
+  // track の音声を溜めるのを止めて、溜まっている音声も破棄する。
+  // この関数から戻った後は、このトラックの音声は届かない。
+  void RemoveTrack(const std::string& track_id);
+  std::vector<std::string> GetTrackIds() const;
+
+  // 溜まっている音声を最大 max_frames フレーム分だけ data に読み出す。
+  // 1 フレームは channels 個のインターリーブされたサンプル。
+  // 読み出したフレーム数を返す。
+  size_t Read(const std::string& track_id, int16_t* data, size_t max_frames);
+  // 溜まっているフレーム数
+  size_t GetAvailableFrames(const std::string& track_id) const;
+  // リングバッファが一杯で捨てたフレーム数の合計
+  uint64_t GetDroppedFrames(const std::string& track_id) const;
+
+  const AudioPcmTapConfig& config() const { return config_; }
+
+ private:
+  AudioPcmTap(AudioPcmTapConfig config);
+
+  class Sink;
+
+  AudioPcmTapConfig config_;
+  // AddTrack() と RemoveTrack() を直列化する。
+  // sinks_ に入れてから AddSink() するまでの間に、別のスレッドで破棄されないようにするため。
+  // AddSink() と RemoveSink() は WebRTC のスレッドを待つので、Read() が使う mutex_ とは分けている。
+  webrtc::Mutex track_mutex_;
+  mutable webrtc::Mutex mutex_;
+  std::map<std::string, std::unique_ptr<Sink>> sinks_ RTC_GUARDED_BY(mutex_);
+};
+
+}  // namespace sora
+
+#endif
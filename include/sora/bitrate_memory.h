@@ -0,0 +1,132 @@
+#ifndef SORA_BITRATE_MEMORY_H_
+#define SORA_BITRATE_MEMORY_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+// Boost
+#include <boost/optional.hpp>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <api/stats/rtc_stats_report.h>
+#include <rtc_base/synchronization/mutex.h>
+
+#include "sora/hls/async_file_writer.h"
+#include "sora/thread_config.h"
+
+namespace sora {
+
+struct BitrateMemoryConfig {
+  // 保存先のファイル。空の場合はファイルに保存せず、プロセス内でだけ覚えておく
+  std::string path;
+  // 覚えている帯域にこの割合を掛けた値を開始ビットレートにする
+  double start_ratio = 0.8;
+  // 開始ビットレートの範囲
+  int min_start_bitrate_bps = 300 * 1000;
+  int max_start_bitrate_bps = 5 * 1000 * 1000;
+  // これより古い値は使わない
+  int max_age_sec = 7 * 24 * 60 * 60;
+  // 覚えておく数。超えた場合は更新が古いものから捨てる
+  size_t max_entries = 64;
+  // SoraSignaling が統計情報を取得する間隔
+  int sample_interval_ms = 2000;
+  // 接続してからこの時間が経つまでは、帯域推定が収束していないので更新しない
+  int warmup_ms = 10000;
+  // SaveAsync() でファイルに書き込む AsyncFileWriter。
+  // 他の BitrateMemory や FlightRecorder, CmafPackager と共有して良い。
+  // nullptr の場合は thread_config の設定で専用のものを作る。path が空の場合は使わない
+  std::shared_ptr<AsyncFileWriter> writer;
+  ThreadConfig thread_config = {"BitrateMemory"};
+};
+
+class BitrateMemorySession;
+
+struct BitrateMemoryEntry {
+  // 送信側の帯域推定の値
+  int64_t send_bps = 0;
+  // 実際に受信できていたビットレート。
+  // 受信側の帯域は送信側が決めるので、受信するレイヤーを選ぶ目安として使う。
+  int64_t receive_bps = 0;
+  // 更新した時刻 (UNIX 時間)
+  int64_t updated_at = 0;
+};
+
+// セッションで収束した帯域を、シグナリングの接続先とローカルのネットワークごとに覚えておき、
+// 次のセッションの開始ビットレートに使うクラス。
+// SoraSignalingConfig::bitrate_memory に指定すると、
+// PeerConnection を作った直後に PeerConnectionInterface::SetBitrate() で開始ビットレートを設定し、
+// 接続中の統計情報から帯域を更新して、切断した時に AsyncFileWriter のスレッドでファイルに保存する。
+//
+// 帯域推定は既定では 300kbps から始まるので、高い解像度で送信する場合に
+// 目標のビットレートに達するまでの時間を短くできる。
+// ネットワークの状況が変わっていても、開始ビットレートから帯域推定で調整される。
+//
+// 複数の SoraSignaling で共有して良い。
+class BitrateMemory : public std::enable_shared_from_this<BitrateMemory> {
+ public:
+  // ファイルがあれば読み込む。読み込めなかった場合も空の状態で作成する
+  static std::shared_ptr<BitrateMemory> Create(BitrateMemoryConfig config);
+
+  // シグナリングのホストと、そこに接続した時のローカルのアドレスからキーを作る。
+  // ローカルのアドレスは IPv4 なら /24、IPv6 なら /64 のネットワークにまとめる。
+  static std::string MakeKey(const std::string& signaling_host,
+                             const std::string& local_address);
+
+  // key の開始ビットレートを返す。覚えていない場合や古い場合は boost::none を返す。
+  // max_bitrate_bps が 0 より大きい場合は、その値も上限にする。
+  boost::optional<int> GetStartBitrate(const std::string& key,
+                                       int max_bitrate_bps = 0) const;
+  boost::optional<BitrateMemoryEntry> GetEntry(const std::string& key) const;
+  // 0 の値は更新しない
+  void Update(const std::string& key, int64_t send_bps, int64_t receive_bps);
+  // AsyncFileWriter のスレッドで config.path に保存する。どのスレッドから呼んでも良い。
+  // 要求済みの保存は、AsyncFileWriter が破棄されるまでに書き込まれる
+  void SaveAsync();
+
+  std::shared_ptr<BitrateMemorySession> CreateSession(const std::string& key);
+
+  const BitrateMemoryConfig& config() const { return config_; }
+
+ private:
+  BitrateMemory(BitrateMemoryConfig config);
+  bool Load();
+
+  BitrateMemoryConfig config_;
+  mutable webrtc::Mutex mutex_;
+  std::map<std::string, BitrateMemoryEntry> entries_ RTC_GUARDED_BY(mutex_);
+};
+
+// 1 つのセッションの統計情報から帯域を集計して、BitrateMemory を更新するクラス。
+// BitrateMemory::CreateSession() で作成する。
+class BitrateMemorySession {
+ public:
+  // 選択されている候補ペアの availableOutgoingBitrate と、
+  // 受信したバイト数から求めたビットレートを平滑化して BitrateMemory に反映する。
+  // 映像を送信していない間は帯域推定が収束しないので、
+  // availableOutgoingBitrate は前回から映像の bytesSent が増えている場合だけ使う。
+  // 複数のスレッドから同時に呼ばないこと。
+  void OnStats(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report);
+
+  const std::string& key() const { return key_; }
+
+ private:
+  friend class BitrateMemory;
+  BitrateMemorySession(std::shared_ptr<BitrateMemory> memory, std::string key);
+
+  std::shared_ptr<BitrateMemory> memory_;
+  std::string key_;
+  int64_t first_timestamp_us_ = -1;
+  int64_t last_timestamp_us_ = -1;
+  uint64_t last_bytes_received_ = 0;
+  uint64_t last_video_bytes_sent_ = 0;
+  double send_bps_ = 0;
+  double receive_bps_ = 0;
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef SORA_CPU_GOVERNOR_H_
+#define SORA_CPU_GOVERNOR_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Boost
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_context.hpp>
+
+// WebRTC
+#include <api/rtp_parameters.h>
+#include <api/rtp_sender_interface.h>
+#include <api/scoped_refptr.h>
+
+#include "sora/sora_signaling.h"
+
+namespace sora {
+
+// /proc/self/stat からプロセスの CPU 使用率を計算する。
+// Linux 以外では常に負の値を返す。
+class ProcessCpuUsage {
+ public:
+  ProcessCpuUsage();
+  // 前回呼び出した時からの CPU 使用率を返す。
+  // 1.0 ですべてのコアを使い切っている状態になる。
+  // 取得できなかった場合は負の値を返す。
+  double Sample();
+
+ private:
+  int64_t last_cpu_ticks_ = -1;
+  int64_t last_wall_us_ = 0;
+};
+
+struct CpuGovernorConfig {
+  boost::asio::io_context* io_context = nullptr;
+  // サンプリング間隔
+  int interval_ms = 1000;
+  // CPU 使用率がこれを超えたら 1 段階品質を落とす
+  double high_cpu_usage = 0.85;
+  // CPU 使用率がこれを下回ったら 1 段階品質を戻す
+  double low_cpu_usage = 0.6;
+  // サンプリング間隔のうちエンコードに使った時間 (totalEncodeTime の増分) の割合。
+  // sender の全レイヤーの合計なので、1 フレームの平均エンコード時間 / フレーム間隔と同じ意味になる。
+  // エンコードが止まっていて framesEncoded が増えなかった場合は、前回の値を使う。
+  // これを超えたら過負荷とみなす
+  double high_encode_usage = 0.8;
+  // エンコードに使った時間の割合がこれを下回ったら余裕があるとみなす
+  double low_encode_usage = 0.5;
+  // 状態が変わってから次に品質を戻すまでの最低サンプル数
+  int restore_hold_samples = 3;
+  // sender 1 つあたりの最大段階数。
+  // 段階が上がるごとに resolution_scales と framerate_scales の値が順に適用される。
+  std::vector<double> resolution_scales = {1.0, 1.5, 2.0, 3.0, 4.0};
+  std::vector<double> framerate_scales = {1.0, 1.0, 0.75, 0.5, 0.5};
+  // max_framerate が設定されていない sender のフレームレートを落とす時の基準値
+  double default_max_framerate = 30.0;
+  // CPU 使用率の取得方法。
+  // 指定しなかった場合は ProcessCpuUsage を使う。テストで負荷を模擬する場合などに指定する。
+  std::function<double()> cpu_usage_sampler;
+};
+
+// プロセス全体の CPU 使用率と各 sender のエンコード時間を見て、
+// 登録されたすべての sender の解像度とフレームレートを協調して調整するクラス。
+//
+// WebRTC の CPU 過負荷検出はエンコーダごとに独立して動くため、
+// 大量の sender があると互いに干渉して品質が振動してしまう。
+// このクラスでは優先度の低い sender から 1 段階ずつ品質を落とし、
+// 余裕ができたら優先度の高い sender から 1 段階ずつ品質を戻す。
+//
+// すべての処理は io_context のスレッドで行われる。
+class CpuGovernor : public std::enable_shared_from_this<CpuGovernor> {
+  CpuGovernor(CpuGovernorConfig config);
+
+ public:
+  static std::shared_ptr<CpuGovernor> Create(CpuGovernorConfig config);
+
+  void Start();
+  void Stop();
+
+  // 調整対象の sender を登録する。priority が小さいほど先に品質が落とされる。
+  // 登録時点のエンコーディングを基準値として覚えておき、品質を戻す時にはその値に戻す。
+  void AddSender(std::shared_ptr<SoraSignaling> signaling,
+                 rtc::scoped_refptr<webrtc::RtpSenderInterface> sender,
+                 int priority);
+  void RemoveSender(rtc::scoped_refptr<webrtc::RtpSenderInterface> sender);
+
+ private:
+  struct Sender {
+    std::weak_ptr<SoraSignaling> signaling;
+    rtc::scoped_refptr<webrtc::RtpSenderInterface> sender;
+    int priority;
+    int level = 0;
+    std::vector<webrtc::RtpEncodingParameters> base_encodings;
+    // エンコード時間の計算用
+    int64_t last_timestamp_us = -1;
+    double last_total_encode_time = 0;
+    uint32_t last_frames_encoded = 0;
+    double encode_usage = 0;
+  };
+  enum class Load { kLow, kNormal, kHigh };
+
+  void DoTick();
+  void SampleEncodeUsage(std::shared_ptr<Sender> s);
+  Load EvaluateLoad(double cpu_usage) const;
+  bool Degrade();
+  bool Restore();
+  void Apply(Sender& s);
+  int MaxLevel() const;
+
+  CpuGovernorConfig config_;
+  boost::asio::deadline_timer timer_;
+  ProcessCpuUsage cpu_usage_;
+  std::vector<std::shared_ptr<Sender>> senders_;
+  int stable_samples_ = 0;
+  bool running_ = false;
+};
+
+}  // namespace sora
+
+#endif
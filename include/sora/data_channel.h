@@ -1,10 +1,15 @@
 #ifndef SORA_DATA_CHANNEL_H_
 #define SORA_DATA_CHANNEL_H_
 
+#include <stdint.h>
+
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
+#include <vector>
 
 // Boost
 #include <boost/asio.hpp>
@@ -14,6 +19,45 @@
 
 namespace sora {
 
+// 値の分布を固定のバケットで数えるヒストグラム
+struct DataChannelHistogram {
+  DataChannelHistogram() = default;
+  DataChannelHistogram(std::vector<double> bounds)
+      : bounds(std::move(bounds)), counts(this->bounds.size() + 1) {}
+
+  // 各バケットの上限 (この値以下が入る)。
+  // counts は bounds より 1 つ多く、最後のバケットは上限なし。
+  std::vector<double> bounds;
+  std::vector<uint64_t> counts;
+  uint64_t count = 0;
+  double sum = 0;
+  double max = 0;
+
+  void Add(double value);
+  double mean() const { return count == 0 ? 0 : sum / count; }
+};
+
+// ラベルごとの DataChannel の送信状況
+struct DataChannelLabelStats {
+  std::string label;
+  uint64_t messages_sent = 0;
+  uint64_t bytes_sent = 0;
+  // Send してから WebRTC の送信待ちバッファを出て SCTP に渡されるまでの時間 (ms)。
+  // SCTP の輻輳制御で送信が詰まってくると、ここが伸びる。
+  DataChannelHistogram send_latency_ms;
+  // 送信待ちバッファから出ていったデータの、1 秒ごとのスループット (kbps)。
+  // 送信していない時間は含まない。
+  DataChannelHistogram throughput_kbps;
+  // プローブの往復時間 (ms)。プローブを有効にしたラベルのみ。
+  // 応答した全ての参加者の分をまとめたもの
+  DataChannelHistogram rtt_ms;
+  // 応答した参加者ごとのプローブの往復時間 (ms)。
+  // キーは応答した参加者の SoraSignaling ごとに生成されるランダムな ID
+  std::map<std::string, DataChannelHistogram> rtt_ms_by_responder;
+  uint64_t probes_sent = 0;
+  uint64_t probes_received = 0;
+};
+
 class DataChannelObserver {
  public:
   ~DataChannelObserver() {}
@@ -40,6 +84,15 @@ class DataChannel {
               std::weak_ptr<DataChannelObserver> observer);
   ~DataChannel();
   bool IsOpen(std::string label) const;
+  // 全てのラベルの送信待ちのバイト数の合計
+  uint64_t GetBufferedAmount() const;
+  // これまでに送信したラベルの統計情報
+  std::vector<DataChannelLabelStats> GetStats() const;
+  // プローブの送信と往復時間を記録する
+  void AddProbeSent(const std::string& label);
+  void AddProbeRtt(const std::string& label,
+                   const std::string& responder_id,
+                   int64_t rtt_us);
   void Send(std::string label, const webrtc::DataBuffer& data);
   void Close(const webrtc::DataBuffer& disconnect_message,
              std::function<void(boost::system::error_code)> on_close,
@@ -53,7 +106,25 @@ class DataChannel {
   void OnMessage(std::shared_ptr<Thunk> thunk,
                  const webrtc::DataBuffer& buffer);
   void OnBufferedAmountChange(std::shared_ptr<Thunk> thunk,
-                              uint64_t previous_amount);
+                              uint64_t bytes_sent,
+                              int64_t timestamp_us);
+  bool SendAndRecord(rtc::scoped_refptr<webrtc::DataChannelInterface> dc,
+                     const webrtc::DataBuffer& data);
+
+  struct LabelState {
+    LabelState();
+    DataChannelLabelStats stats;
+    // Send に渡したバイト数の累計
+    uint64_t queued_bytes = 0;
+    // まだ送信待ちバッファから出ていないメッセージの
+    // (queued_bytes 上での終端, Send した時刻)
+    std::deque<std::pair<uint64_t, int64_t>> pending;
+    uint64_t last_bytes_sent = 0;
+    int64_t last_drained_us = 0;
+    int64_t window_start_us = 0;
+    uint64_t window_bytes = 0;
+  };
+  LabelState& GetLabelState(const std::string& label);
 
  private:
   boost::asio::io_context* ioc_;
@@ -65,6 +136,7 @@ class DataChannel {
   std::weak_ptr<DataChannelObserver> observer_;
   std::function<void(boost::system::error_code)> on_close_;
   boost::asio::deadline_timer timer_;
+  std::map<std::string, LabelState> label_states_;
 };
 
 }  // namespace sora
@@ -0,0 +1,33 @@
+#ifndef SORA_DAV1D_VIDEO_DECODER_H_
+#define SORA_DAV1D_VIDEO_DECODER_H_
+
+#include <memory>
+
+// WebRTC
+#include <api/video_codecs/video_decoder.h>
+
+namespace sora {
+
+struct Dav1dVideoDecoderConfig {
+  // デコードに使うスレッド数。
+  // dav1d 1.0 からはフレーム並列とタイル並列のスレッドが共通になったので、
+  // 両方をこの値で指定する。0 の場合は論理コア数に合わせる。
+  int threads = 0;
+  // 並列にデコードする最大フレーム数。
+  // 増やすとスループットは上がるが、その分だけ出力が遅れるので
+  // リアルタイム用途では 1 のままにしておくこと。0 の場合は dav1d に任せる。
+  int max_frame_delay = 1;
+};
+
+// dav1d を使った AV1 のソフトウェアデコーダ。
+// libaom のデコーダより速く、スレッド数を増やした時の伸びも良い。
+//
+// USE_DAV1D_DECODER が無効な場合は nullptr を返す。
+std::unique_ptr<webrtc::VideoDecoder> CreateDav1dVideoDecoder(
+    Dav1dVideoDecoderConfig config = Dav1dVideoDecoderConfig());
+// dav1d のデコーダが使えるかどうか
+bool IsDav1dVideoDecoderSupported();
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SORA_DTLS_CERTIFICATE_POOL_H_
+#define SORA_DTLS_CERTIFICATE_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <rtc_base/rtc_certificate.h>
+#include <rtc_base/synchronization/mutex.h>
+#include <rtc_base/thread.h>
+
+#include "sora/thread_config.h"
+
+namespace sora {
+
+struct DtlsCertificatePoolConfig {
+  // 事前に生成しておく証明書の数。
+  // 同時に接続する数より多めにしておくと、一斉に接続した時も生成を待たなくて済む
+  size_t pool_size = 4;
+  // 生成する証明書の有効期間
+  int64_t certificate_lifetime_ms = 30LL * 24 * 60 * 60 * 1000;
+  // 残りの有効期間がこれより短くなった証明書は使わずに捨てて、新しく生成し直す
+  int64_t rotation_margin_ms = 24LL * 60 * 60 * 1000;
+  // 証明書を生成するスレッドの設定
+  ThreadConfig thread_config = {"DtlsCertificatePool"};
+};
+
+// DTLS で使う ECDSA (P-256) の証明書を、バックグラウンドのスレッドで事前に生成しておくプール。
+//
+// 証明書を指定せずに PeerConnection を生成すると、接続ごとに証明書の生成が入るので、
+// 接続開始が遅くなり、大量に接続する時に CPU 使用率が跳ね上がる。
+// SoraSignalingConfig::certificate_pool にこのプールを指定すると、
+// PeerConnection ごとにプールから証明書を 1 つ取り出して使う。
+class DtlsCertificatePool {
+ public:
+  static std::shared_ptr<DtlsCertificatePool> Create(
+      DtlsCertificatePoolConfig config);
+  ~DtlsCertificatePool();
+
+  // 証明書を 1 つ取り出して、足りなくなった分をバックグラウンドで生成する。
+  // プールが空の場合は nullptr を返すので、その場合は WebRTC 側で生成させること。
+  rtc::scoped_refptr<rtc::RTCCertificate> Take();
+  // 今すぐ使える証明書の数
+  size_t GetAvailableCount();
+
+ private:
+  DtlsCertificatePool(DtlsCertificatePoolConfig config);
+  bool Init();
+  void RequestRefill();
+  void Refill();
+  void RemoveExpiredCertificates() RTC_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  DtlsCertificatePoolConfig config_;
+  std::unique_ptr<rtc::Thread> thread_;
+  std::atomic<bool> stopped_;
+  webrtc::Mutex mutex_;
+  std::deque<rtc::scoped_refptr<rtc::RTCCertificate>> certificates_
+      RTC_GUARDED_BY(mutex_);
+  bool refilling_ RTC_GUARDED_BY(mutex_) = false;
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef SORA_ENCODED_FRAME_BUFFER_H_
+#define SORA_ENCODED_FRAME_BUFFER_H_
+
+#include <stdint.h>
+
+#include <memory>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <api/video/encoded_image.h>
+#include <api/video/video_frame_buffer.h>
+
+namespace sora {
+
+// パススルーのエンコーダがキーフレームを必要とした時に呼ばれる。
+// エンコーダキューのスレッドから呼ばれるので、すぐに戻ること。
+class KeyFrameRequester {
+ public:
+  virtual ~KeyFrameRequester() {}
+  virtual void RequestKeyFrame() = 0;
+};
+
+// エンコード済みの H.264 のアクセスユニット (Annex B 形式) を持つフレームバッファ。
+// SoraVideoEncoderFactoryConfig::use_passthrough_encoder を有効にすると、
+// このバッファのフレームはエンコードせずにそのまま送信される。
+//
+// 送信側のフレームの間引きに対応するため、ソースは frame_number を 1 ずつ増やして渡すこと。
+// 番号が飛んだ場合、パススルーのエンコーダは次のキーフレームまで送信を止めて
+// key_frame_requester にキーフレームを要求する。
+class EncodedFrameBuffer : public webrtc::VideoFrameBuffer {
+ public:
+  // buffer が EncodedFrameBuffer なら EncodedFrameBuffer として返し、それ以外は nullptr を返す。
+  // kNative のバッファは種類を区別できないので、生存中の EncodedFrameBuffer を登録して判定する。
+  static EncodedFrameBuffer* From(webrtc::VideoFrameBuffer* buffer);
+
+  static rtc::scoped_refptr<EncodedFrameBuffer> Create(
+      rtc::scoped_refptr<webrtc::EncodedImageBufferInterface> data,
+      int width,
+      int height,
+      bool is_key_frame,
+      uint64_t frame_number,
+      std::weak_ptr<KeyFrameRequester> key_frame_requester);
+
+  Type type() const override;
+  int width() const override;
+  int height() const override;
+  // エンコード済みのデータは変換できないので、同じ大きさの黒いフレームを返す。
+  // パススルーのエンコーダ以外 (ソフトウェアエンコーダやプレビュー用のシンクなど) に
+  // 渡ると黒い映像になるので、最初に呼ばれた時にエラーログを出す
+  rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+  // 切り抜きや拡大縮小はできないので、引数を無視して自分自身をそのまま返す。
+  // つまり恒等変換で、返したバッファの width() と height() は元の大きさのままになる。
+  // 帯域や CPU による解像度の調整やサイマルキャストの縮小は効かず、
+  // 元の解像度のまま送信される
+  rtc::scoped_refptr<webrtc::VideoFrameBuffer> CropAndScale(
+      int offset_x,
+      int offset_y,
+      int crop_width,
+      int crop_height,
+      int scaled_width,
+      int scaled_height) override;
+
+  rtc::scoped_refptr<webrtc::EncodedImageBufferInterface> data() const;
+  bool is_key_frame() const;
+  uint64_t frame_number() const;
+  // key_frame_requester が生きていればキーフレームを要求する
+  void RequestKeyFrame() const;
+
+ protected:
+  EncodedFrameBuffer(
+      rtc::scoped_refptr<webrtc::EncodedImageBufferInterface> data,
+      int width,
+      int height,
+      bool is_key_frame,
+      uint64_t frame_number,
+      std::weak_ptr<KeyFrameRequester> key_frame_requester);
+  ~EncodedFrameBuffer() override;
+
+ private:
+  const rtc::scoped_refptr<webrtc::EncodedImageBufferInterface> data_;
+  const int width_;
+  const int height_;
+  const bool is_key_frame_;
+  const uint64_t frame_number_;
+  const std::weak_ptr<KeyFrameRequester> key_frame_requester_;
+};
+
+}  // namespace sora
+
+#endif
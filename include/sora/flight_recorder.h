@@ -0,0 +1,139 @@
+#ifndef SORA_FLIGHT_RECORDER_H_
+#define SORA_FLIGHT_RECORDER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/synchronization/mutex.h>
+
+#include "sora/hls/async_file_writer.h"
+#include "sora/thread_config.h"
+
+namespace sora {
+
+struct FlightRecorderConfig {
+  // ダンプしたファイルの出力先のディレクトリ。事前に作成しておくこと
+  std::string output_dir;
+  // 保持するログの件数
+  size_t log_records = 4096;
+  // 1 件のログの最大のバイト数。これより長いログは切り詰める
+  size_t max_log_size = 256;
+  // 記録するログの重要度。
+  // ここで指定した重要度以上のログは、ファイルやコンソールにログを出していなくても
+  // WebRTC がメッセージを組み立てるようになる。
+  // LS_INFO は接続中に定期的に出るログも多く、組み立てと記録の負荷が常にかかるので、
+  // 既定では LS_WARNING にしている。調査のために詳しいログが必要な場合だけ下げること。
+  rtc::LoggingSeverity min_severity = rtc::LS_WARNING;
+  // SoraSignaling が統計情報を取得する間隔。0 の場合は取得しない
+  int stats_interval_ms = 5000;
+  // セッションごとに保持する統計情報の数
+  size_t stats_samples = 12;
+  // ダンプの整形と書き込みを行う AsyncFileWriter。
+  // 他の FlightRecorder や BitrateMemory, CmafPackager と共有して良い。
+  // nullptr の場合は thread_config の設定で専用のものを作る。
+  std::shared_ptr<AsyncFileWriter> writer;
+  ThreadConfig thread_config = {"FlightRecorder"};
+};
+
+class FlightRecorder;
+
+// 1 つのセッションの統計情報を保持するクラス。
+// FlightRecorder::CreateSession() で作成する。
+class FlightRecorderSession {
+ public:
+  // 統計情報を追加する。古いものから捨てる。複数のスレッドから呼んで良い
+  void AddStats(std::string json);
+  // ログと統計情報をファイルに書き出す。
+  // ログのコピーだけを呼び出したスレッドで行い、整形と書き込みは AsyncFileWriter のスレッドで行う。
+  void Dump(const std::string& reason);
+
+  const std::string& name() const { return name_; }
+
+ private:
+  friend class FlightRecorder;
+  FlightRecorderSession(std::weak_ptr<FlightRecorder> recorder,
+                        std::string name,
+                        size_t max_samples);
+
+  struct StatsSample {
+    int64_t timestamp_us;
+    std::string json;
+  };
+
+  std::weak_ptr<FlightRecorder> recorder_;
+  std::string name_;
+  size_t max_samples_;
+  webrtc::Mutex mutex_;
+  std::deque<StatsSample> samples_ RTC_GUARDED_BY(mutex_);
+};
+
+// ログと統計情報を常にメモリ上に記録しておき、
+// セッションが異常終了した時だけファイルに書き出すクラス。
+// SoraSignalingConfig::flight_recorder に指定すると、
+// PEER_CONNECTION_STATE_FAILED と WEBSOCKET_ONERROR で切断した時に書き出す。
+//
+// ログは rtc::LogSink として受け取り、固定長のリングバッファにバイナリのまま記録する。
+// 書き込みはロックを取らずに行い、時刻や重要度の文字列への整形はダンプする時に行うので、
+// ファイルにログを出す場合に比べて平常時の負荷はほとんど無い。
+//
+// ファイルは <output_dir>/flight_<UTC の時刻>_<セッション名>_<連番>.log に書き出す。
+class FlightRecorder : public rtc::LogSink,
+                       public std::enable_shared_from_this<FlightRecorder> {
+ public:
+  static std::shared_ptr<FlightRecorder> Create(FlightRecorderConfig config);
+  // 要求済みのダンプは、AsyncFileWriter が破棄されるまでに書き込まれる
+  ~FlightRecorder() override;
+
+  // name はファイル名に使う。英数字と - と _ 以外の文字は _ に置き換える
+  std::shared_ptr<FlightRecorderSession> CreateSession(const std::string& name);
+
+  const FlightRecorderConfig& config() const { return config_; }
+
+  // rtc::LogSink の実装
+  void OnLogMessage(const std::string& message,
+                    rtc::LoggingSeverity severity) override;
+  void OnLogMessage(const std::string& message) override;
+
+ private:
+  friend class FlightRecorderSession;
+  FlightRecorder(FlightRecorderConfig config);
+
+  struct Record {
+    // 書き込み中は奇数、書き込み済みの場合は (書き込んだ位置 + 1) * 2 になる
+    std::atomic<uint64_t> seq{0};
+    int64_t timestamp_us;
+    uint64_t thread_id;
+    uint16_t size;
+    uint8_t severity;
+  };
+  struct LogEntry {
+    int64_t timestamp_us;
+    uint64_t thread_id;
+    uint8_t severity;
+    std::string message;
+  };
+
+  void Write(const std::string& message, rtc::LoggingSeverity severity);
+  // 今リングバッファにあるログを古い順に取り出す
+  std::vector<LogEntry> Snapshot() const;
+  void PostDump(const std::string& session_name,
+                const std::string& reason,
+                std::vector<FlightRecorderSession::StatsSample> samples);
+
+  FlightRecorderConfig config_;
+  std::unique_ptr<Record[]> records_;
+  std::unique_ptr<char[]> data_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> dumps_{0};
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef SORA_FRAME_BUFFER_ALLOCATOR_H_
+#define SORA_FRAME_BUFFER_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <api/video/video_frame_buffer.h>
+#include <rtc_base/ref_counted_object.h>
+
+namespace sora {
+
+// フレームバッファのメモリを確保するためのインターフェース。
+// Free には Allocate に渡したのと同じサイズが渡される。
+class FrameBufferAllocator {
+ public:
+  virtual ~FrameBufferAllocator() {}
+  virtual void* Allocate(size_t size) = 0;
+  virtual void Free(void* data, size_t size) = 0;
+};
+
+// 通常のヒープから確保するアロケータ
+std::shared_ptr<FrameBufferAllocator> CreateDefaultFrameBufferAllocator();
+
+struct HugePageFrameBufferAllocatorConfig {
+  // true の場合は MAP_HUGETLB を使って、予約済みの huge page から確保する。
+  // huge page が予約されていない場合は Transparent Huge Pages にフォールバックする。
+  // false の場合は最初から Transparent Huge Pages (madvise) を使う。
+  bool use_reserved_huge_pages = false;
+  // true の場合は指定した NUMA ノードのメモリを優先して使う
+  bool bind_numa_node = true;
+  // 負の値の場合は Allocate を呼び出したスレッドが動いている NUMA ノードを使う。
+  // フレームを書き込むスレッド（キャプチャスレッドやデコードスレッド）から
+  // 確保されるので、通常はそのスレッドと同じノードになる。
+  int numa_node = -1;
+  // これより小さいバッファは huge page を使わずに通常のヒープから確保する。
+  // huge page 単位で切り上げると無駄が大きくなるため。
+  size_t min_huge_page_allocation_size = 1024 * 1024;
+};
+
+// huge page と NUMA ノードを考慮してフレームバッファを確保するアロケータ。
+// 4K のフレームなどでは TLB ミスが減り、変換やスケーリングが速くなる。
+// Linux 以外では通常のヒープから確保する。
+std::shared_ptr<FrameBufferAllocator> CreateHugePageFrameBufferAllocator(
+    HugePageFrameBufferAllocatorConfig config);
+
+// FrameBufferAllocator で確保したメモリを使う I420 バッファ
+class AllocatedI420Buffer : public webrtc::I420BufferInterface {
+ public:
+  static rtc::scoped_refptr<AllocatedI420Buffer> Create(
+      int width,
+      int height,
+      std::shared_ptr<FrameBufferAllocator> allocator);
+
+  int width() const override;
+  int height() const override;
+  const uint8_t* DataY() const override;
+  const uint8_t* DataU() const override;
+  const uint8_t* DataV() const override;
+  int StrideY() const override;
+  int StrideU() const override;
+  int StrideV() const override;
+
+  uint8_t* MutableDataY();
+  uint8_t* MutableDataU();
+  uint8_t* MutableDataV();
+
+  // 確保に失敗していた場合は false
+  bool IsValid() const;
+
+ protected:
+  AllocatedI420Buffer(int width,
+                      int height,
+                      std::shared_ptr<FrameBufferAllocator> allocator);
+  ~AllocatedI420Buffer() override;
+
+ private:
+  const int width_;
+  const int height_;
+  const int stride_y_;
+  const int stride_uv_;
+  const size_t size_;
+  std::shared_ptr<FrameBufferAllocator> allocator_;
+  uint8_t* data_;
+};
+
+// デコーダが出力フレーム用に同時に使うバッファの数のデフォルトの上限
+constexpr size_t kDefaultMaxDecoderFrameBuffers = 300;
+
+// webrtc::VideoFrameBufferPool と同じように使えるバッファプール。
+// バッファのメモリは allocator から確保する。
+// スレッドセーフではないので、同じスレッドから呼び出すこと。
+class FrameBufferPool {
+ public:
+  // allocator が nullptr の場合は CreateDefaultFrameBufferAllocator() を使う
+  FrameBufferPool(size_t max_number_of_buffers,
+                  std::shared_ptr<FrameBufferAllocator> allocator = nullptr);
+
+  // 使われていないバッファを返す。
+  // 使用中のバッファが max_number_of_buffers に達している場合は nullptr を返す。
+  rtc::scoped_refptr<AllocatedI420Buffer> CreateI420Buffer(int width,
+                                                           int height);
+  // プールしているバッファを解放する。
+  // 使用中のバッファは、使い終わった時点で解放される。
+  void Release();
+
+ private:
+  const size_t max_number_of_buffers_;
+  std::shared_ptr<FrameBufferAllocator> allocator_;
+  std::list<rtc::scoped_refptr<rtc::RefCountedObject<AllocatedI420Buffer>>>
+      buffers_;
+};
+
+}  // namespace sora
+
+#endif
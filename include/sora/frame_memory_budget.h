@@ -0,0 +1,61 @@
+#ifndef SORA_FRAME_MEMORY_BUDGET_H_
+#define SORA_FRAME_MEMORY_BUDGET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "sora/frame_buffer_allocator.h"
+
+namespace sora {
+
+struct FrameMemoryBudgetConfig {
+  // このアロケータで同時に確保できるバイト数の上限。0 の場合は制限しない
+  int64_t max_bytes = 0;
+  // 実際にメモリを確保するアロケータ。
+  // nullptr の場合は CreateDefaultFrameBufferAllocator() を使う。
+  std::shared_ptr<FrameBufferAllocator> allocator;
+};
+
+// FrameMemoryBudget::GetStats で取得できる統計情報
+struct FrameMemoryBudgetStats {
+  int64_t max_bytes = 0;
+  int64_t used_bytes = 0;
+  // used_bytes の最大値
+  int64_t peak_bytes = 0;
+  // 上限を超えるので確保しなかった回数。
+  // 増え続けている場合は、フレームを捨てているので上限が小さすぎる。
+  uint64_t rejected_count = 0;
+};
+
+// 確保するメモリの合計に上限を設けるアロケータ。
+//
+// 複数のデコーダに同じアロケータを渡すと、全体で上限を守るようになる。
+// 例えば 50 本のストリームを受信して録画する場合に、
+// デコーダごとのプールが膨らんで全体で数 GB になるのを防げる。
+// 上限に達した場合は Allocate が nullptr を返すので、
+// デコーダはバッファが空くまで出力フレームを捨てる。
+class FrameMemoryBudget : public FrameBufferAllocator {
+ public:
+  static std::shared_ptr<FrameMemoryBudget> Create(
+      FrameMemoryBudgetConfig config);
+
+  void* Allocate(size_t size) override;
+  void Free(void* data, size_t size) override;
+
+  FrameMemoryBudgetStats GetStats() const;
+
+ private:
+  FrameMemoryBudget(FrameMemoryBudgetConfig config);
+
+  FrameMemoryBudgetConfig config_;
+  std::atomic<int64_t> used_bytes_;
+  std::atomic<int64_t> peak_bytes_;
+  std::atomic<uint64_t> rejected_count_;
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SORA_HLS_ASYNC_FILE_WRITER_H_
+#define SORA_HLS_ASYNC_FILE_WRITER_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <rtc_base/thread.h>
+
+#include "sora/thread_config.h"
+
+namespace sora {
+
+struct AsyncFileWriterConfig {
+  ThreadConfig thread_config = {"AsyncFileWriter"};
+};
+
+// ファイルへの書き込みを専用のスレッドで順番に行うクラス。
+// 書き込みを要求したスレッドはディスクの I/O を待たない。
+// 複数の CmafPackager や FlightRecorder, BitrateMemory で共有して良い。
+class AsyncFileWriter {
+ public:
+  static std::shared_ptr<AsyncFileWriter> Create(AsyncFileWriterConfig config);
+  // 要求済みの書き込みが全て終わるまで待つ
+  ~AsyncFileWriter();
+
+  // path を作り直して data を書き込む。既にファイルがある場合は中身を捨てる
+  void Write(const std::string& path, std::vector<uint8_t> data);
+  // path の末尾に data を追加する。ファイルが無い場合は作成する
+  void Append(const std::string& path, std::vector<uint8_t> data);
+  // path を data で置き換える。
+  // 一時ファイルに書いてから rename するので、読み込み側が書きかけのファイルを見ることは無い。
+  void Replace(const std::string& path, std::string data);
+  // make_data() が返したデータで path を置き換える。
+  // make_data() も書き込みのスレッドで呼ぶので、データの整形に時間がかかる場合に使う
+  void ReplaceWith(const std::string& path,
+                   std::function<std::string()> make_data);
+  void Remove(const std::string& path);
+
+ private:
+  AsyncFileWriter(AsyncFileWriterConfig config);
+
+  AsyncFileWriterConfig config_;
+  std::unique_ptr<rtc::Thread> thread_;
+};
+
+}  // namespace sora
+
+#endif
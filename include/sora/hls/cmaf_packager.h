@@ -0,0 +1,166 @@
+#ifndef SORA_HLS_CMAF_PACKAGER_H_
+#define SORA_HLS_CMAF_PACKAGER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/array_view.h>
+#include <api/rtp_receiver_interface.h>
+#include <api/scoped_refptr.h>
+#include <rtc_base/numerics/sequence_number_util.h>
+#include <rtc_base/synchronization/mutex.h>
+
+#include "sora/hls/async_file_writer.h"
+
+namespace sora {
+
+struct CmafPackagerConfig {
+  // ファイルの書き込みに使う。複数の CmafPackager で共有して良い
+  std::shared_ptr<AsyncFileWriter> writer;
+  // 出力先のディレクトリ。事前に作成しておくこと
+  std::string output_dir;
+  std::string playlist_name = "playlist.m3u8";
+  // セグメントの目標の長さ。
+  // この長さに達した後の最初のキーフレームでセグメントを区切る。
+  int segment_duration_ms = 2000;
+  // パートの目標の長さ。パートはこの長さを超えないように区切る。
+  int part_duration_ms = 500;
+  // プレイリストに載せるセグメントの数。
+  // プレイリストから外したセグメントは、更にこの数だけ新しいセグメントができてから削除する。
+  int playlist_segments = 6;
+  // セグメントの区切りが近づいたら、送信側にキーフレームを要求する
+  bool request_key_frame = true;
+};
+
+struct CmafPackagerStats {
+  uint64_t frames_received = 0;
+  // 最初のキーフレームが届く前のフレームや、H.264 として解釈できないフレームの数
+  uint64_t frames_dropped = 0;
+  uint64_t parts_written = 0;
+  uint64_t segments_written = 0;
+  uint64_t bytes_written = 0;
+  uint64_t key_frame_requests = 0;
+};
+
+// 受信した映像のエンコード済みフレームを、デコードし直さずに
+// CMAF (fMP4) のパートと LL-HLS のプレイリストとして書き出すクラス。
+// 1 つの CmafPackager が 1 つの映像トラックを扱う。
+//
+// フレームは RtpReceiver に設定した FrameTransformer で取り出すので、
+// 受信した映像は今まで通りデコードされて OnTrack のトラックにも届く。
+// ファイルの書き込みは AsyncFileWriter のスレッドで行うので、受信処理がディスクの I/O を待つことは無い。
+//
+// 対応しているコーデックは H.264 のみ。音声は扱わない。
+// プレイリストは定期的に読み直すことを前提にしていて、ブロッキングリロードには対応していない。
+//
+// 使い方:
+//   auto writer = sora::AsyncFileWriter::Create(sora::AsyncFileWriterConfig());
+//   // SoraSignalingObserver::OnTrack で
+//   auto receiver = transceiver->receiver();
+//   if (receiver->media_type() == cricket::MEDIA_TYPE_VIDEO) {
+//     sora::CmafPackagerConfig config;
+//     config.writer = writer;
+//     config.output_dir = "hls/" + receiver->track()->id();
+//     auto packager = sora::CmafPackager::Create(config);
+//     packager->SetReceiver(receiver);
+//   }
+class CmafPackager {
+ public:
+  static std::shared_ptr<CmafPackager> Create(CmafPackagerConfig config);
+  // 書きかけのパートとセグメントを書き出して、プレイリストを終端する
+  ~CmafPackager();
+
+  // receiver が受信したフレームの書き出しを始める。
+  // 映像の receiver 以外を渡した場合は false を返す。
+  bool SetReceiver(rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver);
+
+  CmafPackagerStats GetStats() const;
+
+ private:
+  CmafPackager(CmafPackagerConfig config);
+
+  class Transformer;
+
+  struct Sample {
+    int64_t timestamp;
+    int64_t duration;
+    bool is_key_frame;
+    // 長さを先頭に付けた NAL を並べたもの
+    std::vector<uint8_t> data;
+    // キーフレームの時点で有効な SPS と PPS
+    std::vector<uint8_t> sps;
+    std::vector<uint8_t> pps;
+  };
+  struct Part {
+    int64_t duration;
+    size_t offset;
+    size_t size;
+    bool independent;
+  };
+  struct Segment {
+    int index;
+    int init_index;
+    int64_t duration;
+    std::vector<Part> parts;
+  };
+
+  // フレームを受け取る。キーフレームを要求する必要がある場合は true を返す
+  bool OnEncodedFrame(rtc::ArrayView<const uint8_t> data,
+                      uint32_t rtp_timestamp,
+                      bool is_key_frame);
+  bool ParseFrame(rtc::ArrayView<const uint8_t> data, Sample* sample);
+  bool ShouldRequestKeyFrame();
+  void AddSample(Sample sample);
+  void WriteInitSegment(const Sample& sample);
+  void FlushPart();
+  void FinishSegment();
+  void WritePlaylist(bool end);
+  std::string GetPath(const std::string& name) const;
+
+  CmafPackagerConfig config_;
+  rtc::scoped_refptr<Transformer> transformer_;
+
+  mutable webrtc::Mutex mutex_;
+  CmafPackagerStats stats_ RTC_GUARDED_BY(mutex_);
+  webrtc::SeqNumUnwrapper<uint32_t> unwrapper_ RTC_GUARDED_BY(mutex_);
+
+  // ストリームに含まれていた最新の SPS と PPS
+  std::vector<uint8_t> sps_ RTC_GUARDED_BY(mutex_);
+  std::vector<uint8_t> pps_ RTC_GUARDED_BY(mutex_);
+  // 今の初期化セグメントに書いた SPS と PPS
+  std::vector<uint8_t> init_sps_ RTC_GUARDED_BY(mutex_);
+  std::vector<uint8_t> init_pps_ RTC_GUARDED_BY(mutex_);
+  int init_index_ RTC_GUARDED_BY(mutex_) = -1;
+  int width_ RTC_GUARDED_BY(mutex_) = 0;
+  int height_ RTC_GUARDED_BY(mutex_) = 0;
+
+  // 長さが決まっていないので、次のフレームが届くまで持っておくサンプル
+  std::unique_ptr<Sample> pending_ RTC_GUARDED_BY(mutex_);
+  int64_t last_duration_ RTC_GUARDED_BY(mutex_) = 3000;
+  // 書き出したサンプルの長さの合計
+  int64_t decode_time_ RTC_GUARDED_BY(mutex_) = 0;
+
+  std::vector<Sample> part_samples_ RTC_GUARDED_BY(mutex_);
+  int64_t part_start_ RTC_GUARDED_BY(mutex_) = 0;
+  int64_t segment_start_ RTC_GUARDED_BY(mutex_) = 0;
+  int64_t last_key_frame_request_ms_ RTC_GUARDED_BY(mutex_) = -1;
+  uint32_t fragment_sequence_ RTC_GUARDED_BY(mutex_) = 0;
+  int next_segment_index_ RTC_GUARDED_BY(mutex_) = 0;
+  // 書き込み中のセグメント
+  std::unique_ptr<Segment> segment_ RTC_GUARDED_BY(mutex_);
+  size_t segment_bytes_ RTC_GUARDED_BY(mutex_) = 0;
+  // 書き込み済みのセグメント。
+  // プレイリストから外した後も、古いプレイリストを読んだクライアントのために
+  // playlist_segments 個分はファイルを残しておく。
+  std::deque<Segment> segments_ RTC_GUARDED_BY(mutex_);
+  int64_t max_segment_duration_ RTC_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace sora
+
+#endif
@@ -14,9 +14,10 @@
 
 // WebRTC
 #include <api/video_codecs/video_decoder.h>
-#include <common_video/include/video_frame_buffer_pool.h>
 #include <rtc_base/platform_thread.h>
 
+#include "sora/frame_buffer_allocator.h"
+
 struct v4l2_crop;
 class NvV4l2Element;
 class NvVideoDecoder;
@@ -25,7 +26,10 @@ namespace sora {
 
 class JetsonVideoDecoder : public webrtc::VideoDecoder {
  public:
-  JetsonVideoDecoder(webrtc::VideoCodecType codec);
+  JetsonVideoDecoder(
+      webrtc::VideoCodecType codec,
+      std::shared_ptr<FrameBufferAllocator> allocator = nullptr,
+      size_t max_frame_buffers = kDefaultMaxDecoderFrameBuffers);
   ~JetsonVideoDecoder() override;
 
   static bool IsSupportedVP8();
@@ -55,7 +59,7 @@ class JetsonVideoDecoder : public webrtc::VideoDecoder {
   uint32_t input_format_;
   NvVideoDecoder* decoder_;
   webrtc::DecodedImageCallback* decode_complete_callback_;
-  webrtc::VideoFrameBufferPool buffer_pool_;
+  FrameBufferPool buffer_pool_;
   rtc::PlatformThread capture_loop_;
   std::atomic<bool> eos_;
   std::atomic<bool> got_error_;
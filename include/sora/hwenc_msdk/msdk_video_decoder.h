@@ -8,6 +8,7 @@
 #include <api/video_codecs/video_decoder.h>
 
 #include "msdk_session.h"
+#include "sora/frame_buffer_allocator.h"
 
 namespace sora {
 
@@ -17,7 +18,9 @@ class MsdkVideoDecoder : public webrtc::VideoDecoder {
                           webrtc::VideoCodecType codec);
   static std::unique_ptr<MsdkVideoDecoder> Create(
       std::shared_ptr<MsdkSession> session,
-      webrtc::VideoCodecType codec);
+      webrtc::VideoCodecType codec,
+      std::shared_ptr<FrameBufferAllocator> allocator = nullptr,
+      size_t max_frame_buffers = kDefaultMaxDecoderFrameBuffers);
 };
 
 }  // namespace sora
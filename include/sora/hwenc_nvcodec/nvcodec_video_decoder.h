@@ -3,18 +3,21 @@
 
 // WebRTC
 #include <api/video_codecs/video_decoder.h>
-#include <common_video/include/video_frame_buffer_pool.h>
 #include <rtc_base/platform_thread.h>
 
 #include "nvcodec_decoder_cuda.h"
 #include "sora/cuda_context.h"
+#include "sora/frame_buffer_allocator.h"
 
 namespace sora {
 
 class NvCodecVideoDecoder : public webrtc::VideoDecoder {
  public:
-  NvCodecVideoDecoder(std::shared_ptr<CudaContext> context,
-                      CudaVideoCodec codec);
+  NvCodecVideoDecoder(
+      std::shared_ptr<CudaContext> context,
+      CudaVideoCodec codec,
+      std::shared_ptr<FrameBufferAllocator> allocator = nullptr,
+      size_t max_frame_buffers = kDefaultMaxDecoderFrameBuffers);
   ~NvCodecVideoDecoder() override;
 
   static bool IsSupported(std::shared_ptr<CudaContext> context,
@@ -38,7 +41,7 @@ class NvCodecVideoDecoder : public webrtc::VideoDecoder {
   void ReleaseNvCodec();
 
   webrtc::DecodedImageCallback* decode_complete_callback_ = nullptr;
-  webrtc::VideoFrameBufferPool buffer_pool_;
+  FrameBufferPool buffer_pool_;
 
   std::shared_ptr<CudaContext> context_;
   CudaVideoCodec codec_;
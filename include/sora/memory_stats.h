@@ -0,0 +1,41 @@
+#ifndef SORA_MEMORY_STATS_H_
+#define SORA_MEMORY_STATS_H_
+
+#include <stdint.h>
+
+namespace sora {
+
+// SDK 全体で確保しているフレームバッファとコーデックの数。
+// セッションごとの値は SoraSignaling::GetMemoryUsage() で取得する。
+struct SoraMemoryStats {
+  // AllocatedI420Buffer (FrameBufferPool など) で確保しているフレームバッファ
+  int64_t frame_buffer_bytes = 0;
+  int64_t frame_buffer_count = 0;
+  // SoraVideoEncoderFactory/SoraVideoDecoderFactory で生成して、まだ破棄されていないコーデックの数
+  int64_t video_encoder_count = 0;
+  int64_t video_decoder_count = 0;
+  // FrameBufferPool で使用中のバッファが上限に達して、バッファを返せなかった回数
+  uint64_t frame_buffer_pool_exhausted_count = 0;
+  // アロケータがメモリを確保できなかった回数 (FrameMemoryBudget の上限を含む)
+  uint64_t frame_buffer_allocation_failed_count = 0;
+  // 出力バッファを確保できなかったために、ハードウェアデコーダがデコード済みのフレームを捨てた回数
+  uint64_t decoder_frame_dropped_count = 0;
+};
+
+SoraMemoryStats GetSoraMemoryStats();
+
+// 集計用のフック。SDK 内部から呼ばれる。
+// 独自のアロケータやコーデックを使っている場合に、アプリケーションから呼んで集計に含めても良い。
+void AddFrameBufferAllocation(int64_t bytes);
+void RemoveFrameBufferAllocation(int64_t bytes);
+void AddVideoEncoderInstance();
+void RemoveVideoEncoderInstance();
+void AddVideoDecoderInstance();
+void RemoveVideoDecoderInstance();
+void AddFrameBufferPoolExhausted();
+void AddFrameBufferAllocationFailed();
+void AddDecoderFrameDropped();
+
+}  // namespace sora
+
+#endif
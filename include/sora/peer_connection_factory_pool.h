@@ -0,0 +1,160 @@
+#ifndef SORA_PEER_CONNECTION_FACTORY_POOL_H_
+#define SORA_PEER_CONNECTION_FACTORY_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/optional.hpp>
+
+// WebRTC
+#include <api/peer_connection_interface.h>
+#include <api/scoped_refptr.h>
+#include <pc/connection_context.h>
+#include <rtc_base/synchronization/mutex.h>
+#include <rtc_base/thread.h>
+
+#include "sora/dav1d_video_decoder.h"
+#include "sora/frame_buffer_allocator.h"
+#include "sora/thread_cpu_usage.h"
+
+namespace sora {
+
+// セッションをどのシャードに割り当てるか
+enum class PeerConnectionFactoryPlacementPolicy {
+  // 割り当て中のセッションが一番少ないシャード
+  kLeastLoaded,
+  // チャンネル ID のハッシュで決める。
+  // 同じチャンネルのセッションが同じスレッドに集まるので、
+  // チャンネル単位で負荷が偏らない場合はキャッシュの効率が良い。
+  kHashChannelId,
+};
+
+struct PeerConnectionFactoryPoolConfig {
+  // シャードの数。0 の場合は論理コア数の半分 (最低 1) にする
+  int shard_count = 0;
+  PeerConnectionFactoryPlacementPolicy placement =
+      PeerConnectionFactoryPlacementPolicy::kLeastLoaded;
+  // i 番目のシャードのスレッドを動かす CPU 番号のリスト。
+  // 足りない分や空のリストのシャードは制限しない。
+  std::vector<std::vector<int>> shard_cpu_affinity;
+  // 以下は SoraDefaultClientConfig と同じ意味。
+  // シャードごとにオーディオデバイスを掴むと取り合いになるので、オーディオデバイスは使わない。
+  bool use_hardware_encoder = true;
+  bool use_passthrough_encoder = false;
+  bool use_pipelined_encoder = false;
+  bool audio_only = false;
+  boost::optional<int> opus_complexity;
+  std::shared_ptr<Dav1dVideoDecoderConfig> dav1d_decoder_config;
+  // 全てのシャードで同じアロケータを使うので、
+  // FrameMemoryBudget を指定するとプール全体で上限を守る
+  std::shared_ptr<FrameBufferAllocator> decoder_frame_buffer_allocator;
+  size_t max_decoder_frame_buffers = kDefaultMaxDecoderFrameBuffers;
+  // PeerConnectionFactoryDependencies をカスタマイズするためのコールバック関数。
+  // シャードの番号と、値が設定された dependencies が渡される。
+  std::function<void(int, webrtc::PeerConnectionFactoryDependencies&)>
+      configure_dependencies;
+};
+
+// PeerConnectionFactoryPool::GetStats で取得できるシャードごとの統計情報
+struct PeerConnectionFactoryShardStats {
+  int index = 0;
+  // 今割り当てられているセッション数
+  int sessions = 0;
+  // これまでに割り当てたセッション数の合計
+  uint64_t total_sessions = 0;
+  // 前回 GetStats() を呼んでからの、シャードのスレッドの CPU 使用率の合計。1.0 で 1 コア分。
+  // 初回の GetStats() と、Linux 以外の環境では -1 になる。
+  // シャードのスレッド以外 (エンコーダのスレッドなど) で使った分は含まない。
+  double cpu_usage = -1;
+};
+
+class PeerConnectionFactoryPool;
+
+// Place() で割り当てたシャード。
+// これを破棄するとシャードのセッション数が 1 減るので、セッションが終わるまで保持しておくこと。
+class PeerConnectionFactoryLease {
+ public:
+  ~PeerConnectionFactoryLease();
+  int shard_index() const { return shard_index_; }
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory() const {
+    return factory_;
+  }
+
+ private:
+  friend class PeerConnectionFactoryPool;
+  PeerConnectionFactoryLease(
+      std::shared_ptr<PeerConnectionFactoryPool> pool,
+      int shard_index,
+      rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory);
+
+  std::shared_ptr<PeerConnectionFactoryPool> pool_;
+  int shard_index_;
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory_;
+};
+
+// それぞれが専用のネットワーク/ワーカー/シグナリングスレッドを持つ
+// PeerConnectionFactory (シャード) のプール。
+//
+// 1 つの PeerConnectionFactory では、全てのセッションのパケットとメディアの処理が
+// 1 本のネットワークスレッドと 1 本のワーカースレッドに集まるので、
+// コア数の多いマシンでもこの 2 本のスレッドで処理できる分しかセッションを捌けない。
+// シャードに分けて割り当てると、捌けるセッション数がおおよそシャード数に比例して増える。
+//
+// 使い方:
+//   auto pool = sora::PeerConnectionFactoryPool::Create(config);
+//   // セッションごとに
+//   auto lease = pool->Place(channel_id);
+//   sora::SoraSignalingConfig config;
+//   config.pc_factory = lease->factory();
+//   ...
+//   // セッションが終わるまで lease を保持しておく
+class PeerConnectionFactoryPool
+    : public std::enable_shared_from_this<PeerConnectionFactoryPool> {
+ public:
+  static std::shared_ptr<PeerConnectionFactoryPool> Create(
+      PeerConnectionFactoryPoolConfig config);
+  ~PeerConnectionFactoryPool();
+
+  // placement に従ってシャードを選んで、セッション数を 1 増やす
+  std::shared_ptr<PeerConnectionFactoryLease> Place(
+      const std::string& channel_id);
+  std::vector<PeerConnectionFactoryShardStats> GetStats() const;
+  int shard_count() const { return static_cast<int>(shards_.size()); }
+
+ private:
+  friend class PeerConnectionFactoryLease;
+
+  struct Shard {
+    std::unique_ptr<rtc::Thread> network_thread;
+    std::unique_ptr<rtc::Thread> worker_thread;
+    std::unique_ptr<rtc::Thread> signaling_thread;
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+    rtc::scoped_refptr<webrtc::ConnectionContext> connection_context;
+  };
+
+  PeerConnectionFactoryPool(PeerConnectionFactoryPoolConfig config);
+  bool Init();
+  bool CreateShard(int index, Shard* shard);
+  void Release(int shard_index);
+
+  PeerConnectionFactoryPoolConfig config_;
+  // ThreadCpuUsage の owner に付けるプールの ID
+  const int pool_id_;
+  // Init 以降は変更しない
+  std::vector<std::unique_ptr<Shard>> shards_;
+  mutable webrtc::Mutex mutex_;
+  std::vector<PeerConnectionFactoryShardStats> stats_ RTC_GUARDED_BY(mutex_);
+  // /proc を読むので、Place() を待たせないように別のロックにする
+  mutable webrtc::Mutex cpu_usage_mutex_;
+  mutable ThreadCpuUsage cpu_usage_ RTC_GUARDED_BY(cpu_usage_mutex_);
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SORA_PROCESS_MEMORY_H_
+#define SORA_PROCESS_MEMORY_H_
+
+#include <stdint.h>
+
+namespace sora {
+
+// プロセスの物理メモリ使用量 (RSS) をバイト単位で返す。
+// 取得できなかった場合は負の値を返す。
+// 接続の前後で値を比較すると、セッションごとのおおよそのメモリ使用量が分かる。
+int64_t GetProcessResidentMemory();
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef SORA_RTP_H264_INGEST_H_
+#define SORA_RTP_H264_INGEST_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <media/base/adapted_video_track_source.h>
+#include <rtc_base/async_udp_socket.h>
+#include <rtc_base/synchronization/mutex.h>
+#include <rtc_base/third_party/sigslot/sigslot.h>
+#include <rtc_base/thread.h>
+
+#include "sora/encoded_frame_buffer.h"
+#include "sora/thread_config.h"
+
+namespace sora {
+
+class RtpH264Depacketizer;
+
+struct RtpH264IngestConfig {
+  // RTP と RTCP を受信するアドレス
+  std::string local_address = "0.0.0.0";
+  // RTP を受信するポート。0 の場合は空いているポートを使う
+  int rtp_port = 0;
+  // RTCP を送受信するポート。0 の場合は空いているポートを使う
+  int rtcp_port = 0;
+  // キーフレーム要求 (RTCP の FIR と PLI) の宛先。
+  // 空の場合は、最後に RTCP を受信した相手か、RTP の送信元のポート + 1 に送る。
+  std::string remote_rtcp_address;
+  int remote_rtcp_port = 0;
+  // 受け付ける RTP のペイロードタイプ。負の場合は全て受け付ける
+  int payload_type = -1;
+  // SDP の sprop-parameter-sets の値。
+  // ストリームに SPS と PPS が含まれていないカメラの場合に指定する。
+  std::string sprop_parameter_sets;
+  // 受信に使うスレッド。複数の RtpH264Ingest で共有して良い。
+  // rtc::Thread::CreateWithSocketServer() で作ったスレッドを指定すること。
+  // nullptr の場合は専用のスレッドを作る。
+  rtc::Thread* network_thread = nullptr;
+  ThreadConfig thread_config = {"RtpIngestThread"};
+  // キーフレームを要求する最小の間隔
+  int key_frame_request_interval_ms = 500;
+};
+
+struct RtpH264IngestStats {
+  uint64_t packets_received = 0;
+  uint64_t packets_lost = 0;
+  uint64_t frames_received = 0;
+  // パケットロスや SPS が分からないために捨てたフレームの数
+  uint64_t frames_dropped = 0;
+  uint64_t key_frame_requests = 0;
+};
+
+// IP カメラなどが送ってくる H.264 の RTP を受信して、
+// デコードせずに EncodedFrameBuffer のフレームとして流すビデオソース。
+// SoraVideoEncoderFactoryConfig::use_passthrough_encoder と組み合わせると、
+// 再エンコードせずにそのまま Sora に送信できる。
+//
+// RTP の受信とアクセスユニットの組み立ては network_thread で行う。
+// 送信先の受信者からキーフレームを要求された場合と、パケットロスでフレームを捨てた場合は、
+// RTCP の FIR と PLI でカメラにキーフレームを要求する。
+//
+// RTSP のセッションの確立は行わないので、RTSP のカメラの場合は
+// rtp_port() と rtcp_port() を client_port に指定して SETUP と PLAY を行うこと。
+// ビットレートや解像度はカメラが決めるので、Sora の帯域推定に合わせた調整はできない。
+class RtpH264Ingest : public rtc::AdaptedVideoTrackSource,
+                      public sigslot::has_slots<> {
+ public:
+  static rtc::scoped_refptr<RtpH264Ingest> Create(RtpH264IngestConfig config);
+  ~RtpH264Ingest() override;
+
+  // 実際に受信しているポート
+  int rtp_port() const { return rtp_port_; }
+  int rtcp_port() const { return rtcp_port_; }
+
+  // カメラにキーフレームを要求する。どのスレッドから呼んでも良い
+  void RequestKeyFrame();
+
+  RtpH264IngestStats GetStats() const;
+
+  bool is_screencast() const override { return false; }
+  absl::optional<bool> needs_denoising() const override { return false; }
+  webrtc::MediaSourceInterface::SourceState state() const override {
+    return SourceState::kLive;
+  }
+  bool remote() const override { return false; }
+
+ protected:
+  RtpH264Ingest(RtpH264IngestConfig config);
+
+ private:
+  class Requester;
+
+  bool Init();
+  bool ParseSpropParameterSets();
+  void SetSps(const std::vector<uint8_t>& sps);
+  // ここから下は network_thread_ で呼ばれる
+  bool CreateSockets();
+  void OnRtpPacket(rtc::AsyncPacketSocket* socket,
+                   const char* data,
+                   size_t size,
+                   const rtc::SocketAddress& remote_address,
+                   const int64_t& packet_time_us);
+  void OnRtcpPacket(rtc::AsyncPacketSocket* socket,
+                    const char* data,
+                    size_t size,
+                    const rtc::SocketAddress& remote_address,
+                    const int64_t& packet_time_us);
+  void SendKeyFrameRequest();
+
+  RtpH264IngestConfig config_;
+  std::unique_ptr<rtc::Thread> own_thread_;
+  rtc::Thread* network_thread_ = nullptr;
+  int rtp_port_ = 0;
+  int rtcp_port_ = 0;
+  std::shared_ptr<Requester> requester_;
+
+  // ここから下は network_thread_ からのみ触る
+  std::unique_ptr<rtc::AsyncUDPSocket> rtp_socket_;
+  std::unique_ptr<rtc::AsyncUDPSocket> rtcp_socket_;
+  std::unique_ptr<RtpH264Depacketizer> depacketizer_;
+  rtc::SocketAddress rtp_remote_address_;
+  rtc::SocketAddress rtcp_remote_address_;
+  uint32_t local_ssrc_ = 0;
+  uint32_t remote_ssrc_ = 0;
+  uint8_t fir_sequence_number_ = 0;
+  int64_t last_key_frame_request_ms_ = -1;
+  std::vector<uint8_t> sps_;
+  std::vector<uint8_t> pps_;
+  int width_ = 0;
+  int height_ = 0;
+  uint64_t frame_number_ = 0;
+
+  mutable webrtc::Mutex stats_mutex_;
+  RtpH264IngestStats stats_ RTC_GUARDED_BY(stats_mutex_);
+};
+
+}  // namespace sora
+
+#endif
@@ -11,19 +11,59 @@
 #define SORA_SCALABLE_VIDEO_TRACK_SOURCE_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 
 // WebRTC
 #include <media/base/adapted_video_track_source.h>
 #include <media/base/video_adapter.h>
+#include <rtc_base/platform_thread.h>
 #include <rtc_base/timestamp_aligner.h>
 
+#include "sora/frame_buffer_allocator.h"
+#include "sora/thread_config.h"
+
 namespace sora {
 
+struct ScalableVideoTrackSourceConfig {
+  // 画面キャプチャなどのスクリーンコンテンツを配信する場合は true にする。
+  // true にするとエンコーダがスクリーンコンテンツ向けの設定になる。
+  bool is_screencast = false;
+  // リサイズしたフレームのバッファを確保するアロケータ。
+  // 指定しなかった場合は毎フレーム webrtc::I420Buffer を確保する。
+  std::shared_ptr<FrameBufferAllocator> allocator;
+  // キャプチャしたフレームを一定の間隔に揃えてからエンコーダに渡すための設定。
+  // USB カメラやファイルなど、フレームが不規則な間隔で届くソースで使うと、
+  // エンコーダにまとめてフレームが届くことによるビットレートの跳ね上がりを抑えられる。
+  struct Pacing {
+    // 揃える間隔のフレームレート。0 の場合は揃えずにすぐ渡す
+    int framerate = 0;
+    // 送信待ちにしておける最大のフレーム数。
+    // これを超えた場合は、遅らせずに古いフレームから捨てる
+    int max_queue_size = 2;
+    ThreadConfig thread_config = {"PacingThread"};
+  };
+  Pacing pacing;
+};
+
+// ScalableVideoTrackSource::GetPacingStats で取得できる統計情報
+struct ScalableVideoTrackSourcePacingStats {
+  uint64_t frames_captured = 0;
+  uint64_t frames_sent = 0;
+  uint64_t frames_dropped = 0;
+  // フレーム間隔と Pacing::framerate の間隔との差の平滑化した平均 (RFC 3550 のジッタと同じ計算)
+  double capture_jitter_ms = 0;
+  double send_jitter_ms = 0;
+};
+
 class ScalableVideoTrackSource : public rtc::AdaptedVideoTrackSource {
  public:
   ScalableVideoTrackSource();
+  ScalableVideoTrackSource(ScalableVideoTrackSourceConfig config);
   virtual ~ScalableVideoTrackSource();
 
   bool is_screencast() const override;
@@ -32,8 +72,30 @@ class ScalableVideoTrackSource : public rtc::AdaptedVideoTrackSource {
   bool remote() const override;
   void OnCapturedFrame(const webrtc::VideoFrame& frame);
 
+  // Pacing::framerate が 0 の場合はフレーム数以外は 0 のまま
+  ScalableVideoTrackSourcePacingStats GetPacingStats();
+
  private:
+  void ProcessFrame(const webrtc::VideoFrame& frame);
+  void PacingThread();
+  static void UpdateJitter(int64_t interval_us,
+                           int64_t expected_interval_us,
+                           double* jitter_us);
+
+  ScalableVideoTrackSourceConfig config_;
   rtc::TimestampAligner timestamp_aligner_;
+  std::unique_ptr<FrameBufferPool> buffer_pool_;
+
+  std::mutex pacing_mutex_;
+  std::condition_variable pacing_cv_;
+  std::deque<webrtc::VideoFrame> pacing_queue_;
+  bool pacing_quit_ = false;
+  int64_t last_captured_us_ = 0;
+  int64_t last_sent_us_ = 0;
+  double capture_jitter_us_ = 0;
+  double send_jitter_us_ = 0;
+  ScalableVideoTrackSourcePacingStats pacing_stats_;
+  rtc::PlatformThread pacing_thread_;
 };
 
 }
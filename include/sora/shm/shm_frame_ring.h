@@ -0,0 +1,195 @@
+#ifndef SORA_SHM_SHM_FRAME_RING_H_
+#define SORA_SHM_SHM_FRAME_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// 共有メモリ上のフレームのリングバッファ。
+//
+// 別プロセスとフレームをやりとりするためのもので、WebRTC には依存していない。
+// 読み込み側のプロセスはこのヘッダーと shm_frame_ring.cpp だけあれば使える。
+//
+// メモリ配置:
+//   ShmFrameRingHeader
+//   スロット 0: ShmFrameSlotHeader + データ領域 (slot_data_size バイト)
+//   スロット 1: ...
+//
+// 各スロットは seqlock で保護されている。
+// 書き込み側は sequence を奇数にしてからデータを書き込み、書き終わったら偶数に戻す。
+// 読み込み側は読む前と読んだ後で sequence が同じ偶数なら、正しく読めたとみなす。
+// そのため、読み込み側はデータをコピーせずにその場で処理して、最後に検証すれば良い。
+//
+// 読み込み側がフレームをしばらく使い続けたい場合は、ShmFrameRingReader::Hold() で
+// スロットを確保できる。確保されているスロットは書き込み側が飛ばすので上書きされない。
+
+namespace sora {
+
+static const uint32_t kShmFrameRingMagic = 0x41524f53;  // "SORA"
+static const uint32_t kShmFrameRingVersion = 1;
+static const size_t kShmFrameTrackIdSize = 64;
+
+enum class ShmFrameFormat : uint32_t {
+  kI420 = 1,
+};
+
+struct ShmFrameRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_data_size;
+  // スロットの先頭同士の間隔
+  uint32_t slot_stride;
+  uint32_t reserved;
+  // 書き込みが完了した最新のフレーム番号。まだ何も書き込まれていない場合は 0
+  std::atomic<uint64_t> latest_frame_number;
+};
+
+struct ShmFrameSlotHeader {
+  std::atomic<uint32_t> sequence;
+  // 読み込み側がこのスロットを確保している数。0 でなければ書き込み側は使わない
+  std::atomic<uint32_t> hold_count;
+  // 1 から始まる通し番号。スロットは frame_number % slot_count 番目になる
+  uint64_t frame_number;
+  ShmFrameFormat format;
+  char track_id[kShmFrameTrackIdSize];
+  int64_t timestamp_us;
+  uint32_t rtp_timestamp;
+  int32_t width;
+  int32_t height;
+  int32_t stride_y;
+  int32_t stride_u;
+  int32_t stride_v;
+  // データ領域の先頭から各プレーンまでのオフセット
+  uint32_t offset_y;
+  uint32_t offset_u;
+  uint32_t offset_v;
+  uint32_t data_size;
+};
+
+// フレームの情報
+struct ShmFrameInfo {
+  ShmFrameFormat format = ShmFrameFormat::kI420;
+  std::string track_id;
+  int64_t timestamp_us = 0;
+  uint32_t rtp_timestamp = 0;
+  int width = 0;
+  int height = 0;
+  int stride_y = 0;
+  int stride_u = 0;
+  int stride_v = 0;
+  uint32_t offset_y = 0;
+  uint32_t offset_u = 0;
+  uint32_t offset_v = 0;
+  uint32_t data_size = 0;
+};
+
+struct ShmFrameRingConfig {
+  // 空の場合は memfd で名前の無い共有メモリを作る。
+  // その場合は fd() を SCM_RIGHTS などで読み込み側のプロセスに渡すこと。
+  // 名前を指定した場合は shm_open で作成し、読み込み側は同じ名前で開ける。
+  std::string name;
+  uint32_t slot_count = 8;
+  // 1 スロットに書き込める最大のデータサイズ。
+  // デフォルトは 1920x1080 の I420 が入る大きさ
+  uint32_t slot_data_size = 1920 * 1080 * 3 / 2;
+};
+
+// 共有メモリのリングバッファにフレームを書き込む。
+// 同じプロセス内の複数のスレッドから同時に書き込める。
+class ShmFrameRingWriter {
+ public:
+  struct Slot {
+    uint64_t frame_number = 0;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+  };
+
+  static std::unique_ptr<ShmFrameRingWriter> Create(ShmFrameRingConfig config);
+  ~ShmFrameRingWriter();
+
+  int fd() const { return fd_; }
+  const std::string& name() const { return name_; }
+  uint32_t slot_data_size() const { return header_->slot_data_size; }
+
+  // 次のスロットを確保して、データ領域を返す。
+  // 呼び出し側はこのデータ領域に直接書き込み、書き込み終わったら必ず Commit() を呼ぶこと。
+  // 読み込み側が Hold() しているスロットは飛ばすので、その分のフレーム番号は欠番になる。
+  // 全てのスロットが Hold() されている場合は data が nullptr の Slot を返す。
+  // その場合は Commit() を呼ばないこと。
+  Slot Begin();
+  void Commit(const Slot& slot, const ShmFrameInfo& info);
+
+ private:
+  ShmFrameRingWriter() {}
+  ShmFrameSlotHeader* GetSlotHeader(uint64_t frame_number) const;
+
+  std::string name_;
+  int fd_ = -1;
+  uint8_t* memory_ = nullptr;
+  size_t memory_size_ = 0;
+  ShmFrameRingHeader* header_ = nullptr;
+  std::atomic<uint64_t> next_frame_number_{1};
+  // 同じスロットに同時に書き込まないようにするためのもの
+  std::unique_ptr<std::mutex[]> slot_mutexes_;
+};
+
+// 読み込み中のフレーム。
+// data_y などは共有メモリを直接指しているので、使い終わったら ShmFrameRingReader::Validate()
+// で書き込み側に上書きされていないかを確認すること。
+struct ShmFrameView {
+  ShmFrameInfo info;
+  uint64_t frame_number = 0;
+  const uint8_t* data_y = nullptr;
+  const uint8_t* data_u = nullptr;
+  const uint8_t* data_v = nullptr;
+  uint32_t sequence = 0;
+};
+
+// 共有メモリのリングバッファからフレームを読み込む
+class ShmFrameRingReader {
+ public:
+  // fd は内部で dup するので、呼び出し側で閉じて良い。
+  // Hold() を使う場合は holdable を true にすること。
+  // その場合は共有メモリを書き込み可能な状態で開く必要がある。
+  static std::unique_ptr<ShmFrameRingReader> Open(int fd,
+                                                  bool holdable = false);
+  static std::unique_ptr<ShmFrameRingReader> Open(const std::string& name,
+                                                  bool holdable = false);
+  ~ShmFrameRingReader();
+
+  uint32_t slot_count() const { return header_->slot_count; }
+  // 書き込みが完了した最新のフレーム番号。まだ何も無い場合は 0
+  uint64_t GetLatestFrameNumber() const;
+  // frame_number のフレームを view に設定する。
+  // そのフレームがまだ書き込まれていないか、既に上書きされている場合は false を返す。
+  bool Acquire(uint64_t frame_number, ShmFrameView* view) const;
+  // Acquire() してから今までの間にフレームが上書きされていなければ true を返す。
+  // false の場合は読み込んだ内容が壊れている可能性があるので捨てること。
+  bool Validate(const ShmFrameView& view) const;
+  // view のスロットを書き込み側に上書きされないように確保する。
+  // Acquire() してから今までの間に上書きされていた場合は false を返す。
+  // true を返した場合は、使い終わったら必ず Unhold() を呼ぶこと。
+  // 読み込み側のプロセスが Unhold() せずに終了すると、そのスロットはずっと使われなくなる。
+  bool Hold(const ShmFrameView& view) const;
+  void Unhold(uint64_t frame_number) const;
+
+ private:
+  ShmFrameRingReader() {}
+  bool Map(int fd, bool holdable);
+  const ShmFrameSlotHeader* GetSlotHeader(uint64_t frame_number) const;
+
+  int fd_ = -1;
+  uint8_t* memory_ = nullptr;
+  size_t memory_size_ = 0;
+  const ShmFrameRingHeader* header_ = nullptr;
+  bool holdable_ = false;
+};
+
+}  // namespace sora
+
+#endif
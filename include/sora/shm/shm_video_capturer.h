@@ -0,0 +1,73 @@
+#ifndef SORA_SHM_SHM_VIDEO_CAPTURER_H_
+#define SORA_SHM_SHM_VIDEO_CAPTURER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <rtc_base/platform_thread.h>
+
+#include "sora/scalable_track_source.h"
+#include "sora/shm/shm_frame_ring.h"
+#include "sora/thread_config.h"
+
+namespace sora {
+
+struct ShmVideoCapturerConfig : ScalableVideoTrackSourceConfig {
+  // 読み込む共有メモリの名前。空の場合は fd を使う
+  std::string name;
+  // 書き込み側から受け取った memfd などの fd。内部で dup するので閉じて良い
+  int fd = -1;
+  // 空でない場合は、この track_id のフレームだけを使う
+  std::string track_id;
+  // true の場合は、書き込み側のタイムスタンプの間隔に合わせてフレームを送る。
+  // false の場合は、書き込まれたらすぐに送る。
+  bool pace_by_timestamp = true;
+  // 書き込み側のタイムスタンプから計算した送信時刻と現在時刻が、
+  // これ以上ずれている場合は待たずに送り、そこを新しい基準にする
+  int max_pacing_delay_ms = 200;
+  // 新しいフレームが書き込まれていないかを確認する間隔
+  int poll_interval_ms = 2;
+  // 読み込みスレッドの設定。
+  // policy が kDefault の場合は高優先度 (kHigh) で動かす
+  ThreadConfig capture_thread_config = {"ShmCaptureThread"};
+};
+
+// 別のプロセスが共有メモリのリングバッファに書き込んだフレームを配信するキャプチャラ。
+// 書き込み側は ShmFrameRingWriter を使って I420 のフレームを書き込む。
+//
+// フレームはコピーせずに、共有メモリのスロットをそのまま VideoFrameBuffer として使う。
+// エンコーダなどがバッファを解放するまでスロットは確保されたままになり、
+// その間は書き込み側がそのスロットを飛ばす。
+// そのため、書き込み側の slot_count は、エンコーダが保持するフレーム数より十分多くすること。
+class ShmVideoCapturer : public ScalableVideoTrackSource {
+ public:
+  static rtc::scoped_refptr<ShmVideoCapturer> Create(
+      ShmVideoCapturerConfig config);
+  ShmVideoCapturer(ShmVideoCapturerConfig config);
+  ~ShmVideoCapturer();
+
+ private:
+  bool Init();
+  void CaptureThread();
+  // 書き込み側のタイムスタンプに合わせて待つ。
+  // 送る時刻を返すが、待っている間に終了を要求された場合は -1 を返す
+  int64_t WaitForPacing(int64_t timestamp_us);
+
+  ShmVideoCapturerConfig config_;
+  std::shared_ptr<ShmFrameRingReader> reader_;
+  // 書き込み側のタイムスタンプを、こちらの時刻に変換するためのオフセット
+  int64_t pacing_offset_us_ = 0;
+  int64_t last_timestamp_us_ = -1;
+
+  std::atomic<bool> quit_;
+  rtc::PlatformThread capture_thread_;
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SORA_SHM_SHM_VIDEO_SINK_H_
+#define SORA_SHM_SHM_VIDEO_SINK_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/media_stream_interface.h>
+#include <api/scoped_refptr.h>
+#include <rtc_base/synchronization/mutex.h>
+
+#include "sora/shm/shm_frame_ring.h"
+
+namespace sora {
+
+struct ShmVideoSinkConfig {
+  ShmFrameRingConfig ring;
+};
+
+// 受信した映像トラックのデコード済みフレームを、共有メモリのリングバッファに書き込むクラス。
+// 推論処理などを別プロセスで行う場合に、ソケットでフレームを送る代わりに使う。
+//
+// フレームは I420 に変換して、共有メモリのスロットに直接 1 回だけコピーする。
+// 複数のトラックを追加した場合は、同じリングバッファに track_id 付きで書き込まれる。
+// 読み込み側は ShmFrameRingReader を使う。
+//
+// 使い方:
+//   auto sink = sora::ShmVideoSink::Create(config);
+//   // sink->fd() を読み込み側のプロセスに渡す
+//   // SoraSignalingObserver::OnTrack で
+//   if (track->kind() == webrtc::MediaStreamTrackInterface::kVideoKind) {
+//     sink->AddTrack(
+//         static_cast<webrtc::VideoTrackInterface*>(track.get()));
+//   }
+class ShmVideoSink {
+ public:
+  static std::shared_ptr<ShmVideoSink> Create(ShmVideoSinkConfig config);
+  ~ShmVideoSink();
+
+  int fd() const { return writer_->fd(); }
+  const std::string& name() const { return writer_->name(); }
+
+  // track のフレームを書き込み始める。同じ ID のトラックが既にある場合は何もしない
+  void AddTrack(rtc::scoped_refptr<webrtc::VideoTrackInterface> track);
+  // track のフレームを書き込むのを止める。
+  // この関数から戻った後は、このトラックのフレームは書き込まれない。
+  void RemoveTrack(const std::string& track_id);
+  std::vector<std::string> GetTrackIds() const;
+
+ private:
+  ShmVideoSink(std::unique_ptr<ShmFrameRingWriter> writer);
+
+  class Sink;
+
+  std::unique_ptr<ShmFrameRingWriter> writer_;
+  mutable webrtc::Mutex mutex_;
+  std::map<std::string, std::unique_ptr<Sink>> sinks_ RTC_GUARDED_BY(mutex_);
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SORA_SIGNALING_TRACE_H_
+#define SORA_SIGNALING_TRACE_H_
+
+#include <stdint.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <rtc_base/synchronization/mutex.h>
+
+namespace sora {
+
+enum class SignalingTraceDirection {
+  // Sora から受信したメッセージ
+  kInbound,
+  // Sora に送信したメッセージ
+  kOutbound,
+};
+
+// WebSocket のメッセージを記録する時の channel の値
+static const char kSignalingTraceWebSocketChannel[] = "websocket";
+
+struct SignalingTraceEntry {
+  // 記録を開始してからの経過時間
+  int64_t timestamp_us = 0;
+  SignalingTraceDirection direction = SignalingTraceDirection::kInbound;
+  // WebSocket の場合は kSignalingTraceWebSocketChannel、
+  // DataChannel の場合はラベル
+  std::string channel;
+  // 圧縮されている場合は展開した後のメッセージ
+  std::string message;
+};
+
+// シグナリングのメッセージを、受信・送信した時刻と一緒にファイルに記録するクラス。
+// SoraSignalingConfig::trace_recorder に指定すると、
+// WebSocket と DataChannel でやりとりしたシグナリングのメッセージを全て記録する。
+// ユーザ定義のラベル ("#" から始まるラベル) のメッセージは記録しない。
+//
+// ファイルは 1 メッセージごとに以下の形式になっている。
+// 長さを先に書いているので、メッセージに改行などが含まれていても問題ない。
+//   <経過時間(us)> <I または O> <channel> <メッセージのバイト数>\n<メッセージ>\n
+class SignalingTraceRecorder {
+ public:
+  static std::shared_ptr<SignalingTraceRecorder> Create(
+      const std::string& path);
+
+  // 複数のスレッドから呼んで良い
+  void Record(SignalingTraceDirection direction,
+              const std::string& channel,
+              const std::string& message);
+
+ private:
+  SignalingTraceRecorder(int64_t start_us);
+
+  int64_t start_us_;
+  webrtc::Mutex mutex_;
+  std::ofstream ofs_ RTC_GUARDED_BY(mutex_);
+};
+
+// SignalingTraceRecorder で記録したファイルを読み込む。
+// 失敗した場合は false を返す。
+bool LoadSignalingTrace(const std::string& path,
+                        std::vector<SignalingTraceEntry>* entries);
+
+}  // namespace sora
+
+#endif
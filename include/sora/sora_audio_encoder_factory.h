@@ -0,0 +1,26 @@
+#ifndef SORA_SORA_AUDIO_ENCODER_FACTORY_H_
+#define SORA_SORA_AUDIO_ENCODER_FACTORY_H_
+
+// Boost
+#include <boost/optional.hpp>
+
+// WebRTC
+#include <api/audio_codecs/audio_encoder_factory.h>
+#include <api/scoped_refptr.h>
+
+namespace sora {
+
+struct SoraAudioEncoderFactoryConfig {
+  // Opus の複雑度 (0-10)。設定しなかった場合は WebRTC のデフォルト値になる。
+  // 値を小さくすると音質は少し下がるが、エンコードの CPU 使用率が大きく下がる。
+  // 1 台で大量の音声を送信する場合は 0-3 程度にすると良い。
+  boost::optional<int> opus_complexity;
+};
+
+// ビルトインのオーディオエンコーダファクトリに、Opus の設定を上書きする機能を追加したもの
+rtc::scoped_refptr<webrtc::AudioEncoderFactory> CreateSoraAudioEncoderFactory(
+    SoraAudioEncoderFactoryConfig config);
+
+}  // namespace sora
+
+#endif
@@ -5,7 +5,10 @@
 #include <api/peer_connection_interface.h>
 #include <pc/connection_context.h>
 
+#include "sora/dav1d_video_decoder.h"
+#include "sora/frame_buffer_allocator.h"
 #include "sora/sora_signaling.h"
+#include "sora/thread_config.h"
 
 namespace sora {
 
@@ -16,6 +19,35 @@ struct SoraDefaultClientConfig {
   // ハードウェアエンコーダ/デコーダを利用するかどうか
   // false にするとソフトウェアエンコーダ/デコーダのみになる（H.264 は利用できない）
   bool use_hardware_encoder = true;
+  // EncodedFrameBuffer のフレームを再エンコードせずに送信するかどうか。
+  // RtpH264Ingest を使う場合は true にする。
+  bool use_passthrough_encoder = false;
+  // ソフトウェアエンコーダを専用スレッドで動かして、フレームの前処理とエンコードを並列に行うかどうか。
+  // 高解像度の場合にスループットが上がるが、エンコーダ 1 つにつきスレッドが 1 つ増える。
+  bool use_pipelined_encoder = false;
+  // 音声のみで利用する場合は true にする。
+  // 映像のエンコーダ/デコーダを一切用意せず、CUDA などのハードウェアの確認も行わないので、
+  // 起動が速くなり、1 クライアントあたりのメモリ使用量も減る。
+  // この場合 SoraSignalingConfig::video は false にすること。
+  bool audio_only = false;
+  // 指定した場合、AV1 のソフトウェアデコーダに libaom の代わりに dav1d を使う。
+  // USE_DAV1D_DECODER が無効な場合は無視される。
+  std::shared_ptr<Dav1dVideoDecoderConfig> dav1d_decoder_config;
+  // ハードウェアデコーダが出力する I420 バッファを確保するアロケータ。
+  // 多数のストリームを受信する場合は FrameMemoryBudget を指定して、
+  // 全てのデコーダで使うメモリの合計に上限を設けると良い。
+  std::shared_ptr<FrameBufferAllocator> decoder_frame_buffer_allocator;
+  // ハードウェアデコーダ 1 つあたりが同時に使う出力バッファの数の上限
+  size_t max_decoder_frame_buffers = kDefaultMaxDecoderFrameBuffers;
+  // Opus の複雑度 (0-10)。設定しなかった場合は WebRTC のデフォルト値になる。
+  // それ以外の Opus の設定は SoraSignalingConfig::opus で接続ごとに指定する。
+  boost::optional<int> opus_complexity;
+  // 各スレッドの CPU アフィニティやスケジューリングの設定
+  // 例えばネットワークスレッドを NIC と同じソケットの CPU に固定すると、
+  // スレッドが別のソケットに移動してレイテンシが揺らぐのを防げる
+  ThreadConfig network_thread_config = {"network_thread"};
+  ThreadConfig worker_thread_config = {"worker_thread"};
+  ThreadConfig signaling_thread_config = {"signaling_thread"};
 };
 
 // Sora クライアントのデフォルトの実装
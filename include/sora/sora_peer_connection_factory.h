@@ -1,13 +1,53 @@
 #ifndef SORA_SORA_PEER_CONNECTION_FACTORY_H_
 #define SORA_SORA_PEER_CONNECTION_FACTORY_H_
 
+#include <memory>
+
+// Boost
+#include <boost/optional.hpp>
+
 // WebRTC
 #include <api/peer_connection_interface.h>
 #include <api/scoped_refptr.h>
 #include <pc/connection_context.h>
+#include <rtc_base/thread.h>
+
+#include "sora/dav1d_video_decoder.h"
+#include "sora/frame_buffer_allocator.h"
 
 namespace sora {
 
+// CreateSoraPeerConnectionFactoryDependencies() の設定。
+// SoraDefaultClient と PeerConnectionFactoryPool で共通の、メディアエンジンの設定。
+struct SoraPeerConnectionFactoryDependenciesConfig {
+  rtc::Thread* network_thread = nullptr;
+  rtc::Thread* worker_thread = nullptr;
+  rtc::Thread* signaling_thread = nullptr;
+  // 以下は SoraDefaultClientConfig と同じ意味
+  bool use_audio_device = true;
+  bool use_hardware_encoder = true;
+  bool use_passthrough_encoder = false;
+  bool use_pipelined_encoder = false;
+  bool audio_only = false;
+  boost::optional<int> opus_complexity;
+  std::shared_ptr<Dav1dVideoDecoderConfig> dav1d_decoder_config;
+  std::shared_ptr<FrameBufferAllocator> decoder_frame_buffer_allocator;
+  size_t max_decoder_frame_buffers = kDefaultMaxDecoderFrameBuffers;
+  // Android の android.context.Context オブジェクト
+  void* android_application_context = nullptr;
+};
+
+// スレッドとメディアエンジン (オーディオデバイス、音声と映像のエンコーダ/デコーダ) を設定した
+// PeerConnectionFactoryDependencies を作る。
+// オーディオデバイスモジュールは worker_thread で作成する。
+webrtc::PeerConnectionFactoryDependencies
+CreateSoraPeerConnectionFactoryDependencies(
+    const SoraPeerConnectionFactoryDependenciesConfig& config);
+
+// SDK のデフォルトの PeerConnectionFactory のオプション (DTLS 1.2、GCM の有効化) を設定する
+void SetSoraPeerConnectionFactoryOptions(
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory);
+
 rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
 CreateModularPeerConnectionFactoryWithContext(
     webrtc::PeerConnectionFactoryDependencies dependencies,
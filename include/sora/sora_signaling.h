@@ -15,7 +15,12 @@
 #include <api/peer_connection_interface.h>
 #include <api/scoped_refptr.h>
 
+#include "bitrate_memory.h"
 #include "data_channel.h"
+#include "dtls_certificate_pool.h"
+#include "flight_recorder.h"
+#include "memory_stats.h"
+#include "signaling_trace.h"
 #include "websocket.h"
 
 namespace sora {
@@ -46,6 +51,42 @@ class SoraSignalingObserver {
       rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver) = 0;
 };
 
+// SoraSignaling::UpdateSenderEncodings で送信エンコーディングを変更するための値。
+// 設定されていない値は変更しない。
+struct SenderEncodingUpdate {
+  // 変更するエンコーディングの rid。空文字の場合はすべてのエンコーディングを変更する
+  std::string rid;
+  // 0 以下を指定すると制限を解除する
+  boost::optional<int> max_bitrate_bps;
+  // 0 以下を指定すると制限を解除する
+  boost::optional<double> max_framerate;
+  boost::optional<double> scale_resolution_down_by;
+  boost::optional<bool> active;
+};
+
+// SoraSignaling::GetMemoryUsage で取得できる、セッションが保持しているメモリのおおよその量。
+// WebRTC 内部のバッファなどは含まないので、あくまで目安として使うこと。
+struct SoraSignalingMemoryUsage {
+  // WebSocket の送信待ちのバイト数
+  size_t websocket_write_queue_bytes = 0;
+  // DataChannel の送信待ちのバイト数の合計
+  uint64_t data_channel_buffered_bytes = 0;
+  // PeerConnection が保持しているローカルとリモートの SDP のバイト数
+  size_t sdp_bytes = 0;
+  // 最後に送信した統計情報のバイト数
+  size_t stats_bytes = 0;
+  // 圧縮するラベルの一覧やエンコーディングパラメータなど、それ以外の情報のバイト数
+  size_t other_bytes = 0;
+  // SDK 全体のフレームバッファとコーデックの数。
+  // セッションごとには分けられないので、セッション数で割って目安にする。
+  SoraMemoryStats sdk;
+
+  uint64_t session_bytes() const {
+    return websocket_write_queue_bytes + data_channel_buffered_bytes +
+           sdp_bytes + stats_bytes + other_bytes;
+  }
+};
+
 struct SoraSignalingConfig {
   boost::asio::io_context* io_context;
   rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> pc_factory;
@@ -65,6 +106,20 @@ struct SoraSignalingConfig {
   std::string audio_codec_type = "";
   int video_bit_rate = 0;
   int audio_bit_rate = 0;
+  // Opus エンコーダの設定。設定されていない値はデフォルトのまま。
+  // Sora から受け取った offer の fmtp を書き換えて、このクライアントが送信する音声に適用する。
+  // 複雑度は SDP で指定できないので SoraDefaultClientConfig::opus_complexity で指定する。
+  struct Opus {
+    // 1 パケットあたりのフレーム長 (10, 20, 40, 60, 120)
+    boost::optional<int> ptime;
+    // 無音時に送信を止める
+    boost::optional<bool> dtx;
+    // インバンド FEC
+    boost::optional<bool> fec;
+    // false の場合はモノラルでエンコードする
+    boost::optional<bool> stereo;
+  };
+  Opus opus;
   boost::json::value metadata;
   std::string role = "sendonly";
   boost::optional<bool> multistream;
@@ -88,6 +143,28 @@ struct SoraSignalingConfig {
     boost::optional<bool> compress;
   };
   std::vector<DataChannel> data_channels;
+  // DataChannel の往復時間を計測するプローブの設定。
+  // 同じチャンネルの他の参加者に、送信時刻を入れたメッセージを label で定期的に送り、
+  // 同じ設定の参加者が送り返してきたメッセージで往復時間を計測する。
+  // 結果は SoraSignaling::GetDataChannelStats() の rtt_ms と rtt_ms_by_responder で取得できる。
+  // プローブのメッセージは SoraSignalingObserver::OnMessage には渡さない。
+  //
+  // DataChannel のメッセージはチャンネル全体に送られるので、応答もチャンネル全体に届く。
+  // 参加者が N 人いて全員がプローブを送って応答する場合、interval_ms ごとに
+  // N 個のリクエストと N * (N - 1) 個の応答が全員に届く。
+  // 参加者が多いチャンネルでは、計測したい参加者以外は interval_ms を 0 にし、
+  // 応答する参加者も respond で絞ること。
+  struct DataChannelProbe {
+    // プローブに使うラベル。# で始まるラベルを data_channels で設定しておくこと。
+    // 空の場合はプローブを送らず、応答もしない。
+    std::string label;
+    // プローブを送る間隔。0 の場合は送らずに応答だけする
+    int interval_ms = 1000;
+    // 他の参加者から届いたプローブに送り返すかどうか。
+    // 応答はプローブを送った参加者だけでなくチャンネル全体に届く
+    bool respond = true;
+  };
+  DataChannelProbe data_channel_probe;
 
   std::string client_cert;
   std::string client_key;
@@ -102,6 +179,26 @@ struct SoraSignalingConfig {
   // proxy を設定する場合は必須
   rtc::NetworkManager* network_manager = nullptr;
   rtc::PacketSocketFactory* socket_factory = nullptr;
+
+  // 指定した場合は、PeerConnection を生成する時にこのプールから DTLS の証明書を取り出して使う。
+  // 複数の SoraSignaling で同じプールを共有して良い。
+  std::shared_ptr<DtlsCertificatePool> certificate_pool;
+
+  // 指定した場合は、送受信したシグナリングのメッセージを全て記録する。
+  // 記録したファイルは test/signaling_replay.cpp で再生できる。
+  std::shared_ptr<SignalingTraceRecorder> trace_recorder;
+
+  // 指定した場合は、統計情報を定期的に取得して記録しておき、
+  // PEER_CONNECTION_STATE_FAILED か WEBSOCKET_ONERROR で切断した時に
+  // ログと一緒にファイルに書き出す。
+  // 複数の SoraSignaling で同じ FlightRecorder を共有して良い。
+  std::shared_ptr<FlightRecorder> flight_recorder;
+
+  // 指定した場合は、前回同じシグナリングのホストに同じネットワークから接続した時の帯域を
+  // 開始ビットレートに使い、接続中の帯域を記録して切断した時に保存する。
+  // 開始ビットレートは video_bit_rate を超えないようにする。
+  // 複数の SoraSignaling で同じ BitrateMemory を共有して良い。
+  std::shared_ptr<BitrateMemory> bitrate_memory;
 };
 
 class SoraSignaling : public std::enable_shared_from_this<SoraSignaling>,
@@ -119,6 +216,25 @@ class SoraSignaling : public std::enable_shared_from_this<SoraSignaling>,
   void Disconnect();
   bool SendDataChannel(const std::string& label, const std::string& data);
 
+  // 接続中の送信エンコーディングを再ネゴシエーション無しで変更する。
+  // ssrc は維持したまま、指定された sender の rid ごとのエンコーディングを変更する。
+  // サイマルキャストの場合、ここで変更した値は re-offer 後にも引き継がれる。
+  // 任意のスレッドから呼べて、on_complete は io_context のスレッドで呼ばれる。
+  void UpdateSenderEncodings(
+      rtc::scoped_refptr<webrtc::RtpSenderInterface> sender,
+      std::vector<SenderEncodingUpdate> updates,
+      std::function<void(webrtc::RTCError)> on_complete = nullptr);
+
+  // このセッションが保持しているメモリのおおよその量を取得する。
+  // 任意のスレッドから呼べて、on_complete は io_context のスレッドで呼ばれる。
+  void GetMemoryUsage(
+      std::function<void(SoraSignalingMemoryUsage)> on_complete);
+
+  // DataChannel のラベルごとの送信の待ち時間、スループット、プローブの往復時間を取得する。
+  // 任意のスレッドから呼べて、on_complete は io_context のスレッドで呼ばれる。
+  void GetDataChannelStats(
+      std::function<void(std::vector<DataChannelLabelStats>)> on_complete);
+
  private:
   static bool ParseURL(const std::string& url, URLParts& parts, bool& ssl);
 
@@ -133,6 +249,24 @@ class SoraSignaling : public std::enable_shared_from_this<SoraSignaling>,
   void DoSendPong(
       const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report);
   void DoSendUpdate(const std::string& sdp, std::string type);
+  void WriteWebSocketText(std::string text,
+                          Websocket::write_callback_t on_write = nullptr);
+  void TraceMessage(SignalingTraceDirection direction,
+                    const std::string& channel,
+                    const std::string& message);
+  void StartDataChannelProbe();
+  void SendDataChannelProbe();
+  // label がプローブのメッセージなら処理して true を返す
+  bool HandleDataChannelProbe(const std::string& label,
+                              const std::string& data);
+  void StartFlightRecorderStats();
+  void SampleFlightRecorderStats();
+  // 覚えている帯域を pc_ の開始ビットレートに設定する
+  void ApplyBitrateMemory();
+  void StartBitrateMemoryStats();
+  void SampleBitrateMemoryStats();
+  // config_.opus の設定を offer の Opus の fmtp に反映する
+  std::string ApplyOpusParameters(const std::string& sdp) const;
 
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> CreatePeerConnection(
       boost::json::value jconfig);
@@ -161,6 +295,9 @@ class SoraSignaling : public std::enable_shared_from_this<SoraSignaling>,
       std::string mid,
       std::vector<webrtc::RtpEncodingParameters> encodings);
   void ResetEncodingParameters();
+  webrtc::RTCError DoUpdateSenderEncodings(
+      rtc::scoped_refptr<webrtc::RtpSenderInterface> sender,
+      const std::vector<SenderEncodingUpdate>& updates);
 
   void SendOnDisconnect(SoraSignalingErrorCode ec, std::string message);
 
@@ -216,6 +353,7 @@ class SoraSignaling : public std::enable_shared_from_this<SoraSignaling>,
   bool using_datachannel_ = false;
   bool ws_connected_ = false;
   std::set<std::string> compressed_labels_;
+  size_t last_stats_bytes_ = 0;
 
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc_;
   std::vector<webrtc::RtpEncodingParameters> encodings_;
@@ -223,6 +361,17 @@ class SoraSignaling : public std::enable_shared_from_this<SoraSignaling>,
 
   boost::asio::deadline_timer connection_timeout_timer_;
   boost::asio::deadline_timer closing_timeout_timer_;
+  boost::asio::deadline_timer probe_timer_;
+  bool probe_started_ = false;
+  uint32_t probe_seq_ = 0;
+  // 自分が送ったプローブへの応答かを見分けるための ID
+  std::string probe_id_;
+  std::shared_ptr<FlightRecorderSession> flight_session_;
+  boost::asio::deadline_timer flight_stats_timer_;
+  bool flight_stats_started_ = false;
+  std::shared_ptr<BitrateMemorySession> bitrate_session_;
+  boost::asio::deadline_timer bitrate_stats_timer_;
+  bool bitrate_stats_started_ = false;
   std::function<void(boost::system::error_code ec)> on_ws_close_;
   webrtc::PeerConnectionInterface::IceConnectionState ice_state_ =
       webrtc::PeerConnectionInterface::kIceConnectionNew;
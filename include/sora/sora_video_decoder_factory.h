@@ -9,6 +9,8 @@
 #include <api/video_codecs/video_decoder_factory.h>
 
 #include "sora/cuda_context.h"
+#include "sora/dav1d_video_decoder.h"
+#include "sora/frame_buffer_allocator.h"
 
 namespace sora {
 
@@ -60,12 +62,28 @@ class SoraVideoDecoderFactory : public webrtc::VideoDecoderFactory {
   mutable std::vector<std::vector<webrtc::SdpVideoFormat>> formats_;
 };
 
+// GetDefaultVideoDecoderFactoryConfig で使うデコーダの設定
+struct DefaultVideoDecoderFactoryOptions {
+  // 指定した場合、ハードウェアデコーダが出力する I420 バッファはこのアロケータで確保する。
+  // 全てのデコーダで使うメモリの合計に上限を設けたい場合は、
+  // FrameMemoryBudget を指定する。
+  std::shared_ptr<FrameBufferAllocator> allocator;
+  // GetSoftwareOnlyVideoDecoderFactoryConfig を参照
+  std::shared_ptr<Dav1dVideoDecoderConfig> dav1d_config;
+  // ハードウェアデコーダ 1 つあたりが同時に使う出力バッファの数の上限
+  size_t max_frame_buffers = kDefaultMaxDecoderFrameBuffers;
+};
+
 // ハードウェアデコーダを出来るだけ使おうとして、見つからなければソフトウェアデコーダを使う設定を返す
 SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
     std::shared_ptr<CudaContext> cuda_context = nullptr,
-    void* env = nullptr);
+    void* env = nullptr,
+    DefaultVideoDecoderFactoryOptions options = {});
 // ソフトウェアデコーダのみを使う設定を返す
-SoraVideoDecoderFactoryConfig GetSoftwareOnlyVideoDecoderFactoryConfig();
+// dav1d_config を指定して、かつ dav1d が使える場合は、
+// AV1 を libaom の代わりに dav1d でデコードする
+SoraVideoDecoderFactoryConfig GetSoftwareOnlyVideoDecoderFactoryConfig(
+    std::shared_ptr<Dav1dVideoDecoderConfig> dav1d_config = nullptr);
 
 }  // namespace sora
 
@@ -47,6 +47,14 @@ struct SoraVideoEncoderFactoryConfig {
   std::vector<VideoEncoderConfig> encoders;
   // webrtc::SimulcastEncoderAdapter を
   bool use_simulcast_adapter = false;
+  // ソフトウェアエンコーダを専用スレッドで動かして、フレームの前処理とエンコードを並列に行うかどうか
+  // 高解像度の場合にスループットが上がるが、エンコーダ 1 つにつきスレッドが 1 つ増える
+  bool use_pipelined_encoder = false;
+  // H.264 のエンコーダを、EncodedFrameBuffer のフレームはエンコードせずにそのまま送るエンコーダで包むかどうか。
+  // IP カメラなどのエンコード済みの映像を再エンコードせずに送る場合に使う。
+  // H.264 のエンコーダが無い場合も H.264 に対応していることにする。
+  // EncodedFrameBuffer 以外のフレームは、ハードウェアエンコーダ向けの kNative のフレームも含めて包んだエンコーダに渡す。
+  bool use_passthrough_encoder = false;
 };
 
 class SoraVideoEncoderFactory : public webrtc::VideoEncoderFactory {
@@ -0,0 +1,58 @@
+#ifndef SORA_THREAD_CONFIG_H_
+#define SORA_THREAD_CONFIG_H_
+
+#include <string>
+#include <vector>
+
+// Boost
+#include <boost/optional.hpp>
+
+// WebRTC
+#include <rtc_base/thread.h>
+
+#include "sora/thread_cpu_usage.h"
+
+namespace sora {
+
+enum class ThreadSchedulingPolicy {
+  // スケジューリングポリシーを変更しない
+  kDefault,
+  // SCHED_FIFO
+  kFifo,
+  // SCHED_RR
+  kRoundRobin,
+};
+
+// スレッドごとの CPU アフィニティやスケジューリングの設定
+struct ThreadConfig {
+  // スレッド名。空の場合はデフォルトの名前のまま
+  std::string name;
+  // このスレッドを動かす CPU 番号のリスト。空の場合は制限しない
+  std::vector<int> cpu_affinity;
+  ThreadSchedulingPolicy policy = ThreadSchedulingPolicy::kDefault;
+  // policy が kFifo か kRoundRobin の場合の優先度 (1-99)
+  int realtime_priority = 1;
+  // policy が kDefault の場合の nice 値 (-20 から 19)。
+  // 負の値を設定するには CAP_SYS_NICE 権限が必要。
+  boost::optional<int> nice;
+};
+
+// 呼び出したスレッドに config を適用する。
+// 一部でも適用できなかった場合は false を返すが、適用できた設定はそのまま残る。
+// Linux 以外ではスレッド名以外の設定は無視して false を返す。
+// role と owner は ThreadCpuUsage の集計に使うために RegisterCurrentThread() で登録する。
+bool ApplyThreadConfig(const ThreadConfig& config,
+                       SoraThreadRole role = SoraThreadRole::kOther,
+                       const std::string& owner = "");
+
+// thread を起動して config を適用する。
+// スレッド名は起動前に設定する必要があるので、Start() の代わりにこの関数で起動する。
+// 起動に失敗した場合だけ false を返し、設定の適用に失敗した場合はログに出すだけ。
+bool StartThreadWithConfig(rtc::Thread* thread,
+                           const ThreadConfig& config,
+                           SoraThreadRole role = SoraThreadRole::kOther,
+                           const std::string& owner = "");
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SORA_THREAD_CPU_USAGE_H_
+#define SORA_THREAD_CPU_USAGE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sora {
+
+// スレッドの役割
+enum class SoraThreadRole {
+  // 登録されておらず、スレッド名からも推測できなかったスレッド
+  kUnknown,
+  kNetwork,
+  kWorker,
+  kSignaling,
+  // キャプチャや RTP の受信など、映像のソースのスレッド
+  kCapture,
+  kEncoder,
+  kDecoder,
+  // boost::asio::io_context のスレッド。
+  // SoraSignaling::Connect() の処理を実行したスレッドが登録される。
+  kIoContext,
+  // SDK が作ったそれ以外のスレッド
+  kOther,
+};
+
+const char* GetSoraThreadRoleName(SoraThreadRole role);
+
+// 呼び出したスレッドを role のスレッドとして登録する。
+// owner にはスレッドを専有している単位 (PeerConnectionFactoryPool のシャードなど) を指定する。
+// SDK が作るスレッドは SDK 内部で登録するので、アプリケーションが作ったスレッドで呼ぶ。
+// 終了したスレッドは次の ThreadCpuUsage::Sample() で登録が消える。
+void RegisterCurrentThread(SoraThreadRole role, const std::string& owner = "");
+
+struct ThreadCpuUsageEntry {
+  int64_t tid = 0;
+  std::string name;
+  SoraThreadRole role = SoraThreadRole::kUnknown;
+  std::string owner;
+  // 1.0 で 1 コアを使い切っている状態
+  double cpu_usage = 0;
+};
+
+struct ThreadCpuUsageReport {
+  std::vector<ThreadCpuUsageEntry> threads;
+  // 役割ごとの合計。1.0 で 1 コア分
+  std::map<SoraThreadRole, double> roles;
+  // owner ごとの合計。owner が無いスレッドは含まない
+  std::map<std::string, double> owners;
+  double total = 0;
+};
+
+// /proc/self/task/*/stat からスレッドごとの CPU 使用率を計算して、役割ごとに集計する。
+// 登録されていないスレッドは、WebRTC が付けるスレッド名から役割を推測する。
+//
+// Sample() を呼ぶたびに全スレッドの stat を読むので、1 秒程度の間隔で呼ぶこと。
+// Linux 以外では常に false を返す。
+class ThreadCpuUsage {
+ public:
+  // 前回呼び出した時からの CPU 使用率を report に入れる。
+  // 初回と、取得できなかった場合は false を返す。
+  bool Sample(ThreadCpuUsageReport* report);
+
+ private:
+  struct Last {
+    int64_t start_time;
+    int64_t ticks;
+  };
+  std::map<int64_t, Last> last_;
+  int64_t last_wall_us_ = -1;
+};
+
+}  // namespace sora
+
+#endif
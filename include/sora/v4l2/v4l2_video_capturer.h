@@ -23,16 +23,22 @@
 #include <rtc_base/synchronization/mutex.h>
 
 #include "sora/scalable_track_source.h"
+#include "sora/thread_config.h"
 
 namespace sora {
 
-struct V4L2VideoCapturerConfig {
+// ScalableVideoTrackSourceConfig::allocator を指定した場合は、
+// キャプチャしたフレームを I420 に変換する先のバッファもそのアロケータから確保する
+struct V4L2VideoCapturerConfig : ScalableVideoTrackSourceConfig {
   std::string video_device;
   int width = 640;
   int height = 480;
   int framerate = 30;
   bool force_i420 = false;
   bool use_native = false;
+  // キャプチャスレッドの設定。
+  // policy が kDefault の場合は今まで通り高優先度 (kHigh) で動かす
+  ThreadConfig capture_thread_config = {"CaptureThread"};
 };
 
 class V4L2VideoCapturer : public ScalableVideoTrackSource {
@@ -42,6 +48,7 @@ class V4L2VideoCapturer : public ScalableVideoTrackSource {
   static void LogDeviceList(
       webrtc::VideoCaptureModule::DeviceInfo* device_info);
   V4L2VideoCapturer();
+  V4L2VideoCapturer(const V4L2VideoCapturerConfig& config);
   ~V4L2VideoCapturer();
 
   int32_t Init(const char* deviceUniqueId,
@@ -85,6 +92,8 @@ class V4L2VideoCapturer : public ScalableVideoTrackSource {
   int32_t _buffersAllocatedByDevice;
   bool _useNative;
   bool _captureStarted;
+  ThreadConfig capture_thread_config_;
+  std::unique_ptr<FrameBufferPool> buffer_pool_;
 };
 
 }  // namespace sora
@@ -0,0 +1,77 @@
+#ifndef SORA_VIDEO_TRACK_SOURCE_TEE_H_
+#define SORA_VIDEO_TRACK_SOURCE_TEE_H_
+
+#include <memory>
+#include <vector>
+
+// WebRTC
+#include <api/media_stream_interface.h>
+#include <api/scoped_refptr.h>
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+#include <rtc_base/synchronization/mutex.h>
+
+#include "sora/frame_buffer_allocator.h"
+
+namespace sora {
+
+struct VideoTrackSourceTeeConfig {
+  // 出力するソースの is_screencast() の値
+  bool is_screencast = false;
+  // リサイズしたフレームのバッファを確保するアロケータ。
+  // 指定しなかった場合は毎フレーム webrtc::I420Buffer を確保する。
+  std::shared_ptr<FrameBufferAllocator> allocator;
+};
+
+// 1 つのキャプチャを、解像度やフレームレートを個別に調整する複数のソースに分配するクラス。
+//
+// ScalableVideoTrackSource は全てのシンクの VideoSinkWants をまとめて 1 回だけ
+// 調整するので、同じソースを HD と SD の接続で使うと、一番厳しい要求に全部が揃ってしまう。
+// このクラスで作ったソースはそれぞれ自分のシンクの要求だけで調整されるので、
+// 接続ごとにソースを作れば、1 台のカメラを複数の接続でそれぞれの品質で配信できる。
+// 同じフレームで調整後の解像度が一致したソースには、同じバッファを渡して変換を 1 回で済ませる。
+//
+// 使い方:
+//   auto tee = sora::VideoTrackSourceTee::Create(config);
+//   // カメラからは調整せずにそのままの解像度で受け取る
+//   camera->AddOrUpdateSink(tee.get(), rtc::VideoSinkWants());
+//   // 接続ごとに
+//   auto source = tee->CreateSource();
+//   auto track = factory->CreateVideoTrack(track_id, source.get());
+//   ...
+//   tee->RemoveSource(source);
+//   // 破棄する前に
+//   camera->RemoveSink(tee.get());
+class VideoTrackSourceTee
+    : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
+ public:
+  static std::shared_ptr<VideoTrackSourceTee> Create(
+      VideoTrackSourceTeeConfig config);
+  ~VideoTrackSourceTee() override;
+
+  // 新しく出力先のソースを作る
+  rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> CreateSource();
+  // source へのフレームの分配を止める。
+  // この関数から戻った後は、このソースにフレームは届かない。
+  // ソースのシンクの OnFrame から呼び出してはいけない。
+  void RemoveSource(
+      rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> source);
+  size_t GetSourceCount() const;
+
+  // rtc::VideoSinkInterface
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+ private:
+  VideoTrackSourceTee(VideoTrackSourceTeeConfig config);
+
+  class Source;
+
+  VideoTrackSourceTeeConfig config_;
+  // OnFrame の間も保持して、RemoveSource から戻った後にフレームが届かないようにする
+  mutable webrtc::Mutex mutex_;
+  std::vector<rtc::scoped_refptr<Source>> sources_ RTC_GUARDED_BY(mutex_);
+};
+
+}  // namespace sora
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef SORA_WEBSOCKET_H_
 #define SORA_WEBSOCKET_H_
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
@@ -83,6 +84,14 @@ class Websocket {
 
   const boost::beast::websocket::close_reason& reason() const;
 
+  // 接続に使っているソケットのローカルの IP アドレス。取得できない場合は空文字を返す。
+  // プロキシを使っている場合は、プロキシに接続しているソケットのアドレスになる。
+  std::string GetLocalAddress() const;
+
+  // WriteText で渡されて、まだ書き込みが完了していないデータのバイト数。
+  // 任意のスレッドから呼べる。
+  size_t GetWriteQueueBytes() const { return write_queue_bytes_.load(); }
+
  private:
   bool IsSSL() const;
   void InitWss(ssl_websocket_t* wss, bool insecure);
@@ -140,6 +149,7 @@ class Websocket {
     bool text;
   };
   std::vector<std::unique_ptr<WriteData>> write_data_;
+  std::atomic<size_t> write_queue_bytes_{0};
 
   boost::asio::deadline_timer close_timeout_timer_;
   bool closed_ = false;
@@ -0,0 +1,94 @@
+#ifndef SORA_X11_X11_SCREEN_CAPTURER_H_
+#define SORA_X11_X11_SCREEN_CAPTURER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <api/scoped_refptr.h>
+#include <api/video/i420_buffer.h>
+#include <common_video/include/video_frame_buffer_pool.h>
+#include <rtc_base/platform_thread.h>
+
+#include "sora/scalable_track_source.h"
+#include "sora/thread_config.h"
+
+// X11 のヘッダーは WebRTC のヘッダーとマクロが衝突するので、ここではインクルードしない
+struct _XDisplay;
+struct _XImage;
+
+namespace sora {
+
+struct X11ScreenCapturerConfig {
+  // 接続する X ディスプレイ。空文字の場合は DISPLAY 環境変数を利用する
+  std::string display_name;
+  // キャプチャする領域。width または height が 0 の場合は画面全体になる
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+  // 最大フレームレート。画面に変化があってもこれ以上の頻度ではフレームを送らない
+  int max_framerate = 15;
+  // 画面に変化が無い場合でも、この間隔で直前のフレームを送り直す。
+  // 受信側の画質を徐々に改善させるためと、途中から受信した人のためのもの。
+  // 0 の場合は変化がある時だけフレームを送る。
+  int keepalive_interval_ms = 1000;
+  // キャプチャスレッドの設定。
+  // policy が kDefault の場合は高優先度 (kHigh) で動かす
+  ThreadConfig capture_thread_config = {"ScreenCaptureThread"};
+};
+
+// X11 の画面をキャプチャするキャプチャラ。
+//
+// XDamage を使って画面に変化があった時だけフレームを生成する。
+// また、変化した領域だけを I420 に変換し、変化していない領域は直前のフレームの内容を使い回す。
+// is_screencast() は true を返すので、エンコーダはスクリーンコンテンツ向けの設定になる。
+class X11ScreenCapturer : public ScalableVideoTrackSource {
+ public:
+  static rtc::scoped_refptr<X11ScreenCapturer> Create(
+      X11ScreenCapturerConfig config);
+  X11ScreenCapturer(X11ScreenCapturerConfig config);
+  ~X11ScreenCapturer();
+
+ private:
+  struct Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+  };
+
+  bool Init();
+  void Destroy();
+  void CaptureThread();
+  // 溜まっている X のイベントを処理して、変化した領域を damaged_ に追加する
+  void ProcessEvents();
+  // damaged_ の領域だけを取得・変換してフレームを送る
+  void CaptureDamagedRegion(int64_t now_us);
+  void SendFrame(int64_t now_us);
+
+  X11ScreenCapturerConfig config_;
+  _XDisplay* display_ = nullptr;
+  _XImage* image_ = nullptr;
+  unsigned long root_ = 0;
+  unsigned long damage_ = 0;
+  unsigned long region_ = 0;
+  int damage_event_base_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+
+  std::vector<Rect> damaged_;
+  webrtc::VideoFrameBufferPool buffer_pool_;
+  rtc::scoped_refptr<webrtc::I420Buffer> last_buffer_;
+  int64_t last_frame_us_ = 0;
+
+  std::atomic<bool> quit_;
+  rtc::PlatformThread capture_thread_;
+};
+
+}  // namespace sora
+
+#endif
@@ -1465,6 +1465,12 @@ def main():
 
                 if platform.target.os in ('windows', 'macos', 'ubuntu'):
                     cmake_args.append("-DTEST_CONNECT_DISCONNECT=ON")
+                    cmake_args.append("-DTEST_SIGNALING_REPLAY=ON")
+                    cmake_args.append("-DTEST_RTP_H264_INGEST=ON")
+                    cmake_args.append("-DTEST_BITRATE_RAMP_UP=ON")
+                if platform.target.os == 'ubuntu':
+                    cmake_args.append("-DTEST_FRAME_BUFFER_ALLOCATOR=ON")
+                    cmake_args.append("-DTEST_SHM_FRAME_RING=ON")
 
                 cmd(['cmake', os.path.join(BASE_DIR, 'test')] + cmake_args)
                 cmd(['cmake', '--build', '.', f'-j{multiprocessing.cpu_count()}', '--config', configuration])
@@ -0,0 +1,244 @@
+#include "sora/audio_pcm_tap.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+// WebRTC
+#include <common_audio/resampler/include/push_resampler.h>
+#include <rtc_base/logging.h>
+
+namespace sora {
+
+// 音声はワーカースレッドから 1 つだけ書き込まれ、Read() で 1 つずつ読み出されるので、
+// 書き込み位置と読み込み位置をアトミックに更新するだけのリングバッファにしている。
+class AudioPcmTap::Sink : public webrtc::AudioTrackSinkInterface {
+ public:
+  Sink(rtc::scoped_refptr<webrtc::AudioTrackInterface> track,
+       const AudioPcmTapConfig& config)
+      : track_(track),
+        channels_(config.channels),
+        sample_rate_(config.sample_rate),
+        capacity_frames_(std::max<size_t>(
+            1, static_cast<size_t>(config.sample_rate) * config.buffer_ms /
+                   1000)),
+        ring_(capacity_frames_ * channels_),
+        // 48kHz ステレオまでならワーカースレッドでメモリを確保しなくて済むように、
+        // 10ms 分のバッファを先に確保しておく
+        remix_buffer_(480 * channels_),
+        resample_buffer_(sample_rate_ / 100 * channels_) {}
+
+  rtc::scoped_refptr<webrtc::AudioTrackInterface> track() const {
+    return track_;
+  }
+
+  void OnData(const void* audio_data,
+              int bits_per_sample,
+              int sample_rate,
+              size_t number_of_channels,
+              size_t number_of_frames) override {
+    if (bits_per_sample != 16 || number_of_channels == 0 ||
+        number_of_frames == 0) {
+      return;
+    }
+    const int16_t* src = static_cast<const int16_t*>(audio_data);
+
+    // チャンネル数を揃える
+    size_t remix_size = number_of_frames * channels_;
+    if (remix_buffer_.size() < remix_size) {
+      // 入力の形式が変わった時だけここに来る
+      remix_buffer_.resize(remix_size);
+    }
+    Remix(src, number_of_channels, number_of_frames, remix_buffer_.data());
+
+    const int16_t* pcm = remix_buffer_.data();
+    size_t frames = number_of_frames;
+    if (sample_rate != sample_rate_) {
+      resampler_.InitializeIfNeeded(sample_rate, sample_rate_,
+                                    static_cast<int>(channels_));
+      int r = resampler_.Resample(remix_buffer_.data(), remix_size,
+                                  resample_buffer_.data(),
+                                  resample_buffer_.size());
+      if (r < 0) {
+        return;
+      }
+      pcm = resample_buffer_.data();
+      frames = static_cast<size_t>(r) / channels_;
+    }
+    Write(pcm, frames);
+  }
+
+  size_t Read(int16_t* data, size_t max_frames) {
+    uint64_t r = read_pos_.load(std::memory_order_relaxed);
+    uint64_t w = write_pos_.load(std::memory_order_acquire);
+    size_t n = std::min<size_t>(max_frames, static_cast<size_t>(w - r));
+    size_t offset = static_cast<size_t>(r % capacity_frames_);
+    size_t first = std::min(n, capacity_frames_ - offset);
+    memcpy(data, ring_.data() + offset * channels_,
+           first * channels_ * sizeof(int16_t));
+    memcpy(data + first * channels_, ring_.data(),
+           (n - first) * channels_ * sizeof(int16_t));
+    read_pos_.store(r + n, std::memory_order_release);
+    return n;
+  }
+
+  size_t GetAvailableFrames() const {
+    return static_cast<size_t>(write_pos_.load(std::memory_order_acquire) -
+                               read_pos_.load(std::memory_order_acquire));
+  }
+
+  uint64_t GetDroppedFrames() const {
+    return dropped_frames_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void Remix(const int16_t* src,
+             size_t src_channels,
+             size_t frames,
+             int16_t* dst) const {
+    if (src_channels == channels_) {
+      memcpy(dst, src, frames * channels_ * sizeof(int16_t));
+    } else if (channels_ == 1) {
+      // 全チャンネルの平均を取る
+      for (size_t i = 0; i < frames; i++) {
+        int32_t sum = 0;
+        for (size_t c = 0; c < src_channels; c++) {
+          sum += src[i * src_channels + c];
+        }
+        dst[i] = static_cast<int16_t>(sum / static_cast<int32_t>(src_channels));
+      }
+    } else {
+      // 足りないチャンネルは最初のチャンネルで埋めて、余ったチャンネルは捨てる
+      for (size_t i = 0; i < frames; i++) {
+        for (size_t c = 0; c < channels_; c++) {
+          dst[i * channels_ + c] =
+              src[i * src_channels + (c < src_channels ? c : 0)];
+        }
+      }
+    }
+  }
+
+  void Write(const int16_t* data, size_t frames) {
+    uint64_t w = write_pos_.load(std::memory_order_relaxed);
+    uint64_t r = read_pos_.load(std::memory_order_acquire);
+    size_t space = capacity_frames_ - static_cast<size_t>(w - r);
+    size_t n = std::min(frames, space);
+    if (n < frames) {
+      dropped_frames_.fetch_add(frames - n, std::memory_order_relaxed);
+    }
+    size_t offset = static_cast<size_t>(w % capacity_frames_);
+    size_t first = std::min(n, capacity_frames_ - offset);
+    memcpy(ring_.data() + offset * channels_, data,
+           first * channels_ * sizeof(int16_t));
+    memcpy(ring_.data(), data + first * channels_,
+           (n - first) * channels_ * sizeof(int16_t));
+    write_pos_.store(w + n, std::memory_order_release);
+  }
+
+  rtc::scoped_refptr<webrtc::AudioTrackInterface> track_;
+  const size_t channels_;
+  const int sample_rate_;
+  const size_t capacity_frames_;
+  std::vector<int16_t> ring_;
+  std::atomic<uint64_t> write_pos_{0};
+  std::atomic<uint64_t> read_pos_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+
+  // 以下はワーカースレッドからしか触らない
+  std::vector<int16_t> remix_buffer_;
+  std::vector<int16_t> resample_buffer_;
+  webrtc::PushResampler<int16_t> resampler_;
+};
+
+std::shared_ptr<AudioPcmTap> AudioPcmTap::Create(AudioPcmTapConfig config) {
+  if (config.channels != 1 && config.channels != 2) {
+    RTC_LOG(LS_ERROR) << "Unsupported channels: " << config.channels;
+    return nullptr;
+  }
+  if (config.sample_rate < 8000 || config.sample_rate % 100 != 0) {
+    RTC_LOG(LS_ERROR) << "Unsupported sample_rate: " << config.sample_rate;
+    return nullptr;
+  }
+  return std::shared_ptr<AudioPcmTap>(new AudioPcmTap(config));
+}
+
+AudioPcmTap::AudioPcmTap(AudioPcmTapConfig config) : config_(config) {}
+
+AudioPcmTap::~AudioPcmTap() {
+  for (const auto& id : GetTrackIds()) {
+    RemoveTrack(id);
+  }
+}
+
+void AudioPcmTap::AddTrack(
+    rtc::scoped_refptr<webrtc::AudioTrackInterface> track) {
+  webrtc::MutexLock track_lock(&track_mutex_);
+  Sink* sink;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    auto& p = sinks_[track->id()];
+    if (p != nullptr) {
+      return;
+    }
+    p.reset(new Sink(track, config_));
+    sink = p.get();
+  }
+  track->AddSink(sink);
+}
+
+void AudioPcmTap::RemoveTrack(const std::string& track_id) {
+  webrtc::MutexLock track_lock(&track_mutex_);
+  std::unique_ptr<Sink> sink;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    auto it = sinks_.find(track_id);
+    if (it == sinks_.end()) {
+      return;
+    }
+    sink = std::move(it->second);
+    sinks_.erase(it);
+  }
+  // RemoveSink から戻った後は OnData が呼ばれないので、その後で破棄する
+  sink->track()->RemoveSink(sink.get());
+}
+
+std::vector<std::string> AudioPcmTap::GetTrackIds() const {
+  webrtc::MutexLock lock(&mutex_);
+  std::vector<std::string> ids;
+  for (const auto& p : sinks_) {
+    ids.push_back(p.first);
+  }
+  return ids;
+}
+
+size_t AudioPcmTap::Read(const std::string& track_id,
+                         int16_t* data,
+                         size_t max_frames) {
+  webrtc::MutexLock lock(&mutex_);
+  auto it = sinks_.find(track_id);
+  if (it == sinks_.end()) {
+    return 0;
+  }
+  return it->second->Read(data, max_frames);
+}
+
+size_t AudioPcmTap::GetAvailableFrames(const std::string& track_id) const {
+  webrtc::MutexLock lock(&mutex_);
+  auto it = sinks_.find(track_id);
+  if (it == sinks_.end()) {
+    return 0;
+  }
+  return it->second->GetAvailableFrames();
+}
+
+uint64_t AudioPcmTap::GetDroppedFrames(const std::string& track_id) const {
+  webrtc::MutexLock lock(&mutex_);
+  auto it = sinks_.find(track_id);
+  if (it == sinks_.end()) {
+    return 0;
+  }
+  return it->second->GetDroppedFrames();
+}
+
+}  // namespace sora
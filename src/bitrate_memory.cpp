@@ -0,0 +1,222 @@
+#include "sora/bitrate_memory.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// WebRTC
+#include <api/stats/rtcstats_objects.h>
+#include <rtc_base/ip_address.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora {
+
+std::shared_ptr<BitrateMemory> BitrateMemory::Create(
+    BitrateMemoryConfig config) {
+  if (!config.path.empty() && config.writer == nullptr) {
+    AsyncFileWriterConfig writer_config;
+    writer_config.thread_config = config.thread_config;
+    config.writer = AsyncFileWriter::Create(writer_config);
+    if (config.writer == nullptr) {
+      RTC_LOG(LS_ERROR) << "Failed to create BitrateMemory";
+      return nullptr;
+    }
+  }
+  std::shared_ptr<BitrateMemory> memory(new BitrateMemory(config));
+  if (config.path.empty()) {
+    return memory;
+  }
+  if (!memory->Load()) {
+    RTC_LOG(LS_WARNING) << "Failed to load bitrate memory: path="
+                        << config.path;
+  }
+  return memory;
+}
+
+BitrateMemory::BitrateMemory(BitrateMemoryConfig config) : config_(config) {}
+
+std::string BitrateMemory::MakeKey(const std::string& signaling_host,
+                                   const std::string& local_address) {
+  rtc::IPAddress ip;
+  std::string network = local_address;
+  if (rtc::IPFromString(local_address, &ip)) {
+    int length = ip.family() == AF_INET6 ? 64 : 24;
+    network = rtc::TruncateIP(ip, length).ToString() + "/" +
+              std::to_string(length);
+  }
+  return signaling_host + "|" + network;
+}
+
+boost::optional<int> BitrateMemory::GetStartBitrate(
+    const std::string& key,
+    int max_bitrate_bps) const {
+  auto entry = GetEntry(key);
+  if (!entry || entry->send_bps <= 0) {
+    return boost::none;
+  }
+  int64_t now = rtc::TimeUTCMicros() / 1000000;
+  if (now - entry->updated_at > config_.max_age_sec) {
+    return boost::none;
+  }
+  int64_t bps = static_cast<int64_t>(entry->send_bps * config_.start_ratio);
+  bps = std::max<int64_t>(bps, config_.min_start_bitrate_bps);
+  bps = std::min<int64_t>(bps, config_.max_start_bitrate_bps);
+  if (max_bitrate_bps > 0) {
+    bps = std::min<int64_t>(bps, max_bitrate_bps);
+  }
+  return static_cast<int>(bps);
+}
+
+boost::optional<BitrateMemoryEntry> BitrateMemory::GetEntry(
+    const std::string& key) const {
+  webrtc::MutexLock lock(&mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return boost::none;
+  }
+  return it->second;
+}
+
+void BitrateMemory::Update(const std::string& key,
+                           int64_t send_bps,
+                           int64_t receive_bps) {
+  if (key.empty() || (send_bps <= 0 && receive_bps <= 0)) {
+    return;
+  }
+  webrtc::MutexLock lock(&mutex_);
+  auto& entry = entries_[key];
+  if (send_bps > 0) {
+    entry.send_bps = send_bps;
+  }
+  if (receive_bps > 0) {
+    entry.receive_bps = receive_bps;
+  }
+  entry.updated_at = rtc::TimeUTCMicros() / 1000000;
+
+  while (entries_.size() > config_.max_entries) {
+    auto oldest = std::min_element(
+        entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+          return a.second.updated_at < b.second.updated_at;
+        });
+    entries_.erase(oldest);
+  }
+}
+
+std::shared_ptr<BitrateMemorySession> BitrateMemory::CreateSession(
+    const std::string& key) {
+  return std::shared_ptr<BitrateMemorySession>(
+      new BitrateMemorySession(shared_from_this(), key));
+}
+
+// ファイルは 1 行に 1 つずつ以下の形式になっている。
+// キーには空白が含まれる可能性があるので最後に書く。
+//   <send_bps> <receive_bps> <updated_at> <key>\n
+void BitrateMemory::SaveAsync() {
+  if (config_.path.empty()) {
+    return;
+  }
+  // 数十行しかないので、ここで文字列にしてから書き込みを頼む。
+  // タスクに this を持たせると、最後の参照が AsyncFileWriter のスレッドで消えた時に
+  // AsyncFileWriter が自分のスレッドを止めようとしてしまうので持たせない。
+  // 同時に呼ばれても最新の値が最後に書き込まれるように、ロックを取ったまま頼む
+  webrtc::MutexLock lock(&mutex_);
+  std::ostringstream oss;
+  for (const auto& kv : entries_) {
+    oss << kv.second.send_bps << ' ' << kv.second.receive_bps << ' '
+        << kv.second.updated_at << ' ' << kv.first << '\n';
+  }
+  config_.writer->Replace(config_.path, oss.str());
+}
+
+bool BitrateMemory::Load() {
+  std::ifstream ifs(config_.path, std::ios::binary);
+  if (!ifs) {
+    // 初回はファイルが無いので失敗にしない
+    return true;
+  }
+  webrtc::MutexLock lock(&mutex_);
+  std::string line;
+  while (std::getline(ifs, line)) {
+    std::istringstream iss(line);
+    BitrateMemoryEntry entry;
+    std::string key;
+    if (!(iss >> entry.send_bps >> entry.receive_bps >> entry.updated_at)) {
+      return false;
+    }
+    iss.get();
+    std::getline(iss, key);
+    if (key.empty()) {
+      return false;
+    }
+    entries_[key] = entry;
+  }
+  return true;
+}
+
+// --------------------------------
+// BitrateMemorySession
+// --------------------------------
+
+BitrateMemorySession::BitrateMemorySession(
+    std::shared_ptr<BitrateMemory> memory,
+    std::string key)
+    : memory_(memory), key_(std::move(key)) {}
+
+void BitrateMemorySession::OnStats(
+    const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+  const webrtc::RTCIceCandidatePairStats* pair = nullptr;
+  for (const auto* stats :
+       report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+    if (stats->nominated.ValueOrDefault(false) &&
+        stats->state.ValueOrDefault("") == "succeeded") {
+      pair = stats;
+      break;
+    }
+  }
+  if (pair == nullptr) {
+    return;
+  }
+
+  const double kAlpha = 0.3;
+  auto smooth = [kAlpha](double current, double value) {
+    return current <= 0 ? value : current * (1 - kAlpha) + value * kAlpha;
+  };
+
+  uint64_t video_bytes_sent = 0;
+  for (const auto* stats :
+       report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>()) {
+    if (stats->kind.ValueOrDefault("") == "video") {
+      video_bytes_sent += stats->bytes_sent.ValueOrDefault(0);
+    }
+  }
+  bool video_sent = last_timestamp_us_ >= 0 &&
+                    video_bytes_sent > last_video_bytes_sent_;
+  last_video_bytes_sent_ = video_bytes_sent;
+
+  int64_t timestamp_us = report->timestamp_us();
+  uint64_t bytes_received = pair->bytes_received.ValueOrDefault(0);
+  if (first_timestamp_us_ < 0) {
+    first_timestamp_us_ = timestamp_us;
+  } else if (timestamp_us > last_timestamp_us_ &&
+             bytes_received >= last_bytes_received_) {
+    double bps = (bytes_received - last_bytes_received_) * 8 * 1000000.0 /
+                 (timestamp_us - last_timestamp_us_);
+    receive_bps_ = smooth(receive_bps_, bps);
+  }
+  last_timestamp_us_ = timestamp_us;
+  last_bytes_received_ = bytes_received;
+
+  if (video_sent && pair->available_outgoing_bitrate.is_defined()) {
+    send_bps_ = smooth(send_bps_, *pair->available_outgoing_bitrate);
+  }
+
+  if (timestamp_us - first_timestamp_us_ <
+      memory_->config().warmup_ms * 1000LL) {
+    return;
+  }
+  memory_->Update(key_, static_cast<int64_t>(send_bps_),
+                  static_cast<int64_t>(receive_bps_));
+}
+
+}  // namespace sora
@@ -0,0 +1,105 @@
+#include "counted_video_codec.h"
+
+#include "sora/memory_stats.h"
+
+namespace sora {
+
+std::unique_ptr<webrtc::VideoEncoder> CountedVideoEncoder::Wrap(
+    std::unique_ptr<webrtc::VideoEncoder> encoder) {
+  if (encoder == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<webrtc::VideoEncoder>(
+      new CountedVideoEncoder(std::move(encoder)));
+}
+
+CountedVideoEncoder::CountedVideoEncoder(
+    std::unique_ptr<webrtc::VideoEncoder> encoder)
+    : encoder_(std::move(encoder)) {
+  AddVideoEncoderInstance();
+}
+CountedVideoEncoder::~CountedVideoEncoder() {
+  encoder_.reset();
+  RemoveVideoEncoderInstance();
+}
+
+void CountedVideoEncoder::SetFecControllerOverride(
+    webrtc::FecControllerOverride* fec_controller_override) {
+  encoder_->SetFecControllerOverride(fec_controller_override);
+}
+int CountedVideoEncoder::InitEncode(
+    const webrtc::VideoCodec* codec_settings,
+    const webrtc::VideoEncoder::Settings& settings) {
+  return encoder_->InitEncode(codec_settings, settings);
+}
+int32_t CountedVideoEncoder::RegisterEncodeCompleteCallback(
+    webrtc::EncodedImageCallback* callback) {
+  return encoder_->RegisterEncodeCompleteCallback(callback);
+}
+int32_t CountedVideoEncoder::Release() {
+  return encoder_->Release();
+}
+int32_t CountedVideoEncoder::Encode(
+    const webrtc::VideoFrame& frame,
+    const std::vector<webrtc::VideoFrameType>* frame_types) {
+  return encoder_->Encode(frame, frame_types);
+}
+void CountedVideoEncoder::SetRates(const RateControlParameters& parameters) {
+  encoder_->SetRates(parameters);
+}
+void CountedVideoEncoder::OnPacketLossRateUpdate(float packet_loss_rate) {
+  encoder_->OnPacketLossRateUpdate(packet_loss_rate);
+}
+void CountedVideoEncoder::OnRttUpdate(int64_t rtt_ms) {
+  encoder_->OnRttUpdate(rtt_ms);
+}
+void CountedVideoEncoder::OnLossNotification(
+    const LossNotification& loss_notification) {
+  encoder_->OnLossNotification(loss_notification);
+}
+webrtc::VideoEncoder::EncoderInfo CountedVideoEncoder::GetEncoderInfo() const {
+  return encoder_->GetEncoderInfo();
+}
+
+std::unique_ptr<webrtc::VideoDecoder> CountedVideoDecoder::Wrap(
+    std::unique_ptr<webrtc::VideoDecoder> decoder) {
+  if (decoder == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<webrtc::VideoDecoder>(
+      new CountedVideoDecoder(std::move(decoder)));
+}
+
+CountedVideoDecoder::CountedVideoDecoder(
+    std::unique_ptr<webrtc::VideoDecoder> decoder)
+    : decoder_(std::move(decoder)) {
+  AddVideoDecoderInstance();
+}
+CountedVideoDecoder::~CountedVideoDecoder() {
+  decoder_.reset();
+  RemoveVideoDecoderInstance();
+}
+
+bool CountedVideoDecoder::Configure(const Settings& settings) {
+  return decoder_->Configure(settings);
+}
+int32_t CountedVideoDecoder::Decode(const webrtc::EncodedImage& input_image,
+                                    bool missing_frames,
+                                    int64_t render_time_ms) {
+  return decoder_->Decode(input_image, missing_frames, render_time_ms);
+}
+int32_t CountedVideoDecoder::RegisterDecodeCompleteCallback(
+    webrtc::DecodedImageCallback* callback) {
+  return decoder_->RegisterDecodeCompleteCallback(callback);
+}
+int32_t CountedVideoDecoder::Release() {
+  return decoder_->Release();
+}
+webrtc::VideoDecoder::DecoderInfo CountedVideoDecoder::GetDecoderInfo() const {
+  return decoder_->GetDecoderInfo();
+}
+const char* CountedVideoDecoder::ImplementationName() const {
+  return decoder_->ImplementationName();
+}
+
+}  // namespace sora
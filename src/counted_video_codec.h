@@ -0,0 +1,69 @@
+#ifndef SORA_COUNTED_VIDEO_CODEC_H_
+#define SORA_COUNTED_VIDEO_CODEC_H_
+
+#include <memory>
+#include <vector>
+
+// WebRTC
+#include <api/video_codecs/video_decoder.h>
+#include <api/video_codecs/video_encoder.h>
+
+namespace sora {
+
+// 生成と破棄の時に GetSoraMemoryStats() のコーデック数を増減させるだけのラッパー。
+// それ以外は全てそのまま内部のエンコーダ/デコーダに渡す。
+class CountedVideoEncoder : public webrtc::VideoEncoder {
+ public:
+  // encoder が nullptr の場合は nullptr を返す
+  static std::unique_ptr<webrtc::VideoEncoder> Wrap(
+      std::unique_ptr<webrtc::VideoEncoder> encoder);
+
+  CountedVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder);
+  ~CountedVideoEncoder() override;
+
+  void SetFecControllerOverride(
+      webrtc::FecControllerOverride* fec_controller_override) override;
+  int InitEncode(const webrtc::VideoCodec* codec_settings,
+                 const webrtc::VideoEncoder::Settings& settings) override;
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback* callback) override;
+  int32_t Release() override;
+  int32_t Encode(const webrtc::VideoFrame& frame,
+                 const std::vector<webrtc::VideoFrameType>* frame_types)
+      override;
+  void SetRates(const RateControlParameters& parameters) override;
+  void OnPacketLossRateUpdate(float packet_loss_rate) override;
+  void OnRttUpdate(int64_t rtt_ms) override;
+  void OnLossNotification(const LossNotification& loss_notification) override;
+  EncoderInfo GetEncoderInfo() const override;
+
+ private:
+  std::unique_ptr<webrtc::VideoEncoder> encoder_;
+};
+
+class CountedVideoDecoder : public webrtc::VideoDecoder {
+ public:
+  // decoder が nullptr の場合は nullptr を返す
+  static std::unique_ptr<webrtc::VideoDecoder> Wrap(
+      std::unique_ptr<webrtc::VideoDecoder> decoder);
+
+  CountedVideoDecoder(std::unique_ptr<webrtc::VideoDecoder> decoder);
+  ~CountedVideoDecoder() override;
+
+  bool Configure(const Settings& settings) override;
+  int32_t Decode(const webrtc::EncodedImage& input_image,
+                 bool missing_frames,
+                 int64_t render_time_ms) override;
+  int32_t RegisterDecodeCompleteCallback(
+      webrtc::DecodedImageCallback* callback) override;
+  int32_t Release() override;
+  DecoderInfo GetDecoderInfo() const override;
+  const char* ImplementationName() const override;
+
+ private:
+  std::unique_ptr<webrtc::VideoDecoder> decoder_;
+};
+
+}  // namespace sora
+
+#endif
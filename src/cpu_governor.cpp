@@ -0,0 +1,330 @@
+#include "sora/cpu_governor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Boost
+#include <boost/asio/post.hpp>
+
+// WebRTC
+#include <api/stats/rtcstats_objects.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+
+#include "sora/rtc_stats.h"
+
+namespace sora {
+
+ProcessCpuUsage::ProcessCpuUsage() {}
+
+double ProcessCpuUsage::Sample() {
+#if defined(__linux__)
+  std::ifstream ifs("/proc/self/stat");
+  std::string line;
+  if (!std::getline(ifs, line)) {
+    return -1;
+  }
+  // comm にスペースや括弧が含まれていることがあるので、最後の ')' 以降を読む
+  auto pos = line.rfind(')');
+  if (pos == std::string::npos || pos + 2 >= line.size()) {
+    return -1;
+  }
+  std::istringstream iss(line.substr(pos + 2));
+  // 3 番目の state から数えて 12 番目と 13 番目が utime と stime
+  std::string field;
+  for (int i = 0; i < 11; i++) {
+    iss >> field;
+  }
+  int64_t utime = 0;
+  int64_t stime = 0;
+  if (!(iss >> utime >> stime)) {
+    return -1;
+  }
+
+  int64_t ticks = utime + stime;
+  int64_t now_us = rtc::TimeMicros();
+  int64_t last_ticks = last_cpu_ticks_;
+  int64_t last_wall_us = last_wall_us_;
+  last_cpu_ticks_ = ticks;
+  last_wall_us_ = now_us;
+  if (last_ticks < 0 || now_us <= last_wall_us) {
+    return -1;
+  }
+
+  double cpu_sec =
+      static_cast<double>(ticks - last_ticks) / sysconf(_SC_CLK_TCK);
+  double wall_sec =
+      static_cast<double>(now_us - last_wall_us) / rtc::kNumMicrosecsPerSec;
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+  return cpu_sec / (wall_sec * cores);
+#else
+  return -1;
+#endif
+}
+
+CpuGovernor::CpuGovernor(CpuGovernorConfig config)
+    : config_(std::move(config)), timer_(*config_.io_context) {}
+
+std::shared_ptr<CpuGovernor> CpuGovernor::Create(CpuGovernorConfig config) {
+  return std::shared_ptr<CpuGovernor>(new CpuGovernor(std::move(config)));
+}
+
+void CpuGovernor::Start() {
+  boost::asio::post(*config_.io_context, [self = shared_from_this()]() {
+    if (self->running_) {
+      return;
+    }
+    self->running_ = true;
+    // 初回は差分が取れないので、ここで 1 回サンプリングしておく
+    if (!self->config_.cpu_usage_sampler) {
+      self->cpu_usage_.Sample();
+    }
+    self->DoTick();
+  });
+}
+
+void CpuGovernor::Stop() {
+  boost::asio::post(*config_.io_context, [self = shared_from_this()]() {
+    self->running_ = false;
+    self->timer_.cancel();
+  });
+}
+
+void CpuGovernor::AddSender(
+    std::shared_ptr<SoraSignaling> signaling,
+    rtc::scoped_refptr<webrtc::RtpSenderInterface> sender,
+    int priority) {
+  boost::asio::post(*config_.io_context, [self = shared_from_this(),
+                                          signaling, sender, priority]() {
+    auto s = std::make_shared<Sender>();
+    s->signaling = signaling;
+    s->sender = sender;
+    s->priority = priority;
+    s->base_encodings = sender->GetParameters().encodings;
+    self->senders_.push_back(s);
+    RTC_LOG(LS_INFO) << "CpuGovernor: AddSender priority=" << priority
+                     << " encodings=" << s->base_encodings.size();
+  });
+}
+
+void CpuGovernor::RemoveSender(
+    rtc::scoped_refptr<webrtc::RtpSenderInterface> sender) {
+  boost::asio::post(*config_.io_context, [self = shared_from_this(),
+                                          sender]() {
+    auto& v = self->senders_;
+    v.erase(std::remove_if(v.begin(), v.end(),
+                           [&sender](const std::shared_ptr<Sender>& s) {
+                             return s->sender.get() == sender.get();
+                           }),
+            v.end());
+  });
+}
+
+void CpuGovernor::DoTick() {
+  if (!running_) {
+    return;
+  }
+
+  // 切断済みのセッションの sender は取り除く
+  senders_.erase(std::remove_if(senders_.begin(), senders_.end(),
+                                [](const std::shared_ptr<Sender>& s) {
+                                  return s->signaling.expired();
+                                }),
+                 senders_.end());
+
+  double cpu_usage = config_.cpu_usage_sampler ? config_.cpu_usage_sampler()
+                                               : cpu_usage_.Sample();
+  Load load = EvaluateLoad(cpu_usage);
+  if (load == Load::kHigh) {
+    stable_samples_ = 0;
+    Degrade();
+  } else if (load == Load::kLow) {
+    if (++stable_samples_ >= config_.restore_hold_samples) {
+      stable_samples_ = 0;
+      Restore();
+    }
+  } else {
+    stable_samples_ = 0;
+  }
+
+  // エンコード時間は非同期に取得して次の判定で使う
+  for (auto& s : senders_) {
+    SampleEncodeUsage(s);
+  }
+
+  timer_.expires_from_now(boost::posix_time::milliseconds(config_.interval_ms));
+  timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+    if (ec) {
+      return;
+    }
+    self->DoTick();
+  });
+}
+
+void CpuGovernor::SampleEncodeUsage(std::shared_ptr<Sender> s) {
+  auto signaling = s->signaling.lock();
+  if (signaling == nullptr) {
+    return;
+  }
+  auto pc = signaling->GetPeerConnection();
+  if (pc == nullptr) {
+    return;
+  }
+  pc->GetStats(
+      s->sender,
+      RTCStatsCallback::Create(
+          [self = shared_from_this(), s](
+              const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+            int64_t timestamp_us = report->timestamp_us();
+            double total_encode_time = 0;
+            uint32_t frames_encoded = 0;
+            for (const auto* stats :
+                 report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>()) {
+              if (stats->total_encode_time.is_defined()) {
+                total_encode_time += *stats->total_encode_time;
+              }
+              if (stats->frames_encoded.is_defined()) {
+                frames_encoded += *stats->frames_encoded;
+              }
+            }
+            boost::asio::post(*self->config_.io_context, [self, s, timestamp_us,
+                                                          total_encode_time,
+                                                          frames_encoded]() {
+              // 前回のサンプルからの経過時間に対して、エンコードに使った時間の合計の割合を計算する。
+              // (エンコード時間の合計 / 経過時間) は (1 フレームの平均エンコード時間 / 平均フレーム間隔) と等しい。
+              // タイマーのずれや GetStats の遅延があるので、経過時間は統計情報のタイムスタンプから求める。
+              if (s->last_timestamp_us >= 0 &&
+                  timestamp_us > s->last_timestamp_us) {
+                double elapsed_sec =
+                    (timestamp_us - s->last_timestamp_us) / 1000000.0;
+                if (frames_encoded > s->last_frames_encoded) {
+                  s->encode_usage =
+                      (total_encode_time - s->last_total_encode_time) /
+                      elapsed_sec;
+                } else if (frames_encoded < s->last_frames_encoded) {
+                  // エンコーダが作り直されて統計情報が最初からになった
+                  s->encode_usage = 0;
+                }
+                // フレームが増えていない場合は、エンコードが止まっているだけで
+                // 負荷が下がったとは限らないので前回の値のままにする
+              }
+              s->last_timestamp_us = timestamp_us;
+              s->last_total_encode_time = total_encode_time;
+              s->last_frames_encoded = frames_encoded;
+            });
+          })
+          .get());
+}
+
+CpuGovernor::Load CpuGovernor::EvaluateLoad(double cpu_usage) const {
+  double max_encode_usage = 0;
+  for (const auto& s : senders_) {
+    max_encode_usage = std::max(max_encode_usage, s->encode_usage);
+  }
+  if (cpu_usage >= config_.high_cpu_usage ||
+      max_encode_usage >= config_.high_encode_usage) {
+    RTC_LOG(LS_INFO) << "CpuGovernor: overload cpu_usage=" << cpu_usage
+                     << " max_encode_usage=" << max_encode_usage;
+    return Load::kHigh;
+  }
+  // cpu_usage が負の場合は CPU 使用率が取れない環境なので、エンコード時間だけで判定する
+  if (cpu_usage <= config_.low_cpu_usage &&
+      max_encode_usage <= config_.low_encode_usage) {
+    return Load::kLow;
+  }
+  return Load::kNormal;
+}
+
+int CpuGovernor::MaxLevel() const {
+  return static_cast<int>(std::min(config_.resolution_scales.size(),
+                                   config_.framerate_scales.size())) -
+         1;
+}
+
+bool CpuGovernor::Degrade() {
+  // 優先度が一番低い sender の中で、一番段階が低いものを 1 段階落とす
+  std::shared_ptr<Sender> target;
+  for (auto& s : senders_) {
+    if (s->level >= MaxLevel()) {
+      continue;
+    }
+    if (target == nullptr || s->priority < target->priority ||
+        (s->priority == target->priority && s->level < target->level)) {
+      target = s;
+    }
+  }
+  if (target == nullptr) {
+    RTC_LOG(LS_WARNING) << "CpuGovernor: all senders are already degraded";
+    return false;
+  }
+  target->level += 1;
+  Apply(*target);
+  return true;
+}
+
+bool CpuGovernor::Restore() {
+  // 優先度が一番高い sender の中で、一番段階が高いものを 1 段階戻す
+  std::shared_ptr<Sender> target;
+  for (auto& s : senders_) {
+    if (s->level <= 0) {
+      continue;
+    }
+    if (target == nullptr || s->priority > target->priority ||
+        (s->priority == target->priority && s->level > target->level)) {
+      target = s;
+    }
+  }
+  if (target == nullptr) {
+    return false;
+  }
+  target->level -= 1;
+  Apply(*target);
+  return true;
+}
+
+void CpuGovernor::Apply(Sender& s) {
+  auto signaling = s.signaling.lock();
+  if (signaling == nullptr) {
+    return;
+  }
+
+  double resolution_scale = config_.resolution_scales[s.level];
+  double framerate_scale = config_.framerate_scales[s.level];
+  RTC_LOG(LS_INFO) << "CpuGovernor: apply priority=" << s.priority
+                   << " level=" << s.level
+                   << " resolution_scale=" << resolution_scale
+                   << " framerate_scale=" << framerate_scale;
+
+  std::vector<SenderEncodingUpdate> updates;
+  for (const auto& base : s.base_encodings) {
+    SenderEncodingUpdate u;
+    u.rid = base.rid;
+    u.scale_resolution_down_by =
+        base.scale_resolution_down_by.value_or(1.0) * resolution_scale;
+    if (framerate_scale >= 1.0) {
+      // 0 を指定すると制限が解除される
+      u.max_framerate = base.max_framerate.value_or(0);
+    } else {
+      u.max_framerate =
+          base.max_framerate.value_or(config_.default_max_framerate) *
+          framerate_scale;
+    }
+    updates.push_back(u);
+  }
+  signaling->UpdateSenderEncodings(
+      s.sender, std::move(updates), [](webrtc::RTCError error) {
+        if (!error.ok()) {
+          RTC_LOG(LS_WARNING) << "CpuGovernor: failed to update encodings: "
+                              << error.message();
+        }
+      });
+}
+
+}  // namespace sora
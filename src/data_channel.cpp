@@ -1,7 +1,39 @@
 #include "sora/data_channel.h"
 
+#include <algorithm>
+
+// WebRTC
+#include <rtc_base/time_utils.h>
+
 namespace sora {
 
+// スループットを計算する間隔
+static const int64_t kThroughputWindowUs = rtc::kNumMicrosecsPerSec;
+
+void DataChannelHistogram::Add(double value) {
+  size_t i = std::lower_bound(bounds.begin(), bounds.end(), value) -
+             bounds.begin();
+  if (i < counts.size()) {
+    counts[i] += 1;
+  }
+  count += 1;
+  sum += value;
+  max = std::max(max, value);
+}
+
+static DataChannelHistogram CreateRttHistogram() {
+  return DataChannelHistogram(
+      {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000});
+}
+
+DataChannel::LabelState::LabelState() {
+  stats.send_latency_ms = DataChannelHistogram(
+      {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000});
+  stats.throughput_kbps = DataChannelHistogram(
+      {16, 64, 256, 1000, 4000, 16000, 64000, 256000});
+  stats.rtt_ms = CreateRttHistogram();
+}
+
 void DataChannel::Thunk::OnStateChange() {
   p->OnStateChange(shared_from_this());
 }
@@ -9,7 +41,10 @@ void DataChannel::Thunk::OnMessage(const webrtc::DataBuffer& buffer) {
   p->OnMessage(shared_from_this(), buffer);
 }
 void DataChannel::Thunk::OnBufferedAmountChange(uint64_t previous_amount) {
-  p->OnBufferedAmountChange(shared_from_this(), previous_amount);
+  // io_context のスレッドに移ってからだと、その間に送信したデータも含まれてしまうので、
+  // 送信済みのバイト数と時刻はここで取得する
+  p->OnBufferedAmountChange(shared_from_this(), dc->bytes_sent(),
+                            rtc::TimeMicros());
 }
 
 DataChannel::DataChannel(boost::asio::io_context& ioc,
@@ -21,6 +56,13 @@ DataChannel::~DataChannel() {
 bool DataChannel::IsOpen(std::string label) const {
   return labels_.find(label) != labels_.end();
 }
+uint64_t DataChannel::GetBufferedAmount() const {
+  uint64_t amount = 0;
+  for (const auto& p : labels_) {
+    amount += p.second->buffered_amount();
+  }
+  return amount;
+}
 void DataChannel::Send(std::string label, const webrtc::DataBuffer& data) {
   auto it = labels_.find(label);
   if (it == labels_.end()) {
@@ -31,8 +73,53 @@ void DataChannel::Send(std::string label, const webrtc::DataBuffer& data) {
                     (const char*)data.data.cdata() + data.size());
     RTC_LOG(LS_INFO) << "Send DataChannel label=" << label << " data=" << str;
   }
-  auto data_channel = it->second;
-  data_channel->Send(data);
+  SendAndRecord(it->second, data);
+}
+bool DataChannel::SendAndRecord(
+    rtc::scoped_refptr<webrtc::DataChannelInterface> dc,
+    const webrtc::DataBuffer& data) {
+  if (!dc->Send(data)) {
+    return false;
+  }
+  LabelState& state = GetLabelState(dc->label());
+  state.stats.messages_sent += 1;
+  state.stats.bytes_sent += data.size();
+  state.queued_bytes += data.size();
+  state.pending.push_back(
+      std::make_pair(state.queued_bytes, rtc::TimeMicros()));
+  return true;
+}
+DataChannel::LabelState& DataChannel::GetLabelState(const std::string& label) {
+  auto it = label_states_.find(label);
+  if (it == label_states_.end()) {
+    it = label_states_.insert(std::make_pair(label, LabelState())).first;
+    it->second.stats.label = label;
+  }
+  return it->second;
+}
+std::vector<DataChannelLabelStats> DataChannel::GetStats() const {
+  std::vector<DataChannelLabelStats> r;
+  for (const auto& p : label_states_) {
+    r.push_back(p.second.stats);
+  }
+  return r;
+}
+void DataChannel::AddProbeSent(const std::string& label) {
+  GetLabelState(label).stats.probes_sent += 1;
+}
+void DataChannel::AddProbeRtt(const std::string& label,
+                              const std::string& responder_id,
+                              int64_t rtt_us) {
+  LabelState& state = GetLabelState(label);
+  state.stats.probes_received += 1;
+  state.stats.rtt_ms.Add(rtt_us / 1000.0);
+  auto& by_responder = state.stats.rtt_ms_by_responder;
+  auto it = by_responder.find(responder_id);
+  if (it == by_responder.end()) {
+    it = by_responder.insert(std::make_pair(responder_id, CreateRttHistogram()))
+             .first;
+  }
+  it->second.Add(rtt_us / 1000.0);
 }
 void DataChannel::Close(const webrtc::DataBuffer& disconnect_message,
                         std::function<void(boost::system::error_code)> on_close,
@@ -55,8 +142,7 @@ void DataChannel::Close(const webrtc::DataBuffer& disconnect_message,
   });
 
   on_close_ = on_close;
-  auto data_channel = it->second;
-  data_channel->Send(disconnect_message);
+  SendAndRecord(it->second, disconnect_message);
 }
 
 void DataChannel::AddDataChannel(
@@ -111,6 +197,40 @@ void DataChannel::OnMessage(std::shared_ptr<Thunk> thunk,
   });
 }
 void DataChannel::OnBufferedAmountChange(std::shared_ptr<Thunk> thunk,
-                                         uint64_t previous_amount) {}
+                                         uint64_t bytes_sent,
+                                         int64_t timestamp_us) {
+  boost::asio::post(*ioc_, [this, thunk, bytes_sent, timestamp_us]() {
+    LabelState& state = GetLabelState(thunk->dc->label());
+
+    // 送信待ちバッファから出ていったメッセージの待ち時間を記録する
+    while (!state.pending.empty() &&
+           state.pending.front().first <= bytes_sent) {
+      int64_t latency_us = timestamp_us - state.pending.front().second;
+      state.stats.send_latency_ms.Add(std::max<int64_t>(0, latency_us) /
+                                      1000.0);
+      state.pending.pop_front();
+    }
+
+    if (bytes_sent <= state.last_bytes_sent) {
+      return;
+    }
+    if (state.window_start_us == 0 ||
+        timestamp_us - state.last_drained_us >= kThroughputWindowUs) {
+      // 送信していなかった時間を含めないように、ここから数え直す
+      state.window_start_us = timestamp_us;
+      state.window_bytes = 0;
+    }
+    state.window_bytes += bytes_sent - state.last_bytes_sent;
+    state.last_bytes_sent = bytes_sent;
+    state.last_drained_us = timestamp_us;
+    int64_t elapsed_us = timestamp_us - state.window_start_us;
+    if (elapsed_us >= kThroughputWindowUs) {
+      state.stats.throughput_kbps.Add(state.window_bytes * 8.0 * 1000 /
+                                      elapsed_us);
+      state.window_start_us = timestamp_us;
+      state.window_bytes = 0;
+    }
+  });
+}
 
 }  // namespace sora
@@ -0,0 +1,187 @@
+#include "sora/dav1d_video_decoder.h"
+
+#if USE_DAV1D_DECODER
+
+#include <string.h>
+
+#include <algorithm>
+
+// WebRTC
+#include <api/video/video_frame.h>
+#include <common_video/include/video_frame_buffer.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/logging.h>
+
+// dav1d
+#include <dav1d/dav1d.h>
+
+namespace sora {
+
+namespace {
+
+class Dav1dVideoDecoder : public webrtc::VideoDecoder {
+ public:
+  Dav1dVideoDecoder(Dav1dVideoDecoderConfig config) : config_(config) {}
+  ~Dav1dVideoDecoder() override { Release(); }
+
+  bool Configure(const Settings& settings) override {
+    Release();
+
+    Dav1dSettings s;
+    dav1d_default_settings(&s);
+    s.n_threads = std::max(0, config_.threads);
+    s.max_frame_delay = std::max(0, config_.max_frame_delay);
+    // SVC の場合も一番上のレイヤーだけを出力する
+    s.all_layers = 0;
+    int r = dav1d_open(&context_, &s);
+    if (r < 0) {
+      RTC_LOG(LS_ERROR) << "Failed to dav1d_open: r=" << r;
+      context_ = nullptr;
+      return false;
+    }
+    RTC_LOG(LS_INFO) << "Dav1dVideoDecoder: threads=" << s.n_threads
+                     << " max_frame_delay=" << s.max_frame_delay;
+    return true;
+  }
+
+  int32_t Decode(const webrtc::EncodedImage& input_image,
+                 bool missing_frames,
+                 int64_t render_time_ms) override {
+    if (context_ == nullptr || decode_complete_callback_ == nullptr) {
+      return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+    }
+    if (input_image.data() == nullptr || input_image.size() == 0) {
+      return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+    }
+
+    // max_frame_delay が 1 より大きい場合、Decode から戻った後も
+    // dav1d がデータを参照するので、input_image を直接渡さずにコピーする
+    Dav1dData data = {};
+    uint8_t* p = dav1d_data_create(&data, input_image.size());
+    if (p == nullptr) {
+      RTC_LOG(LS_ERROR) << "Failed to dav1d_data_create";
+      return WEBRTC_VIDEO_CODEC_MEMORY;
+    }
+    memcpy(p, input_image.data(), input_image.size());
+    // 出力が遅れても元のフレームと対応付けられるようにする
+    data.m.timestamp = input_image.Timestamp();
+
+    while (data.sz > 0) {
+      int r = dav1d_send_data(context_, &data);
+      if (r < 0 && r != DAV1D_ERR(EAGAIN)) {
+        RTC_LOG(LS_ERROR) << "Failed to dav1d_send_data: r=" << r;
+        dav1d_data_unref(&data);
+        return WEBRTC_VIDEO_CODEC_ERROR;
+      }
+      // EAGAIN の場合は、出力を取り出して空きを作ってから送り直す
+      int count = OutputPictures();
+      if (count < 0 || (r == DAV1D_ERR(EAGAIN) && count == 0)) {
+        dav1d_data_unref(&data);
+        return WEBRTC_VIDEO_CODEC_ERROR;
+      }
+    }
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t RegisterDecodeCompleteCallback(
+      webrtc::DecodedImageCallback* callback) override {
+    decode_complete_callback_ = callback;
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  int32_t Release() override {
+    if (context_ != nullptr) {
+      dav1d_close(&context_);
+      context_ = nullptr;
+    }
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  DecoderInfo GetDecoderInfo() const override {
+    DecoderInfo info;
+    info.implementation_name = "dav1d";
+    info.is_hardware_accelerated = false;
+    return info;
+  }
+
+  const char* ImplementationName() const override { return "dav1d"; }
+
+ private:
+  // デコードが終わったフレームを全て取り出してコールバックに渡す。
+  // 渡したフレームの数を返す。エラーの場合は -1 を返す。
+  int OutputPictures() {
+    int count = 0;
+    while (true) {
+      Dav1dPicture pic = {};
+      int r = dav1d_get_picture(context_, &pic);
+      if (r == DAV1D_ERR(EAGAIN)) {
+        return count;
+      }
+      if (r < 0) {
+        RTC_LOG(LS_ERROR) << "Failed to dav1d_get_picture: r=" << r;
+        return -1;
+      }
+      if (pic.p.bpc != 8 || pic.p.layout != DAV1D_PIXEL_LAYOUT_I420) {
+        RTC_LOG(LS_ERROR) << "Unsupported picture format: bpc=" << pic.p.bpc
+                          << " layout=" << pic.p.layout;
+        dav1d_picture_unref(&pic);
+        return -1;
+      }
+
+      // dav1d のバッファをそのまま参照して、使い終わったら解放する。
+      // Dav1dPicture はコピーすると参照もそのまま移る。
+      auto holder = std::make_shared<Dav1dPicture>(pic);
+      rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+          webrtc::WrapI420Buffer(
+              pic.p.w, pic.p.h, static_cast<const uint8_t*>(pic.data[0]),
+              static_cast<int>(pic.stride[0]),
+              static_cast<const uint8_t*>(pic.data[1]),
+              static_cast<int>(pic.stride[1]),
+              static_cast<const uint8_t*>(pic.data[2]),
+              static_cast<int>(pic.stride[1]),
+              [holder]() { dav1d_picture_unref(holder.get()); });
+
+      webrtc::VideoFrame frame =
+          webrtc::VideoFrame::Builder()
+              .set_video_frame_buffer(buffer)
+              .set_timestamp_rtp(static_cast<uint32_t>(pic.m.timestamp))
+              .build();
+      decode_complete_callback_->Decoded(frame, absl::nullopt, absl::nullopt);
+      count += 1;
+    }
+  }
+
+  Dav1dVideoDecoderConfig config_;
+  Dav1dContext* context_ = nullptr;
+  webrtc::DecodedImageCallback* decode_complete_callback_ = nullptr;
+};
+
+}  // namespace
+
+std::unique_ptr<webrtc::VideoDecoder> CreateDav1dVideoDecoder(
+    Dav1dVideoDecoderConfig config) {
+  return std::unique_ptr<webrtc::VideoDecoder>(new Dav1dVideoDecoder(config));
+}
+
+bool IsDav1dVideoDecoderSupported() {
+  return true;
+}
+
+}  // namespace sora
+
+#else
+
+namespace sora {
+
+std::unique_ptr<webrtc::VideoDecoder> CreateDav1dVideoDecoder(
+    Dav1dVideoDecoderConfig config) {
+  return nullptr;
+}
+
+bool IsDav1dVideoDecoderSupported() {
+  return false;
+}
+
+}  // namespace sora
+
+#endif
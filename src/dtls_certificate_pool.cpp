@@ -0,0 +1,120 @@
+#include "sora/dtls_certificate_pool.h"
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/ssl_identity.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora {
+
+std::shared_ptr<DtlsCertificatePool> DtlsCertificatePool::Create(
+    DtlsCertificatePoolConfig config) {
+  std::shared_ptr<DtlsCertificatePool> pool(new DtlsCertificatePool(config));
+  if (!pool->Init()) {
+    RTC_LOG(LS_ERROR) << "Failed to create DtlsCertificatePool";
+    return nullptr;
+  }
+  return pool;
+}
+
+DtlsCertificatePool::DtlsCertificatePool(DtlsCertificatePoolConfig config)
+    : config_(config), thread_(rtc::Thread::Create()), stopped_(false) {}
+
+DtlsCertificatePool::~DtlsCertificatePool() {
+  stopped_ = true;
+  // 生成中の証明書があれば、それが終わるまで待つ
+  thread_->Stop();
+}
+
+bool DtlsCertificatePool::Init() {
+  // 生成した直後に捨てることになってしまうので、余裕は有効期間より短くする必要がある
+  if (config_.rotation_margin_ms >= config_.certificate_lifetime_ms) {
+    RTC_LOG(LS_ERROR) << "rotation_margin_ms must be less than "
+                         "certificate_lifetime_ms: rotation_margin_ms="
+                      << config_.rotation_margin_ms
+                      << " certificate_lifetime_ms="
+                      << config_.certificate_lifetime_ms;
+    return false;
+  }
+  if (!StartThreadWithConfig(thread_.get(), config_.thread_config)) {
+    return false;
+  }
+  RequestRefill();
+  return true;
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate> DtlsCertificatePool::Take() {
+  rtc::scoped_refptr<rtc::RTCCertificate> certificate;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    RemoveExpiredCertificates();
+    if (!certificates_.empty()) {
+      certificate = certificates_.front();
+      certificates_.pop_front();
+    }
+  }
+  if (certificate == nullptr) {
+    RTC_LOG(LS_INFO) << "DtlsCertificatePool is empty";
+  }
+  RequestRefill();
+  return certificate;
+}
+
+size_t DtlsCertificatePool::GetAvailableCount() {
+  webrtc::MutexLock lock(&mutex_);
+  RemoveExpiredCertificates();
+  return certificates_.size();
+}
+
+void DtlsCertificatePool::RequestRefill() {
+  {
+    webrtc::MutexLock lock(&mutex_);
+    if (refilling_ || certificates_.size() >= config_.pool_size) {
+      return;
+    }
+    refilling_ = true;
+  }
+  thread_->PostTask([this]() { Refill(); });
+}
+
+void DtlsCertificatePool::Refill() {
+  while (!stopped_) {
+    {
+      webrtc::MutexLock lock(&mutex_);
+      RemoveExpiredCertificates();
+      if (certificates_.size() >= config_.pool_size) {
+        refilling_ = false;
+        return;
+      }
+    }
+
+    int64_t start_ms = rtc::TimeMillis();
+    rtc::scoped_refptr<rtc::RTCCertificate> certificate =
+        rtc::RTCCertificateGenerator::GenerateCertificate(
+            rtc::KeyParams::ECDSA(rtc::EC_NIST_P256),
+            static_cast<uint64_t>(config_.certificate_lifetime_ms));
+    if (certificate == nullptr) {
+      RTC_LOG(LS_ERROR) << "Failed to generate DTLS certificate";
+      webrtc::MutexLock lock(&mutex_);
+      refilling_ = false;
+      return;
+    }
+    RTC_LOG(LS_VERBOSE) << "Generated DTLS certificate: elapsed="
+                        << rtc::TimeMillis() - start_ms << "ms";
+
+    webrtc::MutexLock lock(&mutex_);
+    certificates_.push_back(certificate);
+  }
+}
+
+void DtlsCertificatePool::RemoveExpiredCertificates() {
+  // Expires() は UTC のエポックからのミリ秒
+  uint64_t deadline =
+      static_cast<uint64_t>(rtc::TimeUTCMillis() + config_.rotation_margin_ms);
+  while (!certificates_.empty() &&
+         certificates_.front()->HasExpired(deadline)) {
+    certificates_.pop_front();
+  }
+}
+
+}  // namespace sora
@@ -0,0 +1,122 @@
+#include "sora/encoded_frame_buffer.h"
+
+#include <atomic>
+#include <set>
+
+// WebRTC
+#include <api/video/i420_buffer.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <rtc_base/synchronization/mutex.h>
+
+namespace sora {
+
+// 生存中の EncodedFrameBuffer。
+// 破棄する時に消すので、同じアドレスに別のバッファが確保されても誤判定しない。
+static webrtc::Mutex g_buffers_mutex;
+static std::set<const webrtc::VideoFrameBuffer*> g_buffers
+    RTC_GUARDED_BY(g_buffers_mutex);
+
+EncodedFrameBuffer* EncodedFrameBuffer::From(
+    webrtc::VideoFrameBuffer* buffer) {
+  if (buffer == nullptr || buffer->type() != Type::kNative) {
+    return nullptr;
+  }
+  webrtc::MutexLock lock(&g_buffers_mutex);
+  if (g_buffers.find(buffer) == g_buffers.end()) {
+    return nullptr;
+  }
+  return static_cast<EncodedFrameBuffer*>(buffer);
+}
+
+rtc::scoped_refptr<EncodedFrameBuffer> EncodedFrameBuffer::Create(
+    rtc::scoped_refptr<webrtc::EncodedImageBufferInterface> data,
+    int width,
+    int height,
+    bool is_key_frame,
+    uint64_t frame_number,
+    std::weak_ptr<KeyFrameRequester> key_frame_requester) {
+  return rtc::scoped_refptr<EncodedFrameBuffer>(
+      new rtc::RefCountedObject<EncodedFrameBuffer>(
+          data, width, height, is_key_frame, frame_number,
+          std::move(key_frame_requester)));
+}
+
+EncodedFrameBuffer::EncodedFrameBuffer(
+    rtc::scoped_refptr<webrtc::EncodedImageBufferInterface> data,
+    int width,
+    int height,
+    bool is_key_frame,
+    uint64_t frame_number,
+    std::weak_ptr<KeyFrameRequester> key_frame_requester)
+    : data_(data),
+      width_(width),
+      height_(height),
+      is_key_frame_(is_key_frame),
+      frame_number_(frame_number),
+      key_frame_requester_(std::move(key_frame_requester)) {
+  webrtc::MutexLock lock(&g_buffers_mutex);
+  g_buffers.insert(this);
+}
+
+EncodedFrameBuffer::~EncodedFrameBuffer() {
+  webrtc::MutexLock lock(&g_buffers_mutex);
+  g_buffers.erase(this);
+}
+
+webrtc::VideoFrameBuffer::Type EncodedFrameBuffer::type() const {
+  return Type::kNative;
+}
+
+int EncodedFrameBuffer::width() const {
+  return width_;
+}
+
+int EncodedFrameBuffer::height() const {
+  return height_;
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> EncodedFrameBuffer::ToI420() {
+  // フレームごとに出すとログが溢れるので、プロセスで 1 回だけ出す
+  static std::atomic<bool> logged(false);
+  if (!logged.exchange(true)) {
+    RTC_LOG(LS_ERROR) << "EncodedFrameBuffer::ToI420() returns a black frame. "
+                         "Enable use_passthrough_encoder to send encoded "
+                         "frames as they are";
+  }
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+      webrtc::I420Buffer::Create(width_, height_);
+  webrtc::I420Buffer::SetBlack(buffer.get());
+  return buffer;
+}
+
+rtc::scoped_refptr<webrtc::VideoFrameBuffer> EncodedFrameBuffer::CropAndScale(
+    int offset_x,
+    int offset_y,
+    int crop_width,
+    int crop_height,
+    int scaled_width,
+    int scaled_height) {
+  return rtc::scoped_refptr<webrtc::VideoFrameBuffer>(this);
+}
+
+rtc::scoped_refptr<webrtc::EncodedImageBufferInterface>
+EncodedFrameBuffer::data() const {
+  return data_;
+}
+
+bool EncodedFrameBuffer::is_key_frame() const {
+  return is_key_frame_;
+}
+
+uint64_t EncodedFrameBuffer::frame_number() const {
+  return frame_number_;
+}
+
+void EncodedFrameBuffer::RequestKeyFrame() const {
+  if (auto requester = key_frame_requester_.lock()) {
+    requester->RequestKeyFrame();
+  }
+}
+
+}  // namespace sora
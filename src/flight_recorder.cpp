@@ -0,0 +1,251 @@
+#include "sora/flight_recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#if defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+// WebRTC
+#include <rtc_base/platform_thread_types.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora {
+
+static uint64_t GetLogThreadId() {
+#if defined(__APPLE__)
+  // rtc::CurrentThreadId() は pthread_t を返すので、数値の ID を取り直す
+  uint64_t tid = 0;
+  pthread_threadid_np(nullptr, &tid);
+  return tid;
+#else
+  return static_cast<uint64_t>(rtc::CurrentThreadId());
+#endif
+}
+
+static const char* GetSeverityName(uint8_t severity) {
+  switch (severity) {
+    case rtc::LS_VERBOSE:
+      return "VERBOSE";
+    case rtc::LS_INFO:
+      return "INFO";
+    case rtc::LS_WARNING:
+      return "WARNING";
+    case rtc::LS_ERROR:
+      return "ERROR";
+    default:
+      return "NONE";
+  }
+}
+
+// UTC の時刻を 2022-01-02T03:04:05.678901Z の形式にする
+static std::string FormatTime(int64_t timestamp_us, bool for_file_name) {
+  time_t t = static_cast<time_t>(timestamp_us / 1000000);
+  struct tm tm;
+#if defined(_WIN32)
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  char buf[64];
+  if (for_file_name) {
+    strftime(buf, sizeof(buf), "%Y%m%dT%H%M%SZ", &tm);
+    return buf;
+  }
+  size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+  snprintf(buf + n, sizeof(buf) - n, ".%06dZ",
+           static_cast<int>(timestamp_us % 1000000));
+  return buf;
+}
+
+// --------------------------------
+// FlightRecorderSession
+// --------------------------------
+
+FlightRecorderSession::FlightRecorderSession(
+    std::weak_ptr<FlightRecorder> recorder,
+    std::string name,
+    size_t max_samples)
+    : recorder_(recorder), name_(std::move(name)), max_samples_(max_samples) {}
+
+void FlightRecorderSession::AddStats(std::string json) {
+  if (max_samples_ == 0) {
+    return;
+  }
+  StatsSample sample;
+  sample.timestamp_us = rtc::TimeUTCMicros();
+  sample.json = std::move(json);
+  webrtc::MutexLock lock(&mutex_);
+  while (samples_.size() >= max_samples_) {
+    samples_.pop_front();
+  }
+  samples_.push_back(std::move(sample));
+}
+
+void FlightRecorderSession::Dump(const std::string& reason) {
+  auto recorder = recorder_.lock();
+  if (recorder == nullptr) {
+    return;
+  }
+  std::vector<StatsSample> samples;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    samples.assign(samples_.begin(), samples_.end());
+  }
+  recorder->PostDump(name_, reason, std::move(samples));
+}
+
+// --------------------------------
+// FlightRecorder
+// --------------------------------
+
+std::shared_ptr<FlightRecorder> FlightRecorder::Create(
+    FlightRecorderConfig config) {
+  if (config.log_records == 0 || config.max_log_size == 0 ||
+      config.max_log_size > UINT16_MAX) {
+    RTC_LOG(LS_ERROR) << "Invalid FlightRecorderConfig: log_records="
+                      << config.log_records
+                      << " max_log_size=" << config.max_log_size;
+    return nullptr;
+  }
+  if (config.writer == nullptr) {
+    AsyncFileWriterConfig writer_config;
+    writer_config.thread_config = config.thread_config;
+    config.writer = AsyncFileWriter::Create(writer_config);
+    if (config.writer == nullptr) {
+      RTC_LOG(LS_ERROR) << "Failed to create FlightRecorder";
+      return nullptr;
+    }
+  }
+  std::shared_ptr<FlightRecorder> recorder(new FlightRecorder(config));
+  rtc::LogMessage::AddLogToStream(recorder.get(), config.min_severity);
+  return recorder;
+}
+
+FlightRecorder::FlightRecorder(FlightRecorderConfig config)
+    : config_(config),
+      records_(new Record[config.log_records]),
+      data_(new char[config.log_records * config.max_log_size]) {}
+
+FlightRecorder::~FlightRecorder() {
+  rtc::LogMessage::RemoveLogToStream(this);
+}
+
+std::shared_ptr<FlightRecorderSession> FlightRecorder::CreateSession(
+    const std::string& name) {
+  std::string safe_name = name;
+  for (auto& c : safe_name) {
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '-' || c == '_';
+    if (!ok) {
+      c = '_';
+    }
+  }
+  return std::shared_ptr<FlightRecorderSession>(new FlightRecorderSession(
+      shared_from_this(), std::move(safe_name), config_.stats_samples));
+}
+
+void FlightRecorder::OnLogMessage(const std::string& message,
+                                  rtc::LoggingSeverity severity) {
+  Write(message, severity);
+}
+
+void FlightRecorder::OnLogMessage(const std::string& message) {
+  Write(message, rtc::LS_NONE);
+}
+
+void FlightRecorder::Write(const std::string& message,
+                           rtc::LoggingSeverity severity) {
+  // ログを出力している最中に呼ばれるので、ここでログを出してはいけない。
+  //
+  // 書き込む位置を head_ から確保して、seq を奇数にしてから中身を書き、
+  // 最後に書き込み済みの値にする (seqlock)。
+  // 読み込み側は中身をコピーした前後で seq が変わっていないことを確認するので、
+  // 書き込み中や上書きされたレコードを読んでしまうことは無い。
+  uint64_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+  size_t index = static_cast<size_t>(pos % config_.log_records);
+  Record& r = records_[index];
+  r.seq.store(pos * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  size_t size = message.size();
+  // 末尾の改行は要らない
+  while (size > 0 && (message[size - 1] == '\n' || message[size - 1] == '\r')) {
+    --size;
+  }
+  size = std::min(size, config_.max_log_size);
+  memcpy(data_.get() + index * config_.max_log_size, message.data(), size);
+  r.timestamp_us = rtc::TimeUTCMicros();
+  r.thread_id = GetLogThreadId();
+  r.size = static_cast<uint16_t>(size);
+  r.severity = static_cast<uint8_t>(severity);
+
+  r.seq.store((pos + 1) * 2, std::memory_order_release);
+}
+
+std::vector<FlightRecorder::LogEntry> FlightRecorder::Snapshot() const {
+  std::vector<LogEntry> entries;
+  uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t start = head > config_.log_records ? head - config_.log_records : 0;
+  entries.reserve(static_cast<size_t>(head - start));
+  for (uint64_t pos = start; pos < head; pos++) {
+    size_t index = static_cast<size_t>(pos % config_.log_records);
+    const Record& r = records_[index];
+    uint64_t seq = r.seq.load(std::memory_order_acquire);
+    if (seq != (pos + 1) * 2) {
+      // まだ書き込み中か、既に上書きされている
+      continue;
+    }
+    LogEntry entry;
+    entry.timestamp_us = r.timestamp_us;
+    entry.thread_id = r.thread_id;
+    entry.severity = r.severity;
+    size_t size = std::min<size_t>(r.size, config_.max_log_size);
+    entry.message.assign(data_.get() + index * config_.max_log_size, size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (r.seq.load(std::memory_order_relaxed) != seq) {
+      continue;
+    }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+void FlightRecorder::PostDump(
+    const std::string& session_name,
+    const std::string& reason,
+    std::vector<FlightRecorderSession::StatsSample> samples) {
+  // リングバッファはすぐに上書きされるので、コピーだけはここで行う
+  auto logs = Snapshot();
+  int64_t now_us = rtc::TimeUTCMicros();
+  std::string path = config_.output_dir + "/flight_" +
+                     FormatTime(now_us, true) + "_" + session_name + "_" +
+                     std::to_string(dumps_.fetch_add(1)) + ".log";
+  RTC_LOG(LS_INFO) << "Dump flight recorder: path=" << path;
+  config_.writer->ReplaceWith(path, [reason, now_us, logs = std::move(logs),
+                                     samples = std::move(samples)]() {
+    std::string s;
+    s += "# time: " + FormatTime(now_us, false) + "\n";
+    s += "# reason: " + reason + "\n";
+    s += "# logs: " + std::to_string(logs.size()) + "\n";
+    for (const auto& e : logs) {
+      s += FormatTime(e.timestamp_us, false);
+      s += " [" + std::to_string(e.thread_id) + "] ";
+      s += GetSeverityName(e.severity);
+      s += " ";
+      s += e.message;
+      s += "\n";
+    }
+    s += "# stats: " + std::to_string(samples.size()) + "\n";
+    for (const auto& sample : samples) {
+      s += FormatTime(sample.timestamp_us, false) + " " + sample.json + "\n";
+    }
+    return s;
+  });
+}
+
+}  // namespace sora
@@ -0,0 +1,287 @@
+#include "sora/frame_buffer_allocator.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/memory/aligned_malloc.h>
+
+#include "sora/memory_stats.h"
+
+namespace sora {
+
+// SIMD で扱いやすいように各プレーンの先頭と stride をこの値に揃える
+static const size_t kBufferAlignment = 64;
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+static size_t RoundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+class DefaultFrameBufferAllocator : public FrameBufferAllocator {
+ public:
+  void* Allocate(size_t size) override {
+    return webrtc::AlignedMalloc(size, kBufferAlignment);
+  }
+  void Free(void* data, size_t size) override { webrtc::AlignedFree(data); }
+};
+
+std::shared_ptr<FrameBufferAllocator> CreateDefaultFrameBufferAllocator() {
+  return std::make_shared<DefaultFrameBufferAllocator>();
+}
+
+class HugePageFrameBufferAllocator : public FrameBufferAllocator {
+ public:
+  HugePageFrameBufferAllocator(HugePageFrameBufferAllocatorConfig config)
+      : config_(config) {}
+
+  void* Allocate(size_t size) override {
+    if (!UseHugePages(size)) {
+      return webrtc::AlignedMalloc(size, kBufferAlignment);
+    }
+#if defined(__linux__)
+    size_t length = RoundUp(size, kHugePageSize);
+    void* data = nullptr;
+    if (config_.use_reserved_huge_pages) {
+      data = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (data == MAP_FAILED) {
+        RTC_LOG(LS_VERBOSE) << "Failed to mmap with MAP_HUGETLB: errno="
+                            << errno << ". Fallback to transparent huge pages";
+        data = nullptr;
+      }
+    }
+    if (data == nullptr) {
+      data = MapTransparentHugePages(length);
+      if (data == nullptr) {
+        return nullptr;
+      }
+    }
+    // まだページに触っていないので、ここでポリシーを設定すれば
+    // 最初に書き込んだ時にそのノードから割り当てられる
+    if (config_.bind_numa_node) {
+      BindNumaNode(data, length);
+    }
+    return data;
+#else
+    return webrtc::AlignedMalloc(size, kBufferAlignment);
+#endif
+  }
+
+  void Free(void* data, size_t size) override {
+    if (data == nullptr) {
+      return;
+    }
+#if defined(__linux__)
+    if (UseHugePages(size)) {
+      munmap(data, RoundUp(size, kHugePageSize));
+      return;
+    }
+#endif
+    webrtc::AlignedFree(data);
+  }
+
+ private:
+  bool UseHugePages(size_t size) const {
+    return size >= config_.min_huge_page_allocation_size;
+  }
+
+#if defined(__linux__)
+  // huge page の境界に揃えた領域を確保して、THP を使うように指定する
+  static void* MapTransparentHugePages(size_t length) {
+    size_t mapped_length = length + kHugePageSize;
+    void* p = mmap(nullptr, mapped_length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      RTC_LOG(LS_ERROR) << "Failed to mmap: errno=" << errno;
+      return nullptr;
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned = RoundUp(begin, kHugePageSize);
+    // 前後の余った部分は返しておく
+    if (aligned > begin) {
+      munmap(p, aligned - begin);
+    }
+    size_t tail = begin + mapped_length - (aligned + length);
+    if (tail > 0) {
+      munmap(reinterpret_cast<void*>(aligned + length), tail);
+    }
+    void* data = reinterpret_cast<void*>(aligned);
+#if defined(MADV_HUGEPAGE)
+    if (madvise(data, length, MADV_HUGEPAGE) != 0) {
+      RTC_LOG(LS_VERBOSE) << "Failed to madvise(MADV_HUGEPAGE): errno="
+                          << errno;
+    }
+#endif
+    return data;
+  }
+
+  void BindNumaNode(void* data, size_t length) const {
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+    int node = config_.numa_node;
+    if (node < 0) {
+      unsigned int cpu = 0;
+      unsigned int current_node = 0;
+      if (syscall(SYS_getcpu, &cpu, &current_node, nullptr) != 0) {
+        return;
+      }
+      node = static_cast<int>(current_node);
+    }
+    unsigned long mask = 0;
+    if (node >= static_cast<int>(sizeof(mask) * 8)) {
+      return;
+    }
+    mask = 1UL << node;
+    // maxnode はカーネル内で 1 引かれるので、ビット数 + 1 を渡す
+    if (syscall(SYS_mbind, data, length, MPOL_PREFERRED, &mask,
+                sizeof(mask) * 8 + 1, 0) != 0) {
+      // NUMA に対応していないカーネルでは失敗するが、動作には影響しない
+      RTC_LOG(LS_VERBOSE) << "Failed to mbind: node=" << node
+                          << " errno=" << errno;
+    }
+#endif
+  }
+#endif
+
+  HugePageFrameBufferAllocatorConfig config_;
+};
+
+std::shared_ptr<FrameBufferAllocator> CreateHugePageFrameBufferAllocator(
+    HugePageFrameBufferAllocatorConfig config) {
+  return std::make_shared<HugePageFrameBufferAllocator>(config);
+}
+
+rtc::scoped_refptr<AllocatedI420Buffer> AllocatedI420Buffer::Create(
+    int width,
+    int height,
+    std::shared_ptr<FrameBufferAllocator> allocator) {
+  rtc::scoped_refptr<AllocatedI420Buffer> buffer(
+      new rtc::RefCountedObject<AllocatedI420Buffer>(width, height, allocator));
+  if (!buffer->IsValid()) {
+    RTC_LOG(LS_ERROR) << "Failed to allocate I420 buffer: width=" << width
+                      << " height=" << height;
+    return nullptr;
+  }
+  return buffer;
+}
+
+AllocatedI420Buffer::AllocatedI420Buffer(
+    int width,
+    int height,
+    std::shared_ptr<FrameBufferAllocator> allocator)
+    : width_(width),
+      height_(height),
+      stride_y_(static_cast<int>(RoundUp(width, kBufferAlignment))),
+      stride_uv_(static_cast<int>(RoundUp((width + 1) / 2, kBufferAlignment))),
+      size_(static_cast<size_t>(stride_y_) * height +
+            static_cast<size_t>(stride_uv_) * ((height + 1) / 2) * 2),
+      allocator_(allocator != nullptr ? allocator
+                                      : CreateDefaultFrameBufferAllocator()),
+      data_(static_cast<uint8_t*>(allocator_->Allocate(size_))) {
+  if (data_ != nullptr) {
+    AddFrameBufferAllocation(static_cast<int64_t>(size_));
+  } else {
+    AddFrameBufferAllocationFailed();
+  }
+}
+
+AllocatedI420Buffer::~AllocatedI420Buffer() {
+  if (data_ != nullptr) {
+    RemoveFrameBufferAllocation(static_cast<int64_t>(size_));
+  }
+  allocator_->Free(data_, size_);
+}
+
+int AllocatedI420Buffer::width() const {
+  return width_;
+}
+int AllocatedI420Buffer::height() const {
+  return height_;
+}
+const uint8_t* AllocatedI420Buffer::DataY() const {
+  return data_;
+}
+const uint8_t* AllocatedI420Buffer::DataU() const {
+  return data_ + stride_y_ * height_;
+}
+const uint8_t* AllocatedI420Buffer::DataV() const {
+  return data_ + stride_y_ * height_ + stride_uv_ * ((height_ + 1) / 2);
+}
+int AllocatedI420Buffer::StrideY() const {
+  return stride_y_;
+}
+int AllocatedI420Buffer::StrideU() const {
+  return stride_uv_;
+}
+int AllocatedI420Buffer::StrideV() const {
+  return stride_uv_;
+}
+uint8_t* AllocatedI420Buffer::MutableDataY() {
+  return const_cast<uint8_t*>(DataY());
+}
+uint8_t* AllocatedI420Buffer::MutableDataU() {
+  return const_cast<uint8_t*>(DataU());
+}
+uint8_t* AllocatedI420Buffer::MutableDataV() {
+  return const_cast<uint8_t*>(DataV());
+}
+bool AllocatedI420Buffer::IsValid() const {
+  return data_ != nullptr;
+}
+
+FrameBufferPool::FrameBufferPool(
+    size_t max_number_of_buffers,
+    std::shared_ptr<FrameBufferAllocator> allocator)
+    : max_number_of_buffers_(max_number_of_buffers),
+      allocator_(allocator != nullptr ? allocator
+                                      : CreateDefaultFrameBufferAllocator()) {}
+
+rtc::scoped_refptr<AllocatedI420Buffer> FrameBufferPool::CreateI420Buffer(
+    int width,
+    int height) {
+  // 解像度が変わった場合、使われていない古いサイズのバッファはもう使わないので解放する
+  buffers_.remove_if(
+      [width, height](const rtc::scoped_refptr<
+                      rtc::RefCountedObject<AllocatedI420Buffer>>& buffer) {
+        return buffer->HasOneRef() &&
+               (buffer->width() != width || buffer->height() != height);
+      });
+
+  for (const auto& buffer : buffers_) {
+    if (buffer->HasOneRef()) {
+      return buffer;
+    }
+  }
+
+  if (buffers_.size() >= max_number_of_buffers_) {
+    RTC_LOG(LS_WARNING) << "FrameBufferPool: too many buffers in use: "
+                        << buffers_.size();
+    AddFrameBufferPoolExhausted();
+    return nullptr;
+  }
+
+  rtc::scoped_refptr<rtc::RefCountedObject<AllocatedI420Buffer>> buffer(
+      new rtc::RefCountedObject<AllocatedI420Buffer>(width, height,
+                                                     allocator_));
+  if (!buffer->IsValid()) {
+    RTC_LOG(LS_ERROR) << "FrameBufferPool: failed to allocate buffer: width="
+                      << width << " height=" << height;
+    return nullptr;
+  }
+  buffers_.push_back(buffer);
+  return buffer;
+}
+
+void FrameBufferPool::Release() {
+  buffers_.clear();
+}
+
+}  // namespace sora
@@ -0,0 +1,65 @@
+#include "sora/frame_memory_budget.h"
+
+// WebRTC
+#include <rtc_base/logging.h>
+
+namespace sora {
+
+std::shared_ptr<FrameMemoryBudget> FrameMemoryBudget::Create(
+    FrameMemoryBudgetConfig config) {
+  return std::shared_ptr<FrameMemoryBudget>(new FrameMemoryBudget(config));
+}
+
+FrameMemoryBudget::FrameMemoryBudget(FrameMemoryBudgetConfig config)
+    : config_(config), used_bytes_(0), peak_bytes_(0), rejected_count_(0) {
+  if (config_.allocator == nullptr) {
+    config_.allocator = CreateDefaultFrameBufferAllocator();
+  }
+}
+
+void* FrameMemoryBudget::Allocate(size_t size) {
+  const int64_t bytes = static_cast<int64_t>(size);
+  // 先に予約してから確保するので、複数のスレッドから同時に呼ばれても上限を超えない
+  int64_t used = used_bytes_.fetch_add(bytes) + bytes;
+  if (config_.max_bytes > 0 && used > config_.max_bytes) {
+    used_bytes_.fetch_sub(bytes);
+    // 大量に出ないように、最初の 1 回だけ警告する
+    if (rejected_count_.fetch_add(1) == 0) {
+      RTC_LOG(LS_WARNING) << "FrameMemoryBudget exceeded: max_bytes="
+                          << config_.max_bytes << " used_bytes=" << used - bytes
+                          << " requested=" << size;
+    }
+    return nullptr;
+  }
+
+  void* data = config_.allocator->Allocate(size);
+  if (data == nullptr) {
+    used_bytes_.fetch_sub(bytes);
+    return nullptr;
+  }
+
+  int64_t peak = peak_bytes_.load();
+  while (used > peak && !peak_bytes_.compare_exchange_weak(peak, used)) {
+  }
+  return data;
+}
+
+void FrameMemoryBudget::Free(void* data, size_t size) {
+  // 確保に失敗したバッファも Free が呼ばれるので、その場合は何もしない
+  if (data == nullptr) {
+    return;
+  }
+  config_.allocator->Free(data, size);
+  used_bytes_.fetch_sub(static_cast<int64_t>(size));
+}
+
+FrameMemoryBudgetStats FrameMemoryBudget::GetStats() const {
+  FrameMemoryBudgetStats stats;
+  stats.max_bytes = config_.max_bytes;
+  stats.used_bytes = used_bytes_.load();
+  stats.peak_bytes = peak_bytes_.load();
+  stats.rejected_count = rejected_count_.load();
+  return stats;
+}
+
+}  // namespace sora
@@ -0,0 +1,93 @@
+#include "sora/hls/async_file_writer.h"
+
+#include <stdio.h>
+
+// WebRTC
+#include <rtc_base/event.h>
+#include <rtc_base/logging.h>
+
+namespace sora {
+
+static void WriteFile(const std::string& path,
+                      const std::vector<uint8_t>& data,
+                      const char* mode) {
+  FILE* fp = fopen(path.c_str(), mode);
+  if (fp == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to open file: path=" << path;
+    return;
+  }
+  if (fwrite(data.data(), 1, data.size(), fp) != data.size()) {
+    RTC_LOG(LS_ERROR) << "Failed to write file: path=" << path;
+  }
+  fclose(fp);
+}
+
+// 一時ファイルに書いてから rename する
+static void ReplaceFile(const std::string& path, const std::string& data) {
+  std::string tmp = path + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "wb");
+  if (fp == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to open file: path=" << tmp;
+    return;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+  ok = fclose(fp) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    RTC_LOG(LS_ERROR) << "Failed to replace file: path=" << path;
+    remove(tmp.c_str());
+  }
+}
+
+std::shared_ptr<AsyncFileWriter> AsyncFileWriter::Create(
+    AsyncFileWriterConfig config) {
+  std::shared_ptr<AsyncFileWriter> writer(new AsyncFileWriter(config));
+  if (!StartThreadWithConfig(writer->thread_.get(), config.thread_config)) {
+    RTC_LOG(LS_ERROR) << "Failed to create AsyncFileWriter";
+    return nullptr;
+  }
+  return writer;
+}
+
+AsyncFileWriter::AsyncFileWriter(AsyncFileWriterConfig config)
+    : config_(config), thread_(rtc::Thread::Create()) {}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  if (!thread_->IsRunning()) {
+    return;
+  }
+  // 要求済みのタスクの後ろに積んで、全て実行されるのを待ってから止める
+  rtc::Event done;
+  thread_->PostTask([&done]() { done.Set(); });
+  done.Wait(rtc::Event::kForever);
+  thread_->Stop();
+}
+
+void AsyncFileWriter::Write(const std::string& path,
+                            std::vector<uint8_t> data) {
+  thread_->PostTask(
+      [path, data = std::move(data)]() { WriteFile(path, data, "wb"); });
+}
+
+void AsyncFileWriter::Append(const std::string& path,
+                             std::vector<uint8_t> data) {
+  thread_->PostTask(
+      [path, data = std::move(data)]() { WriteFile(path, data, "ab"); });
+}
+
+void AsyncFileWriter::Replace(const std::string& path, std::string data) {
+  thread_->PostTask(
+      [path, data = std::move(data)]() { ReplaceFile(path, data); });
+}
+
+void AsyncFileWriter::ReplaceWith(const std::string& path,
+                                  std::function<std::string()> make_data) {
+  thread_->PostTask([path, make_data = std::move(make_data)]() {
+    ReplaceFile(path, make_data());
+  });
+}
+
+void AsyncFileWriter::Remove(const std::string& path) {
+  thread_->PostTask([path]() { remove(path.c_str()); });
+}
+
+}  // namespace sora
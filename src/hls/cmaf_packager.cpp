@@ -0,0 +1,488 @@
+#include "sora/hls/cmaf_packager.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+
+// WebRTC
+#include <api/frame_transformer_interface.h>
+#include <api/media_stream_interface.h>
+#include <common_video/h264/h264_common.h>
+#include <common_video/h264/sps_parser.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <rtc_base/time_utils.h>
+
+#include "fmp4.h"
+
+namespace sora {
+
+// RTP の H.264 のクロックレートをそのまま使う
+static const uint32_t kTimescale = 90000;
+// プレイリストでパートを載せる書き込み済みのセグメントの数
+static const size_t kPartListedSegments = 2;
+
+static std::string GetInitName(int index) {
+  return "init_" + std::to_string(index) + ".mp4";
+}
+
+static std::string GetSegmentName(int index) {
+  return "segment_" + std::to_string(index) + ".m4s";
+}
+
+static std::string FormatSeconds(int64_t duration) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f",
+           static_cast<double>(duration) / kTimescale);
+  return buf;
+}
+
+// 受信したフレームをコピーして CmafPackager に渡し、
+// フレーム自体はそのままデコーダに流す FrameTransformer
+class CmafPackager::Transformer : public webrtc::FrameTransformerInterface {
+ public:
+  Transformer(CmafPackager* packager,
+              rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> source)
+      : packager_(packager), source_(source) {}
+
+  // この関数から戻った後は CmafPackager にフレームを渡さない
+  void Detach() {
+    webrtc::MutexLock lock(&mutex_);
+    packager_ = nullptr;
+  }
+
+  void Transform(
+      std::unique_ptr<webrtc::TransformableFrameInterface> frame) override {
+    bool request_key_frame = false;
+    {
+      webrtc::MutexLock lock(&mutex_);
+      if (packager_ != nullptr) {
+        auto video_frame =
+            static_cast<webrtc::TransformableVideoFrameInterface*>(
+                frame.get());
+        request_key_frame = packager_->OnEncodedFrame(
+            video_frame->GetData(), video_frame->GetTimestamp(),
+            video_frame->IsKeyFrame());
+      }
+    }
+    if (request_key_frame && source_ != nullptr) {
+      source_->GenerateKeyFrame();
+    }
+
+    rtc::scoped_refptr<webrtc::TransformedFrameCallback> callback;
+    {
+      webrtc::MutexLock lock(&callback_mutex_);
+      auto it = sink_callbacks_.find(frame->GetSsrc());
+      callback = it != sink_callbacks_.end() ? it->second : callback_;
+    }
+    if (callback != nullptr) {
+      callback->OnTransformedFrame(std::move(frame));
+    }
+  }
+
+  void RegisterTransformedFrameCallback(
+      rtc::scoped_refptr<webrtc::TransformedFrameCallback> callback)
+      override {
+    webrtc::MutexLock lock(&callback_mutex_);
+    callback_ = callback;
+  }
+  void RegisterTransformedFrameSinkCallback(
+      rtc::scoped_refptr<webrtc::TransformedFrameCallback> callback,
+      uint32_t ssrc) override {
+    webrtc::MutexLock lock(&callback_mutex_);
+    sink_callbacks_[ssrc] = callback;
+  }
+  void UnregisterTransformedFrameCallback() override {
+    webrtc::MutexLock lock(&callback_mutex_);
+    callback_ = nullptr;
+  }
+  void UnregisterTransformedFrameSinkCallback(uint32_t ssrc) override {
+    webrtc::MutexLock lock(&callback_mutex_);
+    sink_callbacks_.erase(ssrc);
+  }
+
+ private:
+  webrtc::Mutex mutex_;
+  CmafPackager* packager_ RTC_GUARDED_BY(mutex_);
+  rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> source_;
+
+  webrtc::Mutex callback_mutex_;
+  rtc::scoped_refptr<webrtc::TransformedFrameCallback> callback_
+      RTC_GUARDED_BY(callback_mutex_);
+  std::map<uint32_t, rtc::scoped_refptr<webrtc::TransformedFrameCallback>>
+      sink_callbacks_ RTC_GUARDED_BY(callback_mutex_);
+};
+
+std::shared_ptr<CmafPackager> CmafPackager::Create(CmafPackagerConfig config) {
+  if (config.writer == nullptr) {
+    RTC_LOG(LS_ERROR) << "CmafPackager requires AsyncFileWriter";
+    return nullptr;
+  }
+  if (config.segment_duration_ms <= 0 || config.part_duration_ms <= 0 ||
+      config.part_duration_ms > config.segment_duration_ms ||
+      config.playlist_segments <= 0) {
+    RTC_LOG(LS_ERROR) << "Invalid CmafPackager config: segment_duration_ms="
+                      << config.segment_duration_ms
+                      << " part_duration_ms=" << config.part_duration_ms
+                      << " playlist_segments=" << config.playlist_segments;
+    return nullptr;
+  }
+  return std::shared_ptr<CmafPackager>(new CmafPackager(config));
+}
+
+CmafPackager::CmafPackager(CmafPackagerConfig config) : config_(config) {}
+
+CmafPackager::~CmafPackager() {
+  if (transformer_ != nullptr) {
+    transformer_->Detach();
+  }
+
+  webrtc::MutexLock lock(&mutex_);
+  if (pending_ != nullptr) {
+    pending_->duration = last_duration_;
+    AddSample(std::move(*pending_));
+    pending_.reset();
+  }
+  if (segment_ != nullptr) {
+    FinishSegment();
+  }
+  if (init_index_ >= 0) {
+    WritePlaylist(true);
+  }
+}
+
+bool CmafPackager::SetReceiver(
+    rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver) {
+  if (receiver->media_type() != cricket::MEDIA_TYPE_VIDEO) {
+    RTC_LOG(LS_ERROR) << "CmafPackager supports only video receivers";
+    return false;
+  }
+  rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> source;
+  auto track = receiver->track();
+  if (track != nullptr) {
+    source =
+        static_cast<webrtc::VideoTrackInterface*>(track.get())->GetSource();
+  }
+
+  if (transformer_ != nullptr) {
+    transformer_->Detach();
+  }
+  transformer_ = rtc::scoped_refptr<Transformer>(
+      new rtc::RefCountedObject<Transformer>(this, source));
+  receiver->SetDepacketizerToDecoderFrameTransformer(transformer_);
+  return true;
+}
+
+CmafPackagerStats CmafPackager::GetStats() const {
+  webrtc::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+bool CmafPackager::OnEncodedFrame(rtc::ArrayView<const uint8_t> data,
+                                  uint32_t rtp_timestamp,
+                                  bool is_key_frame) {
+  webrtc::MutexLock lock(&mutex_);
+  stats_.frames_received += 1;
+
+  Sample sample;
+  sample.timestamp = unwrapper_.Unwrap(rtp_timestamp);
+  sample.duration = 0;
+  sample.is_key_frame = is_key_frame;
+  if (!ParseFrame(data, &sample)) {
+    stats_.frames_dropped += 1;
+    return false;
+  }
+
+  if (pending_ == nullptr && segment_ == nullptr &&
+      (!sample.is_key_frame || sample.sps.empty() || sample.pps.empty())) {
+    // 最初のキーフレームが届くまでは書き出せない
+    stats_.frames_dropped += 1;
+    return ShouldRequestKeyFrame();
+  }
+
+  if (pending_ != nullptr) {
+    int64_t duration = sample.timestamp - pending_->timestamp;
+    if (duration <= 0) {
+      duration = last_duration_;
+    }
+    last_duration_ = duration;
+    pending_->duration = duration;
+    AddSample(std::move(*pending_));
+  }
+  pending_.reset(new Sample(std::move(sample)));
+
+  // セグメントの区切りに間に合うように、1 パート分前からキーフレームを要求する
+  const int64_t segment_duration =
+      config_.segment_duration_ms * (kTimescale / 1000);
+  const int64_t part_duration = config_.part_duration_ms * (kTimescale / 1000);
+  if (segment_ != nullptr &&
+      decode_time_ - segment_start_ >= segment_duration - part_duration) {
+    return ShouldRequestKeyFrame();
+  }
+  return false;
+}
+
+bool CmafPackager::ParseFrame(rtc::ArrayView<const uint8_t> data,
+                              Sample* sample) {
+  std::vector<webrtc::H264::NaluIndex> nalus =
+      webrtc::H264::FindNaluIndices(data.data(), data.size());
+  sample->data.reserve(data.size() + nalus.size() * 4);
+  for (const auto& nalu : nalus) {
+    if (nalu.payload_size == 0) {
+      continue;
+    }
+    const uint8_t* p = data.data() + nalu.payload_start_offset;
+    switch (webrtc::H264::ParseNaluType(p[0])) {
+      // パラメータセットは初期化セグメントに入れるので、サンプルからは取り除く
+      case webrtc::H264::NaluType::kSps:
+        sps_.assign(p, p + nalu.payload_size);
+        break;
+      case webrtc::H264::NaluType::kPps:
+        pps_.assign(p, p + nalu.payload_size);
+        break;
+      case webrtc::H264::NaluType::kAud:
+        break;
+      default: {
+        uint32_t size = static_cast<uint32_t>(nalu.payload_size);
+        const uint8_t length[4] = {
+            static_cast<uint8_t>(size >> 24), static_cast<uint8_t>(size >> 16),
+            static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size)};
+        sample->data.insert(sample->data.end(), length, length + 4);
+        sample->data.insert(sample->data.end(), p, p + nalu.payload_size);
+        break;
+      }
+    }
+  }
+  if (sample->data.empty()) {
+    return false;
+  }
+  if (sample->is_key_frame) {
+    sample->sps = sps_;
+    sample->pps = pps_;
+  }
+  return true;
+}
+
+bool CmafPackager::ShouldRequestKeyFrame() {
+  if (!config_.request_key_frame) {
+    return false;
+  }
+  // 要求してから届くまでの間に何度も要求しないようにする
+  int64_t now_ms = rtc::TimeMillis();
+  if (last_key_frame_request_ms_ >= 0 &&
+      now_ms - last_key_frame_request_ms_ < config_.segment_duration_ms) {
+    return false;
+  }
+  last_key_frame_request_ms_ = now_ms;
+  stats_.key_frame_requests += 1;
+  return true;
+}
+
+void CmafPackager::AddSample(Sample sample) {
+  const int64_t segment_duration =
+      config_.segment_duration_ms * (kTimescale / 1000);
+  const int64_t part_duration = config_.part_duration_ms * (kTimescale / 1000);
+
+  bool init_changed = sample.is_key_frame && (sample.sps != init_sps_ ||
+                                              sample.pps != init_pps_);
+  if (segment_ != nullptr && sample.is_key_frame &&
+      (init_changed || decode_time_ - segment_start_ >= segment_duration)) {
+    FinishSegment();
+  }
+  if (init_changed) {
+    WriteInitSegment(sample);
+  }
+
+  if (segment_ == nullptr) {
+    segment_.reset(new Segment{next_segment_index_++, init_index_, 0, {}});
+    segment_start_ = decode_time_;
+    segment_bytes_ = 0;
+  } else if (!part_samples_.empty() &&
+             decode_time_ + sample.duration - part_start_ > part_duration) {
+    FlushPart();
+  }
+
+  if (part_samples_.empty()) {
+    part_start_ = decode_time_;
+  }
+  decode_time_ += sample.duration;
+  part_samples_.push_back(std::move(sample));
+
+  // パートが目標の長さに達したら、次のフレームを待たずに書き出す
+  if (decode_time_ - part_start_ >= part_duration) {
+    FlushPart();
+  }
+}
+
+void CmafPackager::WriteInitSegment(const Sample& sample) {
+  init_sps_ = sample.sps;
+  init_pps_ = sample.pps;
+  init_index_ += 1;
+
+  auto sps = webrtc::SpsParser::ParseSps(
+      init_sps_.data() + webrtc::H264::kNaluTypeSize,
+      init_sps_.size() - webrtc::H264::kNaluTypeSize);
+  if (sps) {
+    width_ = sps->width;
+    height_ = sps->height;
+  } else {
+    RTC_LOG(LS_WARNING) << "Failed to parse SPS";
+  }
+  RTC_LOG(LS_INFO) << "CmafPackager: init=" << GetInitName(init_index_)
+                   << " width=" << width_ << " height=" << height_;
+
+  std::vector<uint8_t> data =
+      CreateFmp4InitSegment(width_, height_, kTimescale, init_sps_, init_pps_);
+  stats_.bytes_written += data.size();
+  config_.writer->Replace(GetPath(GetInitName(init_index_)),
+                          std::string(data.begin(), data.end()));
+}
+
+void CmafPackager::FlushPart() {
+  if (part_samples_.empty()) {
+    return;
+  }
+
+  std::vector<Fmp4Sample> samples;
+  samples.reserve(part_samples_.size());
+  size_t mdat_size = 0;
+  for (const auto& s : part_samples_) {
+    mdat_size += s.data.size();
+  }
+  std::vector<uint8_t> mdat;
+  mdat.reserve(mdat_size);
+  int64_t duration = 0;
+  for (const auto& s : part_samples_) {
+    samples.push_back(Fmp4Sample{static_cast<uint32_t>(s.duration),
+                                 static_cast<uint32_t>(s.data.size()),
+                                 s.is_key_frame});
+    mdat.insert(mdat.end(), s.data.begin(), s.data.end());
+    duration += s.duration;
+  }
+
+  std::vector<uint8_t> fragment = CreateFmp4Fragment(
+      ++fragment_sequence_, static_cast<uint64_t>(part_start_), samples, mdat);
+  segment_->parts.push_back(Part{duration, segment_bytes_, fragment.size(),
+                                 part_samples_.front().is_key_frame});
+  segment_->duration += duration;
+  // セグメントの番号は 0 から振り直すので、同じ output_dir で起動し直すと
+  // 前回のセグメントのファイルが残っている。
+  // 古い中身の後ろに追加しないように、最初のパートではファイルを作り直す
+  bool first_part = segment_bytes_ == 0;
+  segment_bytes_ += fragment.size();
+  part_samples_.clear();
+
+  stats_.parts_written += 1;
+  stats_.bytes_written += fragment.size();
+  std::string path = GetPath(GetSegmentName(segment_->index));
+  if (first_part) {
+    config_.writer->Write(path, std::move(fragment));
+  } else {
+    config_.writer->Append(path, std::move(fragment));
+  }
+  WritePlaylist(false);
+}
+
+void CmafPackager::FinishSegment() {
+  FlushPart();
+  max_segment_duration_ = std::max(max_segment_duration_, segment_->duration);
+  segments_.push_back(std::move(*segment_));
+  segment_.reset();
+  stats_.segments_written += 1;
+  // 次のセグメントの区切りでもキーフレームを要求できるようにする
+  last_key_frame_request_ms_ = -1;
+
+  const size_t max_segments =
+      static_cast<size_t>(config_.playlist_segments) * 2;
+  while (segments_.size() > max_segments) {
+    const Segment& removed = segments_.front();
+    config_.writer->Remove(GetPath(GetSegmentName(removed.index)));
+    // どのセグメントからも参照されなくなった初期化セグメントも削除する
+    int next_init_index = segments_.size() > 1 ? segments_[1].init_index
+                                               : init_index_;
+    for (int i = removed.init_index; i < next_init_index; i++) {
+      config_.writer->Remove(GetPath(GetInitName(i)));
+    }
+    segments_.pop_front();
+  }
+  WritePlaylist(false);
+}
+
+void CmafPackager::WritePlaylist(bool end) {
+  size_t listed = std::min(segments_.size(),
+                           static_cast<size_t>(config_.playlist_segments));
+  size_t first = segments_.size() - listed;
+  int media_sequence =
+      listed > 0 ? segments_[first].index
+                 : (segment_ != nullptr ? segment_->index : 0);
+
+  // EXTINF を四捨五入した値が超えないようにする
+  int64_t max_duration = std::max<int64_t>(
+      config_.segment_duration_ms * (kTimescale / 1000), max_segment_duration_);
+  if (segment_ != nullptr) {
+    max_duration = std::max(max_duration, segment_->duration);
+  }
+  int64_t target_duration =
+      std::max<int64_t>(1, (max_duration + kTimescale / 2) / kTimescale);
+  int64_t part_target = config_.part_duration_ms * (kTimescale / 1000);
+
+  std::string s;
+  s += "#EXTM3U\n";
+  s += "#EXT-X-VERSION:6\n";
+  s += "#EXT-X-TARGETDURATION:" + std::to_string(target_duration) + "\n";
+  s += "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=" +
+       FormatSeconds(part_target * 3) + "\n";
+  s += "#EXT-X-PART-INF:PART-TARGET=" + FormatSeconds(part_target) + "\n";
+  s += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(media_sequence) + "\n";
+
+  int last_init_index = -1;
+  auto write_segment = [&](const Segment& segment, bool list_parts,
+                           bool finished) {
+    std::string name = GetSegmentName(segment.index);
+    if (segment.init_index != last_init_index) {
+      s += "#EXT-X-MAP:URI=\"" + GetInitName(segment.init_index) + "\"\n";
+      last_init_index = segment.init_index;
+    }
+    if (list_parts) {
+      for (const auto& part : segment.parts) {
+        s += "#EXT-X-PART:DURATION=" + FormatSeconds(part.duration) +
+             ",URI=\"" + name + "\",BYTERANGE=\"" + std::to_string(part.size) +
+             "@" + std::to_string(part.offset) + "\"";
+        if (part.independent) {
+          s += ",INDEPENDENT=YES";
+        }
+        s += "\n";
+      }
+    }
+    if (finished) {
+      s += "#EXTINF:" + FormatSeconds(segment.duration) + ",\n";
+      s += name + "\n";
+    }
+  };
+  for (size_t i = first; i < segments_.size(); i++) {
+    write_segment(segments_[i], segments_.size() - i <= kPartListedSegments,
+                  true);
+  }
+  if (segment_ != nullptr) {
+    write_segment(*segment_, true, false);
+  }
+
+  if (end) {
+    s += "#EXT-X-ENDLIST\n";
+  } else if (segment_ != nullptr) {
+    s += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"" +
+         GetSegmentName(segment_->index) +
+         "\",BYTERANGE-START=" + std::to_string(segment_bytes_) + "\n";
+  }
+  config_.writer->Replace(GetPath(config_.playlist_name), std::move(s));
+}
+
+std::string CmafPackager::GetPath(const std::string& name) const {
+  if (config_.output_dir.empty()) {
+    return name;
+  }
+  return config_.output_dir + "/" + name;
+}
+
+}  // namespace sora
@@ -0,0 +1,282 @@
+#include "fmp4.h"
+
+#include <string.h>
+
+#include <string>
+
+namespace sora {
+
+namespace {
+
+const uint32_t kTrackId = 1;
+
+// ビッグエンディアンで値を書き込んで、ボックスのサイズを後から埋めるためのクラス
+class BoxWriter {
+ public:
+  void U8(uint8_t v) { buf_.push_back(v); }
+  void U16(uint16_t v) {
+    U8(v >> 8);
+    U8(v & 0xff);
+  }
+  void U32(uint32_t v) {
+    U16(v >> 16);
+    U16(v & 0xffff);
+  }
+  void U64(uint64_t v) {
+    U32(static_cast<uint32_t>(v >> 32));
+    U32(static_cast<uint32_t>(v & 0xffffffff));
+  }
+  void Zeros(size_t n) { buf_.insert(buf_.end(), n, 0); }
+  void Bytes(const uint8_t* p, size_t n) { buf_.insert(buf_.end(), p, p + n); }
+  void Bytes(const std::vector<uint8_t>& v) { Bytes(v.data(), v.size()); }
+  void FourCC(const char* s) { Bytes(reinterpret_cast<const uint8_t*>(s), 4); }
+
+  void Begin(const char* type) {
+    stack_.push_back(buf_.size());
+    U32(0);
+    FourCC(type);
+  }
+  void BeginFull(const char* type, uint8_t version, uint32_t flags) {
+    Begin(type);
+    U32((static_cast<uint32_t>(version) << 24) | (flags & 0xffffff));
+  }
+  void End() {
+    size_t start = stack_.back();
+    stack_.pop_back();
+    Patch32(start, static_cast<uint32_t>(buf_.size() - start));
+  }
+
+  size_t size() const { return buf_.size(); }
+  void Patch32(size_t offset, uint32_t v) {
+    buf_[offset] = v >> 24;
+    buf_[offset + 1] = (v >> 16) & 0xff;
+    buf_[offset + 2] = (v >> 8) & 0xff;
+    buf_[offset + 3] = v & 0xff;
+  }
+  std::vector<uint8_t> Take() { return std::move(buf_); }
+
+ private:
+  std::vector<uint8_t> buf_;
+  std::vector<size_t> stack_;
+};
+
+void WriteMatrix(BoxWriter& w) {
+  const uint32_t matrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0,
+                              0x40000000};
+  for (uint32_t v : matrix) {
+    w.U32(v);
+  }
+}
+
+}  // namespace
+
+std::vector<uint8_t> CreateFmp4InitSegment(int width,
+                                           int height,
+                                           uint32_t timescale,
+                                           const std::vector<uint8_t>& sps,
+                                           const std::vector<uint8_t>& pps) {
+  BoxWriter w;
+
+  w.Begin("ftyp");
+  w.FourCC("iso6");
+  w.U32(0);
+  w.FourCC("iso6");
+  w.FourCC("cmfc");
+  w.FourCC("mp41");
+  w.End();
+
+  w.Begin("moov");
+  {
+    w.BeginFull("mvhd", 0, 0);
+    w.U32(0);  // creation_time
+    w.U32(0);  // modification_time
+    w.U32(1000);
+    w.U32(0);  // duration
+    w.U32(0x00010000);
+    w.U16(0x0100);
+    w.Zeros(10);
+    WriteMatrix(w);
+    w.Zeros(24);
+    w.U32(kTrackId + 1);
+    w.End();
+
+    w.Begin("trak");
+    {
+      // track_enabled | track_in_movie
+      w.BeginFull("tkhd", 0, 3);
+      w.U32(0);
+      w.U32(0);
+      w.U32(kTrackId);
+      w.U32(0);
+      w.U32(0);  // duration
+      w.Zeros(8);
+      w.U16(0);  // layer
+      w.U16(0);  // alternate_group
+      w.U16(0);  // volume
+      w.U16(0);
+      WriteMatrix(w);
+      w.U32(static_cast<uint32_t>(width) << 16);
+      w.U32(static_cast<uint32_t>(height) << 16);
+      w.End();
+
+      w.Begin("mdia");
+      {
+        w.BeginFull("mdhd", 0, 0);
+        w.U32(0);
+        w.U32(0);
+        w.U32(timescale);
+        w.U32(0);
+        w.U16(0x55c4);  // und
+        w.U16(0);
+        w.End();
+
+        w.BeginFull("hdlr", 0, 0);
+        w.U32(0);
+        w.FourCC("vide");
+        w.Zeros(12);
+        const char name[] = "VideoHandler";
+        w.Bytes(reinterpret_cast<const uint8_t*>(name), sizeof(name));
+        w.End();
+
+        w.Begin("minf");
+        {
+          w.BeginFull("vmhd", 0, 1);
+          w.Zeros(8);
+          w.End();
+
+          w.Begin("dinf");
+          w.BeginFull("dref", 0, 0);
+          w.U32(1);
+          // 同じファイル内にデータがある
+          w.BeginFull("url ", 0, 1);
+          w.End();
+          w.End();
+          w.End();
+
+          w.Begin("stbl");
+          {
+            w.BeginFull("stsd", 0, 0);
+            w.U32(1);
+            w.Begin("avc1");
+            {
+              w.Zeros(6);
+              w.U16(1);  // data_reference_index
+              w.Zeros(16);
+              w.U16(static_cast<uint16_t>(width));
+              w.U16(static_cast<uint16_t>(height));
+              w.U32(0x00480000);
+              w.U32(0x00480000);
+              w.U32(0);
+              w.U16(1);  // frame_count
+              w.Zeros(32);
+              w.U16(0x0018);
+              w.U16(0xffff);
+
+              w.Begin("avcC");
+              w.U8(1);
+              // profile_idc, constraint_set_flags, level_idc は SPS のものをそのまま使う
+              w.U8(sps.size() > 1 ? sps[1] : 0);
+              w.U8(sps.size() > 2 ? sps[2] : 0);
+              w.U8(sps.size() > 3 ? sps[3] : 0);
+              // lengthSizeMinusOne = 3
+              w.U8(0xff);
+              // numOfSequenceParameterSets = 1
+              w.U8(0xe1);
+              w.U16(static_cast<uint16_t>(sps.size()));
+              w.Bytes(sps);
+              w.U8(1);
+              w.U16(static_cast<uint16_t>(pps.size()));
+              w.Bytes(pps);
+              w.End();
+            }
+            w.End();
+            w.End();
+
+            // サンプルは全て moof に入れるので、ここは空にする
+            w.BeginFull("stts", 0, 0);
+            w.U32(0);
+            w.End();
+            w.BeginFull("stsc", 0, 0);
+            w.U32(0);
+            w.End();
+            w.BeginFull("stsz", 0, 0);
+            w.U32(0);
+            w.U32(0);
+            w.End();
+            w.BeginFull("stco", 0, 0);
+            w.U32(0);
+            w.End();
+          }
+          w.End();
+        }
+        w.End();
+      }
+      w.End();
+    }
+    w.End();
+
+    w.Begin("mvex");
+    w.BeginFull("trex", 0, 0);
+    w.U32(kTrackId);
+    w.U32(1);  // default_sample_description_index
+    w.U32(0);
+    w.U32(0);
+    w.U32(0);
+    w.End();
+    w.End();
+  }
+  w.End();
+
+  return w.Take();
+}
+
+std::vector<uint8_t> CreateFmp4Fragment(
+    uint32_t sequence_number,
+    uint64_t base_media_decode_time,
+    const std::vector<Fmp4Sample>& samples,
+    const std::vector<uint8_t>& mdat_payload) {
+  BoxWriter w;
+
+  w.Begin("moof");
+  w.BeginFull("mfhd", 0, 0);
+  w.U32(sequence_number);
+  w.End();
+
+  w.Begin("traf");
+  // default-base-is-moof
+  w.BeginFull("tfhd", 0, 0x020000);
+  w.U32(kTrackId);
+  w.End();
+
+  w.BeginFull("tfdt", 1, 0);
+  w.U64(base_media_decode_time);
+  w.End();
+
+  // data-offset, sample-duration, sample-size, sample-flags
+  w.BeginFull("trun", 0, 0x000001 | 0x000100 | 0x000200 | 0x000400);
+  w.U32(static_cast<uint32_t>(samples.size()));
+  // moof の先頭から mdat のデータまでのオフセット。moof を閉じた後に埋める
+  size_t data_offset_pos = w.size();
+  w.U32(0);
+  for (const auto& s : samples) {
+    w.U32(s.duration);
+    w.U32(s.size);
+    // キーフレームは sample_depends_on = 2 (他に依存しない)、
+    // それ以外は sample_depends_on = 1 と sample_is_non_sync_sample を立てる
+    w.U32(s.is_key_frame ? 0x02000000 : 0x01010000);
+  }
+  w.End();
+  w.End();
+  w.End();
+
+  // mdat のヘッダ (8 バイト) の後ろがデータの先頭
+  w.Patch32(data_offset_pos, static_cast<uint32_t>(w.size() + 8));
+
+  w.Begin("mdat");
+  w.Bytes(mdat_payload);
+  w.End();
+
+  return w.Take();
+}
+
+}  // namespace sora
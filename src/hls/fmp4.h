@@ -0,0 +1,37 @@
+#ifndef SORA_HLS_FMP4_H_
+#define SORA_HLS_FMP4_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace sora {
+
+// CMAF (fMP4) の H.264 映像トラックを書き出すための関数
+
+struct Fmp4Sample {
+  uint32_t duration;
+  uint32_t size;
+  bool is_key_frame;
+};
+
+// ftyp と moov からなる初期化セグメントを作る。
+// sps と pps は NAL ヘッダを含み、スタートコードを含まない。
+std::vector<uint8_t> CreateFmp4InitSegment(int width,
+                                           int height,
+                                           uint32_t timescale,
+                                           const std::vector<uint8_t>& sps,
+                                           const std::vector<uint8_t>& pps);
+
+// moof と mdat からなる 1 つのフラグメントを作る。
+// mdat_payload は samples を順番に並べたもので、
+// 各 NAL は 4 バイトのビッグエンディアンの長さを先頭に付けた形式にしておく。
+std::vector<uint8_t> CreateFmp4Fragment(
+    uint32_t sequence_number,
+    uint64_t base_media_decode_time,
+    const std::vector<Fmp4Sample>& samples,
+    const std::vector<uint8_t>& mdat_payload);
+
+}  // namespace sora
+
+#endif
@@ -18,7 +18,6 @@
 #include <rtc_base/checks.h>
 #include <rtc_base/logging.h>
 #include <rtc_base/time_utils.h>
-#include <system_wrappers/include/metrics.h>
 #include <third_party/libyuv/include/libyuv/convert.h>
 
 // L4T Multimedia API
@@ -27,6 +26,9 @@
 // Jetson Linux Multimedia API
 #include <NvVideoDecoder.h>
 
+#include "sora/memory_stats.h"
+#include "sora/thread_cpu_usage.h"
+
 #define INIT_ERROR(cond, desc)                 \
   if (cond) {                                  \
     RTC_LOG(LS_ERROR) << __FUNCTION__ << desc; \
@@ -37,7 +39,10 @@
 
 namespace sora {
 
-JetsonVideoDecoder::JetsonVideoDecoder(webrtc::VideoCodecType codec)
+JetsonVideoDecoder::JetsonVideoDecoder(
+    webrtc::VideoCodecType codec,
+    std::shared_ptr<FrameBufferAllocator> allocator,
+    size_t max_frame_buffers)
     : input_format_(codec == webrtc::kVideoCodecVP8    ? V4L2_PIX_FMT_VP8
                     : codec == webrtc::kVideoCodecVP9  ? V4L2_PIX_FMT_VP9
                     : codec == webrtc::kVideoCodecH264 ? V4L2_PIX_FMT_H264
@@ -45,7 +50,7 @@ JetsonVideoDecoder::JetsonVideoDecoder(webrtc::VideoCodecType codec)
                                                        : 0),
       decoder_(nullptr),
       decode_complete_callback_(nullptr),
-      buffer_pool_(false, 300 /* max_number_of_buffers*/),
+      buffer_pool_(max_frame_buffers, allocator),
       eos_(false),
       got_error_(false),
       dst_dma_fd_(-1) {}
@@ -248,6 +253,7 @@ void JetsonVideoDecoder::SendEOS(NvV4l2Element* element) {
 
 void JetsonVideoDecoder::CaptureLoopFunction(void* obj) {
   JetsonVideoDecoder* _this = static_cast<JetsonVideoDecoder*>(obj);
+  RegisterCurrentThread(SoraThreadRole::kDecoder);
   _this->CaptureLoop();
 }
 
@@ -330,15 +336,20 @@ void JetsonVideoDecoder::CaptureLoop() {
         break;
       }
 
-      rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
+      rtc::scoped_refptr<AllocatedI420Buffer> i420_buffer =
           buffer_pool_.CreateI420Buffer(capture_crop_->c.width,
                                         capture_crop_->c.height);
       if (!i420_buffer.get()) {
-        // Pool has too many pending frames.
-        RTC_HISTOGRAM_BOOLEAN(
-            "WebRTC.Video.LibvpxVp8Decoder.TooManyPendingFrames", 1);
-        got_error_ = true;
-        break;
+        // 出力バッファの数かメモリの上限に達しているので、このフレームだけ捨てる。
+        // 上限は一時的なものなので、デコードは止めずにキャプチャのバッファを戻して続ける。
+        AddDecoderFrameDropped();
+        if (decoder_->capture_plane.qBuffer(v4l2_buf, NULL) < 0) {
+          RTC_LOG(LS_ERROR) << __FUNCTION__
+                            << "Failed to qBuffer at capture_plane";
+          got_error_ = true;
+          break;
+        }
+        continue;
       }
 
       NvBufferParams parm;
@@ -5,7 +5,6 @@
 
 // WebRTC
 #include <api/video_codecs/video_decoder.h>
-#include <common_video/include/video_frame_buffer_pool.h>
 #include <modules/video_coding/include/video_error_codes.h>
 #include <rtc_base/checks.h>
 #include <rtc_base/logging.h>
@@ -20,12 +19,16 @@
 
 #include "msdk_session_impl.h"
 #include "msdk_utils.h"
+#include "sora/memory_stats.h"
 
 namespace sora {
 
 class MsdkVideoDecoderImpl : public MsdkVideoDecoder {
  public:
-  MsdkVideoDecoderImpl(std::shared_ptr<MsdkSession> session, mfxU32 codec);
+  MsdkVideoDecoderImpl(std::shared_ptr<MsdkSession> session,
+                       mfxU32 codec,
+                       std::shared_ptr<FrameBufferAllocator> allocator,
+                       size_t max_frame_buffers);
   ~MsdkVideoDecoderImpl() override;
 
   bool Configure(const Settings& settings) override;
@@ -55,7 +58,7 @@ class MsdkVideoDecoderImpl : public MsdkVideoDecoder {
   int width_ = 0;
   int height_ = 0;
   webrtc::DecodedImageCallback* decode_complete_callback_ = nullptr;
-  webrtc::VideoFrameBufferPool buffer_pool_;
+  FrameBufferPool buffer_pool_;
 
   mfxU32 codec_;
   std::shared_ptr<MsdkSession> session_;
@@ -67,13 +70,16 @@ class MsdkVideoDecoderImpl : public MsdkVideoDecoder {
   mfxBitstream bitstream_;
 };
 
-MsdkVideoDecoderImpl::MsdkVideoDecoderImpl(std::shared_ptr<MsdkSession> session,
-                                           mfxU32 codec)
+MsdkVideoDecoderImpl::MsdkVideoDecoderImpl(
+    std::shared_ptr<MsdkSession> session,
+    mfxU32 codec,
+    std::shared_ptr<FrameBufferAllocator> allocator,
+    size_t max_frame_buffers)
     : session_(session),
       codec_(codec),
       decoder_(nullptr),
       decode_complete_callback_(nullptr),
-      buffer_pool_(false, 300 /* max_number_of_buffers*/) {}
+      buffer_pool_(max_frame_buffers, allocator) {}
 
 MsdkVideoDecoderImpl::~MsdkVideoDecoderImpl() {
   Release();
@@ -231,8 +237,13 @@ int32_t MsdkVideoDecoderImpl::Decode(const webrtc::EncodedImage& input_image,
   MSDK_CHECK_RESULT(sts, MFX_ERR_NONE, sts);
 
   // NV12 から I420 に変換
-  rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
+  rtc::scoped_refptr<AllocatedI420Buffer> i420_buffer =
       buffer_pool_.CreateI420Buffer(width_, height_);
+  if (i420_buffer == nullptr) {
+    // 出力バッファの数かメモリの上限に達しているので、このフレームだけ捨てる
+    AddDecoderFrameDropped();
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
   libyuv::NV12ToI420(out_surface->Data.Y, out_surface->Data.Pitch,
                      out_surface->Data.UV, out_surface->Data.Pitch,
                      i420_buffer->MutableDataY(), i420_buffer->StrideY(),
@@ -346,9 +357,11 @@ bool MsdkVideoDecoder::IsSupported(std::shared_ptr<MsdkSession> session,
 
 std::unique_ptr<MsdkVideoDecoder> MsdkVideoDecoder::Create(
     std::shared_ptr<MsdkSession> session,
-    webrtc::VideoCodecType codec) {
-  return std::unique_ptr<MsdkVideoDecoder>(
-      new MsdkVideoDecoderImpl(session, ToMfxCodec(codec)));
+    webrtc::VideoCodecType codec,
+    std::shared_ptr<FrameBufferAllocator> allocator,
+    size_t max_frame_buffers) {
+  return std::unique_ptr<MsdkVideoDecoder>(new MsdkVideoDecoderImpl(
+      session, ToMfxCodec(codec), allocator, max_frame_buffers));
 }
 
 }  // namespace sora
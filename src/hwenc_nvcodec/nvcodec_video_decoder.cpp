@@ -9,15 +9,19 @@
 
 #include "sora/dyn/cuda.h"
 #include "sora/dyn/nvcuvid.h"
+#include "sora/memory_stats.h"
 
 namespace sora {
 
-NvCodecVideoDecoder::NvCodecVideoDecoder(std::shared_ptr<CudaContext> ctx,
-                                         CudaVideoCodec codec)
+NvCodecVideoDecoder::NvCodecVideoDecoder(
+    std::shared_ptr<CudaContext> ctx,
+    CudaVideoCodec codec,
+    std::shared_ptr<FrameBufferAllocator> allocator,
+    size_t max_frame_buffers)
     : context_(ctx),
       codec_(codec),
       decode_complete_callback_(nullptr),
-      buffer_pool_(false, 300 /* max_number_of_buffers*/) {}
+      buffer_pool_(max_frame_buffers, allocator) {}
 
 NvCodecVideoDecoder::~NvCodecVideoDecoder() {
   Release();
@@ -90,9 +94,15 @@ int32_t NvCodecVideoDecoder::Decode(const webrtc::EncodedImage& input_image,
   for (int i = 0; i < frame_count; i++) {
     const auto* frame = decoder_->GetFrame();
     // NV12 から I420 に変換
-    rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
+    rtc::scoped_refptr<AllocatedI420Buffer> i420_buffer =
         buffer_pool_.CreateI420Buffer(decoder_->GetWidth(),
                                       decoder_->GetHeight());
+    if (i420_buffer == nullptr) {
+      // 出力バッファの数かメモリの上限に達しているので、このフレームだけ捨てる
+      AddDecoderFrameDropped();
+      decoder_->setReconfigParams();
+      continue;
+    }
     libyuv::NV12ToI420(
         frame, decoder_->GetDeviceFramePitch(),
         frame + decoder_->GetHeight() * decoder_->GetDeviceFramePitch(),
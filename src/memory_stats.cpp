@@ -0,0 +1,60 @@
+#include "sora/memory_stats.h"
+
+#include <atomic>
+
+namespace sora {
+
+static std::atomic<int64_t> g_frame_buffer_bytes(0);
+static std::atomic<int64_t> g_frame_buffer_count(0);
+static std::atomic<int64_t> g_video_encoder_count(0);
+static std::atomic<int64_t> g_video_decoder_count(0);
+static std::atomic<uint64_t> g_frame_buffer_pool_exhausted_count(0);
+static std::atomic<uint64_t> g_frame_buffer_allocation_failed_count(0);
+static std::atomic<uint64_t> g_decoder_frame_dropped_count(0);
+
+SoraMemoryStats GetSoraMemoryStats() {
+  SoraMemoryStats stats;
+  stats.frame_buffer_bytes = g_frame_buffer_bytes.load();
+  stats.frame_buffer_count = g_frame_buffer_count.load();
+  stats.video_encoder_count = g_video_encoder_count.load();
+  stats.video_decoder_count = g_video_decoder_count.load();
+  stats.frame_buffer_pool_exhausted_count =
+      g_frame_buffer_pool_exhausted_count.load();
+  stats.frame_buffer_allocation_failed_count =
+      g_frame_buffer_allocation_failed_count.load();
+  stats.decoder_frame_dropped_count = g_decoder_frame_dropped_count.load();
+  return stats;
+}
+
+void AddFrameBufferAllocation(int64_t bytes) {
+  g_frame_buffer_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  g_frame_buffer_count.fetch_add(1, std::memory_order_relaxed);
+}
+void RemoveFrameBufferAllocation(int64_t bytes) {
+  g_frame_buffer_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+  g_frame_buffer_count.fetch_sub(1, std::memory_order_relaxed);
+}
+void AddVideoEncoderInstance() {
+  g_video_encoder_count.fetch_add(1, std::memory_order_relaxed);
+}
+void RemoveVideoEncoderInstance() {
+  g_video_encoder_count.fetch_sub(1, std::memory_order_relaxed);
+}
+void AddVideoDecoderInstance() {
+  g_video_decoder_count.fetch_add(1, std::memory_order_relaxed);
+}
+void RemoveVideoDecoderInstance() {
+  g_video_decoder_count.fetch_sub(1, std::memory_order_relaxed);
+}
+void AddFrameBufferPoolExhausted() {
+  g_frame_buffer_pool_exhausted_count.fetch_add(1, std::memory_order_relaxed);
+}
+void AddFrameBufferAllocationFailed() {
+  g_frame_buffer_allocation_failed_count.fetch_add(1,
+                                                   std::memory_order_relaxed);
+}
+void AddDecoderFrameDropped() {
+  g_decoder_frame_dropped_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace sora
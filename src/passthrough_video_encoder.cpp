@@ -0,0 +1,190 @@
+#include "passthrough_video_encoder.h"
+
+#include <algorithm>
+
+// WebRTC
+#include <modules/video_coding/include/video_codec_interface.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/logging.h>
+
+#include "sora/encoded_frame_buffer.h"
+
+namespace sora {
+
+std::unique_ptr<webrtc::VideoEncoder> PassthroughVideoEncoder::Create(
+    std::unique_ptr<webrtc::VideoEncoder> fallback) {
+  return std::unique_ptr<webrtc::VideoEncoder>(
+      new PassthroughVideoEncoder(std::move(fallback)));
+}
+
+PassthroughVideoEncoder::PassthroughVideoEncoder(
+    std::unique_ptr<webrtc::VideoEncoder> fallback)
+    : fallback_(std::move(fallback)) {}
+
+void PassthroughVideoEncoder::SetFecControllerOverride(
+    webrtc::FecControllerOverride* fec_controller_override) {
+  if (fallback_ != nullptr) {
+    fallback_->SetFecControllerOverride(fec_controller_override);
+  }
+}
+
+int PassthroughVideoEncoder::InitEncode(
+    const webrtc::VideoCodec* codec_settings,
+    const webrtc::VideoEncoder::Settings& settings) {
+  mode_ = codec_settings->mode;
+  has_frame_number_ = false;
+  waiting_for_key_frame_ = true;
+
+  fallback_initialized_ = false;
+  if (fallback_ != nullptr) {
+    int r = fallback_->InitEncode(codec_settings, settings);
+    if (r == WEBRTC_VIDEO_CODEC_OK) {
+      fallback_initialized_ = true;
+    } else {
+      // パススルーだけでも送れるので、エラーにはしない
+      RTC_LOG(LS_WARNING) << "Failed to initialize fallback encoder: " << r;
+    }
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t PassthroughVideoEncoder::RegisterEncodeCompleteCallback(
+    webrtc::EncodedImageCallback* callback) {
+  callback_ = callback;
+  if (fallback_ != nullptr) {
+    fallback_->RegisterEncodeCompleteCallback(callback);
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t PassthroughVideoEncoder::Release() {
+  fallback_initialized_ = false;
+  if (fallback_ != nullptr) {
+    fallback_->Release();
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t PassthroughVideoEncoder::Encode(
+    const webrtc::VideoFrame& frame,
+    const std::vector<webrtc::VideoFrameType>* frame_types) {
+  rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+      frame.video_frame_buffer();
+  EncodedFrameBuffer* encoded = EncodedFrameBuffer::From(buffer.get());
+  if (encoded == nullptr) {
+    passthrough_ = false;
+    if (!fallback_initialized_) {
+      RTC_LOG(LS_ERROR) << "Passthrough encoder received a raw frame";
+      return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+    return fallback_->Encode(frame, frame_types);
+  }
+
+  passthrough_ = true;
+  if (callback_ == nullptr) {
+    return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+  }
+
+  bool key_frame_requested =
+      frame_types != nullptr &&
+      std::find(frame_types->begin(), frame_types->end(),
+                webrtc::VideoFrameType::kVideoFrameKey) != frame_types->end();
+
+  // WebRTC 側でフレームが間引かれた場合、この後のフレームは参照先が欠けているので
+  // 次のキーフレームまで送らない
+  if (has_frame_number_ &&
+      encoded->frame_number() != last_frame_number_ + 1) {
+    waiting_for_key_frame_ = true;
+  }
+  has_frame_number_ = true;
+  last_frame_number_ = encoded->frame_number();
+  if (encoded->is_key_frame()) {
+    waiting_for_key_frame_ = false;
+  } else if (waiting_for_key_frame_ || key_frame_requested) {
+    encoded->RequestKeyFrame();
+  }
+  if (waiting_for_key_frame_) {
+    callback_->OnDroppedFrame(
+        webrtc::EncodedImageCallback::DropReason::kDroppedByEncoder);
+    return WEBRTC_VIDEO_CODEC_OK;
+  }
+
+  webrtc::EncodedImage image;
+  image.SetEncodedData(encoded->data());
+  image._encodedWidth = encoded->width();
+  image._encodedHeight = encoded->height();
+  image.content_type_ = mode_ == webrtc::VideoCodecMode::kScreensharing
+                            ? webrtc::VideoContentType::SCREENSHARE
+                            : webrtc::VideoContentType::UNSPECIFIED;
+  image.timing_.flags = webrtc::VideoSendTiming::kInvalid;
+  image.SetTimestamp(frame.timestamp());
+  image.ntp_time_ms_ = frame.ntp_time_ms();
+  image.capture_time_ms_ = frame.render_time_ms();
+  image.rotation_ = frame.rotation();
+  image.SetColorSpace(frame.color_space());
+  image._frameType = encoded->is_key_frame()
+                         ? webrtc::VideoFrameType::kVideoFrameKey
+                         : webrtc::VideoFrameType::kVideoFrameDelta;
+
+  webrtc::CodecSpecificInfo codec_specific;
+  codec_specific.codecType = webrtc::kVideoCodecH264;
+  codec_specific.codecSpecific.H264.packetization_mode =
+      webrtc::H264PacketizationMode::NonInterleaved;
+  codec_specific.codecSpecific.H264.idr_frame = encoded->is_key_frame();
+
+  webrtc::EncodedImageCallback::Result result =
+      callback_->OnEncodedImage(image, &codec_specific);
+  if (result.error != webrtc::EncodedImageCallback::Result::OK) {
+    RTC_LOG(LS_ERROR) << __FUNCTION__
+                      << " OnEncodedImage failed error:" << result.error;
+    return WEBRTC_VIDEO_CODEC_ERROR;
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+void PassthroughVideoEncoder::SetRates(
+    const RateControlParameters& parameters) {
+  // パススルーの場合、ビットレートは送信元が決めるので何もできない
+  if (fallback_initialized_) {
+    fallback_->SetRates(parameters);
+  }
+}
+
+void PassthroughVideoEncoder::OnPacketLossRateUpdate(float packet_loss_rate) {
+  if (fallback_initialized_) {
+    fallback_->OnPacketLossRateUpdate(packet_loss_rate);
+  }
+}
+
+void PassthroughVideoEncoder::OnRttUpdate(int64_t rtt_ms) {
+  if (fallback_initialized_) {
+    fallback_->OnRttUpdate(rtt_ms);
+  }
+}
+
+void PassthroughVideoEncoder::OnLossNotification(
+    const LossNotification& loss_notification) {
+  if (fallback_initialized_) {
+    fallback_->OnLossNotification(loss_notification);
+  }
+}
+
+webrtc::VideoEncoder::EncoderInfo PassthroughVideoEncoder::GetEncoderInfo()
+    const {
+  webrtc::VideoEncoder::EncoderInfo info;
+  if (fallback_ != nullptr) {
+    info = fallback_->GetEncoderInfo();
+  }
+  // EncodedFrameBuffer をそのまま受け取るために必要
+  info.supports_native_handle = true;
+  if (passthrough_ || fallback_ == nullptr) {
+    info.implementation_name = "Passthrough";
+    // ビットレートも解像度も送信元が決めるので、
+    // WebRTC 側のフレームの間引きと品質に応じた解像度の調整を止める
+    info.has_trusted_rate_controller = true;
+    info.scaling_settings = webrtc::VideoEncoder::ScalingSettings::kOff;
+  }
+  return info;
+}
+
+}  // namespace sora
@@ -0,0 +1,61 @@
+#ifndef SORA_PASSTHROUGH_VIDEO_ENCODER_H_
+#define SORA_PASSTHROUGH_VIDEO_ENCODER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+// WebRTC
+#include <api/video/video_frame.h>
+#include <api/video_codecs/video_codec.h>
+#include <api/video_codecs/video_encoder.h>
+
+namespace sora {
+
+// EncodedFrameBuffer のフレームはエンコードせずにそのまま送り、
+// それ以外のフレーム (ハードウェアエンコーダ向けの kNative のフレームを含む) は
+// fallback に渡して普通にエンコードする H.264 のエンコーダ。
+class PassthroughVideoEncoder : public webrtc::VideoEncoder {
+ public:
+  // fallback は nullptr でも良い。
+  // その場合、EncodedFrameBuffer 以外のフレームはエラーになる。
+  static std::unique_ptr<webrtc::VideoEncoder> Create(
+      std::unique_ptr<webrtc::VideoEncoder> fallback);
+
+  PassthroughVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> fallback);
+
+  void SetFecControllerOverride(
+      webrtc::FecControllerOverride* fec_controller_override) override;
+  int InitEncode(const webrtc::VideoCodec* codec_settings,
+                 const webrtc::VideoEncoder::Settings& settings) override;
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback* callback) override;
+  int32_t Release() override;
+  int32_t Encode(const webrtc::VideoFrame& frame,
+                 const std::vector<webrtc::VideoFrameType>* frame_types)
+      override;
+  void SetRates(const RateControlParameters& parameters) override;
+  void OnPacketLossRateUpdate(float packet_loss_rate) override;
+  void OnRttUpdate(int64_t rtt_ms) override;
+  void OnLossNotification(const LossNotification& loss_notification) override;
+  EncoderInfo GetEncoderInfo() const override;
+
+ private:
+  std::unique_ptr<webrtc::VideoEncoder> fallback_;
+  bool fallback_initialized_ = false;
+  webrtc::EncodedImageCallback* callback_ = nullptr;
+  webrtc::VideoCodecMode mode_ = webrtc::VideoCodecMode::kRealtimeVideo;
+
+  // 最後に EncodedFrameBuffer を受け取ったかどうか。
+  // GetEncoderInfo() はどちらの経路で送っているかによって返す値を変える。
+  bool passthrough_ = false;
+  bool has_frame_number_ = false;
+  uint64_t last_frame_number_ = 0;
+  // フレームが飛んだので、次のキーフレームまで送信を止めている
+  bool waiting_for_key_frame_ = true;
+};
+
+}  // namespace sora
+
+#endif
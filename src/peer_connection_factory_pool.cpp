@@ -0,0 +1,200 @@
+#include "sora/peer_connection_factory_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/ssl_adapter.h>
+
+#include "sora/sora_peer_connection_factory.h"
+#include "sora/thread_config.h"
+
+namespace sora {
+
+// ThreadCpuUsage でシャードのスレッドを集計するための owner。
+// owner はプロセス全体で共有されるので、複数のプールを作っても混ざらないようにプールの ID を付ける
+static std::string GetShardOwner(int pool_id, int index) {
+  return "pool_" + std::to_string(pool_id) + "/shard_" + std::to_string(index);
+}
+
+static std::atomic<int> g_next_pool_id(0);
+
+PeerConnectionFactoryLease::PeerConnectionFactoryLease(
+    std::shared_ptr<PeerConnectionFactoryPool> pool,
+    int shard_index,
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory)
+    : pool_(pool), shard_index_(shard_index), factory_(factory) {}
+
+PeerConnectionFactoryLease::~PeerConnectionFactoryLease() {
+  pool_->Release(shard_index_);
+}
+
+std::shared_ptr<PeerConnectionFactoryPool> PeerConnectionFactoryPool::Create(
+    PeerConnectionFactoryPoolConfig config) {
+  std::shared_ptr<PeerConnectionFactoryPool> pool(
+      new PeerConnectionFactoryPool(config));
+  if (!pool->Init()) {
+    RTC_LOG(LS_ERROR) << "Failed to create PeerConnectionFactoryPool";
+    return nullptr;
+  }
+  return pool;
+}
+
+PeerConnectionFactoryPool::PeerConnectionFactoryPool(
+    PeerConnectionFactoryPoolConfig config)
+    : config_(config), pool_id_(g_next_pool_id.fetch_add(1)) {}
+
+PeerConnectionFactoryPool::~PeerConnectionFactoryPool() {
+  // ファクトリを解放してからスレッドを止める
+  for (auto& shard : shards_) {
+    shard->factory = nullptr;
+    shard->connection_context = nullptr;
+  }
+  shards_.clear();
+}
+
+bool PeerConnectionFactoryPool::Init() {
+  int shard_count = config_.shard_count;
+  if (shard_count <= 0) {
+    shard_count =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+  }
+
+  rtc::InitializeSSL();
+
+  for (int i = 0; i < shard_count; i++) {
+    std::unique_ptr<Shard> shard(new Shard());
+    if (!CreateShard(i, shard.get())) {
+      RTC_LOG(LS_ERROR) << "Failed to create shard: index=" << i;
+      return false;
+    }
+    shards_.push_back(std::move(shard));
+
+    PeerConnectionFactoryShardStats stats;
+    stats.index = i;
+    webrtc::MutexLock lock(&mutex_);
+    stats_.push_back(stats);
+  }
+
+  RTC_LOG(LS_INFO) << "PeerConnectionFactoryPool: shard_count=" << shard_count;
+  return true;
+}
+
+bool PeerConnectionFactoryPool::CreateShard(int index, Shard* shard) {
+  std::vector<int> cpu_affinity;
+  if (index < static_cast<int>(config_.shard_cpu_affinity.size())) {
+    cpu_affinity = config_.shard_cpu_affinity[index];
+  }
+  auto thread_config = [index, &cpu_affinity](const std::string& name) {
+    ThreadConfig config;
+    config.name = name + "_" + std::to_string(index);
+    config.cpu_affinity = cpu_affinity;
+    return config;
+  };
+
+  shard->network_thread = rtc::Thread::CreateWithSocketServer();
+  shard->worker_thread = rtc::Thread::Create();
+  shard->signaling_thread = rtc::Thread::Create();
+  // CPU 使用率をシャードごとに集計できるように、シャードを owner にする
+  std::string owner = GetShardOwner(pool_id_, index);
+  if (!StartThreadWithConfig(shard->network_thread.get(),
+                             thread_config("network_thread"),
+                             SoraThreadRole::kNetwork, owner) ||
+      !StartThreadWithConfig(shard->worker_thread.get(),
+                             thread_config("worker_thread"),
+                             SoraThreadRole::kWorker, owner) ||
+      !StartThreadWithConfig(shard->signaling_thread.get(),
+                             thread_config("signaling_thread"),
+                             SoraThreadRole::kSignaling, owner)) {
+    return false;
+  }
+
+  SoraPeerConnectionFactoryDependenciesConfig dependencies_config;
+  dependencies_config.network_thread = shard->network_thread.get();
+  dependencies_config.worker_thread = shard->worker_thread.get();
+  dependencies_config.signaling_thread = shard->signaling_thread.get();
+  dependencies_config.use_audio_device = false;
+  dependencies_config.use_hardware_encoder = config_.use_hardware_encoder;
+  dependencies_config.use_passthrough_encoder = config_.use_passthrough_encoder;
+  dependencies_config.use_pipelined_encoder = config_.use_pipelined_encoder;
+  dependencies_config.audio_only = config_.audio_only;
+  dependencies_config.opus_complexity = config_.opus_complexity;
+  dependencies_config.dav1d_decoder_config = config_.dav1d_decoder_config;
+  dependencies_config.decoder_frame_buffer_allocator =
+      config_.decoder_frame_buffer_allocator;
+  dependencies_config.max_decoder_frame_buffers =
+      config_.max_decoder_frame_buffers;
+  webrtc::PeerConnectionFactoryDependencies dependencies =
+      CreateSoraPeerConnectionFactoryDependencies(dependencies_config);
+
+  if (config_.configure_dependencies) {
+    config_.configure_dependencies(index, dependencies);
+  }
+
+  shard->factory = sora::CreateModularPeerConnectionFactoryWithContext(
+      std::move(dependencies), shard->connection_context);
+  if (shard->factory == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to create PeerConnectionFactory";
+    return false;
+  }
+
+  SetSoraPeerConnectionFactoryOptions(shard->factory);
+  return true;
+}
+
+std::shared_ptr<PeerConnectionFactoryLease> PeerConnectionFactoryPool::Place(
+    const std::string& channel_id) {
+  int index = 0;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    if (config_.placement ==
+        PeerConnectionFactoryPlacementPolicy::kHashChannelId) {
+      index = static_cast<int>(std::hash<std::string>()(channel_id) %
+                               stats_.size());
+    } else {
+      for (size_t i = 1; i < stats_.size(); i++) {
+        if (stats_[i].sessions < stats_[index].sessions) {
+          index = static_cast<int>(i);
+        }
+      }
+    }
+    stats_[index].sessions += 1;
+    stats_[index].total_sessions += 1;
+  }
+  return std::shared_ptr<PeerConnectionFactoryLease>(
+      new PeerConnectionFactoryLease(shared_from_this(), index,
+                                     shards_[index]->factory));
+}
+
+void PeerConnectionFactoryPool::Release(int shard_index) {
+  webrtc::MutexLock lock(&mutex_);
+  stats_[shard_index].sessions -= 1;
+}
+
+std::vector<PeerConnectionFactoryShardStats>
+PeerConnectionFactoryPool::GetStats() const {
+  ThreadCpuUsageReport report;
+  bool sampled;
+  {
+    webrtc::MutexLock lock(&cpu_usage_mutex_);
+    sampled = cpu_usage_.Sample(&report);
+  }
+
+  std::vector<PeerConnectionFactoryShardStats> stats;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    stats = stats_;
+  }
+  if (sampled) {
+    for (auto& s : stats) {
+      // CreateShard() で owner を付けて登録している
+      auto it = report.owners.find(GetShardOwner(pool_id_, s.index));
+      s.cpu_usage = it != report.owners.end() ? it->second : 0;
+    }
+  }
+  return stats;
+}
+
+}  // namespace sora
@@ -0,0 +1,244 @@
+#include "pipelined_video_encoder.h"
+
+// WebRTC
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame_buffer.h>
+#include <rtc_base/logging.h>
+
+#include "sora/thread_config.h"
+
+namespace sora {
+
+std::unique_ptr<webrtc::VideoEncoder> PipelinedVideoEncoder::WrapIfSoftware(
+    std::unique_ptr<webrtc::VideoEncoder> encoder) {
+  if (encoder == nullptr) {
+    return nullptr;
+  }
+  // ハードウェアエンコーダは既に別スレッドで非同期にエンコードしているので何もしない
+  auto info = encoder->GetEncoderInfo();
+  if (info.is_hardware_accelerated || info.supports_native_handle) {
+    return encoder;
+  }
+  return std::unique_ptr<webrtc::VideoEncoder>(
+      new PipelinedVideoEncoder(std::move(encoder)));
+}
+
+PipelinedVideoEncoder::PipelinedVideoEncoder(
+    std::unique_ptr<webrtc::VideoEncoder> encoder)
+    : encoder_(std::move(encoder)), encode_thread_(rtc::Thread::Create()) {
+  if (!StartThreadWithConfig(encode_thread_.get(),
+                             ThreadConfig{"PipelinedEncodeThread"},
+                             SoraThreadRole::kEncoder)) {
+    RTC_LOG(LS_ERROR) << "Failed to start PipelinedEncodeThread";
+  }
+  encoder_info_ = encoder_->GetEncoderInfo();
+}
+
+PipelinedVideoEncoder::~PipelinedVideoEncoder() {
+  Release();
+  encode_thread_->Stop();
+}
+
+void PipelinedVideoEncoder::SetFecControllerOverride(
+    webrtc::FecControllerOverride* fec_controller_override) {
+  encode_thread_->Invoke<void>(
+      RTC_FROM_HERE, [this, fec_controller_override]() {
+        encoder_->SetFecControllerOverride(fec_controller_override);
+      });
+}
+
+int PipelinedVideoEncoder::InitEncode(
+    const webrtc::VideoCodec* codec_settings,
+    const webrtc::VideoEncoder::Settings& settings) {
+  {
+    webrtc::MutexLock lock(&mutex_);
+    pending_.reset();
+    last_error_ = WEBRTC_VIDEO_CODEC_OK;
+  }
+  // サイマルキャストの場合はエンコーダ側でリサイズするので、ここではリサイズしない
+  if (codec_settings->numberOfSimulcastStreams <= 1) {
+    width_ = codec_settings->width;
+    height_ = codec_settings->height;
+  } else {
+    width_ = 0;
+    height_ = 0;
+  }
+  return encode_thread_->Invoke<int>(RTC_FROM_HERE, [&]() {
+    int r = encoder_->InitEncode(codec_settings, settings);
+    UpdateEncoderInfo();
+    return r;
+  });
+}
+
+int32_t PipelinedVideoEncoder::RegisterEncodeCompleteCallback(
+    webrtc::EncodedImageCallback* callback) {
+  {
+    webrtc::MutexLock lock(&mutex_);
+    callback_ = callback;
+  }
+  return encode_thread_->Invoke<int32_t>(RTC_FROM_HERE, [this, callback]() {
+    return encoder_->RegisterEncodeCompleteCallback(callback);
+  });
+}
+
+int32_t PipelinedVideoEncoder::Release() {
+  {
+    webrtc::MutexLock lock(&mutex_);
+    pending_.reset();
+    last_error_ = WEBRTC_VIDEO_CODEC_OK;
+  }
+  return encode_thread_->Invoke<int32_t>(
+      RTC_FROM_HERE, [this]() { return encoder_->Release(); });
+}
+
+int32_t PipelinedVideoEncoder::Encode(
+    const webrtc::VideoFrame& frame,
+    const std::vector<webrtc::VideoFrameType>* frame_types) {
+  {
+    webrtc::MutexLock lock(&mutex_);
+    if (last_error_ != WEBRTC_VIDEO_CODEC_OK) {
+      int32_t r = last_error_;
+      last_error_ = WEBRTC_VIDEO_CODEC_OK;
+      return r;
+    }
+  }
+
+  PendingFrame pending{Preprocess(frame),
+                       frame_types != nullptr
+                           ? *frame_types
+                           : std::vector<webrtc::VideoFrameType>()};
+
+  webrtc::EncodedImageCallback* dropped_callback = nullptr;
+  bool post = false;
+  {
+    webrtc::MutexLock lock(&mutex_);
+    if (pending_) {
+      // エンコードが追いついていないので古いフレームを捨てる。
+      // ただしキーフレーム要求は引き継ぐ。
+      const auto& old_types = pending_->frame_types;
+      for (size_t i = 0;
+           i < old_types.size() && i < pending.frame_types.size(); i++) {
+        if (old_types[i] == webrtc::VideoFrameType::kVideoFrameKey) {
+          pending.frame_types[i] = webrtc::VideoFrameType::kVideoFrameKey;
+        }
+      }
+      if (pending.frame_types.empty()) {
+        pending.frame_types = old_types;
+      }
+      dropped_callback = callback_;
+    }
+    pending_ = std::move(pending);
+    if (!encoding_) {
+      encoding_ = true;
+      post = true;
+    }
+  }
+  if (dropped_callback != nullptr) {
+    dropped_callback->OnDroppedFrame(
+        webrtc::EncodedImageCallback::DropReason::kDroppedByEncoder);
+  }
+  if (post) {
+    encode_thread_->PostTask([this]() { DoEncode(); });
+  }
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+void PipelinedVideoEncoder::SetRates(const RateControlParameters& parameters) {
+  // エンコード中のフレームを待たないように、コピーして非同期で反映する
+  encode_thread_->PostTask([this, parameters]() {
+    encoder_->SetRates(parameters);
+    UpdateEncoderInfo();
+  });
+}
+
+void PipelinedVideoEncoder::OnPacketLossRateUpdate(float packet_loss_rate) {
+  encode_thread_->PostTask([this, packet_loss_rate]() {
+    encoder_->OnPacketLossRateUpdate(packet_loss_rate);
+  });
+}
+
+void PipelinedVideoEncoder::OnRttUpdate(int64_t rtt_ms) {
+  encode_thread_->PostTask(
+      [this, rtt_ms]() { encoder_->OnRttUpdate(rtt_ms); });
+}
+
+void PipelinedVideoEncoder::OnLossNotification(
+    const LossNotification& loss_notification) {
+  encode_thread_->PostTask([this, loss_notification]() {
+    encoder_->OnLossNotification(loss_notification);
+  });
+}
+
+webrtc::VideoEncoder::EncoderInfo PipelinedVideoEncoder::GetEncoderInfo()
+    const {
+  // エンコード中にブロックしないように、エンコードスレッドで取得した値を返す
+  webrtc::MutexLock lock(&mutex_);
+  return encoder_info_;
+}
+
+webrtc::VideoFrame PipelinedVideoEncoder::Preprocess(
+    const webrtc::VideoFrame& frame) const {
+  rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+      frame.video_frame_buffer();
+  if (buffer->type() != webrtc::VideoFrameBuffer::Type::kI420 &&
+      buffer->type() != webrtc::VideoFrameBuffer::Type::kI420A) {
+    rtc::scoped_refptr<webrtc::I420BufferInterface> i420 = buffer->ToI420();
+    if (i420 == nullptr) {
+      RTC_LOG(LS_WARNING) << "Failed to convert to I420";
+      return frame;
+    }
+    buffer = i420;
+  }
+  if (width_ > 0 && height_ > 0 &&
+      (buffer->width() != width_ || buffer->height() != height_)) {
+    rtc::scoped_refptr<webrtc::I420Buffer> scaled =
+        webrtc::I420Buffer::Create(width_, height_);
+    scaled->ScaleFrom(*buffer->GetI420());
+    buffer = scaled;
+  }
+  if (buffer == frame.video_frame_buffer()) {
+    return frame;
+  }
+  webrtc::VideoFrame r = frame;
+  r.set_video_frame_buffer(buffer);
+  if (buffer->width() != frame.width() || buffer->height() != frame.height()) {
+    // 元のフレームの座標の更新領域はスケール後のフレームでは意味が無いので、全体を更新したことにする
+    r.set_update_rect(webrtc::VideoFrame::UpdateRect{0, 0, buffer->width(),
+                                                     buffer->height()});
+  }
+  return r;
+}
+
+void PipelinedVideoEncoder::DoEncode() {
+  while (true) {
+    absl::optional<PendingFrame> pending;
+    {
+      webrtc::MutexLock lock(&mutex_);
+      if (!pending_) {
+        encoding_ = false;
+        return;
+      }
+      pending = std::move(pending_);
+      pending_.reset();
+    }
+    int32_t r = encoder_->Encode(
+        pending->frame,
+        pending->frame_types.empty() ? nullptr : &pending->frame_types);
+    if (r != WEBRTC_VIDEO_CODEC_OK) {
+      RTC_LOG(LS_WARNING) << "Failed to Encode: r=" << r;
+      if (r < 0) {
+        webrtc::MutexLock lock(&mutex_);
+        last_error_ = r;
+      }
+    }
+    UpdateEncoderInfo();
+  }
+}
+
+void PipelinedVideoEncoder::UpdateEncoderInfo() {
+  EncoderInfo info = encoder_->GetEncoderInfo();
+  webrtc::MutexLock lock(&mutex_);
+  encoder_info_ = std::move(info);
+}
+
+}  // namespace sora
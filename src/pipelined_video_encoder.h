@@ -0,0 +1,80 @@
+#ifndef SORA_PIPELINED_VIDEO_ENCODER_H_
+#define SORA_PIPELINED_VIDEO_ENCODER_H_
+
+#include <memory>
+#include <vector>
+
+// WebRTC
+#include <absl/types/optional.h>
+#include <api/video/video_frame.h>
+#include <api/video_codecs/video_codec.h>
+#include <api/video_codecs/video_encoder.h>
+#include <rtc_base/synchronization/mutex.h>
+#include <rtc_base/thread.h>
+
+namespace sora {
+
+// ソフトウェアエンコーダを専用のスレッドで動かして、
+// フレームの前処理（I420 への変換やリサイズ）とエンコードを並列に行うためのラッパー。
+//
+// 前処理は今まで通りエンコーダキューのスレッドで行い、エンコードは専用スレッドで行う。
+// そのため、フレーム N をエンコードしている間にフレーム N+1 の前処理ができるようになり、
+// 1 フレームあたりの処理時間が「前処理 + エンコード」から「max(前処理, エンコード)」に近づく。
+//
+// エンコード待ちのフレームは 1 つだけ保持し、エンコードが追いつかない場合は古い方を捨てる。
+class PipelinedVideoEncoder : public webrtc::VideoEncoder {
+ public:
+  // encoder がソフトウェアエンコーダの場合はラップしたエンコーダを返し、
+  // それ以外の場合は encoder をそのまま返す。
+  static std::unique_ptr<webrtc::VideoEncoder> WrapIfSoftware(
+      std::unique_ptr<webrtc::VideoEncoder> encoder);
+
+  PipelinedVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder);
+  ~PipelinedVideoEncoder() override;
+
+  void SetFecControllerOverride(
+      webrtc::FecControllerOverride* fec_controller_override) override;
+  int InitEncode(const webrtc::VideoCodec* codec_settings,
+                 const webrtc::VideoEncoder::Settings& settings) override;
+  int32_t RegisterEncodeCompleteCallback(
+      webrtc::EncodedImageCallback* callback) override;
+  int32_t Release() override;
+  int32_t Encode(const webrtc::VideoFrame& frame,
+                 const std::vector<webrtc::VideoFrameType>* frame_types)
+      override;
+  void SetRates(const RateControlParameters& parameters) override;
+  void OnPacketLossRateUpdate(float packet_loss_rate) override;
+  void OnRttUpdate(int64_t rtt_ms) override;
+  void OnLossNotification(const LossNotification& loss_notification) override;
+  EncoderInfo GetEncoderInfo() const override;
+
+ private:
+  struct PendingFrame {
+    webrtc::VideoFrame frame;
+    std::vector<webrtc::VideoFrameType> frame_types;
+  };
+
+  // エンコーダキューのスレッドで呼ばれる
+  webrtc::VideoFrame Preprocess(const webrtc::VideoFrame& frame) const;
+  // エンコードスレッドで呼ばれる
+  void DoEncode();
+  void UpdateEncoderInfo();
+
+  std::unique_ptr<webrtc::VideoEncoder> encoder_;
+  std::unique_ptr<rtc::Thread> encode_thread_;
+  int width_ = 0;
+  int height_ = 0;
+
+  mutable webrtc::Mutex mutex_;
+  absl::optional<PendingFrame> pending_ RTC_GUARDED_BY(mutex_);
+  bool encoding_ RTC_GUARDED_BY(mutex_) = false;
+  webrtc::EncodedImageCallback* callback_ RTC_GUARDED_BY(mutex_) = nullptr;
+  // エンコードスレッドでの Encode() の失敗。
+  // WebRTC がソフトウェアフォールバックなどを行えるように、次の Encode() で返す。
+  int32_t last_error_ RTC_GUARDED_BY(mutex_) = WEBRTC_VIDEO_CODEC_OK;
+  EncoderInfo encoder_info_ RTC_GUARDED_BY(mutex_);
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,36 @@
+#include "sora/process_memory.h"
+
+#include <fstream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace sora {
+
+int64_t GetProcessResidentMemory() {
+#if defined(__linux__)
+  // 2 番目の値が RSS のページ数
+  std::ifstream ifs("/proc/self/statm");
+  int64_t size = 0;
+  int64_t resident = 0;
+  if (!(ifs >> size >> resident)) {
+    return -1;
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+#elif defined(__APPLE__)
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+    return -1;
+  }
+  return static_cast<int64_t>(info.resident_size);
+#else
+  return -1;
+#endif
+}
+
+}  // namespace sora
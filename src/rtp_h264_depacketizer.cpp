@@ -0,0 +1,189 @@
+#include "rtp_h264_depacketizer.h"
+
+namespace sora {
+
+static const uint8_t kStartCode[] = {0, 0, 0, 1};
+
+static const uint8_t kNaluTypeIdr = 5;
+static const uint8_t kNaluTypeSps = 7;
+static const uint8_t kNaluTypePps = 8;
+static const uint8_t kNaluTypeStapA = 24;
+static const uint8_t kNaluTypeFuA = 28;
+
+// RFC 3550 の付録 A.1 と同じ値。
+// これ以上先のシーケンス番号はストリームが変わったものとして扱い、
+// これ以内の前のシーケンス番号は順序が入れ替わったものとして無視する。
+static const uint16_t kMaxDropout = 3000;
+static const uint16_t kMaxMisorder = 100;
+
+void RtpH264Depacketizer::InsertPacket(const uint8_t* data,
+                                       size_t size,
+                                       std::vector<AccessUnit>* units) {
+  // RTP ヘッダ
+  if (size < 12 || (data[0] >> 6) != 2) {
+    return;
+  }
+  bool padding = (data[0] & 0x20) != 0;
+  bool extension = (data[0] & 0x10) != 0;
+  size_t csrc_count = data[0] & 0x0f;
+  bool marker = (data[1] & 0x80) != 0;
+  uint16_t sequence_number = (data[2] << 8) | data[3];
+  uint32_t timestamp = (static_cast<uint32_t>(data[4]) << 24) |
+                       (data[5] << 16) | (data[6] << 8) | data[7];
+  uint32_t ssrc = (static_cast<uint32_t>(data[8]) << 24) | (data[9] << 16) |
+                  (data[10] << 8) | data[11];
+  size_t offset = 12 + csrc_count * 4;
+  if (extension) {
+    if (size < offset + 4) {
+      return;
+    }
+    offset += 4 + ((data[offset + 2] << 8) | data[offset + 3]) * 4;
+  }
+  if (padding && size > 0) {
+    size_t padding_size = data[size - 1];
+    if (size < padding_size) {
+      return;
+    }
+    size -= padding_size;
+  }
+  if (size <= offset) {
+    return;
+  }
+  const uint8_t* payload = data + offset;
+  size_t payload_size = size - offset;
+
+  if (has_sequence_number_ && ssrc != last_ssrc_) {
+    Reset(units);
+  }
+  bool lost = false;
+  if (has_sequence_number_ &&
+      sequence_number != static_cast<uint16_t>(last_sequence_number_ + 1)) {
+    uint16_t diff = sequence_number - last_sequence_number_;
+    if (diff == 0 || diff > static_cast<uint16_t>(-kMaxMisorder)) {
+      // 古いパケットや重複したパケットは無視する
+      return;
+    }
+    if (diff < kMaxDropout) {
+      packets_lost_ += diff - 1;
+      lost = true;
+    } else {
+      // カメラの再起動などでシーケンス番号が新しい乱数から始まった
+      Reset(units);
+    }
+  }
+  has_sequence_number_ = true;
+  last_sequence_number_ = sequence_number;
+  last_ssrc_ = ssrc;
+
+  if (has_current_ &&
+      (current_.timestamp != timestamp || current_.ssrc != ssrc)) {
+    // マーカービットのパケットが欠けていた。
+    // 欠けたパケットが前後どちらのアクセスユニットのものか分からないので、両方とも捨てる
+    corrupted_ = corrupted_ || lost;
+    Finish(units);
+  }
+  if (lost) {
+    corrupted_ = true;
+    in_fragment_ = false;
+  }
+  if (!has_current_) {
+    has_current_ = true;
+    current_.timestamp = timestamp;
+    current_.ssrc = ssrc;
+  }
+
+  uint8_t nalu_type = payload[0] & 0x1f;
+  if (nalu_type == kNaluTypeStapA) {
+    size_t pos = 1;
+    while (pos + 2 <= payload_size) {
+      size_t nalu_size = (payload[pos] << 8) | payload[pos + 1];
+      pos += 2;
+      if (nalu_size == 0 || pos + nalu_size > payload_size) {
+        corrupted_ = true;
+        break;
+      }
+      AppendNalu(payload + pos, nalu_size);
+      pos += nalu_size;
+    }
+  } else if (nalu_type == kNaluTypeFuA) {
+    if (payload_size < 3) {
+      corrupted_ = true;
+    } else {
+      bool start = (payload[1] & 0x80) != 0;
+      bool end = (payload[1] & 0x40) != 0;
+      if (start) {
+        uint8_t header = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+        AppendNalu(&header, 1);
+        in_fragment_ = true;
+      } else if (!in_fragment_) {
+        // 先頭の断片が欠けている
+        corrupted_ = true;
+      }
+      if (in_fragment_) {
+        auto& d = current_.data;
+        d.insert(d.end(), payload + 2, payload + payload_size);
+      }
+      if (end) {
+        in_fragment_ = false;
+      }
+    }
+  } else if (nalu_type >= 1 && nalu_type <= 23) {
+    AppendNalu(payload, payload_size);
+  } else {
+    // STAP-B, MTAP, FU-B はインターリーブモードでしか使わないので対応しない
+    corrupted_ = true;
+  }
+
+  if (marker) {
+    Finish(units);
+  }
+}
+
+void RtpH264Depacketizer::AppendNalu(const uint8_t* data, size_t size) {
+  uint8_t nalu_type = data[0] & 0x1f;
+  if (nalu_type == kNaluTypeIdr) {
+    current_.is_key_frame = true;
+  } else if (nalu_type == kNaluTypeSps) {
+    current_.sps.assign(data, data + size);
+  } else if (nalu_type == kNaluTypePps) {
+    current_.pps.assign(data, data + size);
+  }
+  auto& d = current_.data;
+  d.insert(d.end(), kStartCode, kStartCode + sizeof(kStartCode));
+  d.insert(d.end(), data, data + size);
+}
+
+void RtpH264Depacketizer::Finish(std::vector<AccessUnit>* units) {
+  if (in_fragment_) {
+    // 最後の断片が欠けている
+    corrupted_ = true;
+    in_fragment_ = false;
+  }
+  if (corrupted_ || current_.data.empty()) {
+    waiting_for_key_frame_ = true;
+  } else if (current_.is_key_frame) {
+    waiting_for_key_frame_ = false;
+  }
+
+  if (waiting_for_key_frame_) {
+    units_dropped_ += 1;
+  } else {
+    units->push_back(std::move(current_));
+  }
+  current_ = AccessUnit();
+  has_current_ = false;
+  corrupted_ = false;
+}
+
+void RtpH264Depacketizer::Reset(std::vector<AccessUnit>* units) {
+  if (has_current_) {
+    corrupted_ = true;
+    Finish(units);
+  }
+  in_fragment_ = false;
+  has_sequence_number_ = false;
+  // 新しいストリームは IDR から組み立て直す
+  waiting_for_key_frame_ = true;
+}
+
+}  // namespace sora
@@ -0,0 +1,63 @@
+#ifndef SORA_RTP_H264_DEPACKETIZER_H_
+#define SORA_RTP_H264_DEPACKETIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace sora {
+
+// RFC 6184 の RTP パケットから H.264 のアクセスユニットを組み立てるクラス。
+// 対応しているのは Single NAL Unit, STAP-A, FU-A のみ。
+//
+// パケットが欠けたアクセスユニットは捨てて、次の IDR が届くまで以降のアクセスユニットも捨てる。
+// SSRC が変わった場合やシーケンス番号が大きく飛んだ場合は、カメラが再起動したものとして
+// 組み立て中のアクセスユニットを捨てて、新しいストリームとして受信し直す。
+class RtpH264Depacketizer {
+ public:
+  struct AccessUnit {
+    uint32_t timestamp = 0;
+    uint32_t ssrc = 0;
+    bool is_key_frame = false;
+    // スタートコード付きの NAL を並べたもの
+    std::vector<uint8_t> data;
+    // このアクセスユニットに含まれていた SPS と PPS (NAL ヘッダを含む)
+    std::vector<uint8_t> sps;
+    std::vector<uint8_t> pps;
+  };
+
+  // パケットを 1 つ処理して、組み立て終わったアクセスユニットを units に追加する
+  void InsertPacket(const uint8_t* data,
+                    size_t size,
+                    std::vector<AccessUnit>* units);
+
+  // パケットロスなどで IDR を待っている状態かどうか
+  bool waiting_for_key_frame() const { return waiting_for_key_frame_; }
+  uint64_t packets_lost() const { return packets_lost_; }
+  uint64_t units_dropped() const { return units_dropped_; }
+
+ private:
+  void AppendNalu(const uint8_t* data, size_t size);
+  void Finish(std::vector<AccessUnit>* units);
+  // 組み立て中のアクセスユニットを捨てて、シーケンス番号を忘れる
+  void Reset(std::vector<AccessUnit>* units);
+
+  AccessUnit current_;
+  bool has_current_ = false;
+  // パケットが欠けていて、current_ を捨てる必要がある
+  bool corrupted_ = false;
+  // FU-A の途中かどうか
+  bool in_fragment_ = false;
+
+  bool has_sequence_number_ = false;
+  uint16_t last_sequence_number_ = 0;
+  uint32_t last_ssrc_ = 0;
+  bool waiting_for_key_frame_ = true;
+  uint64_t packets_lost_ = 0;
+  uint64_t units_dropped_ = 0;
+};
+
+}  // namespace sora
+
+#endif
@@ -0,0 +1,309 @@
+#include "sora/rtp_h264_ingest.h"
+
+#include <string.h>
+
+#include <atomic>
+
+// WebRTC
+#include <api/video/encoded_image.h>
+#include <api/video/video_frame.h>
+#include <api/video/video_rotation.h>
+#include <common_video/h264/h264_common.h>
+#include <common_video/h264/sps_parser.h>
+#include <rtc_base/base64.h>
+#include <rtc_base/helpers.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <rtc_base/time_utils.h>
+
+#include "rtp_h264_depacketizer.h"
+
+namespace sora {
+
+static const uint8_t kStartCode[] = {0, 0, 0, 1};
+
+// パススルーのエンコーダからのキーフレーム要求を受け取って、
+// 次にパケットを受信した時に network_thread で送るためのもの
+class RtpH264Ingest::Requester : public KeyFrameRequester {
+ public:
+  void RequestKeyFrame() override { requested_ = true; }
+  bool Take() { return requested_.exchange(false); }
+
+ private:
+  std::atomic<bool> requested_{false};
+};
+
+rtc::scoped_refptr<RtpH264Ingest> RtpH264Ingest::Create(
+    RtpH264IngestConfig config) {
+  rtc::scoped_refptr<RtpH264Ingest> ingest(
+      new rtc::RefCountedObject<RtpH264Ingest>(config));
+  if (!ingest->Init()) {
+    RTC_LOG(LS_ERROR) << "Failed to create RtpH264Ingest";
+    return nullptr;
+  }
+  return ingest;
+}
+
+RtpH264Ingest::RtpH264Ingest(RtpH264IngestConfig config)
+    : config_(config),
+      requester_(std::make_shared<Requester>()),
+      depacketizer_(new RtpH264Depacketizer()),
+      local_ssrc_(rtc::CreateRandomNonZeroId()) {}
+
+RtpH264Ingest::~RtpH264Ingest() {
+  if (network_thread_ != nullptr) {
+    network_thread_->Invoke<void>(RTC_FROM_HERE, [this]() {
+      rtp_socket_.reset();
+      rtcp_socket_.reset();
+    });
+  }
+  if (own_thread_ != nullptr) {
+    own_thread_->Stop();
+  }
+}
+
+bool RtpH264Ingest::Init() {
+  if (!config_.sprop_parameter_sets.empty() && !ParseSpropParameterSets()) {
+    RTC_LOG(LS_ERROR) << "Invalid sprop-parameter-sets: "
+                      << config_.sprop_parameter_sets;
+    return false;
+  }
+
+  if (config_.network_thread != nullptr) {
+    network_thread_ = config_.network_thread;
+  } else {
+    own_thread_ = rtc::Thread::CreateWithSocketServer();
+    if (!StartThreadWithConfig(own_thread_.get(), config_.thread_config,
+                               SoraThreadRole::kCapture)) {
+      own_thread_.reset();
+      return false;
+    }
+    network_thread_ = own_thread_.get();
+  }
+  return network_thread_->Invoke<bool>(RTC_FROM_HERE,
+                                       [this]() { return CreateSockets(); });
+}
+
+bool RtpH264Ingest::ParseSpropParameterSets() {
+  std::string sets = config_.sprop_parameter_sets;
+  size_t pos = 0;
+  while (pos <= sets.size()) {
+    size_t end = sets.find(',', pos);
+    if (end == std::string::npos) {
+      end = sets.size();
+    }
+    std::string nalu;
+    if (!rtc::Base64::Decode(sets.substr(pos, end - pos),
+                             rtc::Base64::DO_STRICT, &nalu, nullptr) ||
+        nalu.empty()) {
+      return false;
+    }
+    std::vector<uint8_t> v(nalu.begin(), nalu.end());
+    auto type = webrtc::H264::ParseNaluType(v[0]);
+    if (type == webrtc::H264::NaluType::kSps) {
+      SetSps(v);
+    } else if (type == webrtc::H264::NaluType::kPps) {
+      pps_ = v;
+    }
+    pos = end + 1;
+  }
+  return width_ > 0 && !pps_.empty();
+}
+
+void RtpH264Ingest::SetSps(const std::vector<uint8_t>& sps) {
+  if (sps == sps_) {
+    return;
+  }
+  auto state = webrtc::SpsParser::ParseSps(
+      sps.data() + webrtc::H264::kNaluTypeSize,
+      sps.size() - webrtc::H264::kNaluTypeSize);
+  if (!state) {
+    RTC_LOG(LS_WARNING) << "Failed to parse SPS";
+    return;
+  }
+  sps_ = sps;
+  width_ = state->width;
+  height_ = state->height;
+  RTC_LOG(LS_INFO) << "RtpH264Ingest: width=" << width_
+                   << " height=" << height_;
+}
+
+bool RtpH264Ingest::CreateSockets() {
+  rtp_socket_.reset(rtc::AsyncUDPSocket::Create(
+      network_thread_->socketserver(),
+      rtc::SocketAddress(config_.local_address, config_.rtp_port)));
+  rtcp_socket_.reset(rtc::AsyncUDPSocket::Create(
+      network_thread_->socketserver(),
+      rtc::SocketAddress(config_.local_address, config_.rtcp_port)));
+  if (rtp_socket_ == nullptr || rtcp_socket_ == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to bind: address=" << config_.local_address
+                      << " rtp_port=" << config_.rtp_port
+                      << " rtcp_port=" << config_.rtcp_port;
+    return false;
+  }
+  rtp_socket_->SignalReadPacket.connect(this, &RtpH264Ingest::OnRtpPacket);
+  rtcp_socket_->SignalReadPacket.connect(this, &RtpH264Ingest::OnRtcpPacket);
+  rtp_port_ = rtp_socket_->GetLocalAddress().port();
+  rtcp_port_ = rtcp_socket_->GetLocalAddress().port();
+  if (!config_.remote_rtcp_address.empty()) {
+    rtcp_remote_address_ = rtc::SocketAddress(config_.remote_rtcp_address,
+                                              config_.remote_rtcp_port);
+  }
+  RTC_LOG(LS_INFO) << "RtpH264Ingest: rtp_port=" << rtp_port_
+                   << " rtcp_port=" << rtcp_port_;
+  return true;
+}
+
+void RtpH264Ingest::RequestKeyFrame() {
+  requester_->RequestKeyFrame();
+}
+
+RtpH264IngestStats RtpH264Ingest::GetStats() const {
+  webrtc::MutexLock lock(&stats_mutex_);
+  return stats_;
+}
+
+void RtpH264Ingest::OnRtpPacket(rtc::AsyncPacketSocket* socket,
+                                const char* data,
+                                size_t size,
+                                const rtc::SocketAddress& remote_address,
+                                const int64_t& packet_time_us) {
+  if (size < 12) {
+    return;
+  }
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  int payload_type = p[1] & 0x7f;
+  // rtcp-mux で RTCP が届いた
+  if (payload_type >= 64 && payload_type <= 95) {
+    OnRtcpPacket(socket, data, size, remote_address, packet_time_us);
+    return;
+  }
+  if (config_.payload_type >= 0 && payload_type != config_.payload_type) {
+    return;
+  }
+  rtp_remote_address_ = remote_address;
+  remote_ssrc_ = (static_cast<uint32_t>(p[8]) << 24) | (p[9] << 16) |
+                 (p[10] << 8) | p[11];
+
+  std::vector<RtpH264Depacketizer::AccessUnit> units;
+  uint64_t lost = depacketizer_->packets_lost();
+  uint64_t dropped = depacketizer_->units_dropped();
+  depacketizer_->InsertPacket(p, size, &units);
+
+  RtpH264IngestStats stats;
+  stats.packets_received = 1;
+  stats.packets_lost = depacketizer_->packets_lost() - lost;
+  stats.frames_dropped = depacketizer_->units_dropped() - dropped;
+
+  for (auto& unit : units) {
+    stats.frames_received += 1;
+    if (!unit.sps.empty()) {
+      SetSps(unit.sps);
+    }
+    if (!unit.pps.empty()) {
+      pps_ = unit.pps;
+    }
+    if (width_ == 0 || height_ == 0) {
+      stats.frames_dropped += 1;
+      continue;
+    }
+
+    // 受信側は IDR の前に SPS と PPS が無いとデコードできないので、足りなければ補う
+    bool prepend =
+        unit.is_key_frame && (unit.sps.empty() || unit.pps.empty());
+    size_t size = unit.data.size();
+    if (prepend) {
+      size += sizeof(kStartCode) * 2 + sps_.size() + pps_.size();
+    }
+    auto buffer = webrtc::EncodedImageBuffer::Create(size);
+    uint8_t* q = buffer->data();
+    if (prepend) {
+      for (const auto* nalu : {&sps_, &pps_}) {
+        memcpy(q, kStartCode, sizeof(kStartCode));
+        q += sizeof(kStartCode);
+        memcpy(q, nalu->data(), nalu->size());
+        q += nalu->size();
+      }
+    }
+    memcpy(q, unit.data.data(), unit.data.size());
+
+    OnFrame(webrtc::VideoFrame::Builder()
+                .set_video_frame_buffer(EncodedFrameBuffer::Create(
+                    buffer, width_, height_, unit.is_key_frame,
+                    frame_number_++, requester_))
+                .set_timestamp_rtp(0)
+                .set_timestamp_us(rtc::TimeMicros())
+                .set_rotation(webrtc::kVideoRotation_0)
+                .build());
+  }
+
+  {
+    webrtc::MutexLock lock(&stats_mutex_);
+    stats_.packets_received += stats.packets_received;
+    stats_.packets_lost += stats.packets_lost;
+    stats_.frames_received += stats.frames_received;
+    stats_.frames_dropped += stats.frames_dropped;
+  }
+
+  if (requester_->Take() || depacketizer_->waiting_for_key_frame()) {
+    SendKeyFrameRequest();
+  }
+}
+
+void RtpH264Ingest::OnRtcpPacket(rtc::AsyncPacketSocket* socket,
+                                 const char* data,
+                                 size_t size,
+                                 const rtc::SocketAddress& remote_address,
+                                 const int64_t& packet_time_us) {
+  // カメラの送信者レポートの送信元をキーフレーム要求の宛先にする
+  if (config_.remote_rtcp_address.empty()) {
+    rtcp_remote_address_ = remote_address;
+  }
+}
+
+void RtpH264Ingest::SendKeyFrameRequest() {
+  int64_t now_ms = rtc::TimeMillis();
+  if (last_key_frame_request_ms_ >= 0 &&
+      now_ms - last_key_frame_request_ms_ <
+          config_.key_frame_request_interval_ms) {
+    return;
+  }
+  rtc::SocketAddress address = rtcp_remote_address_;
+  if (address.IsNil()) {
+    if (rtp_remote_address_.IsNil()) {
+      return;
+    }
+    address = rtp_remote_address_;
+    address.SetPort(rtp_remote_address_.port() + 1);
+  }
+  last_key_frame_request_ms_ = now_ms;
+
+  // 空の受信者レポート + PLI + FIR の複合パケット (RFC 4585, RFC 5104)
+  uint8_t packet[8 + 12 + 20];
+  size_t n = 0;
+  auto write32 = [&](uint32_t v) {
+    packet[n++] = v >> 24;
+    packet[n++] = (v >> 16) & 0xff;
+    packet[n++] = (v >> 8) & 0xff;
+    packet[n++] = v & 0xff;
+  };
+  // RR
+  write32(0x80c90001);
+  write32(local_ssrc_);
+  // PLI
+  write32(0x81ce0002);
+  write32(local_ssrc_);
+  write32(remote_ssrc_);
+  // FIR
+  write32(0x84ce0004);
+  write32(local_ssrc_);
+  write32(0);
+  write32(remote_ssrc_);
+  write32(static_cast<uint32_t>(fir_sequence_number_++) << 24);
+
+  rtcp_socket_->SendTo(packet, n, address, rtc::PacketOptions());
+  webrtc::MutexLock lock(&stats_mutex_);
+  stats_.key_frame_requests += 1;
+}
+
+}  // namespace sora
@@ -11,6 +11,8 @@
 #include "sora/scalable_track_source.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 
 // WebRTC
 #include <api/scoped_refptr.h>
@@ -18,15 +20,49 @@
 #include <api/video/video_frame_buffer.h>
 #include <api/video/video_rotation.h>
 #include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+#include <third_party/libyuv/include/libyuv.h>
 
 namespace sora {
 
+// エンコーダやシンクが保持しているフレームの数より多めにしておく
+static const size_t kMaxScaledBuffers = 16;
+
 ScalableVideoTrackSource::ScalableVideoTrackSource()
-    : AdaptedVideoTrackSource(4) {}
-ScalableVideoTrackSource::~ScalableVideoTrackSource() {}
+    : ScalableVideoTrackSource(ScalableVideoTrackSourceConfig()) {}
+ScalableVideoTrackSource::ScalableVideoTrackSource(
+    ScalableVideoTrackSourceConfig config)
+    : AdaptedVideoTrackSource(4), config_(config) {
+  if (config_.allocator != nullptr) {
+    buffer_pool_.reset(
+        new FrameBufferPool(kMaxScaledBuffers, config_.allocator));
+  }
+  if (config_.pacing.framerate > 0) {
+    pacing_thread_ = rtc::PlatformThread::SpawnJoinable(
+        [this]() {
+          ApplyThreadConfig(config_.pacing.thread_config,
+                            SoraThreadRole::kCapture);
+          PacingThread();
+        },
+        config_.pacing.thread_config.name.empty()
+            ? "PacingThread"
+            : config_.pacing.thread_config.name,
+        rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
+  }
+}
+ScalableVideoTrackSource::~ScalableVideoTrackSource() {
+  if (!pacing_thread_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(pacing_mutex_);
+      pacing_quit_ = true;
+    }
+    pacing_cv_.notify_all();
+    pacing_thread_.Finalize();
+  }
+}
 
 bool ScalableVideoTrackSource::is_screencast() const {
-  return false;
+  return config_.is_screencast;
 }
 
 absl::optional<bool> ScalableVideoTrackSource::needs_denoising() const {
@@ -44,6 +80,97 @@ bool ScalableVideoTrackSource::remote() const {
 
 void ScalableVideoTrackSource::OnCapturedFrame(
     const webrtc::VideoFrame& frame) {
+  if (pacing_thread_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(pacing_mutex_);
+      pacing_stats_.frames_captured += 1;
+      pacing_stats_.frames_sent += 1;
+    }
+    ProcessFrame(frame);
+    return;
+  }
+
+  const int64_t now_us = rtc::TimeMicros();
+  const int64_t interval_us =
+      rtc::kNumMicrosecsPerSec / config_.pacing.framerate;
+  {
+    std::lock_guard<std::mutex> lock(pacing_mutex_);
+    pacing_stats_.frames_captured += 1;
+    if (last_captured_us_ != 0) {
+      UpdateJitter(now_us - last_captured_us_, interval_us,
+                   &capture_jitter_us_);
+    }
+    last_captured_us_ = now_us;
+
+    // 送信が追いついていないので、遅らせるより古いフレームを捨てる
+    const size_t max_queue_size =
+        static_cast<size_t>(std::max(1, config_.pacing.max_queue_size));
+    while (!pacing_queue_.empty() && pacing_queue_.size() >= max_queue_size) {
+      pacing_queue_.pop_front();
+      pacing_stats_.frames_dropped += 1;
+    }
+    pacing_queue_.push_back(frame);
+  }
+  pacing_cv_.notify_one();
+}
+
+ScalableVideoTrackSourcePacingStats ScalableVideoTrackSource::GetPacingStats() {
+  std::lock_guard<std::mutex> lock(pacing_mutex_);
+  ScalableVideoTrackSourcePacingStats stats = pacing_stats_;
+  stats.capture_jitter_ms = capture_jitter_us_ / 1000.0;
+  stats.send_jitter_ms = send_jitter_us_ / 1000.0;
+  return stats;
+}
+
+void ScalableVideoTrackSource::UpdateJitter(int64_t interval_us,
+                                            int64_t expected_interval_us,
+                                            double* jitter_us) {
+  double d = std::abs(static_cast<double>(interval_us - expected_interval_us));
+  *jitter_us += (d - *jitter_us) / 16;
+}
+
+void ScalableVideoTrackSource::PacingThread() {
+  const int64_t interval_us =
+      rtc::kNumMicrosecsPerSec / config_.pacing.framerate;
+  // 実際に送った時刻。ジッタの計算に使う
+  int64_t last_sent_actual_us = 0;
+
+  std::unique_lock<std::mutex> lock(pacing_mutex_);
+  while (!pacing_quit_) {
+    if (pacing_queue_.empty()) {
+      pacing_cv_.wait(lock);
+      continue;
+    }
+
+    // 前のフレームから 1 間隔空いていれば、届いたフレームはすぐに送る。
+    // まとめて届いた場合だけ、間隔が空くまで待つ。
+    int64_t now_us = rtc::TimeMicros();
+    int64_t due_us = last_sent_us_ == 0 ? now_us : last_sent_us_ + interval_us;
+    if (now_us < due_us) {
+      pacing_cv_.wait_for(lock, std::chrono::microseconds(due_us - now_us));
+      continue;
+    }
+
+    webrtc::VideoFrame frame = std::move(pacing_queue_.front());
+    pacing_queue_.pop_front();
+    pacing_stats_.frames_sent += 1;
+    if (last_sent_actual_us != 0) {
+      UpdateJitter(now_us - last_sent_actual_us, interval_us,
+                   &send_jitter_us_);
+    }
+    last_sent_actual_us = now_us;
+    // 少しの遅れであれば間隔を維持し、大きく遅れた場合は今を基準にし直す。
+    // 毎回今を基準にすると、スレッドの起床の遅れが積み重なって少しずつ遅くなる。
+    last_sent_us_ = now_us - due_us < interval_us / 2 ? due_us : now_us;
+
+    lock.unlock();
+    frame.set_timestamp_us(now_us);
+    ProcessFrame(frame);
+    lock.lock();
+  }
+}
+
+void ScalableVideoTrackSource::ProcessFrame(const webrtc::VideoFrame& frame) {
   const int64_t timestamp_us = frame.timestamp_us();
   const int64_t translated_timestamp_us =
       timestamp_aligner_.TranslateTimestamp(timestamp_us, rtc::TimeMicros());
@@ -72,10 +199,27 @@ void ScalableVideoTrackSource::OnCapturedFrame(
   if (adapted_width != frame.width() || adapted_height != frame.height()) {
     // Video adapter has requested a down-scale. Allocate a new buffer and
     // return scaled version.
-    rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
-        webrtc::I420Buffer::Create(adapted_width, adapted_height);
-    i420_buffer->ScaleFrom(*buffer->ToI420());
-    buffer = i420_buffer;
+    rtc::scoped_refptr<AllocatedI420Buffer> pooled_buffer;
+    if (buffer_pool_ != nullptr) {
+      pooled_buffer =
+          buffer_pool_->CreateI420Buffer(adapted_width, adapted_height);
+    }
+    if (pooled_buffer != nullptr) {
+      rtc::scoped_refptr<webrtc::I420BufferInterface> src = buffer->ToI420();
+      libyuv::I420Scale(src->DataY(), src->StrideY(), src->DataU(),
+                        src->StrideU(), src->DataV(), src->StrideV(),
+                        src->width(), src->height(),
+                        pooled_buffer->MutableDataY(), pooled_buffer->StrideY(),
+                        pooled_buffer->MutableDataU(), pooled_buffer->StrideU(),
+                        pooled_buffer->MutableDataV(), pooled_buffer->StrideV(),
+                        adapted_width, adapted_height, libyuv::kFilterBox);
+      buffer = pooled_buffer;
+    } else {
+      rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
+          webrtc::I420Buffer::Create(adapted_width, adapted_height);
+      i420_buffer->ScaleFrom(*buffer->ToI420());
+      buffer = i420_buffer;
+    }
   }
 
   OnFrame(webrtc::VideoFrame::Builder()
@@ -0,0 +1,325 @@
+#include "sora/shm/shm_frame_ring.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace sora {
+
+static const size_t kShmAlignment = 64;
+
+static size_t AlignShm(size_t size) {
+  return (size + kShmAlignment - 1) / kShmAlignment * kShmAlignment;
+}
+
+// 書き込み側と読み込み側で同じ計算をして配置を決める
+static size_t GetSlotDataOffset() {
+  return AlignShm(sizeof(ShmFrameSlotHeader));
+}
+static size_t GetSlotsOffset() {
+  return AlignShm(sizeof(ShmFrameRingHeader));
+}
+static size_t GetSlotStride(uint32_t slot_data_size) {
+  return GetSlotDataOffset() + AlignShm(slot_data_size);
+}
+
+std::unique_ptr<ShmFrameRingWriter> ShmFrameRingWriter::Create(
+    ShmFrameRingConfig config) {
+  if (config.slot_count == 0 || config.slot_data_size == 0) {
+    return nullptr;
+  }
+
+  std::unique_ptr<ShmFrameRingWriter> w(new ShmFrameRingWriter());
+  if (config.name.empty()) {
+    w->fd_ = static_cast<int>(
+        syscall(SYS_memfd_create, "sora-frame-ring", MFD_CLOEXEC));
+  } else {
+    // 前回異常終了して残っていた場合のために O_TRUNC で作り直す
+    w->fd_ = shm_open(config.name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (w->fd_ >= 0) {
+      w->name_ = config.name;
+    }
+  }
+  if (w->fd_ < 0) {
+    return nullptr;
+  }
+
+  size_t slot_stride = GetSlotStride(config.slot_data_size);
+  w->memory_size_ = GetSlotsOffset() + slot_stride * config.slot_count;
+  if (ftruncate(w->fd_, static_cast<off_t>(w->memory_size_)) != 0) {
+    return nullptr;
+  }
+  void* p = mmap(nullptr, w->memory_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 w->fd_, 0);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  w->memory_ = static_cast<uint8_t*>(p);
+
+  // ftruncate した直後なので中身は 0 になっている
+  w->header_ = reinterpret_cast<ShmFrameRingHeader*>(w->memory_);
+  w->header_->version = kShmFrameRingVersion;
+  w->header_->slot_count = config.slot_count;
+  w->header_->slot_data_size = config.slot_data_size;
+  w->header_->slot_stride = static_cast<uint32_t>(slot_stride);
+  w->header_->latest_frame_number.store(0, std::memory_order_relaxed);
+  // magic は最後に書いて、読み込み側が初期化途中のヘッダーを見ないようにする
+  std::atomic_thread_fence(std::memory_order_release);
+  w->header_->magic = kShmFrameRingMagic;
+
+  w->slot_mutexes_.reset(new std::mutex[config.slot_count]);
+  return w;
+}
+
+ShmFrameRingWriter::~ShmFrameRingWriter() {
+  if (memory_ != nullptr) {
+    munmap(memory_, memory_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (!name_.empty()) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+ShmFrameSlotHeader* ShmFrameRingWriter::GetSlotHeader(
+    uint64_t frame_number) const {
+  size_t index = static_cast<size_t>(frame_number % header_->slot_count);
+  return reinterpret_cast<ShmFrameSlotHeader*>(
+      memory_ + GetSlotsOffset() + index * header_->slot_stride);
+}
+
+ShmFrameRingWriter::Slot ShmFrameRingWriter::Begin() {
+  for (uint32_t i = 0; i < header_->slot_count; i++) {
+    uint64_t frame_number =
+        next_frame_number_.fetch_add(1, std::memory_order_relaxed);
+    std::mutex& mutex = slot_mutexes_[frame_number % header_->slot_count];
+    mutex.lock();
+
+    ShmFrameSlotHeader* sh = GetSlotHeader(frame_number);
+    uint32_t seq = sh->sequence.load(std::memory_order_relaxed);
+    // 奇数にして書き込み中であることを示す。
+    // 読み込み側の Hold() と同時に行われた場合に、どちらかが必ず相手に気付けるように、
+    // sequence の書き込みと hold_count の読み込みは seq_cst で行う。
+    sh->sequence.store(seq + 1, std::memory_order_seq_cst);
+    if (sh->hold_count.load(std::memory_order_seq_cst) == 0) {
+      std::atomic_thread_fence(std::memory_order_release);
+      Slot slot;
+      slot.frame_number = frame_number;
+      slot.data = reinterpret_cast<uint8_t*>(sh) + GetSlotDataOffset();
+      slot.size = header_->slot_data_size;
+      return slot;
+    }
+
+    // 読み込み側が使っているので、何も書き込まずに元に戻して次のスロットを試す。
+    // 内容は変わっていないので、sequence を同じ値に戻しても読み込み側は困らない。
+    sh->sequence.store(seq, std::memory_order_release);
+    mutex.unlock();
+  }
+  return Slot();
+}
+
+void ShmFrameRingWriter::Commit(const Slot& slot, const ShmFrameInfo& info) {
+  ShmFrameSlotHeader* sh = GetSlotHeader(slot.frame_number);
+  sh->format = info.format;
+  sh->frame_number = slot.frame_number;
+  memset(sh->track_id, 0, sizeof(sh->track_id));
+  strncpy(sh->track_id, info.track_id.c_str(), sizeof(sh->track_id) - 1);
+  sh->timestamp_us = info.timestamp_us;
+  sh->rtp_timestamp = info.rtp_timestamp;
+  sh->width = info.width;
+  sh->height = info.height;
+  sh->stride_y = info.stride_y;
+  sh->stride_u = info.stride_u;
+  sh->stride_v = info.stride_v;
+  sh->offset_y = info.offset_y;
+  sh->offset_u = info.offset_u;
+  sh->offset_v = info.offset_v;
+  sh->data_size = info.data_size;
+  sh->sequence.store(sh->sequence.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+  slot_mutexes_[slot.frame_number % header_->slot_count].unlock();
+
+  // 複数のスレッドから書き込まれるので、大きい場合だけ更新する
+  uint64_t latest =
+      header_->latest_frame_number.load(std::memory_order_relaxed);
+  while (latest < slot.frame_number &&
+         !header_->latest_frame_number.compare_exchange_weak(
+             latest, slot.frame_number, std::memory_order_release,
+             std::memory_order_relaxed)) {
+  }
+}
+
+std::unique_ptr<ShmFrameRingReader> ShmFrameRingReader::Open(int fd,
+                                                             bool holdable) {
+  int dup_fd = dup(fd);
+  if (dup_fd < 0) {
+    return nullptr;
+  }
+  std::unique_ptr<ShmFrameRingReader> r(new ShmFrameRingReader());
+  if (!r->Map(dup_fd, holdable)) {
+    return nullptr;
+  }
+  return r;
+}
+
+std::unique_ptr<ShmFrameRingReader> ShmFrameRingReader::Open(
+    const std::string& name,
+    bool holdable) {
+  int fd = shm_open(name.c_str(), holdable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::unique_ptr<ShmFrameRingReader> r(new ShmFrameRingReader());
+  if (!r->Map(fd, holdable)) {
+    return nullptr;
+  }
+  return r;
+}
+
+ShmFrameRingReader::~ShmFrameRingReader() {
+  if (memory_ != nullptr) {
+    munmap(memory_, memory_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool ShmFrameRingReader::Map(int fd, bool holdable) {
+  fd_ = fd;
+  holdable_ = holdable;
+  struct stat st;
+  if (fstat(fd_, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(ShmFrameRingHeader)) {
+    return false;
+  }
+  memory_size_ = static_cast<size_t>(st.st_size);
+  int prot = holdable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* p = mmap(nullptr, memory_size_, prot, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  memory_ = static_cast<uint8_t*>(p);
+  header_ = reinterpret_cast<const ShmFrameRingHeader*>(memory_);
+  if (header_->magic != kShmFrameRingMagic) {
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header_->version != kShmFrameRingVersion || header_->slot_count == 0 ||
+      header_->slot_stride != GetSlotStride(header_->slot_data_size) ||
+      memory_size_ < GetSlotsOffset() + static_cast<size_t>(
+                                            header_->slot_stride) *
+                                            header_->slot_count) {
+    return false;
+  }
+  return true;
+}
+
+const ShmFrameSlotHeader* ShmFrameRingReader::GetSlotHeader(
+    uint64_t frame_number) const {
+  size_t index = static_cast<size_t>(frame_number % header_->slot_count);
+  return reinterpret_cast<const ShmFrameSlotHeader*>(
+      memory_ + GetSlotsOffset() + index * header_->slot_stride);
+}
+
+uint64_t ShmFrameRingReader::GetLatestFrameNumber() const {
+  return header_->latest_frame_number.load(std::memory_order_acquire);
+}
+
+bool ShmFrameRingReader::Acquire(uint64_t frame_number,
+                                 ShmFrameView* view) const {
+  if (frame_number == 0) {
+    return false;
+  }
+  const ShmFrameSlotHeader* sh = GetSlotHeader(frame_number);
+  uint32_t seq = sh->sequence.load(std::memory_order_acquire);
+  if (seq & 1) {
+    return false;
+  }
+
+  ShmFrameInfo info;
+  info.format = sh->format;
+  uint64_t slot_frame_number = sh->frame_number;
+  char track_id[kShmFrameTrackIdSize];
+  memcpy(track_id, sh->track_id, sizeof(track_id));
+  track_id[sizeof(track_id) - 1] = '\0';
+  info.timestamp_us = sh->timestamp_us;
+  info.rtp_timestamp = sh->rtp_timestamp;
+  info.width = sh->width;
+  info.height = sh->height;
+  info.stride_y = sh->stride_y;
+  info.stride_u = sh->stride_u;
+  info.stride_v = sh->stride_v;
+  info.offset_y = sh->offset_y;
+  info.offset_u = sh->offset_u;
+  info.offset_v = sh->offset_v;
+  info.data_size = sh->data_size;
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (sh->sequence.load(std::memory_order_relaxed) != seq ||
+      slot_frame_number != frame_number) {
+    return false;
+  }
+  if (info.data_size > header_->slot_data_size ||
+      info.offset_y > info.data_size || info.offset_u > info.data_size ||
+      info.offset_v > info.data_size) {
+    return false;
+  }
+
+  info.track_id = track_id;
+  const uint8_t* data =
+      reinterpret_cast<const uint8_t*>(sh) + GetSlotDataOffset();
+  view->info = std::move(info);
+  view->frame_number = frame_number;
+  view->data_y = data + view->info.offset_y;
+  view->data_u = data + view->info.offset_u;
+  view->data_v = data + view->info.offset_v;
+  view->sequence = seq;
+  return true;
+}
+
+bool ShmFrameRingReader::Validate(const ShmFrameView& view) const {
+  const ShmFrameSlotHeader* sh = GetSlotHeader(view.frame_number);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sh->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+bool ShmFrameRingReader::Hold(const ShmFrameView& view) const {
+  if (!holdable_) {
+    return false;
+  }
+  ShmFrameSlotHeader* sh =
+      const_cast<ShmFrameSlotHeader*>(GetSlotHeader(view.frame_number));
+  sh->hold_count.fetch_add(1, std::memory_order_seq_cst);
+  // 書き込み側の Begin() と対になっていて、ここで sequence が変わっていなければ、
+  // 書き込み側は必ず hold_count が 0 でないことに気付く
+  if (sh->sequence.load(std::memory_order_seq_cst) != view.sequence) {
+    sh->hold_count.fetch_sub(1, std::memory_order_release);
+    return false;
+  }
+  return true;
+}
+
+void ShmFrameRingReader::Unhold(uint64_t frame_number) const {
+  if (!holdable_) {
+    return;
+  }
+  ShmFrameSlotHeader* sh =
+      const_cast<ShmFrameSlotHeader*>(GetSlotHeader(frame_number));
+  sh->hold_count.fetch_sub(1, std::memory_order_release);
+}
+
+}  // namespace sora
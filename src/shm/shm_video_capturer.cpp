@@ -0,0 +1,199 @@
+#include "sora/shm/shm_video_capturer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// WebRTC
+#include <api/video/video_frame.h>
+#include <api/video/video_frame_buffer.h>
+#include <api/video/video_rotation.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora {
+
+// quit_ を確認する間隔
+static const int kMaxWaitMs = 100;
+
+// 共有メモリのスロットをそのまま参照する I420 バッファ。
+// 破棄された時にスロットを書き込み側に返す。
+class ShmI420Buffer : public webrtc::I420BufferInterface {
+ public:
+  ShmI420Buffer(std::shared_ptr<ShmFrameRingReader> reader,
+                const ShmFrameView& view)
+      : reader_(reader), view_(view) {}
+  ~ShmI420Buffer() override { reader_->Unhold(view_.frame_number); }
+
+  int width() const override { return view_.info.width; }
+  int height() const override { return view_.info.height; }
+  const uint8_t* DataY() const override { return view_.data_y; }
+  const uint8_t* DataU() const override { return view_.data_u; }
+  const uint8_t* DataV() const override { return view_.data_v; }
+  int StrideY() const override { return view_.info.stride_y; }
+  int StrideU() const override { return view_.info.stride_u; }
+  int StrideV() const override { return view_.info.stride_v; }
+
+ private:
+  std::shared_ptr<ShmFrameRingReader> reader_;
+  ShmFrameView view_;
+};
+
+// 書き込み側が壊れたデータを書いていても範囲外を読まないように確認する
+static bool IsValidI420(const ShmFrameInfo& info) {
+  if (info.format != ShmFrameFormat::kI420 || info.width <= 0 ||
+      info.height <= 0 || info.stride_y < info.width ||
+      info.stride_u < (info.width + 1) / 2 ||
+      info.stride_v < (info.width + 1) / 2) {
+    return false;
+  }
+  int64_t chroma_height = (info.height + 1) / 2;
+  return info.offset_y + static_cast<int64_t>(info.stride_y) * info.height <=
+             info.data_size &&
+         info.offset_u + static_cast<int64_t>(info.stride_u) * chroma_height <=
+             info.data_size &&
+         info.offset_v + static_cast<int64_t>(info.stride_v) * chroma_height <=
+             info.data_size;
+}
+
+rtc::scoped_refptr<ShmVideoCapturer> ShmVideoCapturer::Create(
+    ShmVideoCapturerConfig config) {
+  rtc::scoped_refptr<ShmVideoCapturer> capturer(
+      new rtc::RefCountedObject<ShmVideoCapturer>(config));
+  if (!capturer->Init()) {
+    RTC_LOG(LS_ERROR) << "Failed to create ShmVideoCapturer";
+    return nullptr;
+  }
+  return capturer;
+}
+
+ShmVideoCapturer::ShmVideoCapturer(ShmVideoCapturerConfig config)
+    : ScalableVideoTrackSource(config), config_(config), quit_(false) {}
+
+ShmVideoCapturer::~ShmVideoCapturer() {
+  if (!capture_thread_.empty()) {
+    quit_ = true;
+    capture_thread_.Finalize();
+  }
+}
+
+bool ShmVideoCapturer::Init() {
+  std::unique_ptr<ShmFrameRingReader> reader;
+  if (!config_.name.empty()) {
+    reader = ShmFrameRingReader::Open(config_.name, true);
+  } else if (config_.fd >= 0) {
+    reader = ShmFrameRingReader::Open(config_.fd, true);
+  }
+  if (!reader) {
+    RTC_LOG(LS_ERROR) << "Failed to open shared memory: name=" << config_.name
+                      << " fd=" << config_.fd;
+    return false;
+  }
+  reader_ = std::move(reader);
+
+  RTC_LOG(LS_INFO) << "ShmVideoCapturer: name=" << config_.name
+                   << " fd=" << config_.fd
+                   << " slot_count=" << reader_->slot_count()
+                   << " track_id=" << config_.track_id;
+
+  capture_thread_ = rtc::PlatformThread::SpawnJoinable(
+      [this]() {
+        ApplyThreadConfig(config_.capture_thread_config,
+                          SoraThreadRole::kCapture);
+        CaptureThread();
+      },
+      config_.capture_thread_config.name.empty()
+          ? "ShmCaptureThread"
+          : config_.capture_thread_config.name,
+      rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
+  return true;
+}
+
+void ShmVideoCapturer::CaptureThread() {
+  // 開く前に書き込まれていたフレームは古いので使わない
+  uint64_t next_frame_number = reader_->GetLatestFrameNumber() + 1;
+  const auto poll_interval =
+      std::chrono::milliseconds(std::max(1, config_.poll_interval_ms));
+
+  while (!quit_) {
+    uint64_t latest = reader_->GetLatestFrameNumber();
+    if (latest < next_frame_number) {
+      std::this_thread::sleep_for(poll_interval);
+      continue;
+    }
+    // 読み込みが遅れている場合は、途中のフレームを捨てて最新のフレームから読む
+    if (latest - next_frame_number >= reader_->slot_count() / 2) {
+      next_frame_number = latest;
+    }
+
+    // 書き込み側が Hold() されたスロットを飛ばした場合などは欠番になるので、
+    // 読めなかったフレームは諦めて次に進む
+    uint64_t frame_number = next_frame_number++;
+    ShmFrameView view;
+    if (!reader_->Acquire(frame_number, &view)) {
+      continue;
+    }
+    if (!config_.track_id.empty() && view.info.track_id != config_.track_id) {
+      continue;
+    }
+    if (!IsValidI420(view.info)) {
+      RTC_LOG(LS_WARNING) << "Invalid frame: frame_number=" << frame_number
+                          << " width=" << view.info.width
+                          << " height=" << view.info.height;
+      continue;
+    }
+
+    int64_t now_us = rtc::TimeMicros();
+    if (config_.pace_by_timestamp) {
+      now_us = WaitForPacing(view.info.timestamp_us);
+      if (now_us < 0) {
+        break;
+      }
+    }
+
+    // 待っている間にスロットを確保すると、書き込み側がそのスロットを使えなくなるので、
+    // 待ち終わってから確保する。Hold() は sequence が Acquire() した時から
+    // 変わっていないことを確認するので、待っている間に上書きされていたら捨てる
+    if (!reader_->Hold(view)) {
+      continue;
+    }
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer(
+        new rtc::RefCountedObject<ShmI420Buffer>(reader_, view));
+
+    OnCapturedFrame(webrtc::VideoFrame::Builder()
+                        .set_video_frame_buffer(buffer)
+                        .set_timestamp_rtp(0)
+                        .set_timestamp_us(now_us)
+                        .set_rotation(webrtc::kVideoRotation_0)
+                        .build());
+  }
+}
+
+int64_t ShmVideoCapturer::WaitForPacing(int64_t timestamp_us) {
+  const int64_t max_delay_us =
+      config_.max_pacing_delay_ms * rtc::kNumMicrosecsPerMillisec;
+  int64_t now_us = rtc::TimeMicros();
+  int64_t due_us = timestamp_us + pacing_offset_us_;
+  // 最初のフレームと、書き込み側の時刻が巻き戻ったり大きく飛んだりした場合は、
+  // 今の時刻を基準にし直す
+  if (last_timestamp_us_ < 0 || timestamp_us < last_timestamp_us_ ||
+      due_us < now_us - max_delay_us || due_us > now_us + max_delay_us) {
+    pacing_offset_us_ = now_us - timestamp_us;
+    due_us = now_us;
+  }
+  last_timestamp_us_ = timestamp_us;
+
+  while (now_us < due_us) {
+    if (quit_) {
+      return -1;
+    }
+    int64_t wait_us = std::min<int64_t>(
+        due_us - now_us, kMaxWaitMs * rtc::kNumMicrosecsPerMillisec);
+    std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    now_us = rtc::TimeMicros();
+  }
+  return now_us;
+}
+
+}  // namespace sora
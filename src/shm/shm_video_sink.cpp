@@ -0,0 +1,134 @@
+#include "sora/shm/shm_video_sink.h"
+
+// WebRTC
+#include <api/video/i420_buffer.h>
+#include <rtc_base/logging.h>
+
+// libyuv
+#include <libyuv.h>
+
+namespace sora {
+
+class ShmVideoSink::Sink : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
+ public:
+  Sink(rtc::scoped_refptr<webrtc::VideoTrackInterface> track,
+       ShmFrameRingWriter* writer)
+      : track_(track), track_id_(track->id()), writer_(writer) {}
+
+  rtc::scoped_refptr<webrtc::VideoTrackInterface> track() const {
+    return track_;
+  }
+
+  void OnFrame(const webrtc::VideoFrame& frame) override {
+    // I420 のバッファであれば変換せずにそのまま返ってくる
+    rtc::scoped_refptr<webrtc::I420BufferInterface> src =
+        frame.video_frame_buffer()->ToI420();
+    if (!src) {
+      return;
+    }
+
+    ShmFrameInfo info;
+    info.format = ShmFrameFormat::kI420;
+    info.track_id = track_id_;
+    info.timestamp_us = frame.timestamp_us();
+    info.rtp_timestamp = frame.timestamp();
+    info.width = src->width();
+    info.height = src->height();
+    info.stride_y = src->width();
+    info.stride_u = (src->width() + 1) / 2;
+    info.stride_v = info.stride_u;
+    size_t size_y = static_cast<size_t>(info.stride_y) * info.height;
+    size_t size_uv =
+        static_cast<size_t>(info.stride_u) * ((info.height + 1) / 2);
+    size_t data_size = size_y + size_uv * 2;
+    if (data_size > writer_->slot_data_size()) {
+      // 毎フレームログを出すと多すぎるので、解像度が変わった時だけ出す
+      if (info.width != warned_width_ || info.height != warned_height_) {
+        RTC_LOG(LS_WARNING) << "ShmVideoSink: frame is too large: track_id="
+                            << track_id_ << " width=" << info.width
+                            << " height=" << info.height
+                            << " slot_data_size=" << writer_->slot_data_size();
+        warned_width_ = info.width;
+        warned_height_ = info.height;
+      }
+      return;
+    }
+    info.offset_y = 0;
+    info.offset_u = static_cast<uint32_t>(size_y);
+    info.offset_v = static_cast<uint32_t>(size_y + size_uv);
+    info.data_size = static_cast<uint32_t>(data_size);
+
+    ShmFrameRingWriter::Slot slot = writer_->Begin();
+    if (slot.data == nullptr) {
+      // 全てのスロットが読み込み側に確保されている
+      return;
+    }
+    libyuv::I420Copy(src->DataY(), src->StrideY(), src->DataU(),
+                     src->StrideU(), src->DataV(), src->StrideV(),
+                     slot.data + info.offset_y, info.stride_y,
+                     slot.data + info.offset_u, info.stride_u,
+                     slot.data + info.offset_v, info.stride_v, info.width,
+                     info.height);
+    writer_->Commit(slot, info);
+  }
+
+ private:
+  rtc::scoped_refptr<webrtc::VideoTrackInterface> track_;
+  std::string track_id_;
+  ShmFrameRingWriter* writer_;
+  int warned_width_ = 0;
+  int warned_height_ = 0;
+};
+
+std::shared_ptr<ShmVideoSink> ShmVideoSink::Create(ShmVideoSinkConfig config) {
+  auto writer = ShmFrameRingWriter::Create(config.ring);
+  if (!writer) {
+    RTC_LOG(LS_ERROR) << "Failed to create ShmFrameRingWriter: name="
+                      << config.ring.name;
+    return nullptr;
+  }
+  return std::shared_ptr<ShmVideoSink>(new ShmVideoSink(std::move(writer)));
+}
+
+ShmVideoSink::ShmVideoSink(std::unique_ptr<ShmFrameRingWriter> writer)
+    : writer_(std::move(writer)) {}
+
+ShmVideoSink::~ShmVideoSink() {
+  webrtc::MutexLock lock(&mutex_);
+  for (auto& p : sinks_) {
+    p.second->track()->RemoveSink(p.second.get());
+  }
+  sinks_.clear();
+}
+
+void ShmVideoSink::AddTrack(
+    rtc::scoped_refptr<webrtc::VideoTrackInterface> track) {
+  webrtc::MutexLock lock(&mutex_);
+  if (sinks_.find(track->id()) != sinks_.end()) {
+    return;
+  }
+  std::unique_ptr<Sink> sink(new Sink(track, writer_.get()));
+  track->AddOrUpdateSink(sink.get(), rtc::VideoSinkWants());
+  sinks_.insert(std::make_pair(track->id(), std::move(sink)));
+}
+
+void ShmVideoSink::RemoveTrack(const std::string& track_id) {
+  webrtc::MutexLock lock(&mutex_);
+  auto it = sinks_.find(track_id);
+  if (it == sinks_.end()) {
+    return;
+  }
+  it->second->track()->RemoveSink(it->second.get());
+  sinks_.erase(it);
+}
+
+std::vector<std::string> ShmVideoSink::GetTrackIds() const {
+  webrtc::MutexLock lock(&mutex_);
+  std::vector<std::string> ids;
+  for (const auto& p : sinks_) {
+    ids.push_back(p.first);
+  }
+  return ids;
+}
+
+}  // namespace sora
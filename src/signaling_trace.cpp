@@ -0,0 +1,73 @@
+#include "sora/signaling_trace.h"
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora {
+
+std::shared_ptr<SignalingTraceRecorder> SignalingTraceRecorder::Create(
+    const std::string& path) {
+  std::shared_ptr<SignalingTraceRecorder> recorder(
+      new SignalingTraceRecorder(rtc::TimeMicros()));
+  webrtc::MutexLock lock(&recorder->mutex_);
+  recorder->ofs_.open(path, std::ios::binary | std::ios::trunc);
+  if (!recorder->ofs_) {
+    RTC_LOG(LS_ERROR) << "Failed to open signaling trace: path=" << path;
+    return nullptr;
+  }
+  return recorder;
+}
+
+SignalingTraceRecorder::SignalingTraceRecorder(int64_t start_us)
+    : start_us_(start_us) {}
+
+void SignalingTraceRecorder::Record(SignalingTraceDirection direction,
+                                    const std::string& channel,
+                                    const std::string& message) {
+  int64_t timestamp_us = rtc::TimeMicros() - start_us_;
+  webrtc::MutexLock lock(&mutex_);
+  ofs_ << timestamp_us << ' '
+       << (direction == SignalingTraceDirection::kInbound ? 'I' : 'O') << ' '
+       << channel << ' ' << message.size() << '\n';
+  ofs_.write(message.data(), message.size());
+  ofs_ << '\n';
+  // 異常終了した時も、そこまでの記録は残るようにする
+  ofs_.flush();
+}
+
+bool LoadSignalingTrace(const std::string& path,
+                        std::vector<SignalingTraceEntry>* entries) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    RTC_LOG(LS_ERROR) << "Failed to open signaling trace: path=" << path;
+    return false;
+  }
+  entries->clear();
+  while (true) {
+    SignalingTraceEntry entry;
+    char direction;
+    size_t size;
+    if (!(ifs >> entry.timestamp_us >> direction >> entry.channel >> size)) {
+      break;
+    }
+    if (direction != 'I' && direction != 'O') {
+      RTC_LOG(LS_ERROR) << "Invalid signaling trace: direction=" << direction;
+      return false;
+    }
+    entry.direction = direction == 'I' ? SignalingTraceDirection::kInbound
+                                       : SignalingTraceDirection::kOutbound;
+    // ヘッダーの行末の改行を読み飛ばす
+    ifs.get();
+    entry.message.resize(size);
+    if (!ifs.read(&entry.message[0], size)) {
+      RTC_LOG(LS_ERROR) << "Signaling trace is truncated";
+      return false;
+    }
+    ifs.get();
+    entries->push_back(std::move(entry));
+  }
+  return ifs.eof();
+}
+
+}  // namespace sora
@@ -0,0 +1,63 @@
+#include "sora/sora_audio_encoder_factory.h"
+
+// WebRTC
+#include <absl/strings/match.h>
+#include <api/audio_codecs/builtin_audio_encoder_factory.h>
+#include <api/audio_codecs/opus/audio_encoder_opus.h>
+#include <rtc_base/logging.h>
+
+namespace sora {
+
+class SoraAudioEncoderFactory : public webrtc::AudioEncoderFactory {
+ public:
+  SoraAudioEncoderFactory(SoraAudioEncoderFactoryConfig config)
+      : config_(config), factory_(webrtc::CreateBuiltinAudioEncoderFactory()) {}
+
+  std::vector<webrtc::AudioCodecSpec> GetSupportedEncoders() override {
+    return factory_->GetSupportedEncoders();
+  }
+
+  absl::optional<webrtc::AudioCodecInfo> QueryAudioEncoder(
+      const webrtc::SdpAudioFormat& format) override {
+    return factory_->QueryAudioEncoder(format);
+  }
+
+  std::unique_ptr<webrtc::AudioEncoder> MakeAudioEncoder(
+      int payload_type,
+      const webrtc::SdpAudioFormat& format,
+      absl::optional<webrtc::AudioCodecPairId> codec_pair_id) override {
+    if (config_.opus_complexity &&
+        absl::EqualsIgnoreCase(format.name, "opus")) {
+      auto opus_config = webrtc::AudioEncoderOpus::SdpToConfig(format);
+      if (opus_config) {
+        // ビットレートが低い時に使われる複雑度も同じ値にする
+        opus_config->complexity = *config_.opus_complexity;
+        opus_config->low_rate_complexity = *config_.opus_complexity;
+        if (opus_config->IsOk()) {
+          RTC_LOG(LS_INFO) << "Create Opus encoder: complexity="
+                           << opus_config->complexity
+                           << " frame_size_ms=" << opus_config->frame_size_ms
+                           << " num_channels=" << opus_config->num_channels
+                           << " dtx=" << opus_config->dtx_enabled
+                           << " fec=" << opus_config->fec_enabled;
+          return webrtc::AudioEncoderOpus::MakeAudioEncoder(
+              *opus_config, payload_type, codec_pair_id);
+        }
+        RTC_LOG(LS_WARNING) << "Invalid Opus complexity: "
+                            << *config_.opus_complexity;
+      }
+    }
+    return factory_->MakeAudioEncoder(payload_type, format, codec_pair_id);
+  }
+
+ private:
+  SoraAudioEncoderFactoryConfig config_;
+  rtc::scoped_refptr<webrtc::AudioEncoderFactory> factory_;
+};
+
+rtc::scoped_refptr<webrtc::AudioEncoderFactory> CreateSoraAudioEncoderFactory(
+    SoraAudioEncoderFactoryConfig config) {
+  return rtc::make_ref_counted<SoraAudioEncoderFactory>(config);
+}
+
+}  // namespace sora
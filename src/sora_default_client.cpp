@@ -1,15 +1,8 @@
 #include "sora/sora_default_client.h"
 
 // WebRTC
-#include <api/audio_codecs/builtin_audio_decoder_factory.h>
-#include <api/audio_codecs/builtin_audio_encoder_factory.h>
-#include <api/create_peerconnection_factory.h>
-#include <api/rtc_event_log/rtc_event_log_factory.h>
-#include <api/task_queue/default_task_queue_factory.h>
-#include <media/engine/webrtc_media_engine.h>
 #include <modules/audio_device/include/audio_device.h>
 #include <modules/audio_device/include/audio_device_factory.h>
-#include <modules/audio_processing/include/audio_processing.h>
 #include <modules/video_capture/video_capture.h>
 #include <modules/video_capture/video_capture_factory.h>
 #include <pc/video_track_source_proxy.h>
@@ -20,12 +13,10 @@
 #include <rtc_base/win/scoped_com_initializer.h>
 #endif
 
-#include "sora/audio_device_module.h"
 #include "sora/camera_device_capturer.h"
 #include "sora/java_context.h"
+#include "sora/process_memory.h"
 #include "sora/sora_peer_connection_factory.h"
-#include "sora/sora_video_decoder_factory.h"
-#include "sora/sora_video_encoder_factory.h"
 
 namespace sora {
 
@@ -33,73 +24,44 @@ SoraDefaultClient::SoraDefaultClient(SoraDefaultClientConfig config)
     : config_(config) {}
 
 bool SoraDefaultClient::Configure() {
+  int64_t memory_before = GetProcessResidentMemory();
+
   rtc::InitializeSSL();
 
   network_thread_ = rtc::Thread::CreateWithSocketServer();
-  network_thread_->Start();
   worker_thread_ = rtc::Thread::Create();
-  worker_thread_->Start();
   signaling_thread_ = rtc::Thread::Create();
-  signaling_thread_->Start();
-
-  webrtc::PeerConnectionFactoryDependencies dependencies;
-  dependencies.network_thread = network_thread_.get();
-  dependencies.worker_thread = worker_thread_.get();
-  dependencies.signaling_thread = signaling_thread_.get();
-  dependencies.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
-  dependencies.call_factory = webrtc::CreateCallFactory();
-  dependencies.event_log_factory =
-      absl::make_unique<webrtc::RtcEventLogFactory>(
-          dependencies.task_queue_factory.get());
-
-  void* env = sora::GetJNIEnv();
-
-  // media_dependencies
-  cricket::MediaEngineDependencies media_dependencies;
-  media_dependencies.task_queue_factory = dependencies.task_queue_factory.get();
-  media_dependencies.adm =
-      worker_thread_->Invoke<rtc::scoped_refptr<webrtc::AudioDeviceModule>>(
-          RTC_FROM_HERE, [&] {
-            sora::AudioDeviceModuleConfig config;
-            if (!config_.use_audio_deivce) {
-              config.audio_layer = webrtc::AudioDeviceModule::kDummyAudio;
-            }
-            config.task_queue_factory = dependencies.task_queue_factory.get();
-            config.jni_env = env;
-            config.application_context = GetAndroidApplicationContext(env);
-            return sora::CreateAudioDeviceModule(config);
-          });
-
-  media_dependencies.audio_encoder_factory =
-      webrtc::CreateBuiltinAudioEncoderFactory();
-  media_dependencies.audio_decoder_factory =
-      webrtc::CreateBuiltinAudioDecoderFactory();
-
-  auto cuda_context = sora::CudaContext::Create();
-  {
-    auto config =
-        config_.use_hardware_encoder
-            ? sora::GetDefaultVideoEncoderFactoryConfig(cuda_context, env)
-            : sora::GetSoftwareOnlyVideoEncoderFactoryConfig();
-    config.use_simulcast_adapter = true;
-    media_dependencies.video_encoder_factory =
-        absl::make_unique<sora::SoraVideoEncoderFactory>(std::move(config));
-  }
-  {
-    auto config =
-        config_.use_hardware_encoder
-            ? sora::GetDefaultVideoDecoderFactoryConfig(cuda_context, env)
-            : sora::GetSoftwareOnlyVideoDecoderFactoryConfig();
-    media_dependencies.video_decoder_factory =
-        absl::make_unique<sora::SoraVideoDecoderFactory>(std::move(config));
+  if (!StartThreadWithConfig(network_thread_.get(),
+                             config_.network_thread_config,
+                             SoraThreadRole::kNetwork) ||
+      !StartThreadWithConfig(worker_thread_.get(),
+                             config_.worker_thread_config,
+                             SoraThreadRole::kWorker) ||
+      !StartThreadWithConfig(signaling_thread_.get(),
+                             config_.signaling_thread_config,
+                             SoraThreadRole::kSignaling)) {
+    return false;
   }
 
-  media_dependencies.audio_mixer = nullptr;
-  media_dependencies.audio_processing =
-      webrtc::AudioProcessingBuilder().Create();
-
-  dependencies.media_engine =
-      cricket::CreateMediaEngine(std::move(media_dependencies));
+  SoraPeerConnectionFactoryDependenciesConfig dependencies_config;
+  dependencies_config.network_thread = network_thread_.get();
+  dependencies_config.worker_thread = worker_thread_.get();
+  dependencies_config.signaling_thread = signaling_thread_.get();
+  dependencies_config.use_audio_device = config_.use_audio_deivce;
+  dependencies_config.use_hardware_encoder = config_.use_hardware_encoder;
+  dependencies_config.use_passthrough_encoder = config_.use_passthrough_encoder;
+  dependencies_config.use_pipelined_encoder = config_.use_pipelined_encoder;
+  dependencies_config.audio_only = config_.audio_only;
+  dependencies_config.opus_complexity = config_.opus_complexity;
+  dependencies_config.dav1d_decoder_config = config_.dav1d_decoder_config;
+  dependencies_config.decoder_frame_buffer_allocator =
+      config_.decoder_frame_buffer_allocator;
+  dependencies_config.max_decoder_frame_buffers =
+      config_.max_decoder_frame_buffers;
+  dependencies_config.android_application_context =
+      GetAndroidApplicationContext(sora::GetJNIEnv());
+  webrtc::PeerConnectionFactoryDependencies dependencies =
+      CreateSoraPeerConnectionFactoryDependencies(dependencies_config);
 
   ConfigureDependencies(dependencies);
 
@@ -111,11 +73,14 @@ bool SoraDefaultClient::Configure() {
     return false;
   }
 
-  webrtc::PeerConnectionFactoryInterface::Options factory_options;
-  factory_options.disable_encryption = false;
-  factory_options.ssl_max_version = rtc::SSL_PROTOCOL_DTLS_12;
-  factory_options.crypto_options.srtp.enable_gcm_crypto_suites = true;
-  factory_->SetOptions(factory_options);
+  SetSoraPeerConnectionFactoryOptions(factory_);
+
+  int64_t memory_after = GetProcessResidentMemory();
+  if (memory_before >= 0 && memory_after >= 0) {
+    RTC_LOG(LS_INFO) << "SoraDefaultClient configured: audio_only="
+                     << config_.audio_only << " memory_usage="
+                     << (memory_after - memory_before) / 1024 << "KiB";
+  }
 
   OnConfigured();
 
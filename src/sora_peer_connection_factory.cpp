@@ -1,9 +1,22 @@
 #include "sora/sora_peer_connection_factory.h"
 
 // WebRTC
+#include <api/audio_codecs/builtin_audio_decoder_factory.h>
+#include <api/create_peerconnection_factory.h>
+#include <api/rtc_event_log/rtc_event_log_factory.h>
+#include <api/task_queue/default_task_queue_factory.h>
+#include <media/engine/webrtc_media_engine.h>
+#include <modules/audio_device/include/audio_device.h>
+#include <modules/audio_processing/include/audio_processing.h>
 #include <pc/peer_connection_factory.h>
 #include <pc/peer_connection_factory_proxy.h>
 
+#include "sora/audio_device_module.h"
+#include "sora/java_context.h"
+#include "sora/sora_audio_encoder_factory.h"
+#include "sora/sora_video_decoder_factory.h"
+#include "sora/sora_video_encoder_factory.h"
+
 namespace sora {
 
 // webrtc::PeerConnectionFactory から ConnectionContext を取り出す方法が無いので、
@@ -58,4 +71,100 @@ CreateModularPeerConnectionFactoryWithContext(
   return p.first;
 }
 
+webrtc::PeerConnectionFactoryDependencies
+CreateSoraPeerConnectionFactoryDependencies(
+    const SoraPeerConnectionFactoryDependenciesConfig& config) {
+  webrtc::PeerConnectionFactoryDependencies dependencies;
+  dependencies.network_thread = config.network_thread;
+  dependencies.worker_thread = config.worker_thread;
+  dependencies.signaling_thread = config.signaling_thread;
+  dependencies.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+  dependencies.call_factory = webrtc::CreateCallFactory();
+  dependencies.event_log_factory =
+      absl::make_unique<webrtc::RtcEventLogFactory>(
+          dependencies.task_queue_factory.get());
+
+  void* env = sora::GetJNIEnv();
+
+  // media_dependencies
+  cricket::MediaEngineDependencies media_dependencies;
+  media_dependencies.task_queue_factory = dependencies.task_queue_factory.get();
+  media_dependencies.adm = config.worker_thread->Invoke<
+      rtc::scoped_refptr<webrtc::AudioDeviceModule>>(RTC_FROM_HERE, [&] {
+    sora::AudioDeviceModuleConfig adm_config;
+    if (!config.use_audio_device) {
+      adm_config.audio_layer = webrtc::AudioDeviceModule::kDummyAudio;
+    }
+    adm_config.task_queue_factory = dependencies.task_queue_factory.get();
+    adm_config.jni_env = env;
+    adm_config.application_context = config.android_application_context;
+    return sora::CreateAudioDeviceModule(adm_config);
+  });
+
+  {
+    SoraAudioEncoderFactoryConfig encoder_config;
+    encoder_config.opus_complexity = config.opus_complexity;
+    media_dependencies.audio_encoder_factory =
+        sora::CreateSoraAudioEncoderFactory(encoder_config);
+  }
+  media_dependencies.audio_decoder_factory =
+      webrtc::CreateBuiltinAudioDecoderFactory();
+
+  if (config.audio_only) {
+    // エンコーダ/デコーダが 1 つも無いファクトリを使うと、映像のコーデックが無い状態になる
+    media_dependencies.video_encoder_factory =
+        absl::make_unique<sora::SoraVideoEncoderFactory>(
+            SoraVideoEncoderFactoryConfig());
+    media_dependencies.video_decoder_factory =
+        absl::make_unique<sora::SoraVideoDecoderFactory>(
+            SoraVideoDecoderFactoryConfig());
+  } else {
+    auto cuda_context = sora::CudaContext::Create();
+    {
+      auto encoder_config =
+          config.use_hardware_encoder
+              ? sora::GetDefaultVideoEncoderFactoryConfig(cuda_context, env)
+              : sora::GetSoftwareOnlyVideoEncoderFactoryConfig();
+      encoder_config.use_simulcast_adapter = true;
+      encoder_config.use_passthrough_encoder = config.use_passthrough_encoder;
+      encoder_config.use_pipelined_encoder = config.use_pipelined_encoder;
+      media_dependencies.video_encoder_factory =
+          absl::make_unique<sora::SoraVideoEncoderFactory>(
+              std::move(encoder_config));
+    }
+    {
+      sora::DefaultVideoDecoderFactoryOptions decoder_options;
+      decoder_options.allocator = config.decoder_frame_buffer_allocator;
+      decoder_options.dav1d_config = config.dav1d_decoder_config;
+      decoder_options.max_frame_buffers = config.max_decoder_frame_buffers;
+      auto decoder_config =
+          config.use_hardware_encoder
+              ? sora::GetDefaultVideoDecoderFactoryConfig(cuda_context, env,
+                                                          decoder_options)
+              : sora::GetSoftwareOnlyVideoDecoderFactoryConfig(
+                    config.dav1d_decoder_config);
+      media_dependencies.video_decoder_factory =
+          absl::make_unique<sora::SoraVideoDecoderFactory>(
+              std::move(decoder_config));
+    }
+  }
+
+  media_dependencies.audio_mixer = nullptr;
+  media_dependencies.audio_processing =
+      webrtc::AudioProcessingBuilder().Create();
+
+  dependencies.media_engine =
+      cricket::CreateMediaEngine(std::move(media_dependencies));
+  return dependencies;
+}
+
+void SetSoraPeerConnectionFactoryOptions(
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory) {
+  webrtc::PeerConnectionFactoryInterface::Options factory_options;
+  factory_options.disable_encryption = false;
+  factory_options.ssl_max_version = rtc::SSL_PROTOCOL_DTLS_12;
+  factory_options.crypto_options.srtp.enable_gcm_crypto_suites = true;
+  factory->SetOptions(factory_options);
+}
+
 }  // namespace sora
\ No newline at end of file
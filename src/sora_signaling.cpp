@@ -1,23 +1,42 @@
 #include "sora/sora_signaling.h"
 
+#include <algorithm>
+#include <set>
+#include <sstream>
+
 // WebRTC
 #include <p2p/client/basic_port_allocator.h>
 #include <pc/rtp_media_utils.h>
+#include <rtc_base/helpers.h>
+#include <rtc_base/time_utils.h>
 
 #include "sora/data_channel.h"
 #include "sora/rtc_ssl_verifier.h"
 #include "sora/rtc_stats.h"
 #include "sora/session_description.h"
+#include "sora/signaling_trace.h"
+#include "sora/thread_cpu_usage.h"
 #include "sora/url_parts.h"
 #include "sora/version.h"
 #include "sora/zlib_helper.h"
 
 namespace sora {
 
+// DataChannel のプローブのメッセージの先頭
+static const char kProbePrefix[] = "sora-dc-probe ";
+
 SoraSignaling::SoraSignaling(const SoraSignalingConfig& config)
     : config_(config),
       connection_timeout_timer_(*config_.io_context),
-      closing_timeout_timer_(*config_.io_context) {}
+      closing_timeout_timer_(*config_.io_context),
+      probe_timer_(*config_.io_context),
+      flight_stats_timer_(*config_.io_context),
+      bitrate_stats_timer_(*config_.io_context) {
+  if (config_.flight_recorder != nullptr) {
+    flight_session_ = config_.flight_recorder->CreateSession(
+        config_.channel_id + "_" + rtc::CreateRandomString(8));
+  }
+}
 
 SoraSignaling::~SoraSignaling() {
   RTC_LOG(LS_INFO) << "SoraSignaling::~SoraSignaling";
@@ -36,8 +55,11 @@ SoraSignaling::GetPeerConnection() const {
 void SoraSignaling::Connect() {
   RTC_LOG(LS_INFO) << "SoraSignaling::Connect";
 
-  boost::asio::post(*config_.io_context,
-                    [self = shared_from_this()]() { self->DoConnect(); });
+  boost::asio::post(*config_.io_context, [self = shared_from_this()]() {
+    // io_context はアプリケーションが動かしているので、ここで役割を登録しておく
+    RegisterCurrentThread(SoraThreadRole::kIoContext);
+    self->DoConnect();
+  });
 }
 
 void SoraSignaling::Disconnect() {
@@ -315,14 +337,14 @@ void SoraSignaling::DoSendConnect(bool redirect) {
     m["data_channels"] = ar;
   }
 
-  ws_->WriteText(
+  WriteWebSocketText(
       boost::json::serialize(m),
       [self = shared_from_this()](boost::system::error_code, size_t) {});
 }
 
 void SoraSignaling::DoSendPong() {
   boost::json::value m = {{"type", "pong"}};
-  ws_->WriteText(
+  WriteWebSocketText(
       boost::json::serialize(m),
       [self = shared_from_this()](boost::system::error_code, size_t) {});
 }
@@ -330,14 +352,16 @@ void SoraSignaling::DoSendPong() {
 void SoraSignaling::DoSendPong(
     const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
   std::string stats = report->ToJson();
+  last_stats_bytes_ = stats.size();
   if (dc_ && using_datachannel_ && dc_->IsOpen("stats")) {
     // DataChannel が使える場合は type: stats で DataChannel に送る
     std::string str = R"({"type":"stats","reports":)" + stats + "}";
     SendDataChannel("stats", str);
   } else if (ws_) {
     std::string str = R"({"type":"pong","stats":)" + stats + "}";
-    ws_->WriteText(std::move(str), [self = shared_from_this()](
-                                       boost::system::error_code, size_t) {});
+    WriteWebSocketText(
+        std::move(str),
+        [self = shared_from_this()](boost::system::error_code, size_t) {});
   }
 }
 
@@ -347,12 +371,143 @@ void SoraSignaling::DoSendUpdate(const std::string& sdp, std::string type) {
     // DataChannel が使える場合は DataChannel に送る
     SendDataChannel("signaling", boost::json::serialize(m));
   } else if (ws_) {
-    ws_->WriteText(
+    WriteWebSocketText(
         boost::json::serialize(m),
         [self = shared_from_this()](boost::system::error_code, size_t) {});
   }
 }
 
+// fmtp の "key=value;key=value" に params を上書きしたものを返す
+static std::string MergeFmtpParameters(
+    const std::string& fmtp,
+    const std::vector<std::pair<std::string, std::string>>& params) {
+  std::vector<std::pair<std::string, std::string>> merged;
+  std::istringstream iss(fmtp);
+  std::string kv;
+  while (std::getline(iss, kv, ';')) {
+    kv.erase(0, kv.find_first_not_of(' '));
+    if (kv.empty()) {
+      continue;
+    }
+    auto pos = kv.find('=');
+    if (pos == std::string::npos) {
+      merged.push_back({kv, ""});
+    } else {
+      merged.push_back({kv.substr(0, pos), kv.substr(pos + 1)});
+    }
+  }
+  for (const auto& p : params) {
+    auto it = std::find_if(
+        merged.begin(), merged.end(),
+        [&p](const std::pair<std::string, std::string>& m) {
+          return m.first == p.first;
+        });
+    if (it != merged.end()) {
+      it->second = p.second;
+    } else {
+      merged.push_back(p);
+    }
+  }
+  std::string r;
+  for (const auto& m : merged) {
+    if (!r.empty()) {
+      r += ";";
+    }
+    r += m.second.empty() ? m.first : m.first + "=" + m.second;
+  }
+  return r;
+}
+
+std::string SoraSignaling::ApplyOpusParameters(const std::string& sdp) const {
+  const auto& opus = config_.opus;
+  std::vector<std::pair<std::string, std::string>> params;
+  if (opus.ptime) {
+    params.push_back({"ptime", std::to_string(*opus.ptime)});
+  }
+  if (opus.dtx) {
+    params.push_back({"usedtx", *opus.dtx ? "1" : "0"});
+  }
+  if (opus.fec) {
+    params.push_back({"useinbandfec", *opus.fec ? "1" : "0"});
+  }
+  if (opus.stereo) {
+    params.push_back({"stereo", *opus.stereo ? "1" : "0"});
+    params.push_back({"sprop-stereo", *opus.stereo ? "1" : "0"});
+  }
+  if (params.empty()) {
+    return sdp;
+  }
+
+  std::vector<std::string> lines;
+  {
+    std::istringstream iss(sdp);
+    std::string line;
+    while (std::getline(iss, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      lines.push_back(line);
+    }
+  }
+
+  // Opus のペイロードタイプと、fmtp 行が既にあるペイロードタイプを調べる
+  const std::string rtpmap_prefix = "a=rtpmap:";
+  const std::string fmtp_prefix = "a=fmtp:";
+  std::set<std::string> opus_pts;
+  std::set<std::string> fmtp_pts;
+  for (const auto& line : lines) {
+    auto pos = line.find(' ');
+    if (pos == std::string::npos) {
+      continue;
+    }
+    if (line.compare(0, rtpmap_prefix.size(), rtpmap_prefix) == 0) {
+      std::string codec = line.substr(pos + 1, 5);
+      std::transform(codec.begin(), codec.end(), codec.begin(), ::tolower);
+      if (codec == "opus/") {
+        opus_pts.insert(line.substr(rtpmap_prefix.size(),
+                                    pos - rtpmap_prefix.size()));
+      }
+    } else if (line.compare(0, fmtp_prefix.size(), fmtp_prefix) == 0) {
+      fmtp_pts.insert(
+          line.substr(fmtp_prefix.size(), pos - fmtp_prefix.size()));
+    }
+  }
+  if (opus_pts.empty()) {
+    return sdp;
+  }
+
+  std::string r;
+  for (const auto& line : lines) {
+    if (line.empty()) {
+      continue;
+    }
+    auto pos = line.find(' ');
+    bool is_rtpmap =
+        line.compare(0, rtpmap_prefix.size(), rtpmap_prefix) == 0;
+    bool is_fmtp = line.compare(0, fmtp_prefix.size(), fmtp_prefix) == 0;
+    if (is_fmtp && pos != std::string::npos) {
+      std::string pt =
+          line.substr(fmtp_prefix.size(), pos - fmtp_prefix.size());
+      if (opus_pts.count(pt) != 0) {
+        r += fmtp_prefix + pt + " " +
+             MergeFmtpParameters(line.substr(pos + 1), params) + "\r\n";
+        continue;
+      }
+    }
+    r += line + "\r\n";
+    // fmtp 行が無い場合は rtpmap の直後に追加する
+    if (is_rtpmap && pos != std::string::npos) {
+      std::string pt =
+          line.substr(rtpmap_prefix.size(), pos - rtpmap_prefix.size());
+      if (opus_pts.count(pt) != 0 && fmtp_pts.count(pt) == 0) {
+        r += fmtp_prefix + pt + " " + MergeFmtpParameters("", params) +
+             "\r\n";
+      }
+    }
+  }
+  return r;
+}
+
 class RawCryptString : public rtc::CryptStringImpl {
  public:
   RawCryptString(const std::string& str) : str_(str) {}
@@ -405,6 +560,15 @@ SoraSignaling::CreatePeerConnection(boost::json::value jconfig) {
 #endif
 
   rtc_config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+
+  // 事前に生成した証明書があればそれを使い、接続時の証明書の生成を省く
+  if (config_.certificate_pool != nullptr) {
+    auto certificate = config_.certificate_pool->Take();
+    if (certificate != nullptr) {
+      rtc_config.certificates.push_back(certificate);
+    }
+  }
+
   webrtc::PeerConnectionDependencies dependencies(this);
 
   // WebRTC の SSL 接続の検証は自前のルート証明書(rtc_base/ssl_roots.h)でやっていて、
@@ -553,7 +717,7 @@ void SoraSignaling::DoInternalDisconnect(
   } else if (!using_datachannel_ && ws_connected_) {
     boost::json::value disconnect = {{"type", "disconnect"},
                                      {"reason", "NO-ERROR"}};
-    ws_->WriteText(
+    WriteWebSocketText(
         boost::json::serialize(disconnect),
         [self = shared_from_this(), on_close](boost::system::error_code ec,
                                               std::size_t) {
@@ -738,6 +902,8 @@ void SoraSignaling::OnRead(boost::system::error_code ec,
   }
 
   RTC_LOG(LS_INFO) << "OnRead: text=" << text;
+  TraceMessage(SignalingTraceDirection::kInbound,
+               kSignalingTraceWebSocketChannel, text);
 
   auto m = boost::json::parse(text);
   const std::string type = m.at("type").as_string().c_str();
@@ -784,7 +950,9 @@ void SoraSignaling::OnRead(boost::system::error_code ec,
     }
 
     pc_ = CreatePeerConnection(m.at("config"));
-    const std::string sdp = m.at("sdp").as_string().c_str();
+    ApplyBitrateMemory();
+    const std::string sdp =
+        ApplyOpusParameters(m.at("sdp").as_string().c_str());
 
     SessionDescription::SetOffer(
         pc_.get(), sdp,
@@ -872,7 +1040,7 @@ void SoraSignaling::OnRead(boost::system::error_code ec,
                     }
 
                     boost::json::value m = {{"type", "answer"}, {"sdp", sdp}};
-                    self->ws_->WriteText(
+                    self->WriteWebSocketText(
                         boost::json::serialize(m),
                         [self](boost::system::error_code, size_t) {});
                   });
@@ -887,7 +1055,8 @@ void SoraSignaling::OnRead(boost::system::error_code ec,
       return;
     }
     std::string answer_type = type == "update" ? "update" : "re-answer";
-    const std::string sdp = m.at("sdp").as_string().c_str();
+    const std::string sdp =
+        ApplyOpusParameters(m.at("sdp").as_string().c_str());
     SessionDescription::SetOffer(
         pc_.get(), sdp,
         [self = shared_from_this(), type, answer_type]() {
@@ -1134,11 +1303,167 @@ void SoraSignaling::ResetEncodingParameters() {
   sender->SetParameters(parameters);
 }
 
+void SoraSignaling::UpdateSenderEncodings(
+    rtc::scoped_refptr<webrtc::RtpSenderInterface> sender,
+    std::vector<SenderEncodingUpdate> updates,
+    std::function<void(webrtc::RTCError)> on_complete) {
+  boost::asio::post(*config_.io_context, [self = shared_from_this(), sender,
+                                          updates = std::move(updates),
+                                          on_complete]() {
+    webrtc::RTCError error = self->DoUpdateSenderEncodings(sender, updates);
+    if (on_complete) {
+      on_complete(error);
+    }
+  });
+}
+
+void SoraSignaling::GetMemoryUsage(
+    std::function<void(SoraSignalingMemoryUsage)> on_complete) {
+  boost::asio::post(*config_.io_context, [self = shared_from_this(),
+                                          on_complete]() {
+    SoraSignalingMemoryUsage usage;
+    if (self->ws_) {
+      usage.websocket_write_queue_bytes = self->ws_->GetWriteQueueBytes();
+    }
+    if (self->dc_) {
+      usage.data_channel_buffered_bytes = self->dc_->GetBufferedAmount();
+    }
+    if (self->pc_) {
+      std::string sdp;
+      auto local = self->pc_->local_description();
+      if (local != nullptr && local->ToString(&sdp)) {
+        usage.sdp_bytes += sdp.size();
+      }
+      auto remote = self->pc_->remote_description();
+      if (remote != nullptr && remote->ToString(&sdp)) {
+        usage.sdp_bytes += sdp.size();
+      }
+    }
+    usage.stats_bytes = self->last_stats_bytes_;
+    for (const auto& label : self->compressed_labels_) {
+      usage.other_bytes += label.size();
+    }
+    for (const auto& enc : self->encodings_) {
+      usage.other_bytes += sizeof(enc) + enc.rid.size();
+    }
+    usage.other_bytes += self->mid_.size();
+    usage.sdk = GetSoraMemoryStats();
+    if (on_complete) {
+      on_complete(usage);
+    }
+  });
+}
+
+webrtc::RTCError SoraSignaling::DoUpdateSenderEncodings(
+    rtc::scoped_refptr<webrtc::RtpSenderInterface> sender,
+    const std::vector<SenderEncodingUpdate>& updates) {
+  if (state_ != State::Connected || pc_ == nullptr) {
+    return webrtc::RTCError(webrtc::RTCErrorType::INVALID_STATE,
+                            "Not connected");
+  }
+  if (sender == nullptr) {
+    return webrtc::RTCError(webrtc::RTCErrorType::INVALID_PARAMETER,
+                            "sender is null");
+  }
+
+  auto apply = [](const SenderEncodingUpdate& u,
+                  webrtc::RtpEncodingParameters& enc) {
+    if (u.max_bitrate_bps) {
+      enc.max_bitrate_bps = *u.max_bitrate_bps > 0
+                                ? absl::optional<int>(*u.max_bitrate_bps)
+                                : absl::nullopt;
+    }
+    if (u.max_framerate) {
+      enc.max_framerate = *u.max_framerate > 0
+                              ? absl::optional<double>(*u.max_framerate)
+                              : absl::nullopt;
+    }
+    if (u.scale_resolution_down_by) {
+      enc.scale_resolution_down_by = *u.scale_resolution_down_by;
+    }
+    if (u.active) {
+      enc.active = *u.active;
+    }
+  };
+
+  // GetParameters で取得したエンコーディングを直接書き換えるので ssrc はそのまま維持される
+  webrtc::RtpParameters parameters = sender->GetParameters();
+  for (const auto& u : updates) {
+    bool found = false;
+    for (auto& enc : parameters.encodings) {
+      if (u.rid.empty() || enc.rid == u.rid) {
+        apply(u, enc);
+        found = true;
+      }
+    }
+    if (!found) {
+      RTC_LOG(LS_WARNING) << "UpdateSenderEncodings: rid [" << u.rid
+                          << "] not found";
+      return webrtc::RTCError(webrtc::RTCErrorType::INVALID_PARAMETER,
+                              "Specified rid [" + u.rid + "] not found");
+    }
+  }
+
+  for (const auto& enc : parameters.encodings) {
+    RTC_LOG(LS_INFO) << "UpdateSenderEncodings: rid=" << enc.rid
+                     << " active=" << (enc.active ? "true" : "false")
+                     << " max_bitrate_bps="
+                     << (enc.max_bitrate_bps
+                             ? std::to_string(*enc.max_bitrate_bps)
+                             : std::string("nullopt"))
+                     << " max_framerate="
+                     << (enc.max_framerate ? std::to_string(*enc.max_framerate)
+                                           : std::string("nullopt"))
+                     << " scale_resolution_down_by="
+                     << (enc.scale_resolution_down_by
+                             ? std::to_string(*enc.scale_resolution_down_by)
+                             : std::string("nullopt"));
+  }
+
+  webrtc::RTCError error = sender->SetParameters(parameters);
+  if (!error.ok()) {
+    RTC_LOG(LS_ERROR) << "Failed to SetParameters: error=" << error.message();
+    return error;
+  }
+
+  // re-offer の後に ResetEncodingParameters で元に戻されないように、
+  // サイマルキャストで管理しているエンコーディングにも反映しておく
+  if (!mid_.empty()) {
+    for (auto transceiver : pc_->GetTransceivers()) {
+      if (transceiver->mid() != mid_ ||
+          transceiver->sender().get() != sender.get()) {
+        continue;
+      }
+      for (const auto& u : updates) {
+        for (auto& enc : encodings_) {
+          if (u.rid.empty() || enc.rid == u.rid) {
+            apply(u, enc);
+          }
+        }
+      }
+      break;
+    }
+  }
+
+  return webrtc::RTCError::OK();
+}
+
 void SoraSignaling::SendOnDisconnect(SoraSignalingErrorCode ec,
                                      std::string message) {
   if (ec != SoraSignalingErrorCode::CLOSE_SUCCEEDED) {
     RTC_LOG(LS_ERROR) << "Failed to Disconnect: message=" << message;
   }
+  // 異常終了した時だけ、直前のログと統計情報を書き出す
+  if (flight_session_ != nullptr &&
+      (ec == SoraSignalingErrorCode::PEER_CONNECTION_STATE_FAILED ||
+       ec == SoraSignalingErrorCode::WEBSOCKET_ONERROR)) {
+    flight_session_->Dump("ec=" + std::to_string(static_cast<int>(ec)) +
+                          " signaling_url=" + connected_signaling_url_ +
+                          " message=" + message);
+  }
+  if (config_.bitrate_memory != nullptr) {
+    config_.bitrate_memory->SaveAsync();
+  }
   boost::asio::post(*config_.io_context, [self = shared_from_this(), ec,
                                           message = std::move(message)]() {
     self->Clear();
@@ -1165,14 +1490,229 @@ bool SoraSignaling::SendDataChannel(const std::string& label,
     return false;
   }
 
+  if (label.empty() || label[0] != '#') {
+    TraceMessage(SignalingTraceDirection::kOutbound, label, input);
+  }
   webrtc::DataBuffer data = ConvertToDataBuffer(label, input);
   dc_->Send(label, data);
   return true;
 }
 
+void SoraSignaling::GetDataChannelStats(
+    std::function<void(std::vector<DataChannelLabelStats>)> on_complete) {
+  boost::asio::post(*config_.io_context, [self = shared_from_this(),
+                                          on_complete]() {
+    std::vector<DataChannelLabelStats> stats;
+    if (self->dc_) {
+      stats = self->dc_->GetStats();
+    }
+    on_complete(std::move(stats));
+  });
+}
+
+void SoraSignaling::StartDataChannelProbe() {
+  // 応答する時にも自分の ID として使うので、送らない場合も生成しておく
+  if (probe_id_.empty()) {
+    probe_id_ = rtc::CreateRandomString(16);
+  }
+  if (probe_started_ || config_.data_channel_probe.interval_ms <= 0) {
+    return;
+  }
+  probe_started_ = true;
+  RTC_LOG(LS_INFO) << "Start DataChannel probe: label="
+                   << config_.data_channel_probe.label
+                   << " interval_ms=" << config_.data_channel_probe.interval_ms;
+  SendDataChannelProbe();
+}
+
+void SoraSignaling::SendDataChannelProbe() {
+  const std::string& label = config_.data_channel_probe.label;
+  if (dc_ == nullptr || state_ == State::Closing || state_ == State::Closed ||
+      state_ == State::Destructing) {
+    probe_started_ = false;
+    return;
+  }
+
+  // DataChannel に切り替わる前は送れないので、次の間隔まで待つ
+  if (state_ == State::Connected && dc_->IsOpen(label)) {
+    std::string message = std::string(kProbePrefix) + "req " + probe_id_ +
+                          " " + std::to_string(++probe_seq_) + " " +
+                          std::to_string(rtc::TimeMicros());
+    if (SendDataChannel(label, message)) {
+      dc_->AddProbeSent(label);
+    }
+  }
+
+  probe_timer_.expires_from_now(boost::posix_time::milliseconds(
+      config_.data_channel_probe.interval_ms));
+  probe_timer_.async_wait(
+      [self = shared_from_this()](boost::system::error_code ec) {
+        if (ec) {
+          return;
+        }
+        self->SendDataChannelProbe();
+      });
+}
+
+bool SoraSignaling::HandleDataChannelProbe(const std::string& label,
+                                           const std::string& data) {
+  const auto& probe = config_.data_channel_probe;
+  const size_t prefix_size = sizeof(kProbePrefix) - 1;
+  if (probe.label.empty() || label != probe.label ||
+      data.compare(0, prefix_size, kProbePrefix) != 0) {
+    return false;
+  }
+
+  // "req <送信した参加者の ID> <seq> <送信時刻>"
+  // "res <送信した参加者の ID> <seq> <送信時刻> <応答した参加者の ID>"
+  std::istringstream iss(data.substr(prefix_size));
+  std::string kind;
+  std::string id;
+  uint32_t seq;
+  int64_t sent_us;
+  std::string responder_id;
+  if (!(iss >> kind >> id >> seq >> sent_us) ||
+      (kind == "res" && !(iss >> responder_id))) {
+    RTC_LOG(LS_WARNING) << "Invalid DataChannel probe: data=" << data;
+    return true;
+  }
+  if (kind == "req") {
+    if (probe.respond && id != probe_id_ && !probe_id_.empty()) {
+      SendDataChannel(label, std::string(kProbePrefix) + "res " + id + " " +
+                                 std::to_string(seq) + " " +
+                                 std::to_string(sent_us) + " " + probe_id_);
+    }
+  } else if (kind == "res" && id == probe_id_ && dc_ != nullptr) {
+    dc_->AddProbeRtt(label, responder_id, rtc::TimeMicros() - sent_us);
+  }
+  return true;
+}
+
+void SoraSignaling::StartFlightRecorderStats() {
+  if (flight_session_ == nullptr || flight_stats_started_ ||
+      config_.flight_recorder->config().stats_interval_ms <= 0) {
+    return;
+  }
+  flight_stats_started_ = true;
+  SampleFlightRecorderStats();
+}
+
+void SoraSignaling::SampleFlightRecorderStats() {
+  if (pc_ == nullptr || state_ == State::Closing || state_ == State::Closed ||
+      state_ == State::Destructing) {
+    flight_stats_started_ = false;
+    return;
+  }
+
+  pc_->GetStats(
+      RTCStatsCallback::Create(
+          [session = flight_session_](
+              const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+            session->AddStats(report->ToJson());
+          })
+          .get());
+
+  flight_stats_timer_.expires_from_now(boost::posix_time::milliseconds(
+      config_.flight_recorder->config().stats_interval_ms));
+  flight_stats_timer_.async_wait(
+      [self = shared_from_this()](boost::system::error_code ec) {
+        if (ec) {
+          return;
+        }
+        self->SampleFlightRecorderStats();
+      });
+}
+
+void SoraSignaling::ApplyBitrateMemory() {
+  if (config_.bitrate_memory == nullptr || pc_ == nullptr || ws_ == nullptr) {
+    return;
+  }
+  URLParts parts;
+  bool ssl;
+  if (!ParseURL(connected_signaling_url_, parts, ssl)) {
+    return;
+  }
+  std::string key = BitrateMemory::MakeKey(parts.host, ws_->GetLocalAddress());
+  bitrate_session_ = config_.bitrate_memory->CreateSession(key);
+
+  auto start_bitrate_bps = config_.bitrate_memory->GetStartBitrate(
+      key, config_.video_bit_rate * 1000);
+  if (!start_bitrate_bps) {
+    RTC_LOG(LS_INFO) << "No bitrate memory: key=" << key;
+    return;
+  }
+  webrtc::BitrateSettings settings;
+  settings.start_bitrate_bps = *start_bitrate_bps;
+  auto error = pc_->SetBitrate(settings);
+  if (!error.ok()) {
+    RTC_LOG(LS_WARNING) << "Failed to SetBitrate: key=" << key
+                        << " error=" << error.message();
+    return;
+  }
+  RTC_LOG(LS_INFO) << "Set start bitrate from bitrate memory: key=" << key
+                   << " start_bitrate_bps=" << *start_bitrate_bps;
+}
+
+void SoraSignaling::StartBitrateMemoryStats() {
+  if (bitrate_session_ == nullptr || bitrate_stats_started_ ||
+      config_.bitrate_memory->config().sample_interval_ms <= 0) {
+    return;
+  }
+  bitrate_stats_started_ = true;
+  SampleBitrateMemoryStats();
+}
+
+void SoraSignaling::SampleBitrateMemoryStats() {
+  if (pc_ == nullptr || state_ == State::Closing || state_ == State::Closed ||
+      state_ == State::Destructing) {
+    bitrate_stats_started_ = false;
+    return;
+  }
+
+  pc_->GetStats(
+      RTCStatsCallback::Create(
+          [session = bitrate_session_](
+              const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+            session->OnStats(report);
+          })
+          .get());
+
+  bitrate_stats_timer_.expires_from_now(boost::posix_time::milliseconds(
+      config_.bitrate_memory->config().sample_interval_ms));
+  bitrate_stats_timer_.async_wait(
+      [self = shared_from_this()](boost::system::error_code ec) {
+        if (ec) {
+          return;
+        }
+        self->SampleBitrateMemoryStats();
+      });
+}
+
+void SoraSignaling::WriteWebSocketText(std::string text,
+                                       Websocket::write_callback_t on_write) {
+  TraceMessage(SignalingTraceDirection::kOutbound,
+               kSignalingTraceWebSocketChannel, text);
+  ws_->WriteText(std::move(text), std::move(on_write));
+}
+
+void SoraSignaling::TraceMessage(SignalingTraceDirection direction,
+                                 const std::string& channel,
+                                 const std::string& message) {
+  if (config_.trace_recorder != nullptr) {
+    config_.trace_recorder->Record(direction, channel, message);
+  }
+}
+
 void SoraSignaling::Clear() {
   connection_timeout_timer_.cancel();
   closing_timeout_timer_.cancel();
+  probe_timer_.cancel();
+  probe_started_ = false;
+  flight_stats_timer_.cancel();
+  flight_stats_started_ = false;
+  bitrate_stats_timer_.cancel();
+  bitrate_stats_started_ = false;
+  bitrate_session_ = nullptr;
   connecting_wss_.clear();
   connected_signaling_url_.clear();
   pc_ = nullptr;
@@ -1228,6 +1768,12 @@ void SoraSignaling::OnConnectionChange(
                          << "]";
         self->connection_state_ = new_state;
 
+        if (new_state == webrtc::PeerConnectionInterface::
+                             PeerConnectionState::kConnected) {
+          self->StartFlightRecorderStats();
+          self->StartBitrateMemoryStats();
+        }
+
         // Failed になったら諦めるしか無いので終了処理に入る
         if (new_state ==
             webrtc::PeerConnectionInterface::PeerConnectionState::kFailed) {
@@ -1265,8 +1811,8 @@ void SoraSignaling::OnIceCandidate(
           return;
         }
 
-        self->ws_->WriteText(boost::json::serialize(m),
-                             [self](boost::system::error_code, size_t) {});
+        self->WriteWebSocketText(boost::json::serialize(m),
+                                 [self](boost::system::error_code, size_t) {});
       });
 }
 
@@ -1315,7 +1861,13 @@ void SoraSignaling::OnRemoveTrack(
 // -----------------------------
 
 void SoraSignaling::OnStateChange(
-    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) {}
+    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) {
+  if (!config_.data_channel_probe.label.empty() &&
+      data_channel->label() == config_.data_channel_probe.label &&
+      data_channel->state() == webrtc::DataChannelInterface::kOpen) {
+    StartDataChannelProbe();
+  }
+}
 void SoraSignaling::OnMessage(
     rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel,
     const webrtc::DataBuffer& buffer) {
@@ -1342,6 +1894,9 @@ void SoraSignaling::OnMessage(
 
   // ユーザ定義のラベルは JSON ではないので JSON パース前に処理して終わる
   if (!label.empty() && label[0] == '#') {
+    if (HandleDataChannelProbe(label, data)) {
+      return;
+    }
     auto ob = config_.observer.lock();
     if (ob != nullptr) {
       ob->OnMessage(std::move(label), std::move(data));
@@ -1349,6 +1904,8 @@ void SoraSignaling::OnMessage(
     return;
   }
 
+  TraceMessage(SignalingTraceDirection::kInbound, label, data);
+
   boost::json::error_code ec;
   auto json = boost::json::parse(data, ec);
   if (ec) {
@@ -1359,7 +1916,8 @@ void SoraSignaling::OnMessage(
   if (label == "signaling") {
     const std::string type = json.at("type").as_string().c_str();
     if (type == "re-offer") {
-      const std::string sdp = json.at("sdp").as_string().c_str();
+      const std::string sdp =
+          ApplyOpusParameters(json.at("sdp").as_string().c_str());
       SessionDescription::SetOffer(
           pc_.get(), sdp,
           [self = shared_from_this()]() {
@@ -35,6 +35,7 @@
 #include "sora/hwenc_jetson/jetson_video_decoder.h"
 #endif
 
+#include "counted_video_codec.h"
 #include "default_video_formats.h"
 
 namespace sora {
@@ -95,7 +96,7 @@ SoraVideoDecoderFactory::CreateVideoDecoder(
     std::unique_ptr<webrtc::VideoDecoder> r;
     for (const auto& f : supported_formats) {
       if (f.IsSameCodec(format)) {
-        return create_video_decoder(format);
+        return CountedVideoDecoder::Wrap(create_video_decoder(format));
       }
     }
 
@@ -109,8 +110,9 @@ SoraVideoDecoderFactory::CreateVideoDecoder(
 
 SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
     std::shared_ptr<CudaContext> cuda_context,
-    void* env) {
-  auto config = GetSoftwareOnlyVideoDecoderFactoryConfig();
+    void* env,
+    DefaultVideoDecoderFactoryOptions options) {
+  auto config = GetSoftwareOnlyVideoDecoderFactoryConfig(options.dav1d_config);
 
 #if defined(__APPLE__)
   config.decoders.insert(config.decoders.begin(),
@@ -131,10 +133,12 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
     config.decoders.insert(
         config.decoders.begin(),
         VideoDecoderConfig(webrtc::kVideoCodecVP8,
-                           [cuda_context = cuda_context](auto format) {
+                           [cuda_context = cuda_context, options](auto format) {
                              return std::unique_ptr<webrtc::VideoDecoder>(
                                  absl::make_unique<NvCodecVideoDecoder>(
-                                     cuda_context, CudaVideoCodec::VP8));
+                                     cuda_context, CudaVideoCodec::VP8,
+                                     options.allocator,
+                                     options.max_frame_buffers));
                            }));
   }
   if (NvCodecVideoDecoder::IsSupported(cuda_context,
@@ -142,10 +146,12 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
     config.decoders.insert(
         config.decoders.begin(),
         VideoDecoderConfig(webrtc::kVideoCodecVP9,
-                           [cuda_context = cuda_context](auto format) {
+                           [cuda_context = cuda_context, options](auto format) {
                              return std::unique_ptr<webrtc::VideoDecoder>(
                                  absl::make_unique<NvCodecVideoDecoder>(
-                                     cuda_context, CudaVideoCodec::VP9));
+                                     cuda_context, CudaVideoCodec::VP9,
+                                     options.allocator,
+                                     options.max_frame_buffers));
                            }));
   }
   if (NvCodecVideoDecoder::IsSupported(cuda_context,
@@ -153,10 +159,12 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
     config.decoders.insert(
         config.decoders.begin(),
         VideoDecoderConfig(webrtc::kVideoCodecH264,
-                           [cuda_context = cuda_context](auto format) {
+                           [cuda_context = cuda_context, options](auto format) {
                              return std::unique_ptr<webrtc::VideoDecoder>(
                                  absl::make_unique<NvCodecVideoDecoder>(
-                                     cuda_context, CudaVideoCodec::H264));
+                                     cuda_context, CudaVideoCodec::H264,
+                                     options.allocator,
+                                     options.max_frame_buffers));
                            }));
   }
 #endif
@@ -168,9 +176,11 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
         config.decoders.begin(),
         VideoDecoderConfig(
             webrtc::kVideoCodecVP8,
-            [](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
+            [options](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
               return MsdkVideoDecoder::Create(MsdkSession::Create(),
-                                              webrtc::kVideoCodecVP8);
+                                              webrtc::kVideoCodecVP8,
+                                              options.allocator,
+                                              options.max_frame_buffers);
             }));
   }
   if (MsdkVideoDecoder::IsSupported(session, webrtc::kVideoCodecVP9)) {
@@ -178,9 +188,11 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
         config.decoders.begin(),
         VideoDecoderConfig(
             webrtc::kVideoCodecVP9,
-            [](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
+            [options](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
               return MsdkVideoDecoder::Create(MsdkSession::Create(),
-                                              webrtc::kVideoCodecVP9);
+                                              webrtc::kVideoCodecVP9,
+                                              options.allocator,
+                                              options.max_frame_buffers);
             }));
   }
   if (MsdkVideoDecoder::IsSupported(session, webrtc::kVideoCodecH264)) {
@@ -188,9 +200,11 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
         config.decoders.begin(),
         VideoDecoderConfig(
             webrtc::kVideoCodecH264,
-            [](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
+            [options](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
               return MsdkVideoDecoder::Create(MsdkSession::Create(),
-                                              webrtc::kVideoCodecH264);
+                                              webrtc::kVideoCodecH264,
+                                              options.allocator,
+                                              options.max_frame_buffers);
             }));
   }
   if (MsdkVideoDecoder::IsSupported(session, webrtc::kVideoCodecAV1)) {
@@ -198,9 +212,11 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
         config.decoders.begin(),
         VideoDecoderConfig(
             webrtc::kVideoCodecAV1,
-            [](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
+            [options](auto format) -> std::unique_ptr<webrtc::VideoDecoder> {
               return MsdkVideoDecoder::Create(MsdkSession::Create(),
-                                              webrtc::kVideoCodecAV1);
+                                              webrtc::kVideoCodecAV1,
+                                              options.allocator,
+                                              options.max_frame_buffers);
             }));
   }
 #endif
@@ -209,37 +225,52 @@ SoraVideoDecoderFactoryConfig GetDefaultVideoDecoderFactoryConfig(
   if (JetsonVideoDecoder::IsSupportedVP8()) {
     config.decoders.insert(
         config.decoders.begin(),
-        VideoDecoderConfig(webrtc::kVideoCodecVP8, [](auto format) {
-          return std::unique_ptr<webrtc::VideoDecoder>(
-              absl::make_unique<JetsonVideoDecoder>(webrtc::kVideoCodecVP8));
-        }));
+        VideoDecoderConfig(
+            webrtc::kVideoCodecVP8,
+            [options](auto format) {
+              return std::unique_ptr<webrtc::VideoDecoder>(
+                  absl::make_unique<JetsonVideoDecoder>(
+                      webrtc::kVideoCodecVP8, options.allocator,
+                      options.max_frame_buffers));
+            }));
   }
   if (JetsonVideoDecoder::IsSupportedAV1()) {
     config.decoders.insert(
         config.decoders.begin(),
-        VideoDecoderConfig(webrtc::kVideoCodecAV1, [](auto format) {
-          return std::unique_ptr<webrtc::VideoDecoder>(
-              absl::make_unique<JetsonVideoDecoder>(webrtc::kVideoCodecAV1));
-        }));
+        VideoDecoderConfig(
+            webrtc::kVideoCodecAV1,
+            [options](auto format) {
+              return std::unique_ptr<webrtc::VideoDecoder>(
+                  absl::make_unique<JetsonVideoDecoder>(
+                      webrtc::kVideoCodecAV1, options.allocator,
+                      options.max_frame_buffers));
+            }));
   }
   config.decoders.insert(
       config.decoders.begin(),
-      VideoDecoderConfig(webrtc::kVideoCodecVP9, [](auto format) {
-        return std::unique_ptr<webrtc::VideoDecoder>(
-            absl::make_unique<JetsonVideoDecoder>(webrtc::kVideoCodecVP9));
-      }));
+      VideoDecoderConfig(
+          webrtc::kVideoCodecVP9, [options](auto format) {
+            return std::unique_ptr<webrtc::VideoDecoder>(
+                absl::make_unique<JetsonVideoDecoder>(
+                    webrtc::kVideoCodecVP9, options.allocator,
+                    options.max_frame_buffers));
+          }));
   config.decoders.insert(
       config.decoders.begin(),
-      VideoDecoderConfig(webrtc::kVideoCodecH264, [](auto format) {
-        return std::unique_ptr<webrtc::VideoDecoder>(
-            absl::make_unique<JetsonVideoDecoder>(webrtc::kVideoCodecH264));
-      }));
+      VideoDecoderConfig(
+          webrtc::kVideoCodecH264, [options](auto format) {
+            return std::unique_ptr<webrtc::VideoDecoder>(
+                absl::make_unique<JetsonVideoDecoder>(
+                    webrtc::kVideoCodecH264, options.allocator,
+                    options.max_frame_buffers));
+          }));
 #endif
 
   return config;
 }
 
-SoraVideoDecoderFactoryConfig GetSoftwareOnlyVideoDecoderFactoryConfig() {
+SoraVideoDecoderFactoryConfig GetSoftwareOnlyVideoDecoderFactoryConfig(
+    std::shared_ptr<Dav1dVideoDecoderConfig> dav1d_config) {
   SoraVideoDecoderFactoryConfig config;
   config.decoders.push_back(VideoDecoderConfig(
       webrtc::kVideoCodecVP8,
@@ -247,6 +278,14 @@ SoraVideoDecoderFactoryConfig GetSoftwareOnlyVideoDecoderFactoryConfig() {
   config.decoders.push_back(VideoDecoderConfig(
       webrtc::kVideoCodecVP9,
       [](auto format) { return webrtc::VP9Decoder::Create(); }));
+  if (dav1d_config != nullptr && IsDav1dVideoDecoderSupported()) {
+    Dav1dVideoDecoderConfig c = *dav1d_config;
+    config.decoders.push_back(
+        VideoDecoderConfig(webrtc::kVideoCodecAV1, [c](auto format) {
+          return CreateDav1dVideoDecoder(c);
+        }));
+    return config;
+  }
 #if !defined(__arm__) || defined(__aarch64__) || defined(__ARM_NEON__)
   config.decoders.push_back(VideoDecoderConfig(
       webrtc::kVideoCodecAV1,
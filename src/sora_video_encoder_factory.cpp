@@ -2,6 +2,7 @@
 
 // WebRTC
 #include <absl/memory/memory.h>
+#include <absl/algorithm/container.h>
 #include <absl/strings/match.h>
 #include <api/video_codecs/sdp_video_format.h>
 #include <api/video_codecs/video_codec.h>
@@ -38,7 +39,10 @@
 #include "sora/hwenc_jetson/jetson_video_encoder.h"
 #endif
 
+#include "counted_video_codec.h"
 #include "default_video_formats.h"
+#include "passthrough_video_encoder.h"
+#include "pipelined_video_encoder.h"
 
 namespace sora {
 
@@ -72,6 +76,15 @@ SoraVideoEncoderFactory::GetSupportedFormats() const {
     r.insert(r.end(), formats.begin(), formats.end());
     formats_.push_back(formats);
   }
+
+  // パススルーは H.264 のエンコーダが無くても送れるので、H.264 に対応していることにする
+  if (config_.use_passthrough_encoder &&
+      absl::c_none_of(r, [](const webrtc::SdpVideoFormat& f) {
+        return absl::EqualsIgnoreCase(f.name, cricket::kH264CodecName);
+      })) {
+    auto formats = GetDefaultVideoFormats(webrtc::kVideoCodecH264);
+    r.insert(r.end(), formats.begin(), formats.end());
+  }
   return r;
 }
 
@@ -113,7 +126,16 @@ SoraVideoEncoderFactory::CreateVideoEncoder(
     std::unique_ptr<webrtc::VideoEncoder> r;
     for (const auto& f : supported_formats) {
       if (f.IsSameCodec(format)) {
-        return create_video_encoder(format);
+        std::unique_ptr<webrtc::VideoEncoder> encoder =
+            create_video_encoder(format);
+        if (config_.use_pipelined_encoder) {
+          encoder = PipelinedVideoEncoder::WrapIfSoftware(std::move(encoder));
+        }
+        if (config_.use_passthrough_encoder &&
+            specified_codec == webrtc::kVideoCodecH264) {
+          encoder = PassthroughVideoEncoder::Create(std::move(encoder));
+        }
+        return CountedVideoEncoder::Wrap(std::move(encoder));
       }
     }
 
@@ -121,6 +143,11 @@ SoraVideoEncoderFactory::CreateVideoEncoder(
       return r;
     }
   }
+
+  if (config_.use_passthrough_encoder &&
+      specified_codec == webrtc::kVideoCodecH264) {
+    return CountedVideoEncoder::Wrap(PassthroughVideoEncoder::Create(nullptr));
+  }
   return nullptr;
 }
 
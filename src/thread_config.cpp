@@ -0,0 +1,95 @@
+#include "sora/thread_config.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/platform_thread_types.h>
+
+namespace sora {
+
+bool ApplyThreadConfig(const ThreadConfig& config,
+                       SoraThreadRole role,
+                       const std::string& owner) {
+  if (!config.name.empty()) {
+    rtc::SetCurrentThreadName(config.name.c_str());
+  }
+  RegisterCurrentThread(role, owner);
+
+  bool result = true;
+#if defined(__linux__)
+  if (!config.cpu_affinity.empty()) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu : config.cpu_affinity) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        RTC_LOG(LS_WARNING) << "Invalid cpu: " << cpu;
+        continue;
+      }
+      CPU_SET(cpu, &cpuset);
+    }
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (r != 0) {
+      RTC_LOG(LS_WARNING) << "Failed to pthread_setaffinity_np: thread="
+                          << config.name << " error=" << r;
+      result = false;
+    }
+  }
+
+  if (config.policy != ThreadSchedulingPolicy::kDefault) {
+    int policy =
+        config.policy == ThreadSchedulingPolicy::kFifo ? SCHED_FIFO : SCHED_RR;
+    sched_param param;
+    param.sched_priority = config.realtime_priority;
+    int r = pthread_setschedparam(pthread_self(), policy, &param);
+    if (r != 0) {
+      // 通常は CAP_SYS_NICE 権限か RLIMIT_RTPRIO の設定が必要
+      RTC_LOG(LS_WARNING) << "Failed to pthread_setschedparam: thread="
+                          << config.name << " error=" << r;
+      result = false;
+    }
+  } else if (config.nice) {
+    // Linux では setpriority にスレッド ID を渡すとそのスレッドだけに適用される
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, *config.nice) != 0) {
+      RTC_LOG(LS_WARNING) << "Failed to setpriority: thread=" << config.name
+                          << " nice=" << *config.nice << " errno=" << errno;
+      result = false;
+    }
+  }
+#else
+  if (!config.cpu_affinity.empty() ||
+      config.policy != ThreadSchedulingPolicy::kDefault || config.nice) {
+    RTC_LOG(LS_WARNING) << "ThreadConfig is not supported on this platform";
+    result = false;
+  }
+#endif
+  return result;
+}
+
+bool StartThreadWithConfig(rtc::Thread* thread,
+                           const ThreadConfig& config,
+                           SoraThreadRole role,
+                           const std::string& owner) {
+  if (!config.name.empty()) {
+    thread->SetName(config.name, nullptr);
+  }
+  if (!thread->Start()) {
+    RTC_LOG(LS_ERROR) << "Failed to start thread: " << config.name;
+    return false;
+  }
+  // 設定が適用できなくてもスレッドは動くので、失敗はログに出すだけにする
+  thread->Invoke<void>(RTC_FROM_HERE, [&config, role, &owner]() {
+    ApplyThreadConfig(config, role, owner);
+  });
+  return true;
+}
+
+}  // namespace sora
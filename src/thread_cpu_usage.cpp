@@ -0,0 +1,256 @@
+#include "sora/thread_cpu_usage.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+// WebRTC
+#include <rtc_base/platform_thread_types.h>
+#include <rtc_base/synchronization/mutex.h>
+#include <rtc_base/time_utils.h>
+
+namespace sora {
+
+namespace {
+
+struct Registration {
+  SoraThreadRole role;
+  std::string owner;
+  // tid が再利用された場合に区別するための、スレッドの開始時刻
+  int64_t start_time;
+};
+
+webrtc::Mutex& GetRegistryMutex() {
+  static webrtc::Mutex* mutex = new webrtc::Mutex();
+  return *mutex;
+}
+
+std::map<int64_t, Registration>& GetRegistry() {
+  static auto* registry = new std::map<int64_t, Registration>();
+  return *registry;
+}
+
+struct TaskStat {
+  std::string name;
+  int64_t ticks = 0;
+  int64_t start_time = 0;
+};
+
+#if defined(__linux__)
+// /proc/self/task/<tid>/stat を読む。
+// 多数のスレッドを毎回読むので、ifstream は使わずに read で読む。
+bool ReadTaskStat(int64_t tid, TaskStat* stat) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%lld/stat",
+           static_cast<long long>(tid));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  char buf[1024];
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return false;
+  }
+  buf[n] = '\0';
+
+  // comm にスペースや括弧が含まれていることがあるので、最後の ')' 以降を読む
+  char* begin = strchr(buf, '(');
+  char* end = strrchr(buf, ')');
+  if (begin == nullptr || end == nullptr || end < begin) {
+    return false;
+  }
+  stat->name.assign(begin + 1, end);
+
+  // 3 番目の state から数えて 12, 13 番目が utime と stime、20 番目が starttime
+  char* p = end + 1;
+  int64_t utime = 0;
+  int64_t stime = 0;
+  for (int i = 0; i < 20; i++) {
+    char* next = nullptr;
+    while (*p == ' ') {
+      p++;
+    }
+    if (*p == '\0') {
+      return false;
+    }
+    if (i == 11) {
+      utime = strtoll(p, &next, 10);
+    } else if (i == 12) {
+      stime = strtoll(p, &next, 10);
+    } else if (i == 19) {
+      stat->start_time = strtoll(p, &next, 10);
+    }
+    while (*p != ' ' && *p != '\0') {
+      p++;
+    }
+  }
+  stat->ticks = utime + stime;
+  return true;
+}
+
+// 登録されていないスレッドの役割を、WebRTC が付けるスレッド名から推測する。
+// スレッド名は 15 文字で切られている。
+SoraThreadRole GuessRole(const std::string& name) {
+  static const struct {
+    const char* prefix;
+    SoraThreadRole role;
+  } kRoles[] = {
+      {"EncoderQueue", SoraThreadRole::kEncoder},
+      {"AudioEncoder", SoraThreadRole::kEncoder},
+      {"DecodingQueue", SoraThreadRole::kDecoder},
+      {"IncomingVideoS", SoraThreadRole::kDecoder},
+      {"network_thread", SoraThreadRole::kNetwork},
+      {"worker_thread", SoraThreadRole::kWorker},
+      {"signaling_threa", SoraThreadRole::kSignaling},
+  };
+  for (const auto& r : kRoles) {
+    if (name.compare(0, strlen(r.prefix), r.prefix) == 0) {
+      return r.role;
+    }
+  }
+  return SoraThreadRole::kUnknown;
+}
+#endif
+
+}  // namespace
+
+const char* GetSoraThreadRoleName(SoraThreadRole role) {
+  switch (role) {
+    case SoraThreadRole::kNetwork:
+      return "network";
+    case SoraThreadRole::kWorker:
+      return "worker";
+    case SoraThreadRole::kSignaling:
+      return "signaling";
+    case SoraThreadRole::kCapture:
+      return "capture";
+    case SoraThreadRole::kEncoder:
+      return "encoder";
+    case SoraThreadRole::kDecoder:
+      return "decoder";
+    case SoraThreadRole::kIoContext:
+      return "io_context";
+    case SoraThreadRole::kOther:
+      return "other";
+    case SoraThreadRole::kUnknown:
+    default:
+      return "unknown";
+  }
+}
+
+void RegisterCurrentThread(SoraThreadRole role, const std::string& owner) {
+  int64_t tid = static_cast<int64_t>(rtc::CurrentThreadId());
+  int64_t start_time = 0;
+#if defined(__linux__)
+  TaskStat stat;
+  if (ReadTaskStat(tid, &stat)) {
+    start_time = stat.start_time;
+  }
+#endif
+  webrtc::MutexLock lock(&GetRegistryMutex());
+  GetRegistry()[tid] = Registration{role, owner, start_time};
+}
+
+bool ThreadCpuUsage::Sample(ThreadCpuUsageReport* report) {
+#if defined(__linux__)
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return false;
+  }
+  std::vector<std::pair<int64_t, TaskStat>> stats;
+  while (struct dirent* ent = readdir(dir)) {
+    if (ent->d_name[0] < '0' || ent->d_name[0] > '9') {
+      continue;
+    }
+    int64_t tid = strtoll(ent->d_name, nullptr, 10);
+    TaskStat stat;
+    // 読んでいる間に終了したスレッドは無視する
+    if (ReadTaskStat(tid, &stat)) {
+      stats.push_back(std::make_pair(tid, std::move(stat)));
+    }
+  }
+  closedir(dir);
+
+  int64_t now_us = rtc::TimeMicros();
+  int64_t last_wall_us = last_wall_us_;
+  std::map<int64_t, Last> last;
+  last.swap(last_);
+  last_wall_us_ = now_us;
+  for (const auto& s : stats) {
+    last_[s.first] = Last{s.second.start_time, s.second.ticks};
+  }
+
+  std::map<int64_t, Registration> registry;
+  {
+    webrtc::MutexLock lock(&GetRegistryMutex());
+    auto& r = GetRegistry();
+    // 終了したスレッドの登録を消す。
+    // 上で読んだ後に開始して登録したスレッドは stats に無いので、
+    // stats に無い場合は今の /proc を読み直して、本当に終了しているかを確認する
+    for (auto it = r.begin(); it != r.end();) {
+      auto cur = last_.find(it->first);
+      bool alive = cur != last_.end() &&
+                   cur->second.start_time == it->second.start_time;
+      if (!alive) {
+        TaskStat stat;
+        alive = ReadTaskStat(it->first, &stat) &&
+                stat.start_time == it->second.start_time;
+      }
+      if (alive) {
+        ++it;
+      } else {
+        it = r.erase(it);
+      }
+    }
+    registry = r;
+  }
+
+  if (last_wall_us < 0 || now_us <= last_wall_us) {
+    return false;
+  }
+  double wall_ticks = static_cast<double>(now_us - last_wall_us) *
+                      sysconf(_SC_CLK_TCK) / rtc::kNumMicrosecsPerSec;
+
+  *report = ThreadCpuUsageReport();
+  for (const auto& s : stats) {
+    // 前回の後に開始したスレッドは、開始からの値をそのまま使う
+    int64_t ticks = s.second.ticks;
+    auto it = last.find(s.first);
+    if (it != last.end() && it->second.start_time == s.second.start_time) {
+      ticks -= it->second.ticks;
+    }
+
+    ThreadCpuUsageEntry entry;
+    entry.tid = s.first;
+    entry.name = s.second.name;
+    auto reg = registry.find(s.first);
+    if (reg != registry.end()) {
+      entry.role = reg->second.role;
+      entry.owner = reg->second.owner;
+    } else {
+      entry.role = GuessRole(entry.name);
+    }
+    entry.cpu_usage = ticks / wall_ticks;
+
+    report->roles[entry.role] += entry.cpu_usage;
+    if (!entry.owner.empty()) {
+      report->owners[entry.owner] += entry.cpu_usage;
+    }
+    report->total += entry.cpu_usage;
+    report->threads.push_back(std::move(entry));
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace sora
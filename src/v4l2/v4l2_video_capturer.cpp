@@ -42,6 +42,9 @@
 
 namespace sora {
 
+// I420 に変換したフレームのバッファをプールしておく最大数
+static const size_t kMaxI420Buffers = 16;
+
 rtc::scoped_refptr<V4L2VideoCapturer> V4L2VideoCapturer::Create(
     V4L2VideoCapturerConfig config) {
   rtc::scoped_refptr<V4L2VideoCapturer> capturer;
@@ -95,7 +98,7 @@ rtc::scoped_refptr<V4L2VideoCapturer> V4L2VideoCapturer::Create(
     return nullptr;
   }
   rtc::scoped_refptr<V4L2VideoCapturer> v4l2_capturer(
-      new rtc::RefCountedObject<V4L2VideoCapturer>());
+      new rtc::RefCountedObject<V4L2VideoCapturer>(config));
   if (v4l2_capturer->Init((const char*)&unique_name, config.video_device) < 0) {
     RTC_LOG(LS_WARNING) << "Failed to create V4L2VideoCapturer(" << unique_name
                         << ")";
@@ -111,7 +114,11 @@ rtc::scoped_refptr<V4L2VideoCapturer> V4L2VideoCapturer::Create(
 }
 
 V4L2VideoCapturer::V4L2VideoCapturer()
-    : _deviceFd(-1),
+    : V4L2VideoCapturer(V4L2VideoCapturerConfig()) {}
+
+V4L2VideoCapturer::V4L2VideoCapturer(const V4L2VideoCapturerConfig& config)
+    : ScalableVideoTrackSource(config),
+      _deviceFd(-1),
       _buffersAllocatedByDevice(-1),
       _currentWidth(-1),
       _currentHeight(-1),
@@ -318,6 +325,13 @@ int32_t V4L2VideoCapturer::StartCapture(V4L2VideoCapturerConfig config) {
     }
   }
 
+  if (config.allocator != nullptr) {
+    buffer_pool_.reset(
+        new FrameBufferPool(kMaxI420Buffers, config.allocator));
+  } else {
+    buffer_pool_.reset();
+  }
+
   if (!AllocateVideoBuffers()) {
     RTC_LOG(LS_INFO) << "failed to allocate video capture buffers";
     return -1;
@@ -326,8 +340,11 @@ int32_t V4L2VideoCapturer::StartCapture(V4L2VideoCapturerConfig config) {
   // start capture thread;
   if (_captureThread.empty()) {
     quit_ = false;
+    capture_thread_config_ = config.capture_thread_config;
     _captureThread = rtc::PlatformThread::SpawnJoinable(
-        std::bind(V4L2VideoCapturer::CaptureThread, this), "CaptureThread",
+        std::bind(V4L2VideoCapturer::CaptureThread, this),
+        capture_thread_config_.name.empty() ? "CaptureThread"
+                                            : capture_thread_config_.name,
         rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
   }
 
@@ -436,6 +453,8 @@ bool V4L2VideoCapturer::DeAllocateVideoBuffers() {
 
 void V4L2VideoCapturer::CaptureThread(void* obj) {
   V4L2VideoCapturer* capturer = static_cast<V4L2VideoCapturer*>(obj);
+  ApplyThreadConfig(capturer->capture_thread_config_,
+                    SoraThreadRole::kCapture);
   while (capturer->CaptureProcess()) {
   }
 }
@@ -523,19 +542,39 @@ bool V4L2VideoCapturer::CaptureProcess() {
 
 void V4L2VideoCapturer::OnCaptured(uint8_t* data, uint32_t bytesused) {
   rtc::scoped_refptr<webrtc::VideoFrameBuffer> dst_buffer = nullptr;
-  rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer(
-      webrtc::I420Buffer::Create(_currentWidth, _currentHeight));
-  i420_buffer->InitializeData();
-  if (libyuv::ConvertToI420(
-          data, bytesused, i420_buffer.get()->MutableDataY(),
-          i420_buffer.get()->StrideY(), i420_buffer.get()->MutableDataU(),
-          i420_buffer.get()->StrideU(), i420_buffer.get()->MutableDataV(),
-          i420_buffer.get()->StrideV(), 0, 0, _currentWidth, _currentHeight,
-          _currentWidth, _currentHeight, libyuv::kRotate0,
-          ConvertVideoType(_captureVideoType)) < 0) {
-    RTC_LOG(LS_ERROR) << "ConvertToI420 Failed";
+  auto convert = [&](uint8_t* dst_y, int dst_stride_y, uint8_t* dst_u,
+                     int dst_stride_u, uint8_t* dst_v, int dst_stride_v) {
+    if (libyuv::ConvertToI420(data, bytesused, dst_y, dst_stride_y, dst_u,
+                              dst_stride_u, dst_v, dst_stride_v, 0, 0,
+                              _currentWidth, _currentHeight, _currentWidth,
+                              _currentHeight, libyuv::kRotate0,
+                              ConvertVideoType(_captureVideoType)) < 0) {
+      RTC_LOG(LS_ERROR) << "ConvertToI420 Failed";
+      return false;
+    }
+    return true;
+  };
+
+  rtc::scoped_refptr<AllocatedI420Buffer> pooled_buffer;
+  if (buffer_pool_ != nullptr) {
+    pooled_buffer =
+        buffer_pool_->CreateI420Buffer(_currentWidth, _currentHeight);
+  }
+  if (pooled_buffer != nullptr) {
+    if (convert(pooled_buffer->MutableDataY(), pooled_buffer->StrideY(),
+                pooled_buffer->MutableDataU(), pooled_buffer->StrideU(),
+                pooled_buffer->MutableDataV(), pooled_buffer->StrideV())) {
+      dst_buffer = pooled_buffer;
+    }
   } else {
-    dst_buffer = i420_buffer;
+    rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer(
+        webrtc::I420Buffer::Create(_currentWidth, _currentHeight));
+    i420_buffer->InitializeData();
+    if (convert(i420_buffer->MutableDataY(), i420_buffer->StrideY(),
+                i420_buffer->MutableDataU(), i420_buffer->StrideU(),
+                i420_buffer->MutableDataV(), i420_buffer->StrideV())) {
+      dst_buffer = i420_buffer;
+    }
   }
 
   if (dst_buffer) {
@@ -0,0 +1,181 @@
+#include "sora/video_track_source_tee.h"
+
+#include <algorithm>
+
+// WebRTC
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame_buffer.h>
+#include <media/base/adapted_video_track_source.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <third_party/libyuv/include/libyuv.h>
+
+namespace sora {
+
+// エンコーダやシンクが保持しているフレームの数より多めにしておく
+static const size_t kMaxScaledBuffers = 16;
+
+// AdaptFrame の結果
+struct Adaptation {
+  int width;
+  int height;
+  int crop_width;
+  int crop_height;
+  int crop_x;
+  int crop_y;
+
+  bool operator==(const Adaptation& o) const {
+    return width == o.width && height == o.height &&
+           crop_width == o.crop_width && crop_height == o.crop_height &&
+           crop_x == o.crop_x && crop_y == o.crop_y;
+  }
+};
+
+class VideoTrackSourceTee::Source : public rtc::AdaptedVideoTrackSource {
+ public:
+  Source(const VideoTrackSourceTeeConfig& config)
+      : AdaptedVideoTrackSource(4), is_screencast_(config.is_screencast) {
+    if (config.allocator != nullptr) {
+      buffer_pool_.reset(
+          new FrameBufferPool(kMaxScaledBuffers, config.allocator));
+    }
+  }
+
+  bool is_screencast() const override { return is_screencast_; }
+  absl::optional<bool> needs_denoising() const override { return false; }
+  SourceState state() const override { return SourceState::kLive; }
+  bool remote() const override { return false; }
+
+  // このソースのシンクの要求に合わせた解像度を計算する。
+  // フレームを捨てる場合とシンクが無い場合は false を返す。
+  bool Adapt(const webrtc::VideoFrame& frame, Adaptation* a) {
+    return AdaptFrame(frame.width(), frame.height(), frame.timestamp_us(),
+                      &a->width, &a->height, &a->crop_width, &a->crop_height,
+                      &a->crop_x, &a->crop_y);
+  }
+
+  // 解像度ごとにプールを分けるため、バッファはソースごとのプールから確保する
+  rtc::scoped_refptr<webrtc::VideoFrameBuffer> Scale(
+      const rtc::scoped_refptr<webrtc::I420BufferInterface>& src,
+      const Adaptation& a) {
+    // 色差成分の境界に合わせる
+    const int uv_crop_x = a.crop_x / 2;
+    const int uv_crop_y = a.crop_y / 2;
+    const int crop_x = uv_crop_x * 2;
+    const int crop_y = uv_crop_y * 2;
+
+    rtc::scoped_refptr<AllocatedI420Buffer> pooled_buffer;
+    if (buffer_pool_ != nullptr) {
+      pooled_buffer = buffer_pool_->CreateI420Buffer(a.width, a.height);
+    }
+    if (pooled_buffer == nullptr) {
+      rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer =
+          webrtc::I420Buffer::Create(a.width, a.height);
+      i420_buffer->CropAndScaleFrom(*src, crop_x, crop_y, a.crop_width,
+                                    a.crop_height);
+      return i420_buffer;
+    }
+    libyuv::I420Scale(
+        src->DataY() + crop_y * src->StrideY() + crop_x, src->StrideY(),
+        src->DataU() + uv_crop_y * src->StrideU() + uv_crop_x, src->StrideU(),
+        src->DataV() + uv_crop_y * src->StrideV() + uv_crop_x, src->StrideV(),
+        a.crop_width, a.crop_height, pooled_buffer->MutableDataY(),
+        pooled_buffer->StrideY(), pooled_buffer->MutableDataU(),
+        pooled_buffer->StrideU(), pooled_buffer->MutableDataV(),
+        pooled_buffer->StrideV(), a.width, a.height, libyuv::kFilterBox);
+    return pooled_buffer;
+  }
+
+  void Deliver(const webrtc::VideoFrame& frame) { OnFrame(frame); }
+
+ private:
+  bool is_screencast_;
+  std::unique_ptr<FrameBufferPool> buffer_pool_;
+};
+
+std::shared_ptr<VideoTrackSourceTee> VideoTrackSourceTee::Create(
+    VideoTrackSourceTeeConfig config) {
+  return std::shared_ptr<VideoTrackSourceTee>(new VideoTrackSourceTee(config));
+}
+
+VideoTrackSourceTee::VideoTrackSourceTee(VideoTrackSourceTeeConfig config)
+    : config_(config) {}
+
+VideoTrackSourceTee::~VideoTrackSourceTee() {}
+
+rtc::scoped_refptr<webrtc::VideoTrackSourceInterface>
+VideoTrackSourceTee::CreateSource() {
+  rtc::scoped_refptr<Source> source(new rtc::RefCountedObject<Source>(config_));
+  webrtc::MutexLock lock(&mutex_);
+  sources_.push_back(source);
+  return source;
+}
+
+void VideoTrackSourceTee::RemoveSource(
+    rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> source) {
+  webrtc::MutexLock lock(&mutex_);
+  sources_.erase(std::remove_if(sources_.begin(), sources_.end(),
+                                [&source](const rtc::scoped_refptr<Source>& s) {
+                                  return s.get() == source.get();
+                                }),
+                 sources_.end());
+}
+
+size_t VideoTrackSourceTee::GetSourceCount() const {
+  webrtc::MutexLock lock(&mutex_);
+  return sources_.size();
+}
+
+void VideoTrackSourceTee::OnFrame(const webrtc::VideoFrame& frame) {
+  webrtc::MutexLock lock(&mutex_);
+
+  const bool is_native = frame.video_frame_buffer()->type() ==
+                         webrtc::VideoFrameBuffer::Type::kNative;
+  // このフレームで作った解像度ごとのバッファ。ソースの数だけなので線形探索で十分
+  struct Variant {
+    Adaptation adaptation;
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer;
+  };
+  std::vector<Variant> variants;
+  // I420 への変換は、リサイズが必要になった時に 1 回だけ行う
+  rtc::scoped_refptr<webrtc::I420BufferInterface> src;
+
+  for (const auto& source : sources_) {
+    Adaptation a;
+    if (!source->Adapt(frame, &a)) {
+      continue;
+    }
+
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer;
+    if (is_native || (a.width == frame.width() && a.height == frame.height())) {
+      // ネイティブバッファはリサイズできないので、そのまま渡して
+      // エンコーダ側で合わせてもらう
+      buffer = frame.video_frame_buffer();
+    } else {
+      auto it = std::find_if(
+          variants.begin(), variants.end(),
+          [&a](const Variant& v) { return v.adaptation == a; });
+      if (it != variants.end()) {
+        buffer = it->buffer;
+      } else {
+        if (src == nullptr) {
+          src = frame.video_frame_buffer()->ToI420();
+          if (src == nullptr) {
+            RTC_LOG(LS_ERROR) << "Failed to convert frame to I420";
+            return;
+          }
+        }
+        buffer = source->Scale(src, a);
+        variants.push_back(Variant{a, buffer});
+      }
+    }
+
+    source->Deliver(webrtc::VideoFrame::Builder()
+                        .set_video_frame_buffer(buffer)
+                        .set_rotation(frame.rotation())
+                        .set_timestamp_us(frame.timestamp_us())
+                        .build());
+  }
+}
+
+}  // namespace sora
@@ -123,6 +123,17 @@ Websocket::ssl_websocket_t& Websocket::NativeSecureSocket() {
   return *wss_;
 }
 
+std::string Websocket::GetLocalAddress() const {
+  boost::system::error_code ec;
+  boost::asio::ip::tcp::endpoint endpoint =
+      wss_ != nullptr ? boost::beast::get_lowest_layer(*wss_).local_endpoint(ec)
+                      : boost::beast::get_lowest_layer(*ws_).local_endpoint(ec);
+  if (ec) {
+    return "";
+  }
+  return endpoint.address().to_string();
+}
+
 void Websocket::Connect(const std::string& url, connect_callback_t on_connect) {
   // proxy 時は wss のみサポート
   if (https_proxy_) {
@@ -425,6 +436,7 @@ void Websocket::OnRead(read_callback_t on_read,
 }
 
 void Websocket::WriteText(std::string text, write_callback_t on_write) {
+  write_queue_bytes_ += text.size();
   boost::asio::post(strand_, std::bind(&Websocket::DoWriteText, this,
                                        std::move(text), std::move(on_write)));
 }
@@ -477,6 +489,7 @@ void Websocket::OnWrite(boost::system::error_code ec,
     std::move(data->callback)(ec, bytes_transferred);
   }
 
+  write_queue_bytes_ -= data->buffer.size();
   write_data_.erase(write_data_.begin());
 
   if (!write_data_.empty()) {
@@ -0,0 +1,304 @@
+#include "sora/x11/x11_screen_capturer.h"
+
+#include <algorithm>
+
+// Linux
+#include <poll.h>
+
+// WebRTC
+#include <api/video/video_frame.h>
+#include <api/video/video_rotation.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <rtc_base/time_utils.h>
+#include <third_party/libyuv/include/libyuv.h>
+
+// X11
+// マクロが衝突しないように最後にインクルードする
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+namespace sora {
+
+// 変化した領域がこれより多くなったら、全体を囲む 1 つの領域にまとめる
+static const size_t kMaxDamagedRects = 16;
+// quit_ を確認する間隔
+static const int kMaxWaitMs = 100;
+
+rtc::scoped_refptr<X11ScreenCapturer> X11ScreenCapturer::Create(
+    X11ScreenCapturerConfig config) {
+  rtc::scoped_refptr<X11ScreenCapturer> capturer(
+      new rtc::RefCountedObject<X11ScreenCapturer>(config));
+  if (!capturer->Init()) {
+    RTC_LOG(LS_ERROR) << "Failed to create X11ScreenCapturer";
+    return nullptr;
+  }
+  return capturer;
+}
+
+X11ScreenCapturer::X11ScreenCapturer(X11ScreenCapturerConfig config)
+    : ScalableVideoTrackSource(ScalableVideoTrackSourceConfig{true}),
+      config_(config),
+      buffer_pool_(false, 4 /* max_number_of_buffers */),
+      quit_(false) {}
+
+X11ScreenCapturer::~X11ScreenCapturer() {
+  Destroy();
+}
+
+bool X11ScreenCapturer::Init() {
+  display_ = XOpenDisplay(
+      config_.display_name.empty() ? nullptr : config_.display_name.c_str());
+  if (display_ == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to XOpenDisplay: display="
+                      << config_.display_name;
+    return false;
+  }
+
+  int damage_error_base;
+  if (!XDamageQueryExtension(display_, &damage_event_base_,
+                             &damage_error_base)) {
+    RTC_LOG(LS_ERROR) << "XDamage extension is not supported";
+    return false;
+  }
+  int fixes_event_base;
+  int fixes_error_base;
+  if (!XFixesQueryExtension(display_, &fixes_event_base, &fixes_error_base)) {
+    RTC_LOG(LS_ERROR) << "XFixes extension is not supported";
+    return false;
+  }
+
+  root_ = DefaultRootWindow(display_);
+  XWindowAttributes attr;
+  if (!XGetWindowAttributes(display_, root_, &attr)) {
+    RTC_LOG(LS_ERROR) << "Failed to XGetWindowAttributes";
+    return false;
+  }
+
+  int width = config_.width;
+  int height = config_.height;
+  if (width <= 0 || height <= 0) {
+    config_.x = 0;
+    config_.y = 0;
+    width = attr.width;
+    height = attr.height;
+  }
+  width = std::min(width, attr.width - config_.x);
+  height = std::min(height, attr.height - config_.y);
+  // I420 の色差成分の境界に合わせるため偶数にする
+  width_ = width & ~1;
+  height_ = height & ~1;
+  if (width_ <= 0 || height_ <= 0) {
+    RTC_LOG(LS_ERROR) << "Invalid capture area: x=" << config_.x
+                      << " y=" << config_.y << " width=" << config_.width
+                      << " height=" << config_.height;
+    return false;
+  }
+
+  image_ = XGetImage(display_, root_, config_.x, config_.y, width_, height_,
+                     AllPlanes, ZPixmap);
+  if (image_ == nullptr) {
+    RTC_LOG(LS_ERROR) << "Failed to XGetImage";
+    return false;
+  }
+  if (image_->bits_per_pixel != 32) {
+    RTC_LOG(LS_ERROR) << "Unsupported bits_per_pixel: "
+                      << image_->bits_per_pixel;
+    return false;
+  }
+
+  damage_ = XDamageCreate(display_, root_, XDamageReportNonEmpty);
+  region_ = XFixesCreateRegion(display_, nullptr, 0);
+
+  // 最初は全体を変換する
+  damaged_.push_back(Rect{0, 0, width_, height_});
+
+  RTC_LOG(LS_INFO) << "X11ScreenCapturer: x=" << config_.x
+                   << " y=" << config_.y << " width=" << width_
+                   << " height=" << height_;
+
+  capture_thread_ = rtc::PlatformThread::SpawnJoinable(
+      [this]() {
+        ApplyThreadConfig(config_.capture_thread_config,
+                          SoraThreadRole::kCapture);
+        CaptureThread();
+      },
+      config_.capture_thread_config.name.empty()
+          ? "ScreenCaptureThread"
+          : config_.capture_thread_config.name,
+      rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
+  return true;
+}
+
+void X11ScreenCapturer::Destroy() {
+  if (!capture_thread_.empty()) {
+    quit_ = true;
+    capture_thread_.Finalize();
+  }
+  if (display_ == nullptr) {
+    return;
+  }
+  if (damage_ != 0) {
+    XDamageDestroy(display_, damage_);
+    damage_ = 0;
+  }
+  if (region_ != 0) {
+    XFixesDestroyRegion(display_, region_);
+    region_ = 0;
+  }
+  if (image_ != nullptr) {
+    XDestroyImage(image_);
+    image_ = nullptr;
+  }
+  XCloseDisplay(display_);
+  display_ = nullptr;
+}
+
+void X11ScreenCapturer::CaptureThread() {
+  const int64_t frame_interval_us =
+      rtc::kNumMicrosecsPerSec / std::max(1, config_.max_framerate);
+  const int64_t keepalive_interval_us =
+      config_.keepalive_interval_ms * rtc::kNumMicrosecsPerMillisec;
+
+  struct pollfd pfd;
+  pfd.fd = ConnectionNumber(display_);
+  pfd.events = POLLIN;
+
+  while (!quit_) {
+    ProcessEvents();
+
+    int64_t now_us = rtc::TimeMicros();
+    int64_t elapsed_us = now_us - last_frame_us_;
+    int64_t wait_us = kMaxWaitMs * rtc::kNumMicrosecsPerMillisec;
+    if (!damaged_.empty()) {
+      if (elapsed_us >= frame_interval_us) {
+        CaptureDamagedRegion(now_us);
+        wait_us = frame_interval_us;
+      } else {
+        wait_us = frame_interval_us - elapsed_us;
+      }
+    } else if (keepalive_interval_us > 0 && last_buffer_ != nullptr) {
+      if (elapsed_us >= keepalive_interval_us) {
+        SendFrame(now_us);
+      } else {
+        wait_us = std::min(wait_us, keepalive_interval_us - elapsed_us);
+      }
+    }
+
+    // 変化が溜まっている間はイベントを待たずにフレーム間隔だけ待つ
+    int timeout_ms = static_cast<int>(
+        std::min<int64_t>(kMaxWaitMs, std::max<int64_t>(
+                                          1, wait_us / 1000)));
+    if (XPending(display_) == 0) {
+      poll(&pfd, 1, timeout_ms);
+    }
+  }
+}
+
+void X11ScreenCapturer::ProcessEvents() {
+  bool damaged = false;
+  while (XPending(display_) > 0) {
+    XEvent ev;
+    XNextEvent(display_, &ev);
+    if (ev.type == damage_event_base_ + XDamageNotify) {
+      damaged = true;
+    }
+  }
+  if (!damaged) {
+    return;
+  }
+
+  // 変化した領域を取り出して、次の変化を通知してもらえるようにする
+  XDamageSubtract(display_, damage_, None, region_);
+  int count = 0;
+  XRectangle* rects = XFixesFetchRegion(display_, region_, &count);
+  for (int i = 0; i < count; i++) {
+    int x0 = std::max(0, rects[i].x - config_.x);
+    int y0 = std::max(0, rects[i].y - config_.y);
+    int x1 = std::min(width_, rects[i].x + rects[i].width - config_.x);
+    int y1 = std::min(height_, rects[i].y + rects[i].height - config_.y);
+    if (x0 >= x1 || y0 >= y1) {
+      continue;
+    }
+    // 色差成分の境界に合わせる
+    x0 &= ~1;
+    y0 &= ~1;
+    x1 = std::min(width_, (x1 + 1) & ~1);
+    y1 = std::min(height_, (y1 + 1) & ~1);
+    damaged_.push_back(Rect{x0, y0, x1 - x0, y1 - y0});
+  }
+  if (rects != nullptr) {
+    XFree(rects);
+  }
+
+  if (damaged_.size() > kMaxDamagedRects) {
+    int x0 = width_, y0 = height_, x1 = 0, y1 = 0;
+    for (const auto& r : damaged_) {
+      x0 = std::min(x0, r.x);
+      y0 = std::min(y0, r.y);
+      x1 = std::max(x1, r.x + r.width);
+      y1 = std::max(y1, r.y + r.height);
+    }
+    damaged_.clear();
+    damaged_.push_back(Rect{x0, y0, x1 - x0, y1 - y0});
+  }
+}
+
+void X11ScreenCapturer::CaptureDamagedRegion(int64_t now_us) {
+  // 直前のフレームはエンコーダが参照している可能性があるので、
+  // プールから新しいバッファを取ってきて、変化していない領域はコピーで済ませる
+  rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+      buffer_pool_.CreateI420Buffer(width_, height_);
+  if (buffer == nullptr) {
+    RTC_LOG(LS_WARNING) << "Failed to allocate buffer. Frame dropped";
+    return;
+  }
+  if (last_buffer_ != nullptr) {
+    libyuv::I420Copy(last_buffer_->DataY(), last_buffer_->StrideY(),
+                     last_buffer_->DataU(), last_buffer_->StrideU(),
+                     last_buffer_->DataV(), last_buffer_->StrideV(),
+                     buffer->MutableDataY(), buffer->StrideY(),
+                     buffer->MutableDataU(), buffer->StrideU(),
+                     buffer->MutableDataV(), buffer->StrideV(), width_,
+                     height_);
+  }
+
+  for (const auto& r : damaged_) {
+    if (XGetSubImage(display_, root_, config_.x + r.x, config_.y + r.y,
+                     r.width, r.height, AllPlanes, ZPixmap, image_, r.x,
+                     r.y) == nullptr) {
+      RTC_LOG(LS_WARNING) << "Failed to XGetSubImage";
+      continue;
+    }
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(image_->data) +
+                         r.y * image_->bytes_per_line + r.x * 4;
+    // 32bpp の ZPixmap はメモリ上で B,G,R,X の順に並んでいて、
+    // これは libyuv の ARGB と同じ並び
+    libyuv::ARGBToI420(
+        src, image_->bytes_per_line,
+        buffer->MutableDataY() + r.y * buffer->StrideY() + r.x,
+        buffer->StrideY(),
+        buffer->MutableDataU() + (r.y / 2) * buffer->StrideU() + r.x / 2,
+        buffer->StrideU(),
+        buffer->MutableDataV() + (r.y / 2) * buffer->StrideV() + r.x / 2,
+        buffer->StrideV(), r.width, r.height);
+  }
+  damaged_.clear();
+
+  last_buffer_ = buffer;
+  SendFrame(now_us);
+}
+
+void X11ScreenCapturer::SendFrame(int64_t now_us) {
+  last_frame_us_ = now_us;
+  OnCapturedFrame(webrtc::VideoFrame::Builder()
+                      .set_video_frame_buffer(last_buffer_)
+                      .set_timestamp_rtp(0)
+                      .set_timestamp_us(now_us)
+                      .set_rotation(webrtc::kVideoRotation_0)
+                      .build());
+}
+
+}  // namespace sora
@@ -0,0 +1,423 @@
+// 帯域推定が目標のビットレートに達するまでの時間を、
+// BitrateMemory の開始ビットレートを使わない場合と使った場合で比較するツール。
+//
+// 同じプロセスの中で PeerConnection を 2 つ作ってループバックで接続し、
+// 合成した映像を片方から送る。送信側で選択されている候補ペアの
+// availableOutgoingBitrate が --target-kbps に達するまでの時間を計測する。
+//
+//   cold: 開始ビットレートを指定せずに接続する。
+//         統計情報を BitrateMemorySession に渡して、収束した帯域を BitrateMemory に覚えさせる
+//   warm: cold で覚えた帯域から BitrateMemory::GetStartBitrate() で開始ビットレートを決めて、
+//         SoraSignaling と同じように PeerConnectionInterface::SetBitrate() で指定して接続する
+//
+// ループバックなのでネットワークの帯域の上限はほぼ無く、帯域推定の立ち上がりの速さだけを比べる。
+// 開始ビットレートは覚えた帯域に BitrateMemoryConfig::start_ratio を掛けた値になるので、
+// --target-kbps がそれより高いと warm でも途中からは帯域推定で上がっていくのを待つことになる。
+//
+// 使い方:
+//   bitrate_ramp_up [--target-kbps N] [--duration-sec N] [--width W]
+//                   [--height H] [--fps F]
+//   --duration-sec は 1 回の接続で統計情報を取り続ける時間。
+//   BitrateMemoryConfig::warmup_ms より長くしないと cold で帯域を覚えられない
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boost
+#include <boost/optional.hpp>
+
+// WebRTC
+#include <api/jsep.h>
+#include <api/peer_connection_interface.h>
+#include <api/stats/rtcstats_objects.h>
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame.h>
+#include <rtc_base/event.h>
+#include <rtc_base/helpers.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/ref_counted_object.h>
+#include <rtc_base/time_utils.h>
+
+#ifdef _WIN32
+#include <rtc_base/win/scoped_com_initializer.h>
+#endif
+
+#include "sora/bitrate_memory.h"
+#include "sora/rtc_stats.h"
+#include "sora/scalable_track_source.h"
+#include "sora/session_description.h"
+#include "sora/sora_default_client.h"
+
+// SDP の交換や統計情報の取得を待つ時間
+static const int kTimeoutMs = 10000;
+// 統計情報を取得する間隔
+static const int kStatsIntervalMs = 100;
+
+struct Options {
+  int target_kbps = 2000;
+  int duration_sec = 20;
+  int width = 1920;
+  int height = 1080;
+  int fps = 30;
+};
+
+// エンコーダが帯域を使い切れるように、ノイズを動かし続ける映像のソース
+class SyntheticVideoSource : public sora::ScalableVideoTrackSource {
+ public:
+  static rtc::scoped_refptr<SyntheticVideoSource> Create(int width,
+                                                         int height,
+                                                         int fps) {
+    return rtc::scoped_refptr<SyntheticVideoSource>(
+        new rtc::RefCountedObject<SyntheticVideoSource>(width, height, fps));
+  }
+  ~SyntheticVideoSource() override { Stop(); }
+
+  void Start() {
+    quit_ = false;
+    thread_ = std::thread([this]() { Run(); });
+  }
+  void Stop() {
+    quit_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ protected:
+  SyntheticVideoSource(int width, int height, int fps)
+      : width_(width), height_(height), fps_(fps) {
+    // フレームごとにずらして読むので、1 フレーム分より大きめに作っておく
+    std::mt19937 rand(0);
+    noise_.resize(static_cast<size_t>(width) * height * 2);
+    for (auto& v : noise_) {
+      v = static_cast<uint8_t>(rand());
+    }
+  }
+
+ private:
+  void Run() {
+    int64_t start_us = rtc::TimeMicros();
+    for (int64_t frame = 0; !quit_; frame++) {
+      int64_t due_us = start_us + frame * rtc::kNumMicrosecsPerSec / fps_;
+      int64_t wait_us = due_us - rtc::TimeMicros();
+      if (wait_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+      }
+
+      auto buffer = webrtc::I420Buffer::Create(width_, height_);
+      size_t offset = static_cast<size_t>(frame * 7919) %
+                      (noise_.size() - static_cast<size_t>(width_) * height_);
+      for (int y = 0; y < height_; y++) {
+        memcpy(buffer->MutableDataY() + y * buffer->StrideY(),
+               noise_.data() + offset + y * width_, width_);
+      }
+      memset(buffer->MutableDataU(), 128,
+             buffer->StrideU() * buffer->ChromaHeight());
+      memset(buffer->MutableDataV(), 128,
+             buffer->StrideV() * buffer->ChromaHeight());
+      OnCapturedFrame(webrtc::VideoFrame::Builder()
+                          .set_video_frame_buffer(buffer)
+                          .set_timestamp_rtp(0)
+                          .set_timestamp_us(rtc::TimeMicros())
+                          .set_rotation(webrtc::kVideoRotation_0)
+                          .build());
+    }
+  }
+
+  int width_;
+  int height_;
+  int fps_;
+  std::vector<uint8_t> noise_;
+  std::atomic<bool> quit_{true};
+  std::thread thread_;
+};
+
+// 非同期の処理の完了を待つためのもの。
+// タイムアウトした後にコールバックが呼ばれても良いように shared_ptr で持つ
+struct Completion {
+  rtc::Event event;
+  std::atomic<bool> ok{false};
+  rtc::scoped_refptr<const webrtc::RTCStatsReport> report;
+
+  void Done(bool r) {
+    ok = r;
+    event.Set();
+  }
+  bool Wait() { return event.Wait(kTimeoutMs) && ok; }
+};
+
+// 候補は SDP に含めて渡すので、ICE の候補の収集が終わるのを待つだけ
+class LoopbackObserver : public webrtc::PeerConnectionObserver {
+ public:
+  bool WaitForGathering() { return gathered_.Wait(kTimeoutMs); }
+
+  void OnSignalingChange(
+      webrtc::PeerConnectionInterface::SignalingState new_state) override {}
+  void OnDataChannel(
+      rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) override {}
+  void OnIceGatheringChange(
+      webrtc::PeerConnectionInterface::IceGatheringState new_state) override {
+    if (new_state == webrtc::PeerConnectionInterface::kIceGatheringComplete) {
+      gathered_.Set();
+    }
+  }
+  void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override {
+  }
+
+ private:
+  rtc::Event gathered_;
+};
+
+struct RampUpResult {
+  // 目標に達するまでの時間。達しなかった場合は -1
+  int64_t time_to_target_ms = -1;
+  // 最後に取得した availableOutgoingBitrate
+  double last_available_bps = 0;
+};
+
+static std::string GetLocalSdp(webrtc::PeerConnectionInterface* pc) {
+  std::string sdp;
+  const webrtc::SessionDescriptionInterface* desc = pc->local_description();
+  if (desc != nullptr) {
+    desc->ToString(&sdp);
+  }
+  return sdp;
+}
+
+// 接続してから duration_sec の間、送信側の統計情報を取り続ける。
+// session を指定した場合は統計情報を渡して帯域を覚えさせる。
+static bool RunRampUp(sora::SoraDefaultClient* client,
+                      const Options& opts,
+                      boost::optional<int> start_bitrate_bps,
+                      sora::BitrateMemorySession* session,
+                      RampUpResult* result) {
+  auto factory = client->factory();
+  webrtc::PeerConnectionInterface::RTCConfiguration rtc_config;
+  rtc_config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+
+  LoopbackObserver sender_observer;
+  LoopbackObserver receiver_observer;
+  auto sender_result = factory->CreatePeerConnectionOrError(
+      rtc_config, webrtc::PeerConnectionDependencies(&sender_observer));
+  auto receiver_result = factory->CreatePeerConnectionOrError(
+      rtc_config, webrtc::PeerConnectionDependencies(&receiver_observer));
+  if (!sender_result.ok() || !receiver_result.ok()) {
+    std::cerr << "Failed to create PeerConnection" << std::endl;
+    return false;
+  }
+  auto sender = sender_result.MoveValue();
+  auto receiver = receiver_result.MoveValue();
+  auto close = [&]() {
+    sender->Close();
+    receiver->Close();
+  };
+
+  if (start_bitrate_bps) {
+    webrtc::BitrateSettings settings;
+    settings.start_bitrate_bps = *start_bitrate_bps;
+    auto error = sender->SetBitrate(settings);
+    if (!error.ok()) {
+      std::cerr << "Failed to SetBitrate: " << error.message() << std::endl;
+      close();
+      return false;
+    }
+  }
+
+  auto source = SyntheticVideoSource::Create(opts.width, opts.height, opts.fps);
+  auto track =
+      factory->CreateVideoTrack(rtc::CreateRandomString(16), source.get());
+  if (!sender->AddTrack(track, {rtc::CreateRandomString(16)}).ok()) {
+    std::cerr << "Failed to AddTrack" << std::endl;
+    close();
+    return false;
+  }
+
+  // offer を作って送信側に設定する
+  auto offer = std::make_shared<Completion>();
+  sender->CreateOffer(
+      sora::CreateSessionDescriptionThunk::Create(
+          [sender, offer](webrtc::SessionDescriptionInterface* desc) {
+            sender->SetLocalDescription(
+                sora::SetSessionDescriptionThunk::Create(
+                    [offer]() { offer->Done(true); },
+                    [offer](webrtc::RTCError) { offer->Done(false); })
+                    .get(),
+                desc);
+          },
+          [offer](webrtc::RTCError) { offer->Done(false); })
+          .get(),
+      webrtc::PeerConnectionInterface::RTCOfferAnswerOptions());
+  if (!offer->Wait() || !sender_observer.WaitForGathering()) {
+    std::cerr << "Failed to create offer" << std::endl;
+    close();
+    return false;
+  }
+
+  // 受信側に offer を設定して answer を作る
+  auto set_offer = std::make_shared<Completion>();
+  sora::SessionDescription::SetOffer(
+      receiver.get(), GetLocalSdp(sender.get()),
+      [set_offer]() { set_offer->Done(true); },
+      [set_offer](webrtc::RTCError) { set_offer->Done(false); });
+  auto answer = std::make_shared<Completion>();
+  if (set_offer->Wait()) {
+    sora::SessionDescription::CreateAnswer(
+        receiver.get(),
+        [answer](webrtc::SessionDescriptionInterface*) { answer->Done(true); },
+        [answer](webrtc::RTCError) { answer->Done(false); });
+  }
+  if (!answer->Wait() || !receiver_observer.WaitForGathering()) {
+    std::cerr << "Failed to create answer" << std::endl;
+    close();
+    return false;
+  }
+
+  auto set_answer = std::make_shared<Completion>();
+  sora::SessionDescription::SetAnswer(
+      sender.get(), GetLocalSdp(receiver.get()),
+      [set_answer]() { set_answer->Done(true); },
+      [set_answer](webrtc::RTCError) { set_answer->Done(false); });
+  if (!set_answer->Wait()) {
+    std::cerr << "Failed to set answer" << std::endl;
+    close();
+    return false;
+  }
+
+  source->Start();
+  int64_t start_us = rtc::TimeMicros();
+  int64_t end_us = start_us + opts.duration_sec * rtc::kNumMicrosecsPerSec;
+  while (rtc::TimeMicros() < end_us) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kStatsIntervalMs));
+
+    auto stats = std::make_shared<Completion>();
+    sender->GetStats(sora::RTCStatsCallback::Create(
+                         [stats](const rtc::scoped_refptr<
+                                 const webrtc::RTCStatsReport>& report) {
+                           stats->report = report;
+                           stats->Done(true);
+                         })
+                         .get());
+    if (!stats->Wait()) {
+      continue;
+    }
+    if (session != nullptr) {
+      session->OnStats(stats->report);
+    }
+    for (const auto* pair :
+         stats->report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+      if (!pair->nominated.ValueOrDefault(false) ||
+          pair->state.ValueOrDefault("") != "succeeded" ||
+          !pair->available_outgoing_bitrate.is_defined()) {
+        continue;
+      }
+      result->last_available_bps = *pair->available_outgoing_bitrate;
+      if (result->time_to_target_ms < 0 &&
+          result->last_available_bps >= opts.target_kbps * 1000.0) {
+        result->time_to_target_ms =
+            (rtc::TimeMicros() - start_us) / rtc::kNumMicrosecsPerMillisec;
+      }
+      break;
+    }
+  }
+
+  source->Stop();
+  close();
+  return true;
+}
+
+static void PrintResult(const std::string& name,
+                        boost::optional<int> start_bitrate_bps,
+                        const RampUpResult& result) {
+  std::cout << std::left << std::setw(8) << name << std::right
+            << std::setw(12)
+            << (start_bitrate_bps ? std::to_string(*start_bitrate_bps / 1000)
+                                  : std::string("-"))
+            << std::setw(18)
+            << (result.time_to_target_ms >= 0
+                    ? std::to_string(result.time_to_target_ms)
+                    : std::string("not reached"))
+            << std::setw(16)
+            << static_cast<int64_t>(result.last_available_bps / 1000)
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--target-kbps") {
+      opts.target_kbps = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--duration-sec") {
+      opts.duration_sec = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--width") {
+      opts.width = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--height") {
+      opts.height = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--fps") {
+      opts.fps = std::stoi(argv[++i]);
+    } else {
+      std::cout << argv[0]
+                << " [--target-kbps N] [--duration-sec N] [--width W]"
+                   " [--height H] [--fps F]"
+                << std::endl;
+      return -1;
+    }
+  }
+
+#ifdef _WIN32
+  webrtc::ScopedCOMInitializer com_initializer(
+      webrtc::ScopedCOMInitializer::kMTA);
+  if (!com_initializer.Succeeded()) {
+    std::cerr << "CoInitializeEx failed" << std::endl;
+    return 1;
+  }
+#endif
+
+  sora::SoraDefaultClientConfig config;
+  config.use_audio_deivce = false;
+  config.use_hardware_encoder = false;
+  auto client = sora::CreateSoraClient<sora::SoraDefaultClient>(config);
+  if (client == nullptr) {
+    std::cerr << "Failed to create SoraDefaultClient" << std::endl;
+    return 1;
+  }
+
+  // path を指定しないので、ファイルには保存せずにプロセス内でだけ覚えておく
+  auto memory = sora::BitrateMemory::Create(sora::BitrateMemoryConfig());
+  std::string key = sora::BitrateMemory::MakeKey("loopback", "127.0.0.1");
+
+  RampUpResult cold;
+  auto session = memory->CreateSession(key);
+  if (!RunRampUp(client.get(), opts, boost::none, session.get(), &cold)) {
+    return 1;
+  }
+  auto start_bitrate_bps = memory->GetStartBitrate(key);
+  if (!start_bitrate_bps) {
+    std::cerr << "BitrateMemory was not updated. Increase --duration-sec"
+              << std::endl;
+    return 1;
+  }
+
+  RampUpResult warm;
+  if (!RunRampUp(client.get(), opts, start_bitrate_bps, nullptr, &warm)) {
+    return 1;
+  }
+
+  std::cout << opts.width << "x" << opts.height << "@" << opts.fps
+            << ", target=" << opts.target_kbps << "kbps" << std::endl;
+  std::cout << std::left << std::setw(8) << "run" << std::right
+            << std::setw(12) << "start(kbps)" << std::setw(18)
+            << "to target(ms)" << std::setw(16) << "last(kbps)" << std::endl;
+  PrintResult("cold", boost::none, cold);
+  PrintResult("warm", start_bitrate_bps, warm);
+  return 0;
+}
@@ -0,0 +1,198 @@
+// FrameBufferAllocator ごとに、フレームの確保、書き込み、縮小、読み込みを繰り返して
+// スループットを比較するツール。
+//
+// キャプチャしたフレームを書き込み、送信用に縮小し、エンコーダが読み込むまでの流れを
+// 1 つのスレッドで模擬する。以下の 2 通りで計測する。
+//
+//   pooled: FrameBufferPool でバッファを使い回す (キャプチャラやデコーダと同じ)
+//   fresh:  フレームごとに AllocatedI420Buffer を確保し直す
+//
+// 使い方:
+//   frame_buffer_allocator [--frames N] [--width W] [--height H] [--node N]
+//   --node を指定すると、huge page のアロケータはそのノードのメモリを使う
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// WebRTC
+#include <rtc_base/time_utils.h>
+#include <third_party/libyuv/include/libyuv.h>
+
+#include "sora/frame_buffer_allocator.h"
+
+struct Options {
+  int frames = 300;
+  int width = 3840;
+  int height = 2160;
+  int numa_node = -1;
+};
+
+// キャプチャされたフレームの代わり
+struct SourceFrame {
+  int width;
+  int height;
+  std::vector<uint8_t> y;
+  std::vector<uint8_t> u;
+  std::vector<uint8_t> v;
+};
+
+static SourceFrame MakeSourceFrame(int width, int height) {
+  SourceFrame f;
+  f.width = width;
+  f.height = height;
+  int chroma_width = (width + 1) / 2;
+  int chroma_height = (height + 1) / 2;
+  f.y.resize(static_cast<size_t>(width) * height);
+  f.u.resize(static_cast<size_t>(chroma_width) * chroma_height);
+  f.v.resize(f.u.size());
+  for (size_t i = 0; i < f.y.size(); i++) {
+    f.y[i] = static_cast<uint8_t>(i * 7);
+  }
+  for (size_t i = 0; i < f.u.size(); i++) {
+    f.u[i] = static_cast<uint8_t>(i * 3);
+    f.v[i] = static_cast<uint8_t>(i * 5);
+  }
+  return f;
+}
+
+// 書き込み、縮小、読み込みを 1 フレーム分行う。
+// 最適化で読み込みが消えないように、読んだ値の合計を返す
+static uint64_t ProcessFrame(const SourceFrame& src,
+                             sora::AllocatedI420Buffer* frame,
+                             sora::AllocatedI420Buffer* scaled) {
+  libyuv::I420Copy(src.y.data(), src.width, src.u.data(), (src.width + 1) / 2,
+                   src.v.data(), (src.width + 1) / 2, frame->MutableDataY(),
+                   frame->StrideY(), frame->MutableDataU(), frame->StrideU(),
+                   frame->MutableDataV(), frame->StrideV(), src.width,
+                   src.height);
+  libyuv::I420Scale(frame->DataY(), frame->StrideY(), frame->DataU(),
+                    frame->StrideU(), frame->DataV(), frame->StrideV(),
+                    frame->width(), frame->height(), scaled->MutableDataY(),
+                    scaled->StrideY(), scaled->MutableDataU(),
+                    scaled->StrideU(), scaled->MutableDataV(),
+                    scaled->StrideV(), scaled->width(), scaled->height(),
+                    libyuv::kFilterBox);
+  uint64_t sum = 0;
+  for (int y = 0; y < scaled->height(); y++) {
+    const uint8_t* p = scaled->DataY() + y * scaled->StrideY();
+    for (int x = 0; x < scaled->width(); x += 64) {
+      sum += p[x];
+    }
+  }
+  return sum;
+}
+
+// frames 回 process を呼んだ時の fps を返す。失敗した場合は負の値を返す
+static double Measure(int frames, std::function<bool()> process) {
+  // 最初の数フレームはページフォルトが多いので計測しない
+  for (int i = 0; i < 5; i++) {
+    if (!process()) {
+      return -1;
+    }
+  }
+  int64_t start_us = rtc::TimeMicros();
+  for (int i = 0; i < frames; i++) {
+    if (!process()) {
+      return -1;
+    }
+  }
+  int64_t elapsed_us = rtc::TimeMicros() - start_us;
+  return frames * 1000000.0 / std::max<int64_t>(elapsed_us, 1);
+}
+
+static void Run(const std::string& name,
+                std::shared_ptr<sora::FrameBufferAllocator> allocator,
+                const SourceFrame& src,
+                const Options& opts) {
+  int scaled_width = opts.width / 2;
+  int scaled_height = opts.height / 2;
+  uint64_t sum = 0;
+
+  sora::FrameBufferPool frame_pool(4, allocator);
+  sora::FrameBufferPool scaled_pool(4, allocator);
+  double pooled = Measure(opts.frames, [&]() {
+    auto frame = frame_pool.CreateI420Buffer(opts.width, opts.height);
+    auto scaled = scaled_pool.CreateI420Buffer(scaled_width, scaled_height);
+    if (frame == nullptr || scaled == nullptr) {
+      return false;
+    }
+    sum += ProcessFrame(src, frame.get(), scaled.get());
+    return true;
+  });
+
+  double fresh = Measure(opts.frames, [&]() {
+    auto frame =
+        sora::AllocatedI420Buffer::Create(opts.width, opts.height, allocator);
+    auto scaled = sora::AllocatedI420Buffer::Create(scaled_width,
+                                                    scaled_height, allocator);
+    if (frame == nullptr || scaled == nullptr) {
+      return false;
+    }
+    sum += ProcessFrame(src, frame.get(), scaled.get());
+    return true;
+  });
+
+  auto fps = [](double v) -> std::string {
+    if (v < 0) {
+      return "failed";
+    }
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << v;
+    return oss.str();
+  };
+  std::cout << std::left << std::setw(12) << name << std::right
+            << std::setw(14) << fps(pooled) << std::setw(14) << fps(fresh)
+            << "  (checksum=" << sum << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--frames") {
+      opts.frames = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--width") {
+      opts.width = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--height") {
+      opts.height = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--node") {
+      opts.numa_node = std::stoi(argv[++i]);
+    } else {
+      std::cout << argv[0]
+                << " [--frames N] [--width W] [--height H] [--node N]"
+                << std::endl;
+      return -1;
+    }
+  }
+
+  std::cout << opts.width << "x" << opts.height << " -> " << opts.width / 2
+            << "x" << opts.height / 2 << ", " << opts.frames << " frames"
+            << std::endl;
+  std::cout << std::left << std::setw(12) << "allocator" << std::right
+            << std::setw(14) << "pooled(fps)" << std::setw(14)
+            << "fresh(fps)" << std::endl;
+
+  SourceFrame src = MakeSourceFrame(opts.width, opts.height);
+
+  Run("default", sora::CreateDefaultFrameBufferAllocator(), src, opts);
+
+  sora::HugePageFrameBufferAllocatorConfig thp;
+  thp.use_reserved_huge_pages = false;
+  thp.numa_node = opts.numa_node;
+  Run("thp", sora::CreateHugePageFrameBufferAllocator(thp), src, opts);
+
+  // huge page が予約されていない場合は Transparent Huge Pages と同じ結果になる
+  sora::HugePageFrameBufferAllocatorConfig hugetlb = thp;
+  hugetlb.use_reserved_huge_pages = true;
+  Run("hugetlb", sora::CreateHugePageFrameBufferAllocator(hugetlb), src,
+      opts);
+
+  return 0;
+}
@@ -0,0 +1,434 @@
+// カメラの代わりに H.264 の RTP を UDP で送って、RtpH264Ingest の受信を確認するツール。
+//
+// ローカルで RtpH264Ingest を作り、以下の順番でパケットを送る。
+// それぞれの段階で、シンクに届いたフレームと統計情報、
+// カメラ側で受信した RTCP のキーフレーム要求 (PLI と FIR) を確認する。
+//
+//   single_nal: SPS, PPS, IDR, P をそれぞれ Single NAL Unit で送る
+//   stap_a:     SPS, PPS, IDR を 1 つの STAP-A にまとめて送る
+//   fu_a:       MTU より大きい IDR と P を FU-A に分割して送る
+//   loss:       FU-A の途中の断片を落として、フレームが捨てられ、キーフレームが要求されること
+//   recover:    loss の後の IDR から受信し直せること
+//   request:    RtpH264Ingest::RequestKeyFrame() で PLI と FIR が送られること
+//   restart:    カメラの再起動を想定して、SSRC とシーケンス番号を変えても受信できること
+//
+// 使い方:
+//   rtp_h264_ingest
+//   全て成功したら 0 を返す
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boost
+#include <boost/asio/ip/udp.hpp>
+
+// WebRTC
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+#include <rtc_base/logging.h>
+
+#include "sora/encoded_frame_buffer.h"
+#include "sora/rtp_h264_ingest.h"
+
+using boost::asio::ip::udp;
+
+// 640x480 の Baseline の SPS と PPS (NAL ヘッダを含む)
+static const std::vector<uint8_t> kSps = {0x67, 0x42, 0xc0, 0x1e, 0xda,
+                                          0x02, 0x80, 0xf6, 0x40};
+static const std::vector<uint8_t> kPps = {0x68, 0xce, 0x3c, 0x80};
+static const int kWidth = 640;
+static const int kHeight = 480;
+
+static const uint8_t kNaluTypeStapA = 24;
+static const uint8_t kNaluTypeFuA = 28;
+static const int kPayloadType = 96;
+// これより大きい NAL は FU-A に分割する
+static const size_t kMaxPayloadSize = 1200;
+
+// 中身はデコードしないので、スライスのデータは適当な値で埋める
+static std::vector<uint8_t> MakeSlice(bool idr, size_t size) {
+  std::vector<uint8_t> nalu(size, 0xaa);
+  nalu[0] = idr ? 0x65 : 0x41;
+  return nalu;
+}
+
+// RtpH264Ingest のシンクに届いたフレーム
+class FrameCounter : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
+ public:
+  struct Frame {
+    bool encoded = false;
+    bool is_key_frame = false;
+    int width = 0;
+    int height = 0;
+    size_t size = 0;
+  };
+
+  void OnFrame(const webrtc::VideoFrame& frame) override {
+    Frame f;
+    auto buffer = frame.video_frame_buffer();
+    auto encoded = sora::EncodedFrameBuffer::From(buffer.get());
+    f.encoded = encoded != nullptr;
+    f.width = buffer->width();
+    f.height = buffer->height();
+    if (encoded != nullptr) {
+      f.is_key_frame = encoded->is_key_frame();
+      f.size = encoded->data()->size();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.push_back(f);
+  }
+
+  std::vector<Frame> Take() {
+    std::vector<Frame> frames;
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames.swap(frames_);
+    return frames;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<Frame> frames_;
+};
+
+// カメラの代わりに RTP を送って、RTCP を受信する
+class CameraStandIn {
+ public:
+  CameraStandIn()
+      : rtp_socket_(ioc_, udp::endpoint(udp::v4(), 0)),
+        rtcp_socket_(ioc_, udp::endpoint(udp::v4(), 0)) {
+    rtcp_socket_.non_blocking(true);
+  }
+
+  int rtcp_port() const { return rtcp_socket_.local_endpoint().port(); }
+  void set_rtp_port(int port) {
+    remote_ = udp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port);
+  }
+
+  void Restart(uint32_t ssrc, uint16_t sequence_number) {
+    ssrc_ = ssrc;
+    sequence_number_ = sequence_number;
+  }
+
+  // NAL を 1 つ送る。大きい場合は FU-A に分割する。
+  // drop_fragment に断片の番号を指定すると、その断片は送らずにシーケンス番号だけ進める
+  void SendNalu(const std::vector<uint8_t>& nalu,
+                uint32_t timestamp,
+                bool marker,
+                int drop_fragment = -1) {
+    if (nalu.size() <= kMaxPayloadSize) {
+      SendPacket(nalu, timestamp, marker);
+      return;
+    }
+    size_t pos = 1;
+    int index = 0;
+    while (pos < nalu.size()) {
+      size_t size = std::min(kMaxPayloadSize - 2, nalu.size() - pos);
+      bool start = pos == 1;
+      bool end = pos + size == nalu.size();
+      std::vector<uint8_t> payload;
+      payload.push_back((nalu[0] & 0xe0) | kNaluTypeFuA);
+      payload.push_back((start ? 0x80 : 0) | (end ? 0x40 : 0) |
+                        (nalu[0] & 0x1f));
+      payload.insert(payload.end(), nalu.begin() + pos,
+                     nalu.begin() + pos + size);
+      if (index == drop_fragment) {
+        sequence_number_ += 1;
+      } else {
+        SendPacket(payload, timestamp, marker && end);
+      }
+      pos += size;
+      index += 1;
+    }
+  }
+
+  void SendStapA(const std::vector<std::vector<uint8_t>>& nalus,
+                 uint32_t timestamp,
+                 bool marker) {
+    std::vector<uint8_t> payload;
+    uint8_t nri = 0;
+    for (const auto& nalu : nalus) {
+      nri = std::max<uint8_t>(nri, nalu[0] & 0x60);
+    }
+    payload.push_back(nri | kNaluTypeStapA);
+    for (const auto& nalu : nalus) {
+      payload.push_back(static_cast<uint8_t>(nalu.size() >> 8));
+      payload.push_back(static_cast<uint8_t>(nalu.size() & 0xff));
+      payload.insert(payload.end(), nalu.begin(), nalu.end());
+    }
+    SendPacket(payload, timestamp, marker);
+  }
+
+  // 受信した RTCP に含まれていた PLI と FIR の数を数える
+  void ReadRtcp(int* pli, int* fir) {
+    *pli = 0;
+    *fir = 0;
+    while (true) {
+      uint8_t buf[1500];
+      udp::endpoint from;
+      boost::system::error_code ec;
+      size_t size = rtcp_socket_.receive_from(boost::asio::buffer(buf), from,
+                                              0, ec);
+      if (ec) {
+        return;
+      }
+      size_t pos = 0;
+      while (pos + 12 <= size) {
+        int fmt = buf[pos] & 0x1f;
+        int pt = buf[pos + 1];
+        size_t length = (((buf[pos + 2] << 8) | buf[pos + 3]) + 1) * 4;
+        uint32_t media_ssrc =
+            (static_cast<uint32_t>(buf[pos + 8]) << 24) |
+            (buf[pos + 9] << 16) | (buf[pos + 10] << 8) | buf[pos + 11];
+        if (pt == 206 && fmt == 1 && media_ssrc == ssrc_) {
+          *pli += 1;
+        } else if (pt == 206 && fmt == 4 && pos + 16 <= size) {
+          // FIR はメディアの SSRC が FCI に入っている
+          uint32_t fci_ssrc =
+              (static_cast<uint32_t>(buf[pos + 12]) << 24) |
+              (buf[pos + 13] << 16) | (buf[pos + 14] << 8) | buf[pos + 15];
+          if (fci_ssrc == ssrc_) {
+            *fir += 1;
+          }
+        }
+        pos += length;
+      }
+    }
+  }
+
+ private:
+  void SendPacket(const std::vector<uint8_t>& payload,
+                  uint32_t timestamp,
+                  bool marker) {
+    std::vector<uint8_t> packet = {
+        0x80,
+        static_cast<uint8_t>((marker ? 0x80 : 0) | kPayloadType),
+        static_cast<uint8_t>(sequence_number_ >> 8),
+        static_cast<uint8_t>(sequence_number_ & 0xff),
+        static_cast<uint8_t>(timestamp >> 24),
+        static_cast<uint8_t>((timestamp >> 16) & 0xff),
+        static_cast<uint8_t>((timestamp >> 8) & 0xff),
+        static_cast<uint8_t>(timestamp & 0xff),
+        static_cast<uint8_t>(ssrc_ >> 24),
+        static_cast<uint8_t>((ssrc_ >> 16) & 0xff),
+        static_cast<uint8_t>((ssrc_ >> 8) & 0xff),
+        static_cast<uint8_t>(ssrc_ & 0xff),
+    };
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    rtp_socket_.send_to(boost::asio::buffer(packet), remote_);
+    sequence_number_ += 1;
+  }
+
+  boost::asio::io_context ioc_;
+  udp::socket rtp_socket_;
+  udp::socket rtcp_socket_;
+  udp::endpoint remote_;
+  uint32_t ssrc_ = 0x12345678;
+  uint16_t sequence_number_ = 1000;
+};
+
+class IngestTest {
+ public:
+  IngestTest(rtc::scoped_refptr<sora::RtpH264Ingest> ingest,
+             CameraStandIn* camera)
+      : ingest_(ingest), camera_(camera) {
+    ingest_->AddOrUpdateSink(&counter_, rtc::VideoSinkWants());
+  }
+  ~IngestTest() { ingest_->RemoveSink(&counter_); }
+
+  // send でパケットを送り、packets 個受信されるまで待ってから check で結果を確認する
+  void Run(const std::string& name,
+           uint64_t packets,
+           std::function<void()> send,
+           std::function<bool(const std::vector<FrameCounter::Frame>&,
+                              const sora::RtpH264IngestStats&,
+                              int pli,
+                              int fir)> check) {
+    auto before = ingest_->GetStats();
+    int pli, fir;
+    camera_->ReadRtcp(&pli, &fir);
+    counter_.Take();
+
+    send();
+
+    auto stats = ingest_->GetStats();
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (stats.packets_received - before.packets_received < packets &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      stats = ingest_->GetStats();
+    }
+    // RTCP が届くのを少し待つ
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stats = ingest_->GetStats();
+    camera_->ReadRtcp(&pli, &fir);
+
+    sora::RtpH264IngestStats diff;
+    diff.packets_received = stats.packets_received - before.packets_received;
+    diff.packets_lost = stats.packets_lost - before.packets_lost;
+    diff.frames_received = stats.frames_received - before.frames_received;
+    diff.frames_dropped = stats.frames_dropped - before.frames_dropped;
+    diff.key_frame_requests =
+        stats.key_frame_requests - before.key_frame_requests;
+    auto frames = counter_.Take();
+    bool ok = diff.packets_received == packets &&
+              check(frames, diff, pli, fir);
+    if (!ok) {
+      failed_ = true;
+    }
+    std::cout << (ok ? "PASS " : "FAIL ") << name
+              << ": packets=" << diff.packets_received
+              << " lost=" << diff.packets_lost
+              << " frames=" << frames.size()
+              << " dropped=" << diff.frames_dropped << " pli=" << pli
+              << " fir=" << fir << std::endl;
+  }
+
+  bool failed() const { return failed_; }
+
+ private:
+  rtc::scoped_refptr<sora::RtpH264Ingest> ingest_;
+  CameraStandIn* camera_;
+  FrameCounter counter_;
+  bool failed_ = false;
+};
+
+static bool IsFrame(const FrameCounter::Frame& f, bool is_key_frame) {
+  return f.encoded && f.is_key_frame == is_key_frame && f.width == kWidth &&
+         f.height == kHeight;
+}
+
+int main() {
+  rtc::LogMessage::LogToDebug(rtc::LS_WARNING);
+
+  CameraStandIn camera;
+
+  sora::RtpH264IngestConfig config;
+  config.local_address = "127.0.0.1";
+  config.payload_type = kPayloadType;
+  config.remote_rtcp_address = "127.0.0.1";
+  config.remote_rtcp_port = camera.rtcp_port();
+  // 要求を間引かれると数えられないので、毎回送らせる
+  config.key_frame_request_interval_ms = 0;
+  auto ingest = sora::RtpH264Ingest::Create(config);
+  if (ingest == nullptr) {
+    std::cerr << "Failed to create RtpH264Ingest" << std::endl;
+    return 1;
+  }
+  camera.set_rtp_port(ingest->rtp_port());
+
+  IngestTest test(ingest, &camera);
+  uint32_t timestamp = 90000;
+
+  test.Run(
+      "single_nal", 4,
+      [&]() {
+        camera.SendNalu(kSps, timestamp, false);
+        camera.SendNalu(kPps, timestamp, false);
+        camera.SendNalu(MakeSlice(true, 500), timestamp, true);
+        timestamp += 3000;
+        camera.SendNalu(MakeSlice(false, 200), timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        return frames.size() == 2 && IsFrame(frames[0], true) &&
+               IsFrame(frames[1], false) && stats.packets_lost == 0;
+      });
+
+  test.Run(
+      "stap_a", 2,
+      [&]() {
+        camera.SendStapA({kSps, kPps, MakeSlice(true, 500)}, timestamp, true);
+        timestamp += 3000;
+        camera.SendStapA({MakeSlice(false, 100), MakeSlice(false, 100)},
+                         timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        return frames.size() == 2 && IsFrame(frames[0], true) &&
+               IsFrame(frames[1], false) && stats.packets_lost == 0 &&
+               pli == 0 && fir == 0;
+      });
+
+  // 5000 バイトの IDR は 5 つ、2000 バイトの P は 2 つに分割される
+  test.Run(
+      "fu_a", 7,
+      [&]() {
+        camera.SendNalu(MakeSlice(true, 5000), timestamp, true);
+        timestamp += 3000;
+        camera.SendNalu(MakeSlice(false, 2000), timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        // IDR には SPS と PPS が足される
+        size_t key_frame_size = 4 + kSps.size() + 4 + kPps.size() + 4 + 5000;
+        return frames.size() == 2 && IsFrame(frames[0], true) &&
+               frames[0].size == key_frame_size && IsFrame(frames[1], false) &&
+               frames[1].size == 4 + 2000 && stats.packets_lost == 0;
+      });
+
+  test.Run(
+      "loss", 3,
+      [&]() {
+        camera.SendNalu(MakeSlice(false, 3000), timestamp, true, 1);
+        timestamp += 3000;
+        camera.SendNalu(MakeSlice(false, 200), timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        return frames.empty() && stats.packets_lost == 1 &&
+               stats.frames_dropped == 2 && pli > 0 && fir > 0;
+      });
+
+  test.Run(
+      "recover", 3,
+      [&]() {
+        camera.SendStapA({kSps, kPps}, timestamp, false);
+        camera.SendNalu(MakeSlice(true, 500), timestamp, true);
+        timestamp += 3000;
+        camera.SendNalu(MakeSlice(false, 200), timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        // IDR が届くまでは要求を送り続けるので、PLI と FIR の数は確認しない
+        return frames.size() == 2 && IsFrame(frames[0], true) &&
+               IsFrame(frames[1], false);
+      });
+
+  test.Run(
+      "request", 1,
+      [&]() {
+        ingest->RequestKeyFrame();
+        camera.SendNalu(MakeSlice(false, 200), timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        return frames.size() == 1 && IsFrame(frames[0], false) && pli == 1 &&
+               fir == 1 && stats.key_frame_requests == 1;
+      });
+
+  test.Run(
+      "restart", 3,
+      [&]() {
+        camera.Restart(0x9abcdef0, 40000);
+        camera.SendNalu(MakeSlice(false, 200), timestamp, true);
+        timestamp += 3000;
+        camera.SendStapA({kSps, kPps, MakeSlice(true, 500)}, timestamp, true);
+        timestamp += 3000;
+        camera.SendNalu(MakeSlice(false, 200), timestamp, true);
+        timestamp += 3000;
+      },
+      [](const auto& frames, const auto& stats, int pli, int fir) {
+        // 再起動した直後の P は IDR が来るまで捨てる
+        return frames.size() == 2 && IsFrame(frames[0], true) &&
+               IsFrame(frames[1], false) && stats.packets_lost == 0 &&
+               stats.frames_dropped == 1;
+      });
+
+  return test.failed() ? 1 : 0;
+}
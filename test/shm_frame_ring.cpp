@@ -0,0 +1,273 @@
+// ShmFrameRingWriter で書き込んだフレームを、fork した別プロセスの ShmFrameRingReader で読み込んで、
+// スループットと読み込みの失敗を計測するツール。
+//
+// 書き込み側はスロットのデータ領域全体をフレーム番号の下位 8 ビットで埋めて Commit() する。
+// 読み込み側は届いたフレームを順番に Acquire() して全体を読み、最後に Validate() する。
+// 書き込み側は最後に track_id が kEndTrackId のフレームを書いて、終わったことを伝える。
+//
+//   read:    正しく読めたフレーム
+//   torn:    読んでいる間に上書きされて Validate() が失敗したフレーム
+//   skipped: 読む前に上書きされていたか、書き込み側が飛ばしたフレーム。
+//            書き込み側の skipped は、全てのスロットが Hold() されていて Begin() が失敗した回数
+//   corrupt: Validate() が成功したのに中身が違ったフレーム。0 以外ならバグ
+//
+// 使い方:
+//   shm_frame_ring [--frames N] [--fps F] [--slots N] [--width W] [--height H]
+//                  [--hold]
+//   --fps を 0 にすると書き込み側は待たずに書き込み続ける
+//   --hold を指定すると、読み込み側は読んでいる間スロットを Hold() する
+//   corrupt が 0 なら 0 を返す
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sora/shm/shm_frame_ring.h"
+
+static const char kEndTrackId[] = "end";
+
+struct Options {
+  uint64_t frames = 1000;
+  int fps = 0;
+  uint32_t slots = 8;
+  int width = 1920;
+  int height = 1080;
+  bool hold = false;
+};
+
+static int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 読み込み側のプロセス。結果を標準出力に書いて終了コードを返す
+static int RunReader(int fd, int ready_fd, const Options& opts) {
+  auto reader = sora::ShmFrameRingReader::Open(fd, opts.hold);
+  if (reader == nullptr) {
+    std::cerr << "Failed to open ShmFrameRingReader" << std::endl;
+    return 1;
+  }
+  // 開いたことを書き込み側に伝える
+  char c = 0;
+  if (write(ready_fd, &c, 1) != 1) {
+    return 1;
+  }
+  close(ready_fd);
+
+  uint64_t read = 0;
+  uint64_t torn = 0;
+  uint64_t skipped = 0;
+  uint64_t corrupt = 0;
+  uint64_t bytes = 0;
+  int64_t start_us = -1;
+  uint64_t next = 1;
+  while (true) {
+    uint64_t latest = reader->GetLatestFrameNumber();
+    if (latest < next) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (start_us < 0) {
+      start_us = NowUs();
+    }
+    // 遅れすぎていて既に上書きされているフレームは読まない
+    if (latest - next >= reader->slot_count()) {
+      uint64_t oldest = latest - reader->slot_count() + 1;
+      skipped += oldest - next;
+      next = oldest;
+    }
+
+    sora::ShmFrameView view;
+    if (!reader->Acquire(next, &view)) {
+      skipped += 1;
+      next += 1;
+      continue;
+    }
+    if (view.info.track_id == kEndTrackId) {
+      break;
+    }
+    bool held = opts.hold && reader->Hold(view);
+    if (opts.hold && !held) {
+      torn += 1;
+      next += 1;
+      continue;
+    }
+    uint8_t expected = static_cast<uint8_t>(view.frame_number & 0xff);
+    uint8_t diff = 0;
+    for (uint32_t i = 0; i < view.info.data_size; i++) {
+      diff |= view.data_y[i] ^ expected;
+    }
+    bool ok = diff == 0;
+    if (!reader->Validate(view)) {
+      torn += 1;
+    } else if (!ok) {
+      corrupt += 1;
+    } else {
+      read += 1;
+      bytes += view.info.data_size;
+    }
+    if (held) {
+      reader->Unhold(view.frame_number);
+    }
+    next += 1;
+  }
+
+  double elapsed_sec = (NowUs() - start_us) / 1000000.0;
+  printf("reader: read=%llu torn=%llu skipped=%llu corrupt=%llu "
+         "fps=%.1f MB/s=%.1f\n",
+         static_cast<unsigned long long>(read),
+         static_cast<unsigned long long>(torn),
+         static_cast<unsigned long long>(skipped),
+         static_cast<unsigned long long>(corrupt), read / elapsed_sec,
+         bytes / elapsed_sec / 1000000);
+  fflush(stdout);
+  return corrupt == 0 ? 0 : 1;
+}
+
+static bool ParseOptions(int argc, char* argv[], Options* opts) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--frames") {
+      opts->frames = std::stoull(argv[++i]);
+    } else if (i + 1 < argc && arg == "--fps") {
+      opts->fps = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--slots") {
+      opts->slots = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (i + 1 < argc && arg == "--width") {
+      opts->width = std::stoi(argv[++i]);
+    } else if (i + 1 < argc && arg == "--height") {
+      opts->height = std::stoi(argv[++i]);
+    } else if (arg == "--hold") {
+      opts->hold = true;
+    } else {
+      return false;
+    }
+  }
+  return opts->frames > 0 && opts->slots > 0 && opts->width > 0 &&
+         opts->height > 0;
+}
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if (!ParseOptions(argc, argv, &opts)) {
+    std::cout << argv[0]
+              << " [--frames N] [--fps F] [--slots N] [--width W]"
+                 " [--height H] [--hold]"
+              << std::endl;
+    return -1;
+  }
+
+  int chroma_width = (opts.width + 1) / 2;
+  int chroma_height = (opts.height + 1) / 2;
+  uint32_t size_y = static_cast<uint32_t>(opts.width * opts.height);
+  uint32_t size_uv = static_cast<uint32_t>(chroma_width * chroma_height);
+
+  sora::ShmFrameRingConfig config;
+  config.slot_count = opts.slots;
+  config.slot_data_size = size_y + size_uv * 2;
+  auto writer = sora::ShmFrameRingWriter::Create(config);
+  if (writer == nullptr) {
+    std::cerr << "Failed to create ShmFrameRingWriter" << std::endl;
+    return 1;
+  }
+
+  int ready[2];
+  if (pipe(ready) != 0) {
+    std::cerr << "Failed to create pipe" << std::endl;
+    return 1;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "Failed to fork" << std::endl;
+    return 1;
+  }
+  if (pid == 0) {
+    close(ready[0]);
+    // 書き込み側のオブジェクトを破棄しないように、デストラクタを呼ばずに終了する
+    _exit(RunReader(writer->fd(), ready[1], opts));
+  }
+  close(ready[1]);
+  char c;
+  if (read(ready[0], &c, 1) != 1) {
+    std::cerr << "Reader process failed to start" << std::endl;
+    waitpid(pid, nullptr, 0);
+    return 1;
+  }
+  close(ready[0]);
+
+  sora::ShmFrameInfo info;
+  info.track_id = "shm_frame_ring";
+  info.width = opts.width;
+  info.height = opts.height;
+  info.stride_y = opts.width;
+  info.stride_u = chroma_width;
+  info.stride_v = chroma_width;
+  info.offset_y = 0;
+  info.offset_u = size_y;
+  info.offset_v = size_y + size_uv;
+  info.data_size = config.slot_data_size;
+
+  uint64_t written = 0;
+  uint64_t writer_skipped = 0;
+  int64_t start_us = NowUs();
+  while (written < opts.frames) {
+    if (opts.fps > 0) {
+      int64_t due_us =
+          start_us + static_cast<int64_t>(written * 1000000 / opts.fps);
+      int64_t wait_us = due_us - NowUs();
+      if (wait_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+      }
+    }
+    auto slot = writer->Begin();
+    if (slot.data == nullptr) {
+      // 全てのスロットが Hold() されているので、空くまで待つ
+      writer_skipped += 1;
+      std::this_thread::yield();
+      continue;
+    }
+    memset(slot.data, static_cast<int>(slot.frame_number & 0xff),
+           info.data_size);
+    info.timestamp_us = NowUs();
+    writer->Commit(slot, info);
+    written += 1;
+  }
+  double elapsed_sec = (NowUs() - start_us) / 1000000.0;
+
+  // 終わったことを伝えるフレーム
+  while (true) {
+    auto slot = writer->Begin();
+    if (slot.data != nullptr) {
+      info.track_id = kEndTrackId;
+      info.offset_u = 0;
+      info.offset_v = 0;
+      info.data_size = 0;
+      writer->Commit(slot, info);
+      break;
+    }
+    std::this_thread::yield();
+  }
+
+  printf("writer: written=%llu skipped=%llu fps=%.1f MB/s=%.1f\n",
+         static_cast<unsigned long long>(written),
+         static_cast<unsigned long long>(writer_skipped),
+         written / elapsed_sec,
+         written * static_cast<double>(config.slot_data_size) /
+             elapsed_sec / 1000000);
+  fflush(stdout);
+
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    std::cerr << "Reader process failed" << std::endl;
+    return 1;
+  }
+  return WEXITSTATUS(status);
+}
@@ -0,0 +1,351 @@
+// SignalingTraceRecorder で記録したシグナリングを再生して、
+// メッセージの種類ごとに SDK 側の処理にかかった時間を計測するツール。
+//
+// ローカルで Sora の代わりをする WebSocket サーバを立てて SoraSignaling を接続させ、
+// 記録した WebSocket の受信メッセージを順番に送る。
+// 送ってから SDK の応答 (answer, re-answer, pong) か
+// コールバック (OnNotify, OnPush) が来るまでの時間を計測する。
+//
+// 実際には Sora と接続しないので、メディアは流れず DataChannel にも切り替わらない。
+// そのため、DataChannel で受信したメッセージと redirect, switched は再生しない。
+//
+// 使い方:
+//   signaling_replay <trace file> [--realtime] [--repeat N]
+//                    [--certificate-pool]
+//   --realtime を指定すると、記録した時の間隔を空けてメッセージを送る
+//   --repeat を指定すると、同じ PeerConnectionFactory で N 回接続し直して再生する
+//   --certificate-pool を指定すると、DtlsCertificatePool から証明書を取り出して接続する。
+//     offer を送ってから answer が返るまでの時間に証明書の生成が含まれなくなるので、
+//     指定しない場合と比べると接続時間の差が分かる
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Boost
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/json.hpp>
+
+// WebRTC
+#include <rtc_base/logging.h>
+#include <rtc_base/time_utils.h>
+
+#ifdef _WIN32
+#include <rtc_base/win/scoped_com_initializer.h>
+#endif
+
+#include "sora/dtls_certificate_pool.h"
+#include "sora/signaling_trace.h"
+#include "sora/sora_default_client.h"
+
+static std::string GetMessageType(const std::string& message) {
+  boost::json::error_code ec;
+  auto json = boost::json::parse(message, ec);
+  if (ec || !json.is_object()) {
+    return "";
+  }
+  auto it = json.as_object().find("type");
+  if (it == json.as_object().end() || !it->value().is_string()) {
+    return "";
+  }
+  return it->value().as_string().c_str();
+}
+
+// OnNotify や OnPush が呼ばれるのを別スレッドで待つためのもの
+class CallbackCounter {
+ public:
+  void Increment(const std::string& type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts_[type] += 1;
+    cv_.notify_all();
+  }
+  int Get(const std::string& type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_[type];
+  }
+  bool WaitFor(const std::string& type, int count, int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                        [&]() { return counts_[type] >= count; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::map<std::string, int> counts_;
+};
+
+// Sora の代わりに、記録したメッセージを送る WebSocket サーバ
+class SignalingStandIn {
+ public:
+  SignalingStandIn(std::vector<sora::SignalingTraceEntry> entries,
+                   bool realtime,
+                   CallbackCounter* counter)
+      : entries_(std::move(entries)),
+        realtime_(realtime),
+        counter_(counter),
+        acceptor_(ioc_,
+                  boost::asio::ip::tcp::endpoint(
+                      boost::asio::ip::make_address("127.0.0.1"), 0)) {}
+
+  int port() const { return acceptor_.local_endpoint().port(); }
+
+  // 再生が終わったら on_finished を呼んで、SDK が切断するまで待つ
+  void Run(std::function<void()> on_finished) {
+    boost::asio::ip::tcp::socket socket(ioc_);
+    acceptor_.accept(socket);
+    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> ws(
+        std::move(socket));
+    ws.accept();
+
+    if (!ReadUntil(ws, "connect")) {
+      std::cerr << "Failed to read connect message" << std::endl;
+      on_finished();
+      return;
+    }
+
+    int64_t first_timestamp_us = -1;
+    int64_t start_us = rtc::TimeMicros();
+    for (const auto& entry : entries_) {
+      if (entry.direction != sora::SignalingTraceDirection::kInbound ||
+          entry.channel != sora::kSignalingTraceWebSocketChannel) {
+        continue;
+      }
+      std::string type = GetMessageType(entry.message);
+      if (type == "redirect" || type == "switched") {
+        skipped_[type] += 1;
+        continue;
+      }
+
+      if (realtime_) {
+        if (first_timestamp_us < 0) {
+          first_timestamp_us = entry.timestamp_us;
+        }
+        int64_t due_us = start_us + entry.timestamp_us - first_timestamp_us;
+        int64_t wait_us = due_us - rtc::TimeMicros();
+        if (wait_us > 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+        }
+      }
+
+      int callbacks = counter_->Get(type);
+      int64_t sent_us = rtc::TimeMicros();
+      ws.text(true);
+      ws.write(boost::asio::buffer(entry.message));
+
+      bool measured = false;
+      if (type == "offer") {
+        measured = ReadUntil(ws, "answer");
+      } else if (type == "re-offer") {
+        measured = ReadUntil(ws, "re-answer");
+      } else if (type == "update") {
+        measured = ReadUntil(ws, "update");
+      } else if (type == "ping") {
+        measured = ReadUntil(ws, "pong");
+      } else if (type == "notify" || type == "push") {
+        measured = counter_->WaitFor(type, callbacks + 1, 5000);
+      }
+      if (measured) {
+        latencies_[type].push_back(rtc::TimeMicros() - sent_us);
+      } else {
+        unmeasured_[type] += 1;
+      }
+    }
+
+    on_finished();
+    // 切断されるまで読み捨てる
+    ReadUntil(ws, "");
+  }
+
+  void PrintReport() const {
+    std::cout << std::left << std::setw(12) << "type" << std::right
+              << std::setw(8) << "count" << std::setw(12) << "avg(ms)"
+              << std::setw(12) << "p50(ms)" << std::setw(12) << "p95(ms)"
+              << std::setw(12) << "max(ms)" << std::endl;
+    for (const auto& p : latencies_) {
+      std::vector<int64_t> v = p.second;
+      std::sort(v.begin(), v.end());
+      int64_t sum = 0;
+      for (int64_t x : v) {
+        sum += x;
+      }
+      auto ms = [](int64_t us) { return us / 1000.0; };
+      std::cout << std::left << std::setw(12) << p.first << std::right
+                << std::setw(8) << v.size() << std::fixed
+                << std::setprecision(3) << std::setw(12)
+                << ms(sum / static_cast<int64_t>(v.size())) << std::setw(12)
+                << ms(v[v.size() / 2]) << std::setw(12)
+                << ms(v[std::min(v.size() - 1, v.size() * 95 / 100)])
+                << std::setw(12) << ms(v.back()) << std::endl;
+    }
+    for (const auto& p : unmeasured_) {
+      std::cout << "not measured: type=" << p.first << " count=" << p.second
+                << std::endl;
+    }
+    for (const auto& p : skipped_) {
+      std::cout << "skipped: type=" << p.first << " count=" << p.second
+                << std::endl;
+    }
+  }
+
+ private:
+  // type のメッセージを受信するまで読み捨てる。
+  // 切断された場合は false を返す。
+  bool ReadUntil(
+      boost::beast::websocket::stream<boost::asio::ip::tcp::socket>& ws,
+      const std::string& type) {
+    while (true) {
+      boost::beast::flat_buffer buffer;
+      boost::system::error_code ec;
+      ws.read(buffer, ec);
+      if (ec) {
+        return false;
+      }
+      if (!type.empty() &&
+          GetMessageType(boost::beast::buffers_to_string(buffer.data())) ==
+              type) {
+        return true;
+      }
+    }
+  }
+
+  std::vector<sora::SignalingTraceEntry> entries_;
+  bool realtime_;
+  CallbackCounter* counter_;
+  boost::asio::io_context ioc_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  std::map<std::string, std::vector<int64_t>> latencies_;
+  std::map<std::string, int> unmeasured_;
+  std::map<std::string, int> skipped_;
+};
+
+class ReplayClient : public std::enable_shared_from_this<ReplayClient>,
+                     public sora::SoraDefaultClient {
+ public:
+  ReplayClient(sora::SoraDefaultClientConfig config,
+               CallbackCounter* counter)
+      : sora::SoraDefaultClient(config), counter_(counter) {}
+
+  void Run(int port,
+           SignalingStandIn* stand_in,
+           std::shared_ptr<sora::DtlsCertificatePool> certificate_pool) {
+    ioc_.reset(new boost::asio::io_context(1));
+
+    sora::SoraSignalingConfig config;
+    config.pc_factory = factory();
+    config.io_context = ioc_.get();
+    config.observer = shared_from_this();
+    config.signaling_urls.push_back("ws://127.0.0.1:" + std::to_string(port) +
+                                    "/signaling");
+    config.channel_id = "signaling-replay";
+    config.sora_client = "Signaling Replay";
+    config.role = "recvonly";
+    config.multistream = true;
+    config.certificate_pool = certificate_pool;
+    conn_ = sora::SoraSignaling::Create(config);
+
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+        work_guard(ioc_->get_executor());
+
+    std::thread th([this, stand_in]() {
+      stand_in->Run([this]() {
+        boost::asio::post(*ioc_, [this]() { conn_->Disconnect(); });
+      });
+    });
+
+    conn_->Connect();
+    ioc_->run();
+    th.join();
+  }
+
+  void OnNotify(std::string text) override { counter_->Increment("notify"); }
+  void OnPush(std::string text) override { counter_->Increment("push"); }
+  void OnDisconnect(sora::SoraSignalingErrorCode ec,
+                    std::string message) override {
+    RTC_LOG(LS_INFO) << "OnDisconnect: " << message;
+    ioc_->stop();
+  }
+
+ private:
+  CallbackCounter* counter_;
+  std::shared_ptr<sora::SoraSignaling> conn_;
+  std::unique_ptr<boost::asio::io_context> ioc_;
+};
+
+int main(int argc, char* argv[]) {
+  bool realtime = false;
+  int repeat = 1;
+  bool use_certificate_pool = false;
+  bool valid = argc >= 2;
+  for (int i = 2; valid && i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--realtime") {
+      realtime = true;
+    } else if (i + 1 < argc && arg == "--repeat") {
+      repeat = std::stoi(argv[++i]);
+    } else if (arg == "--certificate-pool") {
+      use_certificate_pool = true;
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid || repeat < 1) {
+    std::cout << argv[0]
+              << " <trace file> [--realtime] [--repeat N] [--certificate-pool]"
+              << std::endl;
+    return -1;
+  }
+
+#ifdef _WIN32
+  webrtc::ScopedCOMInitializer com_initializer(
+      webrtc::ScopedCOMInitializer::kMTA);
+  if (!com_initializer.Succeeded()) {
+    std::cerr << "CoInitializeEx failed" << std::endl;
+    return 1;
+  }
+#endif
+
+  std::vector<sora::SignalingTraceEntry> entries;
+  if (!sora::LoadSignalingTrace(argv[1], &entries)) {
+    std::cerr << "Failed to load trace: " << argv[1] << std::endl;
+    return 1;
+  }
+
+  CallbackCounter counter;
+  SignalingStandIn stand_in(std::move(entries), realtime, &counter);
+
+  sora::SoraDefaultClientConfig config;
+  config.use_audio_deivce = false;
+  config.use_hardware_encoder = false;
+  auto client = sora::CreateSoraClient<ReplayClient>(config, &counter);
+
+  std::shared_ptr<sora::DtlsCertificatePool> certificate_pool;
+  sora::DtlsCertificatePoolConfig pool_config;
+  if (use_certificate_pool) {
+    certificate_pool = sora::DtlsCertificatePool::Create(pool_config);
+    if (certificate_pool == nullptr) {
+      std::cerr << "Failed to create DtlsCertificatePool" << std::endl;
+      return 1;
+    }
+  }
+
+  for (int i = 0; i < repeat; i++) {
+    // 毎回プールが埋まった状態から接続して、生成を待たない場合の時間を計測する
+    while (certificate_pool != nullptr &&
+           certificate_pool->GetAvailableCount() < pool_config.pool_size) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    client->Run(stand_in.port(), &stand_in, certificate_pool);
+  }
+
+  std::cout << "repeat=" << repeat << " certificate_pool="
+            << (use_certificate_pool ? "on" : "off") << std::endl;
+  stand_in.PrintReport();
+  return 0;
+}